@@ -56,6 +56,10 @@ struct _MetaCompScreen
 
   gint                   switch_workspace_in_progress;
 
+  /* Number of round trips made to synchronize damage repair; at most
+   * one per frame */
+  guint                  damage_round_trips;
+
   MetaPluginManager *plugin_mgr;
 };
 
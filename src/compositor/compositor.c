@@ -18,6 +18,8 @@
 #include <meta/meta-shadow-factory.h>
 #include "meta-window-actor-private.h"
 #include "meta-window-group.h"
+#include "meta-frame-profiler.h"
+#include "meta-stack-order.h"
 #include "window-private.h" /* to check window->hidden */
 #include "display-private.h" /* for meta_display_lookup_x_window() */
 #include <X11/extensions/shape.h>
@@ -458,9 +460,14 @@ after_stage_paint (gpointer data)
   MetaCompScreen *info = (MetaCompScreen*) data;
   GList *l;
 
+  meta_frame_profiler_stage_begin (META_FRAME_STAGE_POST_PAINT);
+
   for (l = info->windows; l; l = l->next)
     meta_window_actor_post_paint (l->data);
 
+  meta_frame_profiler_stage_end (META_FRAME_STAGE_POST_PAINT);
+  meta_frame_profiler_end_frame ();
+
   return TRUE;
 }
 
@@ -1038,83 +1045,108 @@ static void
 sync_actor_stacking (MetaCompScreen *info)
 {
   GList *children;
-  GList *expected_window_node;
   GList *tmp;
-  GList *old;
-  GList *backgrounds;
-  gboolean has_windows;
-  gboolean reordered;
+  GHashTable *window_positions;
+  ClutterActor **by_position;
+  int *positions;
+  gboolean *kept, *kept_by_position;
+  int n_children, n_backgrounds, n_windows, n_actors, n_kept;
+  int background_position;
+  int i;
 
   /* NB: The first entries in the lists are stacked the lowest */
 
   /* Restacking will trigger full screen redraws, so it's worth a
-   * little effort to make sure we actually need to restack before
-   * we go ahead and do it */
-
-  children = clutter_actor_get_children (info->window_group);
-  reordered = FALSE;
-
-  /* We allow for actors in the window group other than the actors we
+   * little effort to restack only what actually needs to move. The
+   * backgrounds should be at the bottom, in the order they are in now,
+   * followed by the windows in the order of info->windows.
+   *
+   * We allow for actors in the window group other than the actors we
    * know about, but it's up to a plugin to try and keep them stacked correctly
    * (we really need extra API to make that reliable.)
    */
 
-  /* First we collect a list of all backgrounds, and check if they're at the
-   * bottom. Then we check if the window actors are in the correct sequence */
-  backgrounds = NULL;
-  expected_window_node = info->windows;
-  for (old = children; old != NULL; old = old->next)
+  children = clutter_actor_get_children (info->window_group);
+  n_children = g_list_length (children);
+
+  window_positions = g_hash_table_new (NULL, NULL);
+  n_windows = 0;
+  for (tmp = info->windows; tmp != NULL; tmp = tmp->next)
+    {
+      if (clutter_actor_get_parent (tmp->data) == info->window_group)
+        g_hash_table_insert (window_positions, tmp->data, GINT_TO_POINTER (n_windows++));
+    }
+
+  n_backgrounds = 0;
+  for (tmp = children; tmp != NULL; tmp = tmp->next)
     {
-      ClutterActor *actor = old->data;
+      if (META_IS_BACKGROUND_GROUP (tmp->data) ||
+          META_IS_BACKGROUND_ACTOR (tmp->data))
+        n_backgrounds++;
+    }
+
+  /* For each background and window, in the current order, where it
+   * should be */
+  positions = g_new (int, n_children);
+  kept = g_new (gboolean, n_children);
+  by_position = g_new (ClutterActor *, n_children);
+  n_actors = 0;
+  background_position = 0;
+
+  for (tmp = children; tmp != NULL; tmp = tmp->next)
+    {
+      ClutterActor *actor = tmp->data;
+      gpointer position;
 
       if (META_IS_BACKGROUND_GROUP (actor) ||
           META_IS_BACKGROUND_ACTOR (actor))
-        {
-          backgrounds = g_list_prepend (backgrounds, actor);
-
-          if (has_windows)
-            reordered = TRUE;
-        }
-      else if (META_IS_WINDOW_ACTOR (actor) && !reordered)
-        {
-          has_windows = TRUE;
+        positions[n_actors] = background_position++;
+      else if (META_IS_WINDOW_ACTOR (actor) &&
+               g_hash_table_lookup_extended (window_positions, actor, NULL, &position))
+        positions[n_actors] = n_backgrounds + GPOINTER_TO_INT (position);
+      else
+        continue;
 
-          if (expected_window_node != NULL && actor == expected_window_node->data)
-            expected_window_node = expected_window_node->next;
-          else
-            reordered = TRUE;
-        }
+      by_position[positions[n_actors]] = actor;
+      n_actors++;
     }
 
+  g_hash_table_destroy (window_positions);
   g_list_free (children);
 
-  if (!reordered)
-    {
-      g_list_free (backgrounds);
-      return;
-    }
+  n_kept = meta_stack_order_find_kept (positions, n_actors, kept);
 
-  /* reorder the actors by lowering them in turn to the bottom of the stack.
-   * windows first, then background */
-  for (tmp = g_list_last (info->windows); tmp != NULL; tmp = tmp->prev)
+  if (n_kept < n_actors)
     {
-      ClutterActor *actor = tmp->data;
+      meta_topic (META_DEBUG_COMPOSITOR,
+                  "Restacking %d of %d actors\n", n_actors - n_kept, n_actors);
 
-      if (clutter_actor_get_parent (actor) == info->window_group)
-        clutter_actor_set_child_below_sibling (info->window_group, actor, NULL);
-    }
+      kept_by_position = g_new (gboolean, n_actors);
+      for (i = 0; i < n_actors; i++)
+        kept_by_position[positions[i]] = kept[i];
 
-  /* we prepended the backgrounds above so the last actor in the list
-   * should get lowered to the bottom last.
-   */
-  for (tmp = backgrounds; tmp != NULL; tmp = tmp->next)
-    {
-      ClutterActor *actor = tmp->data;
+      /* Going up from the bottom, put each actor that has to move just
+       * above the one that should be below it, which is already in place */
+      for (i = 0; i < n_actors; i++)
+        {
+          if (kept_by_position[i])
+            continue;
 
-      if (clutter_actor_get_parent (actor) == info->window_group)
-        clutter_actor_set_child_below_sibling (info->window_group, actor, NULL);
+          if (i == 0)
+            clutter_actor_set_child_below_sibling (info->window_group,
+                                                   by_position[i], NULL);
+          else
+            clutter_actor_set_child_above_sibling (info->window_group,
+                                                   by_position[i],
+                                                   by_position[i - 1]);
+        }
+
+      g_free (kept_by_position);
     }
-  g_list_free (backgrounds);
+
+  g_free (positions);
+  g_free (kept);
+  g_free (by_position);
 }
 
 void
@@ -1122,7 +1154,8 @@ meta_compositor_sync_stack (MetaCompositor  *compositor,
 			    MetaScreen	    *screen,
 			    GList	    *stack)
 {
-  GList *old_stack;
+  GList *old_stack, *old_node, *stack_node;
+  GHashTable *stacked;
   MetaCompScreen *info = meta_screen_get_compositor_data (screen);
 
   DEBUG_TRACE ("meta_compositor_sync_stack\n");
@@ -1134,10 +1167,14 @@ meta_compositor_sync_stack (MetaCompositor  *compositor,
    */
 
   /* Sources: first window is the highest */
-  stack = g_list_copy (stack); /* The new stack of MetaWindow */
+  stack_node = stack; /* The new stack of MetaWindow */
   old_stack = g_list_reverse (info->windows); /* The old stack of MetaWindowActor */
+  old_node = old_stack;
   info->windows = NULL;
 
+  /* Actors we have taken from either list, to be skipped in the other */
+  stacked = g_hash_table_new (NULL, NULL);
+
   while (TRUE)
     {
       MetaWindowActor *old_actor = NULL, *stack_actor = NULL, *actor;
@@ -1145,15 +1182,16 @@ meta_compositor_sync_stack (MetaCompositor  *compositor,
 
       /* Find the remaining top actor in our existing stack (ignoring
        * windows that have been hidden and are no longer animating) */
-      while (old_stack)
+      while (old_node)
         {
-          old_actor = old_stack->data;
+          old_actor = old_node->data;
           old_window = meta_window_actor_get_meta_window (old_actor);
 
-          if (old_window->hidden &&
-              !meta_window_actor_effect_in_progress (old_actor))
+          if (g_hash_table_lookup (stacked, old_actor) ||
+              (old_window->hidden &&
+               !meta_window_actor_effect_in_progress (old_actor)))
             {
-              old_stack = g_list_delete_link (old_stack, old_stack);
+              old_node = old_node->next;
               old_actor = NULL;
             }
           else
@@ -1161,15 +1199,20 @@ meta_compositor_sync_stack (MetaCompositor  *compositor,
         }
 
       /* And the remaining top actor in the new stack */
-      while (stack)
+      while (stack_node)
         {
-          stack_window = stack->data;
+          stack_window = stack_node->data;
           stack_actor = META_WINDOW_ACTOR (meta_window_get_compositor_private (stack_window));
           if (!stack_actor)
             {
               meta_verbose ("Failed to find corresponding MetaWindowActor "
                             "for window %s\n", meta_window_get_description (stack_window));
-              stack = g_list_delete_link (stack, stack);
+              stack_node = stack_node->next;
+            }
+          else if (g_hash_table_lookup (stacked, stack_actor))
+            {
+              stack_node = stack_node->next;
+              stack_actor = NULL;
             }
           else
             break;
@@ -1196,16 +1239,15 @@ meta_compositor_sync_stack (MetaCompositor  *compositor,
         }
 
       /* OK, we know what actor we want next. Add it to our window
-       * list, and remove it from both source lists. (It will
-       * be at the front of at least one, hopefully it will be
-       * near the front of the other.)
+       * list, and skip it in both source lists from now on.
        */
       info->windows = g_list_prepend (info->windows, actor);
-
-      stack = g_list_remove (stack, window);
-      old_stack = g_list_remove (old_stack, actor);
+      g_hash_table_insert (stacked, actor, window);
     }
 
+  g_hash_table_destroy (stacked);
+  g_list_free (old_stack);
+
   sync_actor_stacking (info);
 }
 
@@ -1312,6 +1354,9 @@ frame_callback (CoglOnscreen  *onscreen,
           presentation_time = 0;
         }
 
+      meta_frame_profiler_presented (cogl_frame_info_get_frame_counter (frame_info),
+                                     presentation_time);
+
       for (l = info->windows; l; l = l->next)
         meta_window_actor_frame_complete (l->data, frame_info, presentation_time);
     }
@@ -1323,6 +1368,7 @@ pre_paint_windows (MetaCompScreen *info)
   GList *l;
   MetaWindowActor *top_window;
   MetaWindowActor *expected_unredirected_window = NULL;
+  int n_damaged = 0;
 
   if (info->onscreen == NULL)
     {
@@ -1333,9 +1379,13 @@ pre_paint_windows (MetaCompScreen *info)
                                                               NULL);
     }
 
+  meta_frame_profiler_begin_frame (cogl_onscreen_get_frame_counter (info->onscreen));
+
   if (info->windows == NULL)
     return;
 
+  meta_frame_profiler_stage_begin (META_FRAME_STAGE_PRE_PAINT);
+
   top_window = g_list_last (info->windows)->data;
 
   if (meta_window_actor_should_unredirect (top_window) &&
@@ -1361,8 +1411,34 @@ pre_paint_windows (MetaCompScreen *info)
       info->unredirected_window = expected_unredirected_window;
     }
 
+  /* Subtract damage for every window first and then do a single round
+   * trip to make sure that X drawing preceding the XDamageSubtract()
+   * calls is visible to GL; see meta_window_actor_handle_updates() for
+   * the details. Doing this per window costs a round trip for each
+   * window that was damaged during the frame. The replies with the
+   * parts of large damage are read during the same round trip.
+   */
+  for (l = info->windows; l; l = l->next)
+    if (meta_window_actor_repair_damage (l->data))
+      n_damaged++;
+
+  if (n_damaged > 0)
+    {
+      XSync (meta_display_get_xdisplay (meta_screen_get_display (info->screen)), False);
+      info->damage_round_trips++;
+
+      meta_frame_profiler_count (META_FRAME_COUNT_DAMAGED_ACTORS, n_damaged);
+      meta_frame_profiler_count (META_FRAME_COUNT_ROUND_TRIPS, 1);
+
+      meta_topic (META_DEBUG_COMPOSITOR,
+                  "Repaired %d damaged windows with 1 round trip (%u total)\n",
+                  n_damaged, info->damage_round_trips);
+    }
+
   for (l = info->windows; l; l = l->next)
     meta_window_actor_pre_paint (l->data);
+
+  meta_frame_profiler_stage_end (META_FRAME_STAGE_PRE_PAINT);
 }
 
 static gboolean
@@ -1405,6 +1481,27 @@ on_shadow_factory_changed (MetaShadowFactory *factory,
     }
 }
 
+static void
+on_shadow_ready (MetaShadowFactory *factory,
+                 MetaShadow        *shadow,
+                 MetaCompositor    *compositor)
+{
+  GSList *screens = meta_display_get_screens (compositor->display);
+  GList *l;
+  GSList *sl;
+
+  for (sl = screens; sl; sl = sl->next)
+    {
+      MetaScreen *screen = sl->data;
+      MetaCompScreen *info = meta_screen_get_compositor_data (screen);
+      if (!info)
+        continue;
+
+      for (l = info->windows; l; l = l->next)
+        meta_window_actor_shadow_ready (l->data, shadow);
+    }
+}
+
 /**
  * meta_compositor_new: (skip)
  *
@@ -1438,6 +1535,10 @@ meta_compositor_new (MetaDisplay *display)
                     "changed",
                     G_CALLBACK (on_shadow_factory_changed),
                     compositor);
+  g_signal_connect (meta_shadow_factory_get_default (),
+                    "shadow-ready",
+                    G_CALLBACK (on_shadow_ready),
+                    compositor);
 
   compositor->atom_x_root_pixmap = atoms[0];
   compositor->atom_net_wm_window_opacity = atoms[1];
@@ -0,0 +1,449 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Masks for the rounded corners of window frames
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* The mask of a decorated window is the rounded rectangle of the frame,
+ * antialiased along the corner arcs, and its shape is the set of fully
+ * opaque pixels of that mask. Away from the corners, both are simple
+ * rectangles, so rather than rasterizing the whole frame and scanning
+ * every pixel on each reshape, we render each corner once for a given
+ * radius, into a tile of ceil(radius) x ceil(radius) pixels, scan the
+ * tile once, and paste tiles and their opaque regions into place.
+ *
+ * The arcs in the tiles are centered where draw_and_scan_frame() in
+ * meta-window-actor.c centers them, and tiles are only placed at whole
+ * pixel offsets; testframecorners compares the masks and opaque regions
+ * of the two.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "meta-frame-corners.h"
+#include "region-utils.h"
+
+#define TAU (2*M_PI)
+
+/* Number of different radii to keep tiles for; themes typically only
+ * use one or two */
+#define MAX_CACHED_RADII 8
+
+enum
+{
+  TOP_LEFT,
+  TOP_RIGHT,
+  BOTTOM_RIGHT,
+  BOTTOM_LEFT,
+  N_CORNERS
+};
+
+typedef struct
+{
+  float radius;
+  int size;
+  int stride;
+  guchar *tiles[N_CORNERS];
+  /* The fully opaque pixels of each tile */
+  cairo_region_t *opaque[N_CORNERS];
+} CornerTiles;
+
+/* Most recently used first */
+static GList *corner_cache;
+
+/**
+ * meta_frame_corners_scan_mask:
+ * @mask_data: A8 mask
+ * @stride: rowstride of @mask_data
+ * @scan_area: area of the mask to scan
+ *
+ * Finds the fully opaque pixels of a mask. Identical runs of opaque
+ * pixels on consecutive rows are merged into a single rectangle.
+ *
+ * Return value: a new region containing the opaque pixels of @mask_data
+ *  within @scan_area
+ */
+cairo_region_t *
+meta_frame_corners_scan_mask (guchar         *mask_data,
+                              int             stride,
+                              cairo_region_t *scan_area)
+{
+  int i, n_rects = cairo_region_num_rectangles (scan_area);
+  MetaRegionBuilder builder;
+  int *runs, *prev_runs, *tmp;
+  int n_runs, n_prev_runs;
+
+  meta_region_builder_init (&builder);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+      int x, y, j;
+      int start_y;
+
+      cairo_region_get_rectangle (scan_area, i, &rect);
+
+      /* Pairs of x1, x2 */
+      runs = g_new (int, rect.width + 1);
+      prev_runs = g_new (int, rect.width + 1);
+      n_prev_runs = 0;
+      start_y = rect.y;
+
+      for (y = rect.y; y <= rect.y + rect.height; y++)
+        {
+          n_runs = 0;
+
+          if (y < rect.y + rect.height)
+            {
+              const guchar *row = mask_data + y * stride;
+              int x_end = rect.x + rect.width;
+
+              x = rect.x;
+              while (x < x_end)
+                {
+                  int x2;
+
+                  while (x < x_end && row[x] != 255)
+                    x++;
+
+                  x2 = x;
+                  while (x2 < x_end && row[x2] == 255)
+                    x2++;
+
+                  if (x2 > x)
+                    {
+                      runs[n_runs++] = x;
+                      runs[n_runs++] = x2;
+                    }
+
+                  x = x2;
+                }
+
+              if (n_runs == n_prev_runs &&
+                  memcmp (runs, prev_runs, n_runs * sizeof (int)) == 0)
+                continue;
+            }
+
+          /* The runs changed; the previous ones end here */
+          for (j = 0; j < n_prev_runs; j += 2)
+            meta_region_builder_add_rectangle (&builder,
+                                               prev_runs[j], start_y,
+                                               prev_runs[j + 1] - prev_runs[j],
+                                               y - start_y);
+
+          tmp = prev_runs;
+          prev_runs = runs;
+          runs = tmp;
+          n_prev_runs = n_runs;
+          start_y = y;
+        }
+
+      g_free (runs);
+      g_free (prev_runs);
+    }
+
+  return meta_region_builder_finish (&builder);
+}
+
+/* Draws the part of the rounded frame that falls in the tile of a
+ * corner; the outer edges of the frame are along the edges of the tile
+ * for that corner.
+ */
+static void
+draw_corner (cairo_t *cr,
+             int      corner,
+             float    radius,
+             int      size)
+{
+  int x, y;
+
+  /* Like the fallback, truncate the centers of the right and bottom
+   * arcs to whole pixels */
+  switch (corner)
+    {
+    case TOP_LEFT:
+      cairo_arc (cr, radius, radius, radius, 2 * TAU / 4, 3 * TAU / 4);
+      cairo_line_to (cr, size, 0);
+      cairo_line_to (cr, size, size);
+      cairo_line_to (cr, 0, size);
+      break;
+    case TOP_RIGHT:
+      x = size - radius;
+      cairo_arc (cr, x, radius, radius, 3 * TAU / 4, 4 * TAU / 4);
+      cairo_line_to (cr, size, size);
+      cairo_line_to (cr, 0, size);
+      cairo_line_to (cr, 0, 0);
+      break;
+    case BOTTOM_RIGHT:
+      x = size - radius;
+      y = size - radius;
+      cairo_arc (cr, x, y, radius, 0 * TAU / 4, 1 * TAU / 4);
+      cairo_line_to (cr, 0, size);
+      cairo_line_to (cr, 0, 0);
+      cairo_line_to (cr, size, 0);
+      break;
+    case BOTTOM_LEFT:
+      y = size - radius;
+      cairo_arc (cr, radius, y, radius, 1 * TAU / 4, 2 * TAU / 4);
+      cairo_line_to (cr, 0, 0);
+      cairo_line_to (cr, size, 0);
+      cairo_line_to (cr, size, size);
+      break;
+    }
+
+  cairo_close_path (cr);
+  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+  cairo_fill (cr);
+}
+
+static CornerTiles *
+corner_tiles_new (float radius)
+{
+  CornerTiles *tiles;
+  cairo_rectangle_int_t rect;
+  cairo_region_t *tile_region;
+  int i;
+
+  tiles = g_slice_new0 (CornerTiles);
+  tiles->radius = radius;
+  tiles->size = (int) ceilf (radius);
+  tiles->stride = cairo_format_stride_for_width (CAIRO_FORMAT_A8, tiles->size);
+
+  rect.x = rect.y = 0;
+  rect.width = rect.height = tiles->size;
+  tile_region = cairo_region_create_rectangle (&rect);
+
+  for (i = 0; i < N_CORNERS; i++)
+    {
+      cairo_surface_t *surface;
+      cairo_t *cr;
+
+      tiles->tiles[i] = g_malloc0 (tiles->stride * tiles->size);
+
+      surface = cairo_image_surface_create_for_data (tiles->tiles[i],
+                                                     CAIRO_FORMAT_A8,
+                                                     tiles->size,
+                                                     tiles->size,
+                                                     tiles->stride);
+      cr = cairo_create (surface);
+      draw_corner (cr, i, radius, tiles->size);
+      cairo_destroy (cr);
+      cairo_surface_flush (surface);
+      cairo_surface_destroy (surface);
+
+      tiles->opaque[i] = meta_frame_corners_scan_mask (tiles->tiles[i],
+                                                       tiles->stride,
+                                                       tile_region);
+    }
+
+  cairo_region_destroy (tile_region);
+
+  return tiles;
+}
+
+static void
+corner_tiles_free (CornerTiles *tiles)
+{
+  int i;
+
+  for (i = 0; i < N_CORNERS; i++)
+    {
+      g_free (tiles->tiles[i]);
+      cairo_region_destroy (tiles->opaque[i]);
+    }
+
+  g_slice_free (CornerTiles, tiles);
+}
+
+static CornerTiles *
+get_corner_tiles (float radius)
+{
+  CornerTiles *tiles;
+  GList *l;
+
+  for (l = corner_cache; l; l = l->next)
+    {
+      tiles = l->data;
+
+      if (tiles->radius == radius)
+        {
+          corner_cache = g_list_remove_link (corner_cache, l);
+          corner_cache = g_list_concat (l, corner_cache);
+
+          return tiles;
+        }
+    }
+
+  tiles = corner_tiles_new (radius);
+  corner_cache = g_list_prepend (corner_cache, tiles);
+
+  if (g_list_length (corner_cache) > MAX_CACHED_RADII)
+    {
+      l = g_list_last (corner_cache);
+      corner_tiles_free (l->data);
+      corner_cache = g_list_delete_link (corner_cache, l);
+    }
+
+  return tiles;
+}
+
+static void
+fill_rectangle (guchar                *mask_data,
+                int                    stride,
+                cairo_rectangle_int_t *rect)
+{
+  int y;
+
+  for (y = rect->y; y < rect->y + rect->height; y++)
+    memset (mask_data + y * stride + rect->x, 255, rect->width);
+}
+
+/**
+ * meta_frame_corners_draw_mask:
+ * @mask_data: A8 mask to draw into
+ * @stride: rowstride of @mask_data
+ * @frame_region: the area to draw in; pixels outside of it are
+ *  left untouched
+ * @outer: the outer rectangle of the frame
+ * @top_left: radius of the top left corner
+ * @top_right: radius of the top right corner
+ * @bottom_left: radius of the bottom left corner
+ * @bottom_right: radius of the bottom right corner
+ *
+ * Draws the frame rectangle @outer, with rounded corners, into the
+ * part of @mask_data in @frame_region, which must be cleared to 0.
+ *
+ * Return value: a new region containing the pixels that were made
+ *  fully opaque, or %NULL if the corners of the frame overlap or the
+ *  right or bottom edge of the frame doesn't fall on a pixel boundary;
+ *  the caller then has to draw the frame some other way.
+ */
+cairo_region_t *
+meta_frame_corners_draw_mask (guchar                      *mask_data,
+                              int                          stride,
+                              cairo_region_t              *frame_region,
+                              const cairo_rectangle_int_t *outer,
+                              float                        top_left,
+                              float                        top_right,
+                              float                        bottom_left,
+                              float                        bottom_right)
+{
+  float radii[N_CORNERS];
+  CornerTiles *tiles[N_CORNERS];
+  cairo_rectangle_int_t tile_rects[N_CORNERS];
+  cairo_region_t *region, *body, *opaque;
+  int sizes[N_CORNERS];
+  int i, j, n_rects;
+
+  radii[TOP_LEFT] = top_left;
+  radii[TOP_RIGHT] = top_right;
+  radii[BOTTOM_RIGHT] = bottom_right;
+  radii[BOTTOM_LEFT] = bottom_left;
+
+  /* With its center truncated, an arc with a fractional radius ends
+   * inside a pixel, and so does the whole right or bottom edge of the
+   * frame that continues from it; tiles can only do the top left one */
+  if (top_right != floorf (top_right) ||
+      bottom_right != floorf (bottom_right) ||
+      bottom_left != floorf (bottom_left))
+    return NULL;
+
+  for (i = 0; i < N_CORNERS; i++)
+    sizes[i] = radii[i] > 0 ? (int) ceilf (radii[i]) : 0;
+
+  if (sizes[TOP_LEFT] + sizes[TOP_RIGHT] > outer->width ||
+      sizes[BOTTOM_LEFT] + sizes[BOTTOM_RIGHT] > outer->width ||
+      sizes[TOP_LEFT] + sizes[BOTTOM_LEFT] > outer->height ||
+      sizes[TOP_RIGHT] + sizes[BOTTOM_RIGHT] > outer->height)
+    return NULL;
+
+  tile_rects[TOP_LEFT].x = outer->x;
+  tile_rects[TOP_LEFT].y = outer->y;
+  tile_rects[TOP_RIGHT].x = outer->x + outer->width - sizes[TOP_RIGHT];
+  tile_rects[TOP_RIGHT].y = outer->y;
+  tile_rects[BOTTOM_RIGHT].x = outer->x + outer->width - sizes[BOTTOM_RIGHT];
+  tile_rects[BOTTOM_RIGHT].y = outer->y + outer->height - sizes[BOTTOM_RIGHT];
+  tile_rects[BOTTOM_LEFT].x = outer->x;
+  tile_rects[BOTTOM_LEFT].y = outer->y + outer->height - sizes[BOTTOM_LEFT];
+
+  region = cairo_region_copy (frame_region);
+  cairo_region_intersect_rectangle (region, outer);
+
+  /* Everything but the corners is opaque */
+  body = cairo_region_copy (region);
+  for (i = 0; i < N_CORNERS; i++)
+    {
+      tile_rects[i].width = tile_rects[i].height = sizes[i];
+      tiles[i] = sizes[i] > 0 ? get_corner_tiles (radii[i]) : NULL;
+
+      if (tiles[i])
+        cairo_region_subtract_rectangle (body, &tile_rects[i]);
+    }
+
+  n_rects = cairo_region_num_rectangles (body);
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (body, i, &rect);
+      fill_rectangle (mask_data, stride, &rect);
+    }
+
+  opaque = body;
+
+  for (i = 0; i < N_CORNERS; i++)
+    {
+      cairo_region_t *tile_region, *tile_opaque;
+      int x, y;
+
+      if (tiles[i] == NULL)
+        continue;
+
+      tile_region = cairo_region_copy (region);
+      cairo_region_intersect_rectangle (tile_region, &tile_rects[i]);
+
+      n_rects = cairo_region_num_rectangles (tile_region);
+      for (j = 0; j < n_rects; j++)
+        {
+          cairo_rectangle_int_t rect;
+
+          cairo_region_get_rectangle (tile_region, j, &rect);
+
+          for (y = rect.y; y < rect.y + rect.height; y++)
+            {
+              x = rect.x - tile_rects[i].x;
+
+              memcpy (mask_data + y * stride + rect.x,
+                      tiles[i]->tiles[i] + (y - tile_rects[i].y) * tiles[i]->stride + x,
+                      rect.width);
+            }
+        }
+
+      tile_opaque = cairo_region_copy (tiles[i]->opaque[i]);
+      cairo_region_translate (tile_opaque, tile_rects[i].x, tile_rects[i].y);
+      cairo_region_intersect (tile_opaque, tile_region);
+      cairo_region_union (opaque, tile_opaque);
+
+      cairo_region_destroy (tile_opaque);
+      cairo_region_destroy (tile_region);
+    }
+
+  cairo_region_destroy (region);
+
+  return opaque;
+}
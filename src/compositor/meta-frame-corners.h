@@ -0,0 +1,40 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Masks for the rounded corners of window frames
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __META_FRAME_CORNERS_H__
+#define __META_FRAME_CORNERS_H__
+
+#include <cairo.h>
+#include <glib.h>
+
+cairo_region_t *meta_frame_corners_scan_mask (guchar         *mask_data,
+                                              int             stride,
+                                              cairo_region_t *scan_area);
+
+cairo_region_t *meta_frame_corners_draw_mask (guchar                      *mask_data,
+                                              int                          stride,
+                                              cairo_region_t              *frame_region,
+                                              const cairo_rectangle_int_t *outer,
+                                              float                        top_left,
+                                              float                        top_right,
+                                              float                        bottom_left,
+                                              float                        bottom_right);
+
+#endif /* __META_FRAME_CORNERS_H__ */
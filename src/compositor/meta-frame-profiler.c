@@ -0,0 +1,255 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Per-frame timing of the stages of compositing
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* The profiler always records the last N_FRAMES frames into a ring
+ * buffer, so that when something janks, the user can dump what just
+ * happened with the set-spew-mark keybinding, without having to restart
+ * mutter in verbose mode. Recording a frame is a handful of calls to
+ * g_get_monotonic_time() and some additions.
+ *
+ * Frames are only written from the main thread. A frame's slot is
+ * filled in while the frame is in progress and then published by
+ * incrementing n_frames, so the published frames can be read without
+ * locking.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <meta/util.h>
+#include "meta-frame-profiler.h"
+
+#define N_FRAMES 1024
+
+/* How far back to look for the frame a presentation time is for */
+#define MAX_PENDING_PRESENTATIONS 16
+
+typedef struct
+{
+  gint64 frame_counter;
+  gint64 start_time;
+  gint64 end_time;
+  gint64 presentation_time;
+  gint64 stage_time[META_FRAME_N_STAGES];
+  guint counts[META_FRAME_N_COUNTS];
+} MetaFrameRecord;
+
+static const char * const stage_names[] = {
+  "pre-paint",
+  "cull",
+  "paint",
+  "shadows",
+  "post-paint",
+  "resize-laters",
+  "before-redraw-laters",
+  "idle-laters"
+};
+
+static const char * const count_names[] = {
+  "damaged",
+  "culled",
+  "round-trips",
+  "uploads",
+  "deferred-laters",
+  "decoration-hits",
+  "decoration-misses"
+};
+
+static MetaFrameRecord frames[N_FRAMES];
+/* Number of frames published so far; frames[n_frames % N_FRAMES] is
+ * the one being recorded */
+static volatile gint n_frames;
+static gint64 stage_start[META_FRAME_N_STAGES];
+static gboolean in_frame;
+
+static inline MetaFrameRecord *
+current_frame (void)
+{
+  return &frames[(guint) n_frames % N_FRAMES];
+}
+
+/**
+ * meta_frame_profiler_begin_frame:
+ * @frame_counter: the Cogl frame counter the frame will be presented with
+ *
+ * Starts recording a frame. Counts recorded between frames are
+ * attributed to the next frame.
+ */
+void
+meta_frame_profiler_begin_frame (gint64 frame_counter)
+{
+  MetaFrameRecord *frame = current_frame ();
+
+  /* With several screens, all of them are painted in the same frame */
+  if (in_frame)
+    return;
+
+  in_frame = TRUE;
+  frame->frame_counter = frame_counter;
+  frame->start_time = g_get_monotonic_time ();
+}
+
+/**
+ * meta_frame_profiler_end_frame:
+ *
+ * Finishes recording the current frame and makes it available in
+ * dumps.
+ */
+void
+meta_frame_profiler_end_frame (void)
+{
+  MetaFrameRecord *frame = current_frame ();
+
+  if (!in_frame)
+    return;
+
+  in_frame = FALSE;
+  frame->end_time = g_get_monotonic_time ();
+
+  g_atomic_int_inc (&n_frames);
+
+  memset (current_frame (), 0, sizeof (MetaFrameRecord));
+}
+
+void
+meta_frame_profiler_stage_begin (MetaFrameStage stage)
+{
+  stage_start[stage] = g_get_monotonic_time ();
+}
+
+void
+meta_frame_profiler_stage_end (MetaFrameStage stage)
+{
+  current_frame ()->stage_time[stage] += g_get_monotonic_time () - stage_start[stage];
+}
+
+void
+meta_frame_profiler_count (MetaFrameCount count,
+                           int            n)
+{
+  current_frame ()->counts[count] += n;
+}
+
+/**
+ * meta_frame_profiler_presented:
+ * @frame_counter: the Cogl frame counter of the frame
+ * @presentation_time: when the frame was presented, in the
+ *  g_get_monotonic_time() timescale, or 0 if unknown
+ *
+ * Records the presentation time of a recently finished frame.
+ */
+void
+meta_frame_profiler_presented (gint64 frame_counter,
+                               gint64 presentation_time)
+{
+  gint published = g_atomic_int_get (&n_frames);
+  int i;
+
+  for (i = 1; i <= MIN (published, MAX_PENDING_PRESENTATIONS); i++)
+    {
+      MetaFrameRecord *frame = &frames[(guint) (published - i) % N_FRAMES];
+
+      if (frame->frame_counter == frame_counter)
+        {
+          frame->presentation_time = presentation_time;
+          break;
+        }
+    }
+}
+
+static void
+write_frames (FILE *file)
+{
+  gint published = g_atomic_int_get (&n_frames);
+  gint first = MAX (0, published - N_FRAMES);
+  int i, j;
+
+  fprintf (file, "# frame start-us total-us present-latency-us");
+  for (j = 0; j < META_FRAME_N_STAGES; j++)
+    fprintf (file, " %s-us", stage_names[j]);
+  for (j = 0; j < META_FRAME_N_COUNTS; j++)
+    fprintf (file, " %s", count_names[j]);
+  fprintf (file, "\n");
+
+  for (i = first; i < published; i++)
+    {
+      MetaFrameRecord *frame = &frames[(guint) i % N_FRAMES];
+
+      fprintf (file, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GINT64_FORMAT,
+               frame->frame_counter,
+               frame->start_time,
+               frame->end_time - frame->start_time,
+               frame->presentation_time ? frame->presentation_time - frame->start_time : -1);
+
+      for (j = 0; j < META_FRAME_N_STAGES; j++)
+        fprintf (file, " %" G_GINT64_FORMAT, frame->stage_time[j]);
+      for (j = 0; j < META_FRAME_N_COUNTS; j++)
+        fprintf (file, " %u", frame->counts[j]);
+
+      fprintf (file, "\n");
+    }
+}
+
+/**
+ * meta_frame_profiler_dump:
+ *
+ * Writes the recorded frames to a new file in the temporary directory,
+ * one line per frame, with the time spent in each stage and the counts.
+ */
+void
+meta_frame_profiler_dump (void)
+{
+  char *filename = NULL;
+  char *tmpl;
+  GError *err = NULL;
+  FILE *file;
+  int fd;
+
+  tmpl = g_strdup_printf ("mutter-%d-frames-XXXXXX", (int) getpid ());
+  fd = g_file_open_tmp (tmpl, &filename, &err);
+  g_free (tmpl);
+
+  if (err != NULL)
+    {
+      meta_warning ("Failed to open frame profile: %s\n", err->message);
+      g_error_free (err);
+      return;
+    }
+
+  file = fdopen (fd, "w");
+  if (file == NULL)
+    {
+      meta_warning ("Failed to fdopen() frame profile %s: %s\n",
+                    filename, strerror (errno));
+      close (fd);
+      g_free (filename);
+      return;
+    }
+
+  write_frames (file);
+  fclose (file);
+
+  g_message ("Wrote frame profile to %s", filename);
+  g_free (filename);
+}
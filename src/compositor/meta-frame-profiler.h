@@ -0,0 +1,77 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Per-frame timing of the stages of compositing
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __META_FRAME_PROFILER_H__
+#define __META_FRAME_PROFILER_H__
+
+#include <glib.h>
+
+typedef enum
+{
+  /* pre_paint_windows(): unredirection, damage repair, updates */
+  META_FRAME_STAGE_PRE_PAINT,
+  /* Computing the visible regions in meta_window_group_paint() */
+  META_FRAME_STAGE_CULL,
+  /* Painting the window group, including the shadows */
+  META_FRAME_STAGE_PAINT,
+  /* Painting shadows, summed over all windows */
+  META_FRAME_STAGE_SHADOWS,
+  /* after_stage_paint() */
+  META_FRAME_STAGE_POST_PAINT,
+  /* The phases of meta_later_add() callbacks; these run outside of
+   * frames too, and are attributed to the next frame */
+  META_FRAME_STAGE_RESIZE_LATERS,
+  META_FRAME_STAGE_BEFORE_REDRAW_LATERS,
+  META_FRAME_STAGE_IDLE_LATERS,
+
+  META_FRAME_N_STAGES
+} MetaFrameStage;
+
+typedef enum
+{
+  META_FRAME_COUNT_DAMAGED_ACTORS,
+  META_FRAME_COUNT_CULLED_ACTORS,
+  META_FRAME_COUNT_ROUND_TRIPS,
+  META_FRAME_COUNT_TEXTURE_UPLOADS,
+  /* META_LATER_IDLE callbacks left for later for lack of time */
+  META_FRAME_COUNT_DEFERRED_LATERS,
+  /* Pieces of window decorations drawn from the render cache of
+   * MetaFrames, and drawn by the theme */
+  META_FRAME_COUNT_DECORATION_HITS,
+  META_FRAME_COUNT_DECORATION_MISSES,
+
+  META_FRAME_N_COUNTS
+} MetaFrameCount;
+
+void meta_frame_profiler_begin_frame (gint64 frame_counter);
+void meta_frame_profiler_end_frame   (void);
+
+void meta_frame_profiler_stage_begin (MetaFrameStage stage);
+void meta_frame_profiler_stage_end   (MetaFrameStage stage);
+
+void meta_frame_profiler_count       (MetaFrameCount count,
+                                      int            n);
+
+void meta_frame_profiler_presented   (gint64 frame_counter,
+                                      gint64 presentation_time);
+
+void meta_frame_profiler_dump        (void);
+
+#endif /* __META_FRAME_PROFILER_H__ */
@@ -0,0 +1,198 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Fetching the rectangles of XFixes regions without waiting for them
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* XFixesFetchRegion() waits for its reply. Like async-getprop.c, this
+ * sends the request and reads the reply from an Xlib async handler,
+ * so that the regions of several windows can be fetched with a single
+ * round trip. The reply is read by whatever next waits on the server,
+ * usually the XSync() the compositor makes once per frame anyway.
+ *
+ * This file is kept free of GLib, as Xlibint.h doesn't mix well.
+ */
+
+#include <config.h>
+
+#include "meta-region-fetch.h"
+
+#define NEED_REPLIES
+#include <X11/Xlibint.h>
+#include <X11/extensions/xfixesproto.h>
+
+struct _MetaRegionFetch
+{
+  _XAsyncHandler async;
+  Display *display;
+  unsigned long request_seq;
+  Bool done;
+  XRectangle *rects;
+  int n_rects;
+};
+
+static Display *opcode_display = NULL;
+static int xfixes_opcode = 0;
+
+static int
+get_xfixes_opcode (Display *dpy)
+{
+  int event_base, error_base;
+
+  if (opcode_display != dpy)
+    {
+      if (!XQueryExtension (dpy, "XFIXES",
+                            &xfixes_opcode, &event_base, &error_base))
+        xfixes_opcode = 0;
+      opcode_display = dpy;
+    }
+
+  return xfixes_opcode;
+}
+
+static Bool
+region_fetch_handler (Display *dpy,
+                      xReply  *rep,
+                      char    *buf,
+                      int      len,
+                      XPointer data)
+{
+  MetaRegionFetch *fetch = (MetaRegionFetch *) data;
+  xXFixesFetchRegionReply replbuf;
+  xXFixesFetchRegionReply *reply;
+  int n_rects;
+
+  if (dpy->last_request_read != fetch->request_seq)
+    return False;
+
+  DeqAsyncHandler (dpy, &fetch->async);
+  fetch->done = True;
+
+  if (rep->generic.type == X_Error)
+    {
+      xError errbuf;
+
+      /* Eat the error, like async-getprop.c; the caller gets no
+       * rectangles and falls back to what it had.
+       */
+      _XGetAsyncReply (dpy, (char *) &errbuf, rep, buf, len,
+                       (SIZEOF (xError) - SIZEOF (xReply)) >> 2,
+                       False);
+      return True;
+    }
+
+  reply = (xXFixesFetchRegionReply *)
+    _XGetAsyncReply (dpy, (char *) &replbuf, rep, buf, len,
+                     (SIZEOF (xXFixesFetchRegionReply) - SIZEOF (xReply)) >> 2,
+                     False);
+
+  /* Each rectangle is two words on the wire, laid out as XRectangle */
+  n_rects = reply->length / 2;
+  fetch->rects = Xmalloc ((n_rects > 0 ? n_rects : 1) * sizeof (XRectangle));
+  if (fetch->rects != NULL)
+    {
+      fetch->n_rects = n_rects;
+      _XGetAsyncData (dpy, (char *) fetch->rects, buf, len,
+                      SIZEOF (xXFixesFetchRegionReply),
+                      n_rects * sizeof (XRectangle),
+                      reply->length << 2);
+    }
+  else
+    {
+      _XGetAsyncData (dpy, NULL, buf, len,
+                      SIZEOF (xXFixesFetchRegionReply),
+                      0, reply->length << 2);
+    }
+
+  return True;
+}
+
+/**
+ * meta_region_fetch_begin: (skip)
+ * @xdisplay: the display
+ * @region: the region to fetch
+ *
+ * Sends a request for the rectangles of @region, without waiting for
+ * the reply.
+ *
+ * Return value: a fetch to pass to meta_region_fetch_finish(), or
+ *  %NULL if XFixes is missing
+ */
+MetaRegionFetch *
+meta_region_fetch_begin (Display       *dpy,
+                         XserverRegion  region)
+{
+  xXFixesFetchRegionReq *req;
+  MetaRegionFetch *fetch;
+  int opcode;
+
+  opcode = get_xfixes_opcode (dpy);
+  if (opcode == 0)
+    return NULL;
+
+  fetch = Xcalloc (1, sizeof (MetaRegionFetch));
+  if (fetch == NULL)
+    return NULL;
+
+  fetch->display = dpy;
+
+  LockDisplay (dpy);
+
+  GetReq (XFixesFetchRegion, req);
+  req->reqType = opcode;
+  req->xfixesReqType = X_XFixesFetchRegion;
+  req->region = region;
+
+  fetch->request_seq = dpy->request;
+
+  fetch->async.next = dpy->async_handlers;
+  fetch->async.handler = region_fetch_handler;
+  fetch->async.data = (XPointer) fetch;
+  dpy->async_handlers = &fetch->async;
+
+  UnlockDisplay (dpy);
+  SyncHandle ();
+
+  return fetch;
+}
+
+/**
+ * meta_region_fetch_finish: (skip)
+ * @fetch: a fetch started with meta_region_fetch_begin()
+ * @n_rects: (out): the number of rectangles
+ *
+ * Gets the rectangles of the region and frees @fetch. If the reply
+ * hasn't been read yet, this makes a round trip for it.
+ *
+ * Return value: the rectangles, to be freed with XFree(), or %NULL
+ */
+XRectangle *
+meta_region_fetch_finish (MetaRegionFetch *fetch,
+                          int             *n_rects)
+{
+  XRectangle *rects;
+
+  if (!fetch->done)
+    XSync (fetch->display, False);
+
+  rects = fetch->rects;
+  *n_rects = fetch->n_rects;
+
+  XFree (fetch);
+
+  return rects;
+}
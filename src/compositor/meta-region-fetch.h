@@ -0,0 +1,34 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Fetching the rectangles of XFixes regions without waiting for them
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __META_REGION_FETCH_H__
+#define __META_REGION_FETCH_H__
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+
+typedef struct _MetaRegionFetch MetaRegionFetch;
+
+MetaRegionFetch *meta_region_fetch_begin  (Display         *xdisplay,
+                                           XserverRegion    region);
+XRectangle      *meta_region_fetch_finish (MetaRegionFetch *fetch,
+                                           int             *n_rects);
+
+#endif /* __META_REGION_FETCH_H__ */
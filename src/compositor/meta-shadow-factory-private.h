@@ -65,4 +65,12 @@ MetaShadow *meta_shadow_factory_get_shadow (MetaShadowFactory *factory,
                                             const char        *class_name,
                                             gboolean           focused);
 
+void meta_shadow_blur_rows (cairo_region_t *convolve_region,
+                            int             x_offset,
+                            int             y_offset,
+                            guchar         *buffer,
+                            int             buffer_width,
+                            int             buffer_height,
+                            int             d);
+
 #endif /* __META_SHADOW_FACTORY_PRIVATE_H__ */
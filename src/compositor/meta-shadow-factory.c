@@ -24,9 +24,13 @@
 #include <config.h>
 #include <math.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "cogl-utils.h"
 #include "meta-shadow-factory-private.h"
+#include "meta-frame-profiler.h"
 #include "region-utils.h"
 
 /* This file implements blurring the shape of a window to produce a
@@ -47,6 +51,10 @@
  *   in blocks, blur rows again, and then transpose back.
  *
  * - We approximate the 1D gaussian blur as 3 successive box filters.
+ *
+ * - Each box filter pass is computed from prefix sums, with the divide
+ *   by the filter size replaced by a multiply, and vectorized with SSE2
+ *   where available.
  */
 
 typedef struct _MetaShadowCacheKey  MetaShadowCacheKey;
@@ -84,6 +92,36 @@ struct _MetaShadow
   guint scale_height : 1;
 };
 
+/* Shadows with fewer pixels than this are made synchronously */
+#define ASYNC_SHADOW_MIN_PIXELS (256 * 256)
+#define N_SHADOW_THREADS 2
+
+typedef struct _MetaShadowJob MetaShadowJob;
+
+struct _MetaShadowJob
+{
+  /* References held while the job is pending, only touched in
+   * the main thread */
+  MetaShadowFactory *factory;
+  MetaShadow *shadow;
+
+  /* Input */
+  cairo_region_t *region;
+  int radius;
+  int top_fade;
+  int outer_border_top;
+  int outer_border_right;
+  int outer_border_bottom;
+  int outer_border_left;
+
+  /* Output */
+  guchar *buffer;
+  int rowstride;
+  int data_offset;
+  int texture_width;
+  int texture_height;
+};
+
 struct _MetaShadowClassInfo
 {
   const char *name; /* const so we can reuse for static definitions */
@@ -101,6 +139,9 @@ struct _MetaShadowFactory
 
   /* class name => MetaShadowClassInfo */
   GHashTable *shadow_classes;
+
+  /* Worker threads blurring large shadows */
+  GThreadPool *pool;
 };
 
 struct _MetaShadowFactoryClass
@@ -111,6 +152,7 @@ struct _MetaShadowFactoryClass
 enum
 {
   CHANGED,
+  SHADOW_READY,
 
   LAST_SIGNAL
 };
@@ -175,8 +217,10 @@ meta_shadow_unref (MetaShadow *shadow)
         }
 
       meta_window_shape_unref (shadow->key.shape);
-      cogl_object_unref (shadow->texture);
-      cogl_object_unref (shadow->pipeline);
+      if (shadow->texture)
+        cogl_object_unref (shadow->texture);
+      if (shadow->pipeline)
+        cogl_object_unref (shadow->pipeline);
 
       g_slice_free (MetaShadow, shadow);
     }
@@ -209,8 +253,8 @@ meta_shadow_paint (MetaShadow     *shadow,
                    cairo_region_t *clip,
                    gboolean        clip_strictly)
 {
-  float texture_width = cogl_texture_get_width (shadow->texture);
-  float texture_height = cogl_texture_get_height (shadow->texture);
+  float texture_width;
+  float texture_height;
   int i, j;
   float src_x[4];
   float src_y[4];
@@ -218,6 +262,13 @@ meta_shadow_paint (MetaShadow     *shadow,
   int dest_y[4];
   int n_x, n_y;
 
+  /* Still being made in the background */
+  if (shadow->texture == NULL)
+    return;
+
+  texture_width = cogl_texture_get_width (shadow->texture);
+  texture_height = cogl_texture_get_height (shadow->texture);
+
   cogl_pipeline_set_color4ub (shadow->pipeline,
                               opacity, opacity, opacity, opacity);
 
@@ -424,6 +475,10 @@ meta_shadow_factory_finalize (GObject *object)
       shadow->factory = NULL;
     }
 
+  /* Pending jobs hold a reference on the factory, so there are none left */
+  if (factory->pool)
+    g_thread_pool_free (factory->pool, FALSE, TRUE);
+
   g_hash_table_destroy (factory->shadows);
   g_hash_table_destroy (factory->shadow_classes);
 
@@ -444,6 +499,17 @@ meta_shadow_factory_class_init (MetaShadowFactoryClass *klass)
                   0,
                   NULL, NULL, NULL,
                   G_TYPE_NONE, 0);
+
+  /* Emitted when the texture of a shadow that was made in the
+   * background becomes available. */
+  signals[SHADOW_READY] =
+    g_signal_new ("shadow-ready",
+                  G_TYPE_FROM_CLASS (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE, 1,
+                  G_TYPE_POINTER);
 }
 
 MetaShadowFactory *
@@ -489,8 +555,8 @@ get_box_filter_size (int radius)
 
 /* The "spread" of the filter is the number of pixels from an original
  * pixel that it's blurred image extends. (A no-op blur that doesn't
- * blur would have a spread of 0.) See comment in blur_rows() for why the
- * odd and even cases are different
+ * blur would have a spread of 0.) See comment in meta_shadow_blur_rows()
+ * for why the odd and even cases are different
  */
 static int
 get_shadow_spread (int radius)
@@ -503,74 +569,187 @@ get_shadow_spread (int radius)
     return 3 * (d / 2) - 1;
 }
 
-/* This applies a single box blur pass to a horizontal range of pixels;
- * since the box blur has the same weight for all pixels, we can
- * implement an efficient sliding window algorithm where we add
- * in pixels coming into the window from the right and remove
- * them when they leave the windw to the left.
+/* The largest filter size for which blur_divide() is exact; see below */
+#define MAX_EXACT_DIVISOR 4096
+
+typedef struct
+{
+  int     d;
+  guint64 multiplier;
+} BlurDivisor;
+
+/* Dividing by d is by far the most expensive part of a box blur pass;
+ * since d is constant over the whole blur, we replace it by a multiply
+ * with a precomputed reciprocal. With multiplier = ceil(2^32 / d), the
+ * result of (n * multiplier) >> 32 is exactly n / d as long as
+ * n * d < 2^32; since n <= 256 * d, that holds for d <= 4096.
+ */
+static void
+blur_divisor_init (BlurDivisor *div,
+                   int          d)
+{
+  div->d = d;
+  div->multiplier = ((G_GUINT64_CONSTANT (1) << 32) + d - 1) / d;
+}
+
+static inline guint32
+blur_divide (const BlurDivisor *div,
+             guint32            n)
+{
+  if (G_UNLIKELY (div->d > MAX_EXACT_DIVISOR))
+    return n / div->d;
+
+  return (guint32) ((n * div->multiplier) >> 32);
+}
+
+/* This applies a single box blur pass to a horizontal range of pixels.
  *
  * d is the filter width; for even d shift indicates how the blurred
  * result is aligned with the original - does ' x ' go to ' yy' (shift=1)
  * or 'yy ' (shift=-1)
+ *
+ * The result is the same as that of a sliding window that adds in pixels
+ * coming into the window from the right and removes them when they leave
+ * the window to the left, rounding to the nearest integer after each
+ * pass; prefix must have room for row_width + 1 values.
  */
 static void
-blur_xspan (guchar *row,
-            guchar *tmp_buffer,
-            int     row_width,
-            int     x0,
-            int     x1,
-            int     d,
-            int     shift)
+blur_xspan (guchar            *row,
+            guint32           *prefix,
+            guchar            *tmp_buffer,
+            int                row_width,
+            int                x0,
+            int                x1,
+            int                d,
+            int                shift,
+            const BlurDivisor *div)
 {
   int offset;
-  int sum = 0;
-  int i;
+  int first, last;
+  int start, end;
+  guint32 half = d / 2;
+  int k, p;
+
+  if (x1 <= x0)
+    return;
 
   if (d % 2 == 1)
     offset = d / 2;
   else
     offset = (d - shift) / 2;
 
-  /* All the conditionals in here look slow, but the branches will
-   * be well predicted and there are enough different possibilities
-   * that trying to write this as a series of unconditional loops
-   * is hard and not an obvious win. The main slow down here seems
-   * to be the integer division for pixel; one possible optimization
-   * would be to accumulate into two 16-bit integer buffers and
-   * only divide down after all three passes. (SSE parallel implementation
-   * of the divide step is possible.)
+  /* The blurred value at p is the average of row[p + offset - d + 1]
+   * through row[p + offset], treating pixels outside the row as 0.
+   * Rather than updating a running sum, which needs a divide per pixel
+   * inline with the sum, we compute prefix sums over the range of the
+   * row we read and take differences; prefix[k - first] is the sum of
+   * row[first] .. row[k - 1].
    */
-  for (i = x0 - d + offset; i < x1 + offset; i++)
+  first = MAX (x0 + offset - d + 1, 0);
+  last = MIN (x1 + offset, row_width);
+
+  prefix[0] = 0;
+  for (k = first; k < last; k++)
+    prefix[k - first + 1] = prefix[k - first] + row[k];
+
+  /* Between start and end the window doesn't cross the row edges */
+  start = CLAMP (d - 1 - offset, x0, x1);
+  end = CLAMP (row_width - offset, start, x1);
+
+  for (p = x0; p < start; p++)
     {
-      if (i >= 0 && i < row_width)
-	sum += row[i];
+      int a = MAX (p + offset - d + 1, 0);
+      int b = MIN (p + offset + 1, row_width);
 
-      if (i >= x0 + offset)
-	{
-	  if (i >= d)
-	    sum -= row[i - d];
+      tmp_buffer[p] = blur_divide (div, prefix[b - first] - prefix[a - first] + half);
+    }
 
-	  tmp_buffer[i - offset] = (sum + d / 2) / d;
-	}
+  p = start;
+
+#ifdef __SSE2__
+  if (d > 1 && d <= MAX_EXACT_DIVISOR)
+    {
+      const guint32 *upper = prefix + (offset + 1 - first);
+      const guint32 *lower = prefix + (offset - d + 1 - first);
+      __m128i multiplier = _mm_set1_epi32 ((int) div->multiplier);
+      __m128i rounding = _mm_set1_epi32 (half);
+      __m128i odd_mask = _mm_set_epi32 (-1, 0, -1, 0);
+
+      for (; p + 4 <= end; p += 4)
+        {
+          __m128i n, even, odd, q;
+          guint32 out;
+
+          n = _mm_sub_epi32 (_mm_loadu_si128 ((const __m128i *) (upper + p)),
+                             _mm_loadu_si128 ((const __m128i *) (lower + p)));
+          n = _mm_add_epi32 (n, rounding);
+
+          /* SSE2 only has a 32x32->64 multiply for the even lanes, so
+           * do the even and odd lanes separately and keep the high halves */
+          even = _mm_srli_epi64 (_mm_mul_epu32 (n, multiplier), 32);
+          odd = _mm_and_si128 (_mm_mul_epu32 (_mm_srli_epi64 (n, 32), multiplier),
+                               odd_mask);
+          q = _mm_or_si128 (even, odd);
+
+          /* All values are <= 255, so packing can't saturate */
+          q = _mm_packs_epi32 (q, q);
+          q = _mm_packus_epi16 (q, q);
+
+          out = _mm_cvtsi128_si32 (q);
+          memcpy (tmp_buffer + p, &out, 4);
+        }
     }
+#endif
 
-  memcpy(row + x0, tmp_buffer + x0, x1 - x0);
+  for (; p < end; p++)
+    tmp_buffer[p] = blur_divide (div,
+                                 prefix[p + offset + 1 - first] -
+                                 prefix[p + offset - d + 1 - first] + half);
+
+  for (p = end; p < x1; p++)
+    {
+      int a = MAX (p + offset - d + 1, 0);
+      int b = MIN (p + offset + 1, row_width);
+
+      tmp_buffer[p] = blur_divide (div, prefix[b - first] - prefix[a - first] + half);
+    }
+
+  memcpy (row + x0, tmp_buffer + x0, x1 - x0);
 }
 
-static void
-blur_rows (cairo_region_t   *convolve_region,
-           int               x_offset,
-           int               y_offset,
-	   guchar           *buffer,
-	   int               buffer_width,
-	   int               buffer_height,
-           int               d)
+/**
+ * meta_shadow_blur_rows: (skip)
+ * @convolve_region: the region to blur, relative to the offsets
+ * @x_offset: offset between the region and buffer x coordinates
+ * @y_offset: offset between the region and buffer y coordinates
+ * @buffer: an A8 buffer
+ * @buffer_width: width and rowstride of @buffer
+ * @buffer_height: height of @buffer
+ * @d: the box filter size
+ *
+ * Blurs the rows of @buffer within @convolve_region with three box blur
+ * passes of size @d, emulating a Gaussian blur.
+ */
+void
+meta_shadow_blur_rows (cairo_region_t   *convolve_region,
+                       int               x_offset,
+                       int               y_offset,
+                       guchar           *buffer,
+                       int               buffer_width,
+                       int               buffer_height,
+                       int               d)
 {
   int i, j;
   int n_rectangles;
   guchar *tmp_buffer;
+  guint32 *prefix;
+  BlurDivisor div, div_plus_one;
 
   tmp_buffer = g_malloc (buffer_width);
+  prefix = g_new (guint32, buffer_width + 1);
+
+  blur_divisor_init (&div, d);
+  blur_divisor_init (&div_plus_one, d + 1);
 
   n_rectangles = cairo_region_num_rectangles (convolve_region);
   for (i = 0; i < n_rectangles; i++)
@@ -593,19 +772,20 @@ blur_rows (cairo_region_t   *convolve_region,
            */
 	  if (d % 2 == 1)
 	    {
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
+	      blur_xspan (row, prefix, tmp_buffer, buffer_width, x0, x1, d, 0, &div);
+	      blur_xspan (row, prefix, tmp_buffer, buffer_width, x0, x1, d, 0, &div);
+	      blur_xspan (row, prefix, tmp_buffer, buffer_width, x0, x1, d, 0, &div);
 	    }
 	  else
 	    {
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 1);
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, -1);
-	      blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d + 1, 0);
+	      blur_xspan (row, prefix, tmp_buffer, buffer_width, x0, x1, d, 1, &div);
+	      blur_xspan (row, prefix, tmp_buffer, buffer_width, x0, x1, d, -1, &div);
+	      blur_xspan (row, prefix, tmp_buffer, buffer_width, x0, x1, d + 1, 0, &div_plus_one);
 	    }
 	}
     }
 
+  g_free (prefix);
   g_free (tmp_buffer);
 }
 
@@ -694,12 +874,15 @@ flip_buffer (guchar *buffer,
 #undef BLOCK_SIZE
 }
 
+/* Computes the blurred A8 image for a shadow. This only looks at the
+ * job, not at the shadow itself, so that it can run in a worker thread.
+ */
 static void
-make_shadow (MetaShadow     *shadow,
-             cairo_region_t *region)
+make_shadow_buffer (MetaShadowJob *job)
 {
-  int d = get_box_filter_size (shadow->key.radius);
-  int spread = get_shadow_spread (shadow->key.radius);
+  cairo_region_t *region = job->region;
+  int d = get_box_filter_size (job->radius);
+  int spread = get_shadow_spread (job->radius);
   cairo_rectangle_int_t extents;
   cairo_region_t *row_convolve_region;
   cairo_region_t *column_convolve_region;
@@ -764,44 +947,138 @@ make_shadow (MetaShadow     *shadow,
   buffer = flip_buffer (buffer, buffer_width, buffer_height);
 
   /* Step 3: blur rows (really columns) */
-  blur_rows (column_convolve_region, y_offset, x_offset,
-             buffer, buffer_height, buffer_width,
-             d);
+  meta_shadow_blur_rows (column_convolve_region, y_offset, x_offset,
+                         buffer, buffer_height, buffer_width,
+                         d);
 
   /* Step 4: swap rows and columns */
   buffer = flip_buffer (buffer, buffer_height, buffer_width);
 
   /* Step 5: blur rows */
-  blur_rows (row_convolve_region, x_offset, y_offset,
-             buffer, buffer_width, buffer_height,
-             d);
+  meta_shadow_blur_rows (row_convolve_region, x_offset, y_offset,
+                         buffer, buffer_width, buffer_height,
+                         d);
 
   /* Step 6: fade out the top, if applicable */
-  if (shadow->key.top_fade >= 0)
+  if (job->top_fade >= 0)
     {
-      for (j = y_offset; j < y_offset + MIN (shadow->key.top_fade, extents.height + shadow->outer_border_bottom); j++)
-        fade_bytes(buffer + j * buffer_width, buffer_width, j - y_offset, shadow->key.top_fade);
+      for (j = y_offset; j < y_offset + MIN (job->top_fade, extents.height + job->outer_border_bottom); j++)
+        fade_bytes(buffer + j * buffer_width, buffer_width, j - y_offset, job->top_fade);
     }
 
+  cairo_region_destroy (row_convolve_region);
+  cairo_region_destroy (column_convolve_region);
+
   /* We offset the passed in pixels to crop off the extra area we allocated at the top
    * in the case of top_fade >= 0. We also account for padding at the left for symmetry
    * though that doesn't currently occur.
    */
-  shadow->texture = cogl_texture_new_from_data (shadow->outer_border_left + extents.width + shadow->outer_border_right,
-                                                shadow->outer_border_top + extents.height + shadow->outer_border_bottom,
-                                                COGL_TEXTURE_NONE,
-                                                COGL_PIXEL_FORMAT_A_8,
-                                                COGL_PIXEL_FORMAT_ANY,
-                                                buffer_width,
-                                                (buffer +
-                                                 (y_offset - shadow->outer_border_top) * buffer_width +
-                                                 (x_offset - shadow->outer_border_left)));
+  job->buffer = buffer;
+  job->rowstride = buffer_width;
+  job->data_offset = ((y_offset - job->outer_border_top) * buffer_width +
+                      (x_offset - job->outer_border_left));
+  job->texture_width = job->outer_border_left + extents.width + job->outer_border_right;
+  job->texture_height = job->outer_border_top + extents.height + job->outer_border_bottom;
+}
 
-  cairo_region_destroy (row_convolve_region);
-  cairo_region_destroy (column_convolve_region);
-  g_free (buffer);
+/* Uploads the result of a job if @upload is set and frees the job;
+ * must be called from the main thread */
+static void
+finish_shadow_job (MetaShadowJob *job,
+                   gboolean       upload)
+{
+  MetaShadow *shadow = job->shadow;
+
+  if (upload)
+    {
+      shadow->texture = cogl_texture_new_from_data (job->texture_width,
+                                                    job->texture_height,
+                                                    COGL_TEXTURE_NONE,
+                                                    COGL_PIXEL_FORMAT_A_8,
+                                                    COGL_PIXEL_FORMAT_ANY,
+                                                    job->rowstride,
+                                                    job->buffer + job->data_offset);
+      shadow->pipeline = meta_create_texture_pipeline (shadow->texture);
+      meta_frame_profiler_count (META_FRAME_COUNT_TEXTURE_UPLOADS, 1);
+    }
+
+  g_free (job->buffer);
+  cairo_region_destroy (job->region);
+  g_slice_free (MetaShadowJob, job);
+}
+
+static gboolean
+shadow_job_completed (gpointer data)
+{
+  MetaShadowJob *job = data;
+  MetaShadowFactory *factory = job->factory;
+  MetaShadow *shadow = job->shadow;
+
+  /* If nobody but the job is interested in the shadow anymore, it is
+   * going to be freed right away; don't bother uploading it.
+   */
+  finish_shadow_job (job, shadow->ref_count > 1);
+
+  if (shadow->texture != NULL)
+    g_signal_emit (factory, signals[SHADOW_READY], 0, shadow);
+
+  meta_shadow_unref (shadow);
+  g_object_unref (factory);
+
+  return FALSE;
+}
+
+static void
+run_shadow_job (gpointer data,
+                gpointer user_data)
+{
+  MetaShadowJob *job = data;
+
+  make_shadow_buffer (job);
+
+  g_idle_add (shadow_job_completed, job);
+}
+
+static void
+make_shadow (MetaShadowFactory *factory,
+             MetaShadow        *shadow,
+             cairo_region_t    *region)
+{
+  MetaShadowJob *job;
+  cairo_rectangle_int_t extents;
+
+  job = g_slice_new0 (MetaShadowJob);
+  job->region = cairo_region_copy (region);
+  job->radius = shadow->key.radius;
+  job->top_fade = shadow->key.top_fade;
+  job->outer_border_top = shadow->outer_border_top;
+  job->outer_border_right = shadow->outer_border_right;
+  job->outer_border_bottom = shadow->outer_border_bottom;
+  job->outer_border_left = shadow->outer_border_left;
+
+  /* Small shadows are quick to make; doing them right away avoids
+   * painting a window without its shadow for a frame.
+   */
+  cairo_region_get_extents (region, &extents);
+  if (extents.width * extents.height < ASYNC_SHADOW_MIN_PIXELS)
+    {
+      job->shadow = shadow;
+      make_shadow_buffer (job);
+      finish_shadow_job (job, TRUE);
+      return;
+    }
+
+  if (factory->pool == NULL)
+    factory->pool = g_thread_pool_new (run_shadow_job, NULL,
+                                       N_SHADOW_THREADS, FALSE, NULL);
+
+  /* The shadow stays in the cache while pending, without a texture, so
+   * other windows with the same shape share this job.
+   */
+  job->factory = g_object_ref (factory);
+  job->shadow = meta_shadow_ref (shadow);
 
-  shadow->pipeline = meta_create_texture_pipeline (shadow->texture);
+  g_thread_pool_push (factory->pool, job, NULL);
 }
 
 static MetaShadowParams *
@@ -965,7 +1242,7 @@ meta_shadow_factory_get_shadow (MetaShadowFactory *factory,
   g_assert (center_width >= 0 && center_height >= 0);
 
   region = meta_window_shape_to_region (shape, center_width, center_height);
-  make_shadow (shadow, region);
+  make_shadow (factory, shadow, region);
 
   cairo_region_destroy (region);
 
@@ -29,6 +29,7 @@
 
 #include <meta/meta-shaped-texture.h>
 #include "meta-texture-tower.h"
+#include "meta-frame-profiler.h"
 
 #include <clutter/clutter.h>
 #include <cogl/cogl.h>
@@ -431,12 +432,53 @@ meta_shaped_texture_update_area (MetaShapedTexture *stex,
 
   cogl_texture_pixmap_x11_update_area (priv->texture,
                                        x, y, width, height);
+  meta_frame_profiler_count (META_FRAME_COUNT_TEXTURE_UPLOADS, 1);
 
   meta_texture_tower_update_area (priv->paint_tower, x, y, width, height);
 
   clutter_actor_queue_redraw_with_clip (CLUTTER_ACTOR (stex), &clip);
 }
 
+/**
+ * meta_shaped_texture_update_region:
+ * @stex: #MetaShapedTexture
+ * @region: the damaged region, in texture coordinates
+ *
+ * Like meta_shaped_texture_update_area(), but for each rectangle of
+ * @region, so that only the parts that actually changed are copied,
+ * scaled down for the texture tower, and redrawn.
+ */
+void
+meta_shaped_texture_update_region (MetaShapedTexture *stex,
+                                   cairo_region_t    *region)
+{
+  MetaShapedTexturePrivate *priv;
+  int i, n_rects;
+
+  priv = stex->priv;
+
+  if (priv->texture == NULL)
+    return;
+
+  n_rects = cairo_region_num_rectangles (region);
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (region, i, &rect);
+
+      cogl_texture_pixmap_x11_update_area (priv->texture,
+                                           rect.x, rect.y,
+                                           rect.width, rect.height);
+      meta_frame_profiler_count (META_FRAME_COUNT_TEXTURE_UPLOADS, 1);
+
+      meta_texture_tower_update_area (priv->paint_tower,
+                                      rect.x, rect.y,
+                                      rect.width, rect.height);
+      clutter_actor_queue_redraw_with_clip (CLUTTER_ACTOR (stex), &rect);
+    }
+}
+
 static void
 set_cogl_texture (MetaShapedTexture    *stex,
                   CoglTexturePixmapX11 *cogl_tex)
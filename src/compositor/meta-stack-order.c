@@ -0,0 +1,88 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Minimal reordering of stacked actors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include "meta-stack-order.h"
+
+/**
+ * meta_stack_order_find_kept:
+ * @positions: for each item, in the current order, its position in
+ *   the desired order; positions must be distinct
+ * @n_items: number of items
+ * @kept: (out caller-allocates): for each item, set to %TRUE if it can
+ *   stay where it is
+ *
+ * Finds a largest set of items that are already in the desired order
+ * relative to each other (a longest increasing subsequence of
+ * @positions), so that the items can be put in the desired order by
+ * moving only the others. When a single window is raised, for example,
+ * that is the only item that needs to move.
+ *
+ * Return value: the number of items that can stay where they are
+ */
+int
+meta_stack_order_find_kept (const int *positions,
+                            int        n_items,
+                            gboolean  *kept)
+{
+  /* tails[k] is the index of the item ending the increasing
+   * subsequence of length k + 1 with the smallest last position */
+  int *tails;
+  int *previous;
+  int length = 0;
+  int i;
+
+  if (n_items == 0)
+    return 0;
+
+  tails = g_new (int, n_items);
+  previous = g_new (int, n_items);
+
+  for (i = 0; i < n_items; i++)
+    {
+      int low = 0, high = length;
+
+      while (low < high)
+        {
+          int mid = (low + high) / 2;
+
+          if (positions[tails[mid]] < positions[i])
+            low = mid + 1;
+          else
+            high = mid;
+        }
+
+      previous[i] = low > 0 ? tails[low - 1] : -1;
+      tails[low] = i;
+      if (low == length)
+        length++;
+
+      kept[i] = FALSE;
+    }
+
+  for (i = tails[length - 1]; i >= 0; i = previous[i])
+    kept[i] = TRUE;
+
+  g_free (tails);
+  g_free (previous);
+
+  return length;
+}
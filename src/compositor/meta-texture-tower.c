@@ -25,8 +25,14 @@
 #include <math.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cogl-utils.h"
 #include "meta-texture-tower.h"
 #include "meta-texture-rectangle.h"
+#include "meta-frame-profiler.h"
 
 #ifndef M_LOG2E
 #define M_LOG2E 1.4426950408889634074
@@ -34,6 +40,12 @@
 
 #define MAX_TEXTURE_LEVELS 12
 
+/* Separate areas of a level we keep track of before merging them; this
+ * keeps, for example, a blinking cursor and a clock in opposite corners
+ * of a window from invalidating everything in between.
+ */
+#define MAX_INVALID_BOXES 4
+
 /* If the texture format in memory doesn't match this, then Mesa
  * will do the conversion, so things will still work, but it might
  * be slow depending on how efficient Mesa is. These should be the
@@ -61,9 +73,106 @@ struct _MetaTextureTower
   int n_levels;
   CoglTexture *textures[MAX_TEXTURE_LEVELS];
   CoglOffscreen *fbos[MAX_TEXTURE_LEVELS];
-  Box invalid[MAX_TEXTURE_LEVELS];
+  /* Set when we failed to render into a level, so the CPU fallback is used */
+  gboolean no_fbo[MAX_TEXTURE_LEVELS];
+  /* Non-overlapping areas of each level that need to be recomputed */
+  Box invalid[MAX_TEXTURE_LEVELS][MAX_INVALID_BOXES];
+  int n_invalid[MAX_TEXTURE_LEVELS];
 };
 
+static gboolean
+boxes_overlap (const Box *a,
+               const Box *b)
+{
+  return (a->x1 < b->x2 && b->x1 < a->x2 &&
+          a->y1 < b->y2 && b->y1 < a->y2);
+}
+
+static void
+box_union (Box       *dest,
+           const Box *a,
+           const Box *b)
+{
+  dest->x1 = MIN (a->x1, b->x1);
+  dest->y1 = MIN (a->y1, b->y1);
+  dest->x2 = MAX (a->x2, b->x2);
+  dest->y2 = MAX (a->y2, b->y2);
+}
+
+static gint64
+box_area (const Box *box)
+{
+  return (gint64) (box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void
+texture_tower_add_invalid (MetaTextureTower *tower,
+                           int               level,
+                           const Box        *box)
+{
+  Box *boxes = tower->invalid[level];
+  int n_boxes = tower->n_invalid[level];
+  Box merged = *box;
+  int i;
+
+  if (merged.x1 >= merged.x2 || merged.y1 >= merged.y2)
+    return;
+
+ again:
+  /* Absorb the boxes the new box overlaps, starting over each time it
+   * grows, so that the boxes stay disjoint */
+  for (i = 0; i < n_boxes; i++)
+    {
+      if (boxes_overlap (&boxes[i], &merged))
+        {
+          box_union (&merged, &merged, &boxes[i]);
+          boxes[i] = boxes[--n_boxes];
+          goto again;
+        }
+    }
+
+  /* Out of room; merge with the box that adds the least area */
+  if (n_boxes == MAX_INVALID_BOXES)
+    {
+      gint64 best_growth = G_MAXINT64;
+      int best = 0;
+
+      for (i = 0; i < n_boxes; i++)
+        {
+          Box u;
+          gint64 growth;
+
+          box_union (&u, &boxes[i], &merged);
+          growth = box_area (&u) - box_area (&boxes[i]) - box_area (&merged);
+          if (growth < best_growth)
+            {
+              best_growth = growth;
+              best = i;
+            }
+        }
+
+      box_union (&merged, &merged, &boxes[best]);
+      boxes[best] = boxes[--n_boxes];
+      goto again;
+    }
+
+  boxes[n_boxes++] = merged;
+  tower->n_invalid[level] = n_boxes;
+}
+
+static void
+texture_tower_invalidate_all (MetaTextureTower *tower,
+                              int               level,
+                              int               width,
+                              int               height)
+{
+  tower->invalid[level][0].x1 = 0;
+  tower->invalid[level][0].y1 = 0;
+  tower->invalid[level][0].x2 = width;
+  tower->invalid[level][0].y2 = height;
+  tower->n_invalid[level] = 1;
+}
+
 /**
  * meta_texture_tower_new:
  *
@@ -134,6 +243,8 @@ meta_texture_tower_set_base_texture (MetaTextureTower *tower,
               cogl_object_unref (tower->fbos[i]);
               tower->fbos[i] = NULL;
             }
+
+          tower->no_fbo[i] = FALSE;
         }
 
       cogl_object_unref (tower->textures[0]);
@@ -172,6 +283,9 @@ meta_texture_tower_set_base_texture (MetaTextureTower *tower,
  * Mark a region of the base texture as having changed; the next
  * time a scaled down version of the base texture is retrieved,
  * the appropriate area of the scaled down texture will be updated.
+ * Separate areas are kept track of separately, up to a small limit,
+ * so calling this for each rectangle of a damaged region does less
+ * work than calling it for the extents of the region.
  */
 void
 meta_texture_tower_update_area (MetaTextureTower *tower,
@@ -207,18 +321,7 @@ meta_texture_tower_update_area (MetaTextureTower *tower,
       invalid.x2 = MIN (texture_width, (invalid.x2 + 1) / 2);
       invalid.y2 = MIN (texture_height, (invalid.y2 + 1) / 2);
 
-      if (tower->invalid[i].x1 == tower->invalid[i].x2 ||
-          tower->invalid[i].y1 == tower->invalid[i].y2)
-        {
-          tower->invalid[i] = invalid;
-        }
-      else
-        {
-          tower->invalid[i].x1 = MIN (tower->invalid[i].x1, invalid.x1);
-          tower->invalid[i].y1 = MIN (tower->invalid[i].y1, invalid.y1);
-          tower->invalid[i].x2 = MAX (tower->invalid[i].x2, invalid.x2);
-          tower->invalid[i].y2 = MAX (tower->invalid[i].y2, invalid.y2);
-        }
+      texture_tower_add_invalid (tower, i, &invalid);
     }
 }
 
@@ -377,10 +480,57 @@ texture_tower_create_texture (MetaTextureTower *tower,
                                                            TEXTURE_FORMAT);
     }
 
-  tower->invalid[level].x1 = 0;
-  tower->invalid[level].y1 = 0;
-  tower->invalid[level].x2 = width;
-  tower->invalid[level].y2 = height;
+  texture_tower_invalidate_all (tower, level, width, height);
+}
+
+static CoglOffscreen *
+texture_tower_get_fbo (MetaTextureTower *tower,
+                       int               level)
+{
+  CoglTexture *dest_texture;
+  int width, height;
+
+  if (tower->fbos[level] != NULL || tower->no_fbo[level])
+    return tower->fbos[level];
+
+  tower->fbos[level] = cogl_offscreen_new_to_texture (tower->textures[level]);
+  if (tower->fbos[level] != NULL)
+    return tower->fbos[level];
+
+  /* Some drivers can't render to rectangle textures; if that's what
+   * we made for this level, try again with a normal texture so that
+   * we can still scale down on the GPU.
+   */
+  if (meta_texture_rectangle_check (tower->textures[level]))
+    {
+      width = cogl_texture_get_width (tower->textures[level]);
+      height = cogl_texture_get_height (tower->textures[level]);
+
+      dest_texture = cogl_texture_new_with_size (width, height,
+                                                 COGL_TEXTURE_NO_AUTO_MIPMAP |
+                                                 COGL_TEXTURE_NO_SLICING,
+                                                 TEXTURE_FORMAT);
+      if (dest_texture != NULL)
+        {
+          tower->fbos[level] = cogl_offscreen_new_to_texture (dest_texture);
+
+          if (tower->fbos[level] != NULL)
+            {
+              cogl_object_unref (tower->textures[level]);
+              tower->textures[level] = dest_texture;
+              texture_tower_invalidate_all (tower, level, width, height);
+
+              return tower->fbos[level];
+            }
+
+          cogl_object_unref (dest_texture);
+        }
+    }
+
+  /* Don't try again every frame; this only changes with the base texture */
+  tower->no_fbo[level] = TRUE;
+
+  return NULL;
 }
 
 static gboolean
@@ -390,101 +540,149 @@ texture_tower_revalidate_fbo (MetaTextureTower *tower,
   CoglTexture *source_texture = tower->textures[level - 1];
   int source_texture_width = cogl_texture_get_width (source_texture);
   int source_texture_height = cogl_texture_get_height (source_texture);
-  CoglTexture *dest_texture = tower->textures[level];
-  int dest_texture_width = cogl_texture_get_width (dest_texture);
-  int dest_texture_height = cogl_texture_get_height (dest_texture);
-  Box *invalid = &tower->invalid[level];
-  CoglMatrix modelview;
-
-  if (tower->fbos[level] == NULL)
-    tower->fbos[level] = cogl_offscreen_new_to_texture (dest_texture);
+  CoglTexture *dest_texture;
+  int dest_texture_width;
+  int dest_texture_height;
+  CoglFramebuffer *fb;
+  CoglPipeline *pipeline;
+  int i;
 
-  if (tower->fbos[level] == NULL)
+  if (texture_tower_get_fbo (tower, level) == NULL)
     return FALSE;
 
-  cogl_push_framebuffer (COGL_FRAMEBUFFER (tower->fbos[level]));
+  /* The texture may have been replaced by texture_tower_get_fbo() */
+  dest_texture = tower->textures[level];
+  dest_texture_width = cogl_texture_get_width (dest_texture);
+  dest_texture_height = cogl_texture_get_height (dest_texture);
+
+  fb = COGL_FRAMEBUFFER (tower->fbos[level]);
 
-  cogl_ortho (0, dest_texture_width, dest_texture_height, 0, -1., 1.);
+  cogl_framebuffer_orthographic (fb, 0, 0,
+                                 dest_texture_width, dest_texture_height,
+                                 -1., 1.);
 
-  cogl_matrix_init_identity (&modelview);
-  cogl_set_modelview_matrix (&modelview);
+  /* Each destination pixel is centered on the corner shared by a 2x2
+   * block of source pixels, so linear filtering averages the block in
+   * a single sample.
+   */
+  pipeline = meta_create_texture_pipeline (source_texture);
+  cogl_pipeline_set_layer_filters (pipeline, 0,
+                                   COGL_PIPELINE_FILTER_LINEAR,
+                                   COGL_PIPELINE_FILTER_LINEAR);
+  cogl_pipeline_set_blend (pipeline, "RGBA = ADD (SRC_COLOR, 0)", NULL);
 
-  cogl_set_source_texture (tower->textures[level - 1]);
-  cogl_rectangle_with_texture_coords (invalid->x1, invalid->y1,
-                                      invalid->x2, invalid->y2,
-                                      (2. * invalid->x1) / source_texture_width,
-                                      (2. * invalid->y1) / source_texture_height,
-                                      (2. * invalid->x2) / source_texture_width,
-                                      (2. * invalid->y2) / source_texture_height);
+  for (i = 0; i < tower->n_invalid[level]; i++)
+    {
+      Box *invalid = &tower->invalid[level][i];
+
+      cogl_framebuffer_draw_textured_rectangle (fb, pipeline,
+                                                invalid->x1, invalid->y1,
+                                                invalid->x2, invalid->y2,
+                                                (2. * invalid->x1) / source_texture_width,
+                                                (2. * invalid->y1) / source_texture_height,
+                                                (2. * invalid->x2) / source_texture_width,
+                                                (2. * invalid->y2) / source_texture_height);
+    }
 
-  cogl_pop_framebuffer ();
+  cogl_object_unref (pipeline);
 
   return TRUE;
 }
 
+/* (a + b) / 2 for each byte */
 static void
-fill_copy (guchar       *buf,
-           const guchar *source,
-           int           width)
+average_bytes (guchar       *dest,
+               const guchar *a,
+               const guchar *b,
+               int           n_bytes)
 {
-  memcpy (buf, source, width * 4);
+  int i = 0;
+
+#ifdef __SSE2__
+  /* _mm_avg_epu8() rounds up; subtracting the low bit of a ^ b makes it
+   * round down like the scalar code */
+  const __m128i one = _mm_set1_epi8 (1);
+
+  for (; i + 16 <= n_bytes; i += 16)
+    {
+      __m128i va = _mm_loadu_si128 ((const __m128i *)(a + i));
+      __m128i vb = _mm_loadu_si128 ((const __m128i *)(b + i));
+      __m128i avg = _mm_sub_epi8 (_mm_avg_epu8 (va, vb),
+                                  _mm_and_si128 (_mm_xor_si128 (va, vb), one));
+
+      _mm_storeu_si128 ((__m128i *)(dest + i), avg);
+    }
+#endif
+
+  for (; i < n_bytes; i++)
+    dest[i] = (a[i] + b[i]) / 2;
 }
 
+/* Averages horizontally adjacent pairs of the @width * 2 pixels in
+ * @source into @width pixels in @buf */
 static void
 fill_scale_down (guchar       *buf,
                  const guchar *source,
                  int           width)
 {
-  while (width > 1)
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128i one = _mm_set1_epi8 (1);
+
+  for (; i + 4 <= width; i += 4)
     {
-      buf[0] = (source[0] + source[4]) / 2;
-      buf[1] = (source[1] + source[5]) / 2;
-      buf[2] = (source[2] + source[6]) / 2;
-      buf[3] = (source[3] + source[7]) / 2;
-
-      buf += 4;
-      source += 8;
-      width -= 2;
+      __m128 v0 = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *)(source + i * 8)));
+      __m128 v1 = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *)(source + i * 8 + 16)));
+      __m128i even = _mm_castps_si128 (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE (2, 0, 2, 0)));
+      __m128i odd = _mm_castps_si128 (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE (3, 1, 3, 1)));
+      __m128i avg = _mm_sub_epi8 (_mm_avg_epu8 (even, odd),
+                                  _mm_and_si128 (_mm_xor_si128 (even, odd), one));
+
+      _mm_storeu_si128 ((__m128i *)(buf + i * 4), avg);
     }
+#endif
 
-  if (width > 0)
+  for (; i < width; i++)
     {
-      buf[0] = source[0] / 2;
-      buf[1] = source[1] / 2;
-      buf[2] = source[2] / 2;
-      buf[3] = source[3] / 2;
+      buf[i * 4 + 0] = (source[i * 8 + 0] + source[i * 8 + 4]) / 2;
+      buf[i * 4 + 1] = (source[i * 8 + 1] + source[i * 8 + 5]) / 2;
+      buf[i * 4 + 2] = (source[i * 8 + 2] + source[i * 8 + 6]) / 2;
+      buf[i * 4 + 3] = (source[i * 8 + 3] + source[i * 8 + 7]) / 2;
     }
 }
 
-static void
-texture_tower_revalidate_client (MetaTextureTower *tower,
-                                 int               level)
+/**
+ * meta_texture_tower_scale_down:
+ * @dest: destination pixels
+ * @dest_rowstride: rowstride of @dest
+ * @source: source pixels
+ * @source_rowstride: rowstride of @source
+ * @dest_width: width of @dest, in pixels
+ * @dest_height: height of @dest, in pixels
+ * @scale_width: if %TRUE, @source is @dest_width * 2 pixels wide,
+ *   otherwise it has the same width as @dest
+ * @scale_height: if %TRUE, @source is @dest_height * 2 pixels high,
+ *   otherwise it has the same height as @dest
+ *
+ * Computes the next level of a tower from 4-byte pixels on the CPU, by
+ * averaging each 2x2 (or 2x1 or 1x2) block of source pixels. This is
+ * only used when we can't render into the textures of the tower.
+ */
+void
+meta_texture_tower_scale_down (guchar       *dest,
+                               int           dest_rowstride,
+                               const guchar *source,
+                               int           source_rowstride,
+                               int           dest_width,
+                               int           dest_height,
+                               gboolean      scale_width,
+                               gboolean      scale_height)
 {
-  CoglTexture *source_texture = tower->textures[level - 1];
-  int source_texture_width = cogl_texture_get_width (source_texture);
-  int source_texture_height = cogl_texture_get_height (source_texture);
-  guint source_rowstride;
-  guchar *source_data;
-  CoglTexture *dest_texture = tower->textures[level];
-  int dest_texture_width = cogl_texture_get_width (dest_texture);
-  int dest_texture_height = cogl_texture_get_height (dest_texture);
-  int dest_x = tower->invalid[level].x1;
-  int dest_y = tower->invalid[level].y1;
-  int dest_width = tower->invalid[level].x2 - tower->invalid[level].x1;
-  int dest_height = tower->invalid[level].y2 - tower->invalid[level].y1;
-  guchar *dest_data;
   guchar *source_tmp1 = NULL, *source_tmp2 = NULL;
-  int i, j;
-
-  source_rowstride = source_texture_width * 4;
-
-  source_data = g_malloc (source_texture_height * source_rowstride);
-  cogl_texture_get_data (source_texture, TEXTURE_FORMAT, source_rowstride,
-                         source_data);
-
-  dest_data = g_malloc (dest_height * dest_width * 4);
+  int i;
 
-  if (dest_texture_height < source_texture_height)
+  if (scale_height && scale_width)
     {
       source_tmp1 = g_malloc (dest_width * 4);
       source_tmp2 = g_malloc (dest_width * 4);
@@ -492,51 +690,88 @@ texture_tower_revalidate_client (MetaTextureTower *tower,
 
   for (i = 0; i < dest_height; i++)
     {
-      guchar *dest_row = dest_data + i * dest_width * 4;
-      if (dest_texture_height < source_texture_height)
+      guchar *dest_row = dest + i * dest_rowstride;
+
+      if (scale_height)
         {
-          guchar *source1, *source2;
-          guchar *dest;
+          const guchar *source1 = source + (i * 2) * source_rowstride;
+          const guchar *source2 = source + (i * 2 + 1) * source_rowstride;
 
-          if (dest_texture_width < source_texture_width)
+          if (scale_width)
             {
-              fill_scale_down (source_tmp1,
-                               source_data + ((i + dest_y) * 2) * source_rowstride + dest_x * 2 * 4,
-                               dest_width * 2);
-              fill_scale_down (source_tmp2,
-                               source_data + ((i + dest_y) * 2 + 1) * source_rowstride + dest_x * 2 * 4,
-                               dest_width * 2);
-            }
-          else
-            {
-              fill_copy (source_tmp1,
-                         source_data + ((i + dest_y) * 2) * source_rowstride + dest_x * 4,
-                         dest_width);
-              fill_copy (source_tmp2,
-                         source_data + ((i + dest_y) * 2 + 1) * source_rowstride + dest_x * 4,
-                         dest_width);
-            }
+              fill_scale_down (source_tmp1, source1, dest_width);
+              fill_scale_down (source_tmp2, source2, dest_width);
 
-          source1 = source_tmp1;
-          source2 = source_tmp2;
+              source1 = source_tmp1;
+              source2 = source_tmp2;
+            }
 
-          dest = dest_row;
-          for (j = 0; j < dest_width * 4; j++)
-            *(dest++) = (*(source1++) + *(source2++)) / 2;
+          average_bytes (dest_row, source1, source2, dest_width * 4);
         }
       else
         {
-          if (dest_texture_width < source_texture_width)
-            fill_scale_down (dest_row,
-                             source_data + (i + dest_y) * source_rowstride + dest_x * 2 * 4,
-                             dest_width * 2);
+          if (scale_width)
+            fill_scale_down (dest_row, source + i * source_rowstride, dest_width);
           else
-            fill_copy (dest_row,
-                       source_data + (i + dest_y) * source_rowstride,
-                       dest_width);
+            memcpy (dest_row, source + i * source_rowstride, dest_width * 4);
         }
     }
 
+  g_free (source_tmp1);
+  g_free (source_tmp2);
+}
+
+static void
+texture_tower_revalidate_client (MetaTextureTower *tower,
+                                 int               level,
+                                 const Box        *invalid)
+{
+  CoglTexture *source_texture = tower->textures[level - 1];
+  int source_texture_width = cogl_texture_get_width (source_texture);
+  int source_texture_height = cogl_texture_get_height (source_texture);
+  CoglTexture *dest_texture = tower->textures[level];
+  int dest_texture_width = cogl_texture_get_width (dest_texture);
+  int dest_texture_height = cogl_texture_get_height (dest_texture);
+  gboolean scale_width = dest_texture_width < source_texture_width;
+  gboolean scale_height = dest_texture_height < source_texture_height;
+  int dest_x = invalid->x1;
+  int dest_y = invalid->y1;
+  int dest_width = invalid->x2 - invalid->x1;
+  int dest_height = invalid->y2 - invalid->y1;
+  CoglTexture *source_region;
+  int source_x, source_y, source_width, source_height;
+  guint source_rowstride;
+  guchar *source_data;
+  guchar *dest_data;
+
+  /* Only read back the part of the source level that the invalid
+   * area of this level is computed from */
+  source_x = scale_width ? dest_x * 2 : dest_x;
+  source_y = scale_height ? dest_y * 2 : dest_y;
+  source_width = scale_width ? dest_width * 2 : dest_width;
+  source_height = scale_height ? dest_height * 2 : dest_height;
+
+  if (source_width == source_texture_width &&
+      source_height == source_texture_height)
+    source_region = cogl_object_ref (source_texture);
+  else
+    source_region = cogl_texture_new_from_sub_texture (source_texture,
+                                                       source_x, source_y,
+                                                       source_width, source_height);
+
+  source_rowstride = source_width * 4;
+  source_data = g_malloc (source_height * source_rowstride);
+  cogl_texture_get_data (source_region, TEXTURE_FORMAT, source_rowstride,
+                         source_data);
+  cogl_object_unref (source_region);
+
+  dest_data = g_malloc (dest_height * dest_width * 4);
+
+  meta_texture_tower_scale_down (dest_data, dest_width * 4,
+                                 source_data, source_rowstride,
+                                 dest_width, dest_height,
+                                 scale_width, scale_height);
+
   cogl_texture_set_region (dest_texture,
                            0, 0,
                            dest_x, dest_y,
@@ -545,12 +780,7 @@ texture_tower_revalidate_client (MetaTextureTower *tower,
                            TEXTURE_FORMAT,
                            4 * dest_width,
                            dest_data);
-
-  if (dest_texture_height < source_texture_height)
-    {
-      g_free (source_tmp1);
-      g_free (source_tmp2);
-    }
+  meta_frame_profiler_count (META_FRAME_COUNT_TEXTURE_UPLOADS, 1);
 
   g_free (source_data);
   g_free (dest_data);
@@ -560,8 +790,15 @@ static void
 texture_tower_revalidate (MetaTextureTower *tower,
                           int               level)
 {
+  int i;
+
   if (!texture_tower_revalidate_fbo (tower, level))
-    texture_tower_revalidate_client (tower, level);
+    {
+      for (i = 0; i < tower->n_invalid[level]; i++)
+        texture_tower_revalidate_client (tower, level, &tower->invalid[level][i]);
+    }
+
+  tower->n_invalid[level] = 0;
 }
 
 /**
@@ -596,9 +833,7 @@ meta_texture_tower_get_paint_texture (MetaTextureTower *tower)
     return NULL;
   level = MIN (level, tower->n_levels - 1);
 
-  if (tower->textures[level] == NULL ||
-      (tower->invalid[level].x2 != tower->invalid[level].x1 &&
-       tower->invalid[level].y2 != tower->invalid[level].y1))
+  if (tower->textures[level] == NULL || tower->n_invalid[level] > 0)
     {
       int i;
 
@@ -614,8 +849,7 @@ meta_texture_tower_get_paint_texture (MetaTextureTower *tower)
 
       for (i = 1; i <= level; i++)
        {
-         if (tower->invalid[level].x2 != tower->invalid[level].x1 &&
-             tower->invalid[level].y2 != tower->invalid[level].y1)
+         if (tower->n_invalid[i] > 0)
            texture_tower_revalidate (tower, i);
        }
    }
@@ -64,6 +64,15 @@ void              meta_texture_tower_update_area       (MetaTextureTower *tower,
                                                         int               height);
 CoglTexture      *meta_texture_tower_get_paint_texture (MetaTextureTower *tower);
 
+void              meta_texture_tower_scale_down        (guchar           *dest,
+                                                        int               dest_rowstride,
+                                                        const guchar     *source,
+                                                        int               source_rowstride,
+                                                        int               dest_width,
+                                                        int               dest_height,
+                                                        gboolean          scale_width,
+                                                        gboolean          scale_height);
+
 G_BEGIN_DECLS
 
 #endif /* __META_TEXTURE_TOWER_H__ */
@@ -7,6 +7,7 @@
 
 #include <X11/extensions/Xdamage.h>
 #include <meta/compositor-mutter.h>
+#include "meta-shadow-factory-private.h"
 
 MetaWindowActor *meta_window_actor_new (MetaWindow *window);
 
@@ -27,6 +28,8 @@ void meta_window_actor_unmaximize (MetaWindowActor *self,
 void meta_window_actor_process_damage (MetaWindowActor    *self,
                                        XDamageNotifyEvent *event);
 
+gboolean meta_window_actor_repair_damage (MetaWindowActor  *self);
+
 void meta_window_actor_pre_paint      (MetaWindowActor    *self);
 void meta_window_actor_post_paint     (MetaWindowActor    *self);
 void meta_window_actor_frame_complete (MetaWindowActor    *self,
@@ -34,6 +37,8 @@ void meta_window_actor_frame_complete (MetaWindowActor    *self,
                                        gint64              presentation_time);
 
 void meta_window_actor_invalidate_shadow (MetaWindowActor *self);
+void meta_window_actor_shadow_ready      (MetaWindowActor *self,
+                                          MetaShadow      *shadow);
 
 void meta_window_actor_set_redirected (MetaWindowActor *self, gboolean state);
 
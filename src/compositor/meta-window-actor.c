@@ -25,6 +25,9 @@
 #include "meta-shadow-factory-private.h"
 #include "meta-window-actor-private.h"
 #include "meta-texture-rectangle.h"
+#include "meta-frame-corners.h"
+#include "meta-frame-profiler.h"
+#include "meta-region-fetch.h"
 #include "region-utils.h"
 
 enum {
@@ -36,6 +39,27 @@ enum {
 static guint signals[LAST_SIGNAL] = {0};
 
 
+typedef struct _FrameMaskKey FrameMaskKey;
+
+struct _FrameMaskKey
+{
+  int tex_width;
+  int tex_height;
+  gboolean rectangle;
+  cairo_rectangle_int_t client_area;
+  cairo_rectangle_int_t outer;
+  float top_left;
+  float top_right;
+  float bottom_left;
+  float bottom_right;
+};
+
+/* The most rectangles of damage we keep track of for a frame */
+#define MAX_PENDING_DAMAGE_RECTS 16
+
+/* Smaller damage isn't worth a round trip to split into its parts */
+#define MIN_SPLIT_DAMAGE_AREA (256 * 256)
+
 struct _MetaWindowActorPrivate
 {
   MetaWindow       *window;
@@ -61,6 +85,12 @@ struct _MetaWindowActorPrivate
   Pixmap            back_pixmap;
 
   Damage            damage;
+  /* Set to the damage by XDamageSubtract(), to split it into parts */
+  XserverRegion     damage_parts;
+  MetaRegionFetch  *damage_parts_fetch;
+  /* Damage received since the last frame, in window coordinates; it is
+   * applied to the texture once per frame in pre_paint() */
+  cairo_region_t   *pending_damage;
 
   guint8            opacity;
   guint8            shadow_opacity;
@@ -78,6 +108,12 @@ struct _MetaWindowActorPrivate
   /* Extracted size-invariant shape used for shadows */
   MetaWindowShape  *shadow_shape;
 
+  /* The last mask built for a window without a client shape, with the
+   * opaque part of the frame, reused while the geometry is the same */
+  FrameMaskKey      frame_mask_key;
+  CoglTexture      *frame_mask_texture;
+  cairo_region_t   *frame_mask_region;
+
   gint              last_width;
   gint              last_height;
 
@@ -173,6 +209,7 @@ static void     meta_window_actor_detach     (MetaWindowActor *self);
 static gboolean meta_window_actor_has_shadow (MetaWindowActor *self);
 
 static void meta_window_actor_handle_updates (MetaWindowActor *self);
+static void meta_window_actor_collect_damage_parts (MetaWindowActor *self);
 
 static void check_needs_reshape (MetaWindowActor *self);
 
@@ -422,6 +459,9 @@ meta_window_actor_dispose (GObject *object)
   g_clear_pointer (&priv->focused_shadow, meta_shadow_unref);
   g_clear_pointer (&priv->unfocused_shadow, meta_shadow_unref);
   g_clear_pointer (&priv->shadow_shape, meta_window_shape_unref);
+  g_clear_pointer (&priv->frame_mask_texture, cogl_object_unref);
+  g_clear_pointer (&priv->frame_mask_region, cairo_region_destroy);
+  g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
 
   if (priv->damage != None)
     {
@@ -432,6 +472,15 @@ meta_window_actor_dispose (GObject *object)
       priv->damage = None;
     }
 
+  /* Reads the reply, so that the async handler goes away */
+  meta_window_actor_collect_damage_parts (self);
+
+  if (priv->damage_parts != None)
+    {
+      XFixesDestroyRegion (xdisplay, priv->damage_parts);
+      priv->damage_parts = None;
+    }
+
   info->windows = g_list_remove (info->windows, (gconstpointer) self);
 
   g_clear_object (&priv->window);
@@ -661,6 +710,7 @@ meta_window_actor_paint (ClutterActor *actor)
           cairo_region_subtract (clip, frame_bounds);
         }
 
+      meta_frame_profiler_stage_begin (META_FRAME_STAGE_SHADOWS);
       meta_shadow_paint (shadow,
                          params.x_offset + shape_bounds.x,
                          params.y_offset + shape_bounds.y,
@@ -669,6 +719,7 @@ meta_window_actor_paint (ClutterActor *actor)
                          (clutter_actor_get_paint_opacity (actor) * params.opacity * priv->opacity) / (255 * 255),
                          clip,
                          clip_shadow_under_window (self)); /* clip_strictly - not just as an optimization */
+      meta_frame_profiler_stage_end (META_FRAME_STAGE_SHADOWS);
 
       if (clip && clip != priv->shadow_clip)
         cairo_region_destroy (clip);
@@ -1790,6 +1841,7 @@ check_needs_pixmap (MetaWindowActor *self)
 
       priv->back_pixmap = XCompositeNameWindowPixmap (xdisplay, xwindow);
 
+      meta_frame_profiler_count (META_FRAME_COUNT_ROUND_TRIPS, 1);
       if (meta_error_trap_pop_with_return (display) != Success)
         {
           /* Probably a BadMatch if the window isn't viewable; we could
@@ -1914,6 +1966,7 @@ meta_window_actor_process_damage (MetaWindowActor    *self,
 {
   MetaWindowActorPrivate *priv = self->priv;
   MetaCompScreen *info = meta_screen_get_compositor_data (priv->screen);
+  cairo_rectangle_int_t rect;
 
   priv->received_damage = TRUE;
 
@@ -1961,14 +2014,103 @@ meta_window_actor_process_damage (MetaWindowActor    *self,
   if (!priv->mapped || priv->needs_pixmap)
     return;
 
-  meta_shaped_texture_update_area (META_SHAPED_TEXTURE (priv->actor),
-                                   event->area.x,
-                                   event->area.y,
-                                   event->area.width,
-                                   event->area.height);
+  rect.x = event->area.x;
+  rect.y = event->area.y;
+  rect.width = event->area.width;
+  rect.height = event->area.height;
+
+  /* With XDamageReportBoundingBox each event has the bounding box of
+   * all the damage since the last XDamageSubtract(); when that is large,
+   * meta_window_actor_repair_damage() asks for the parts of the damage
+   * and flush_damage() uses them, so that separate updates stay separate.
+   */
+  if (priv->pending_damage == NULL)
+    {
+      priv->pending_damage = cairo_region_create_rectangle (&rect);
+
+      /* Make sure that there is a frame, so that pre_paint() gets called
+       * and queues redraws for the rest */
+      clutter_actor_queue_redraw_with_clip (priv->actor, &rect);
+    }
+  else
+    {
+      cairo_region_union_rectangle (priv->pending_damage, &rect);
+    }
+
+  /* Past this, the rectangles cost more than the area they save */
+  if (cairo_region_num_rectangles (priv->pending_damage) > MAX_PENDING_DAMAGE_RECTS)
+    {
+      cairo_rectangle_int_t extents;
+
+      cairo_region_get_extents (priv->pending_damage, &extents);
+      cairo_region_destroy (priv->pending_damage);
+      priv->pending_damage = cairo_region_create_rectangle (&extents);
+    }
+
   priv->repaint_scheduled = TRUE;
 }
 
+static void
+meta_window_actor_collect_damage_parts (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  cairo_region_t *parts;
+  XRectangle *rects;
+  int n_rects;
+  int i;
+
+  if (priv->damage_parts_fetch == NULL)
+    return;
+
+  rects = meta_region_fetch_finish (priv->damage_parts_fetch, &n_rects);
+  priv->damage_parts_fetch = NULL;
+
+  if (rects == NULL)
+    return;
+
+  if (priv->pending_damage != NULL &&
+      n_rects > 0 && n_rects <= MAX_PENDING_DAMAGE_RECTS)
+    {
+      parts = cairo_region_create ();
+      for (i = 0; i < n_rects; i++)
+        {
+          cairo_rectangle_int_t rect;
+
+          rect.x = rects[i].x;
+          rect.y = rects[i].y;
+          rect.width = rects[i].width;
+          rect.height = rects[i].height;
+          cairo_region_union_rectangle (parts, &rect);
+        }
+
+      cairo_region_destroy (priv->pending_damage);
+      priv->pending_damage = parts;
+    }
+
+  XFree (rects);
+}
+
+static void
+meta_window_actor_flush_damage (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  meta_window_actor_collect_damage_parts (self);
+
+  if (priv->pending_damage == NULL)
+    return;
+
+  /* As in process_damage(); a window frozen since gets a full update
+   * when it is thawed */
+  if (is_frozen (self))
+    priv->needs_damage_all = TRUE;
+  else if (priv->mapped && !priv->needs_pixmap && !priv->unredirected)
+    meta_shaped_texture_update_region (META_SHAPED_TEXTURE (priv->actor),
+                                       priv->pending_damage);
+
+  g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+}
+
 void
 meta_window_actor_sync_visibility (MetaWindowActor *self)
 {
@@ -2050,56 +2192,93 @@ install_corners (MetaWindow       *window,
   cairo_fill (cr);
 }
 
-static cairo_region_t *
-scan_visible_region (guchar         *mask_data,
-                     int             stride,
-                     cairo_region_t *scan_area)
+/* Sets the pixels of region in the mask, clipped to the mask; the
+ * region comes from the window geometry, which may not match the
+ * size of the pixmap, for example in the middle of a resize.
+ */
+static void
+fill_mask_region (guchar         *mask_data,
+                  int             stride,
+                  int             tex_width,
+                  int             tex_height,
+                  cairo_region_t *region)
 {
-  int i, n_rects = cairo_region_num_rectangles (scan_area);
-  MetaRegionBuilder builder;
-
-  meta_region_builder_init (&builder);
+  int i, y, n_rects = cairo_region_num_rectangles (region);
 
   for (i = 0; i < n_rects; i++)
     {
-      int x, y;
       cairo_rectangle_int_t rect;
+      int x1, y1, x2, y2;
 
-      cairo_region_get_rectangle (scan_area, i, &rect);
+      cairo_region_get_rectangle (region, i, &rect);
 
-      for (y = rect.y; y < (rect.y + rect.height); y++)
-        {
-          for (x = rect.x; x < (rect.x + rect.width); x++)
-            {
-              int x2 = x;
-              while (mask_data[y * stride + x2] == 255 && x2 < (rect.x + rect.width))
-                x2++;
-
-              if (x2 > x)
-                {
-                  meta_region_builder_add_rectangle (&builder, x, y, x2 - x, 1);
-                  x = x2;
-                }
-            }
-        }
+      x1 = MAX (rect.x, 0);
+      y1 = MAX (rect.y, 0);
+      x2 = MIN (rect.x + rect.width, tex_width);
+      y2 = MIN (rect.y + rect.height, tex_height);
+      if (x1 >= x2 || y1 >= y2)
+        continue;
+
+      for (y = y1; y < y2; y++)
+        memset (mask_data + y * stride + x1, 255, x2 - x1);
     }
+}
+
+/* Draws the frame by rasterizing it as a whole; only used when the
+ * corners are too large for meta_frame_corners_draw_mask() */
+static cairo_region_t *
+draw_and_scan_frame (MetaWindowActor  *self,
+                     MetaFrameBorders *borders,
+                     guchar           *mask_data,
+                     int               stride,
+                     int               tex_width,
+                     int               tex_height,
+                     cairo_region_t   *frame_paint_region)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+
+  surface = cairo_image_surface_create_for_data (mask_data,
+                                                 CAIRO_FORMAT_A8,
+                                                 tex_width,
+                                                 tex_height,
+                                                 stride);
+  cr = cairo_create (surface);
+
+  gdk_cairo_region (cr, frame_paint_region);
+  cairo_clip (cr);
+
+  install_corners (priv->window, borders, cr);
+
+  cairo_destroy (cr);
+  cairo_surface_flush (surface);
+  cairo_surface_destroy (surface);
+
+  return meta_frame_corners_scan_mask (mask_data, stride, frame_paint_region);
+}
 
-  return meta_region_builder_finish (&builder);
+static gboolean
+frame_mask_key_equal (const FrameMaskKey *a,
+                      const FrameMaskKey *b)
+{
+  return memcmp (a, b, sizeof (FrameMaskKey)) == 0;
 }
 
 static void
 build_and_scan_frame_mask (MetaWindowActor       *self,
                            MetaFrameBorders      *borders,
                            cairo_rectangle_int_t *client_area,
-                           cairo_region_t        *shape_region)
+                           cairo_region_t        *shape_region,
+                           gboolean               client_shaped)
 {
   MetaWindowActorPrivate *priv = self->priv;
   guchar *mask_data;
   guint tex_width, tex_height;
   CoglTexture *paint_tex, *mask_texture;
   int stride;
-  cairo_t *cr;
-  cairo_surface_t *surface;
+  cairo_region_t *frame_opaque_region = NULL;
+  FrameMaskKey key;
 
   paint_tex = meta_shaped_texture_get_texture (META_SHAPED_TEXTURE (priv->actor));
   if (paint_tex == NULL)
@@ -2108,46 +2287,77 @@ build_and_scan_frame_mask (MetaWindowActor       *self,
   tex_width = cogl_texture_get_width (paint_tex);
   tex_height = cogl_texture_get_height (paint_tex);
 
+  /* The mask of an unshaped window only depends on its geometry, so
+   * if that didn't change since the last reshape, reuse the old mask.
+   */
+  memset (&key, 0, sizeof (FrameMaskKey));
+  key.tex_width = tex_width;
+  key.tex_height = tex_height;
+  key.client_area = *client_area;
+  key.rectangle = meta_texture_rectangle_check (paint_tex);
+
+  if (priv->window->frame != NULL)
+    {
+      MetaRectangle outer;
+
+      meta_window_get_outer_rect (priv->window, &outer);
+      key.outer.x = borders->invisible.left;
+      key.outer.y = borders->invisible.top;
+      key.outer.width = outer.width;
+      key.outer.height = outer.height;
+
+      meta_frame_get_corner_radiuses (priv->window->frame,
+                                      &key.top_left,
+                                      &key.top_right,
+                                      &key.bottom_left,
+                                      &key.bottom_right);
+    }
+
+  if (!client_shaped && priv->frame_mask_texture != NULL &&
+      frame_mask_key_equal (&key, &priv->frame_mask_key))
+    {
+      if (priv->frame_mask_region)
+        cairo_region_union (shape_region, priv->frame_mask_region);
+
+      meta_shaped_texture_set_mask_texture (META_SHAPED_TEXTURE (priv->actor),
+                                            priv->frame_mask_texture);
+      return;
+    }
+
   stride = cairo_format_stride_for_width (CAIRO_FORMAT_A8, tex_width);
 
   /* Create data for an empty image */
   mask_data = g_malloc0 (stride * tex_height);
 
-  surface = cairo_image_surface_create_for_data (mask_data,
-                                                 CAIRO_FORMAT_A8,
-                                                 tex_width,
-                                                 tex_height,
-                                                 stride);
-  cr = cairo_create (surface);
-
-  gdk_cairo_region (cr, shape_region);
-  cairo_fill (cr);
+  fill_mask_region (mask_data, stride, tex_width, tex_height, shape_region);
 
   if (priv->window->frame != NULL)
     {
-      cairo_region_t *frame_paint_region, *scanned_region;
+      cairo_region_t *frame_paint_region;
       cairo_rectangle_int_t rect = { 0, 0, tex_width, tex_height };
 
       /* Make sure we don't paint the frame over the client window. */
       frame_paint_region = cairo_region_create_rectangle (&rect);
       cairo_region_subtract_rectangle (frame_paint_region, client_area);
 
-      gdk_cairo_region (cr, frame_paint_region);
-      cairo_clip (cr);
-
-      install_corners (priv->window, borders, cr);
-
-      cairo_surface_flush (surface);
-      scanned_region = scan_visible_region (mask_data, stride, frame_paint_region);
-      cairo_region_union (shape_region, scanned_region);
-      cairo_region_destroy (scanned_region);
+      frame_opaque_region = meta_frame_corners_draw_mask (mask_data, stride,
+                                                          frame_paint_region,
+                                                          &key.outer,
+                                                          key.top_left,
+                                                          key.top_right,
+                                                          key.bottom_left,
+                                                          key.bottom_right);
+      if (frame_opaque_region == NULL)
+        frame_opaque_region = draw_and_scan_frame (self, borders,
+                                                   mask_data, stride,
+                                                   tex_width, tex_height,
+                                                   frame_paint_region);
+
+      cairo_region_union (shape_region, frame_opaque_region);
       cairo_region_destroy (frame_paint_region);
     }
 
-  cairo_destroy (cr);
-  cairo_surface_destroy (surface);
-
-  if (meta_texture_rectangle_check (paint_tex))
+  if (key.rectangle)
     {
       mask_texture = meta_texture_rectangle_new (tex_width, tex_height,
                                                  COGL_PIXEL_FORMAT_A_8,
@@ -2171,6 +2381,22 @@ build_and_scan_frame_mask (MetaWindowActor       *self,
 
   meta_shaped_texture_set_mask_texture (META_SHAPED_TEXTURE (priv->actor),
                                         mask_texture);
+  meta_frame_profiler_count (META_FRAME_COUNT_TEXTURE_UPLOADS, 1);
+
+  g_clear_pointer (&priv->frame_mask_texture, cogl_object_unref);
+  g_clear_pointer (&priv->frame_mask_region, cairo_region_destroy);
+
+  if (!client_shaped)
+    {
+      priv->frame_mask_key = key;
+      priv->frame_mask_texture = cogl_object_ref (mask_texture);
+      priv->frame_mask_region = frame_opaque_region;
+      frame_opaque_region = NULL;
+    }
+
+  if (frame_opaque_region)
+    cairo_region_destroy (frame_opaque_region);
+
   cogl_object_unref (mask_texture);
 
   g_free (mask_data);
@@ -2186,6 +2412,7 @@ check_needs_reshape (MetaWindowActor *self)
   cairo_region_t *region = NULL;
   cairo_rectangle_int_t client_area;
   gboolean needs_mask;
+  gboolean client_shaped;
 
   if (!priv->mapped)
     return;
@@ -2247,7 +2474,8 @@ check_needs_reshape (MetaWindowActor *self)
     }
 #endif
 
-  needs_mask = (region != NULL) || (priv->window->frame != NULL);
+  client_shaped = (region != NULL);
+  needs_mask = client_shaped || (priv->window->frame != NULL);
 
   if (region != NULL)
     {
@@ -2294,11 +2522,12 @@ check_needs_reshape (MetaWindowActor *self)
 
   if (needs_mask)
     {
-      /* This takes the region, generates a mask using GTK+
-       * and scans the mask looking for all opaque pixels,
-       * adding it to region.
+      /* This takes the region, generates a mask including the
+       * rounded frame, and adds the opaque pixels of the frame
+       * to region.
        */
-      build_and_scan_frame_mask (self, &borders, &client_area, region);
+      build_and_scan_frame_mask (self, &borders, &client_area, region,
+                                 client_shaped);
     }
 
   priv->shape_region = region;
@@ -2320,6 +2549,61 @@ meta_window_actor_update_shape (MetaWindowActor *self)
   clutter_actor_queue_redraw (priv->actor);
 }
 
+/**
+ * meta_window_actor_repair_damage:
+ * @self: a #MetaWindowActor
+ *
+ * Subtracts any damage the window has received since the last repair,
+ * without synchronizing with the X server. The caller is responsible
+ * for making a round trip before the window pixmap is used for
+ * rendering; this allows the compositor to repair all windows on a
+ * screen and then synchronize once per frame.
+ *
+ * Return value: %TRUE if damage was subtracted and a round trip is needed
+ */
+gboolean
+meta_window_actor_repair_damage (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  MetaDisplay *display;
+
+  if (!priv->received_damage)
+    return FALSE;
+
+  /* Frozen windows are repaired when they are thawed; unredirected
+   * windows have nothing to repair until they get redirected again */
+  if (is_frozen (self) || priv->unredirected)
+    return FALSE;
+
+  display = meta_screen_get_display (priv->screen);
+
+  if (priv->damage_parts == None)
+    priv->damage_parts = XFixesCreateRegion (meta_display_get_xdisplay (display),
+                                             NULL, 0);
+
+  meta_error_trap_push (display);
+  XDamageSubtract (meta_display_get_xdisplay (display), priv->damage, None,
+                   priv->damage_parts);
+  meta_error_trap_pop (display);
+
+  priv->received_damage = FALSE;
+
+  /* Ask for the parts of large damage; the reply comes in with the
+   * round trip the caller makes, and flush_damage() uses it */
+  if (priv->pending_damage != NULL && priv->damage_parts_fetch == NULL)
+    {
+      cairo_rectangle_int_t extents;
+
+      cairo_region_get_extents (priv->pending_damage, &extents);
+      if (extents.width * extents.height >= MIN_SPLIT_DAMAGE_AREA)
+        priv->damage_parts_fetch =
+          meta_region_fetch_begin (meta_display_get_xdisplay (display),
+                                   priv->damage_parts);
+    }
+
+  return TRUE;
+}
+
 static void
 meta_window_actor_handle_updates (MetaWindowActor *self)
 {
@@ -2341,12 +2625,8 @@ meta_window_actor_handle_updates (MetaWindowActor *self)
       return;
     }
 
-  if (priv->received_damage)
+  if (meta_window_actor_repair_damage (self))
     {
-      meta_error_trap_push (display);
-      XDamageSubtract (xdisplay, priv->damage, None, None);
-      meta_error_trap_pop (display);
-
       /* We need to make sure that any X drawing that happens before the
        * XDamageSubtract() above is visible to subsequent GL rendering;
        * the only standardized way to do this is EXT_x11_sync_object,
@@ -2358,16 +2638,16 @@ meta_window_actor_handle_updates (MetaWindowActor *self)
        *
        * The X server makes sure to flush drawing to the kernel before
        * sending out damage events, but since we use DamageReportBoundingBox
-       * there may be drawing between the last damage event and the
-       * XDamageSubtract() that needs to be flushed as well.
+       * there may be drawing to already damaged areas between the last
+       * damage event and the XDamageSubtract() that needs to be flushed
+       * as well.
        *
        * Xorg always makes sure that drawing is flushed to the kernel
        * before writing events or responses to the client, so any round trip
        * request at this point is sufficient to flush the GLX buffers.
        */
       XSync (xdisplay, False);
-
-      priv->received_damage = FALSE;
+      meta_frame_profiler_count (META_FRAME_COUNT_ROUND_TRIPS, 1);
     }
 
   check_needs_pixmap (self);
@@ -2382,6 +2662,7 @@ meta_window_actor_pre_paint (MetaWindowActor *self)
   GList *l;
 
   meta_window_actor_handle_updates (self);
+  meta_window_actor_flush_damage (self);
 
   for (l = priv->frames; l != NULL; l = l->next)
     {
@@ -2522,6 +2803,29 @@ meta_window_actor_invalidate_shadow (MetaWindowActor *self)
   clutter_actor_queue_redraw (CLUTTER_ACTOR (self));
 }
 
+/**
+ * meta_window_actor_shadow_ready:
+ * @self: a #MetaWindowActor
+ * @shadow: a #MetaShadow whose texture was just made
+ *
+ * Queues a redraw of the actor if it uses @shadow; shadows made in the
+ * background are skipped when painting until they are ready.
+ */
+void
+meta_window_actor_shadow_ready (MetaWindowActor *self,
+                                MetaShadow      *shadow)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  if (priv->focused_shadow != shadow && priv->unfocused_shadow != shadow)
+    return;
+
+  if (is_frozen (self))
+    return;
+
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (self));
+}
+
 void
 meta_window_actor_update_opacity (MetaWindowActor *self)
 {
@@ -13,6 +13,7 @@
 #include "meta-window-group.h"
 #include "meta-background-actor-private.h"
 #include "meta-background-group-private.h"
+#include "meta-frame-profiler.h"
 
 struct _MetaWindowGroupClass
 {
@@ -86,10 +87,36 @@ painting_untransformed (MetaWindowGroup *window_group,
   return meta_actor_vertices_are_untransformed (vertices, width, height, x_origin, y_origin);
 }
 
+/* Gets the area an actor paints in, including shadows, in the
+ * coordinates of the current paint */
+static void
+get_paint_bounds (ClutterActor          *actor,
+                  int                    paint_x_offset,
+                  int                    paint_y_offset,
+                  cairo_rectangle_int_t *bounds)
+{
+  ClutterActorBox box;
+
+  if (!clutter_actor_get_paint_box (actor, &box))
+    {
+      /* Unknown, so assume the worst */
+      bounds->x = bounds->y = G_MININT / 2;
+      bounds->width = bounds->height = G_MAXINT;
+      return;
+    }
+
+  bounds->x = floorf (box.x1) + paint_x_offset;
+  bounds->y = floorf (box.y1) + paint_y_offset;
+  bounds->width = ceilf (box.x2) + paint_x_offset - bounds->x;
+  bounds->height = ceilf (box.y2) + paint_y_offset - bounds->y;
+}
+
 static void
 meta_window_group_paint (ClutterActor *actor)
 {
   cairo_region_t *visible_region;
+  cairo_region_t *empty_region;
+  MetaOcclusionGrid *occlusion;
   ClutterActor *stage;
   cairo_rectangle_int_t visible_rect;
   GList *children, *l;
@@ -123,6 +150,8 @@ meta_window_group_paint (ClutterActor *actor)
   paint_x_offset = paint_x_origin - actor_x_origin;
   paint_y_offset = paint_y_origin - actor_y_origin;
 
+  meta_frame_profiler_stage_begin (META_FRAME_STAGE_CULL);
+
   /* We walk the list from top to bottom (opposite of painting order),
    * and subtract the opaque area of each window out of the visible
    * region that we pass to the windows below.
@@ -141,6 +170,14 @@ meta_window_group_paint (ClutterActor *actor)
                                         &visible_rect);
 
   visible_region = cairo_region_create_rectangle (&visible_rect);
+  empty_region = cairo_region_create ();
+
+  /* Tracks what is covered by the windows we've already been through,
+   * so that we can tell cheaply when a window or background further
+   * down is entirely hidden, without going through visible_region,
+   * which gets more and more complex as windows are subtracted from it.
+   */
+  occlusion = meta_occlusion_grid_new (&visible_rect);
 
   if (info->unredirected_window != NULL)
     {
@@ -148,7 +185,10 @@ meta_window_group_paint (ClutterActor *actor)
       MetaWindow *window = meta_window_actor_get_meta_window (info->unredirected_window);
 
       meta_window_get_outer_rect (window, (MetaRectangle *)&unredirected_rect);
+      unredirected_rect.x += paint_x_offset;
+      unredirected_rect.y += paint_y_offset;
       cairo_region_subtract_rectangle (visible_region, &unredirected_rect);
+      meta_occlusion_grid_add_rectangle (occlusion, &unredirected_rect);
     }
 
   for (l = children; l; l = l->next)
@@ -181,6 +221,7 @@ meta_window_group_paint (ClutterActor *actor)
       if (META_IS_WINDOW_ACTOR (l->data))
         {
           MetaWindowActor *window_actor = l->data;
+          cairo_rectangle_int_t bounds;
           int x, y;
 
           if (!meta_actor_is_untransformed (CLUTTER_ACTOR (window_actor), &x, &y))
@@ -189,6 +230,18 @@ meta_window_group_paint (ClutterActor *actor)
           x += paint_x_offset;
           y += paint_y_offset;
 
+          /* Everything the window paints, shadow included, is hidden */
+          get_paint_bounds (CLUTTER_ACTOR (window_actor),
+                            paint_x_offset, paint_y_offset, &bounds);
+          if (meta_occlusion_grid_is_covered (occlusion, &bounds) ||
+              cairo_region_contains_rectangle (visible_region, &bounds) == CAIRO_REGION_OVERLAP_OUT)
+            {
+              meta_window_actor_set_visible_region (window_actor, empty_region);
+              meta_window_actor_set_visible_region_beneath (window_actor, empty_region);
+              meta_frame_profiler_count (META_FRAME_COUNT_CULLED_ACTORS, 1);
+              continue;
+            }
+
           /* Temporarily move to the coordinate system of the actor */
           cairo_region_translate (visible_region, - x, - y);
 
@@ -198,7 +251,10 @@ meta_window_group_paint (ClutterActor *actor)
             {
               cairo_region_t *obscured_region = meta_window_actor_get_obscured_region (window_actor);
               if (obscured_region)
-                cairo_region_subtract (visible_region, obscured_region);
+                {
+                  cairo_region_subtract (visible_region, obscured_region);
+                  meta_occlusion_grid_add_region (occlusion, obscured_region, x, y);
+                }
             }
 
           meta_window_actor_set_visible_region_beneath (window_actor, visible_region);
@@ -216,6 +272,15 @@ meta_window_group_paint (ClutterActor *actor)
           x += paint_x_offset;
           y += paint_y_offset;
 
+          if (meta_occlusion_grid_is_covered (occlusion, &visible_rect))
+            {
+              if (META_IS_BACKGROUND_GROUP (background_actor))
+                meta_background_group_set_visible_region (META_BACKGROUND_GROUP (background_actor), empty_region);
+              else
+                meta_background_actor_set_visible_region (META_BACKGROUND_ACTOR (background_actor), empty_region);
+              continue;
+            }
+
           cairo_region_translate (visible_region, - x, - y);
 
           if (META_IS_BACKGROUND_GROUP (background_actor))
@@ -227,8 +292,14 @@ meta_window_group_paint (ClutterActor *actor)
     }
 
   cairo_region_destroy (visible_region);
+  cairo_region_destroy (empty_region);
+  meta_occlusion_grid_free (occlusion);
+
+  meta_frame_profiler_stage_end (META_FRAME_STAGE_CULL);
 
+  meta_frame_profiler_stage_begin (META_FRAME_STAGE_PAINT);
   CLUTTER_ACTOR_CLASS (meta_window_group_parent_class)->paint (actor);
+  meta_frame_profiler_stage_end (META_FRAME_STAGE_PAINT);
 
   /* Now that we are done painting, unset the visible regions (they will
    * mess up painting clones of our actors)
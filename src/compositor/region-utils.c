@@ -311,3 +311,181 @@ meta_make_border_region (cairo_region_t *region,
 
   return border_region;
 }
+
+/* MetaOcclusionGrid */
+
+#define OCCLUSION_TILE_SIZE 32
+
+struct _MetaOcclusionGrid
+{
+  cairo_rectangle_int_t area;
+  int n_columns;
+  int n_rows;
+  /* Number of tiles not yet covered */
+  int n_uncovered;
+  guint8 *covered;
+};
+
+/**
+ * meta_occlusion_grid_new:
+ * @area: the area covered by the grid; everything outside of it is
+ *  considered to be covered
+ *
+ * Return value: a new #MetaOcclusionGrid with no tiles covered
+ */
+MetaOcclusionGrid *
+meta_occlusion_grid_new (const cairo_rectangle_int_t *area)
+{
+  MetaOcclusionGrid *grid;
+
+  grid = g_slice_new (MetaOcclusionGrid);
+  grid->area = *area;
+  grid->n_columns = (MAX (area->width, 0) + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+  grid->n_rows = (MAX (area->height, 0) + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+  grid->n_uncovered = grid->n_columns * grid->n_rows;
+  grid->covered = g_malloc0 (grid->n_uncovered);
+
+  return grid;
+}
+
+void
+meta_occlusion_grid_free (MetaOcclusionGrid *grid)
+{
+  g_free (grid->covered);
+  g_slice_free (MetaOcclusionGrid, grid);
+}
+
+/* Range of tiles completely inside [start, end) along one axis; tiles
+ * at the edge of the area are clipped to it, so a span reaching the
+ * edge covers the last tile even if it is partial.
+ */
+static void
+get_covered_span (int  area_start,
+                  int  area_end,
+                  int  n_tiles,
+                  int  start,
+                  int  end,
+                  int *first,
+                  int *last)
+{
+  start = MAX (start, area_start);
+  end = MIN (end, area_end);
+
+  *first = (start - area_start + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+  if (end == area_end)
+    *last = n_tiles;
+  else
+    *last = (end - area_start) / OCCLUSION_TILE_SIZE;
+}
+
+/**
+ * meta_occlusion_grid_add_rectangle:
+ * @grid: a #MetaOcclusionGrid
+ * @rect: a rectangle that is now covered
+ *
+ * Marks the tiles that are entirely within @rect as covered.
+ */
+void
+meta_occlusion_grid_add_rectangle (MetaOcclusionGrid           *grid,
+                                   const cairo_rectangle_int_t *rect)
+{
+  int first_column, last_column, first_row, last_row;
+  int i, j;
+
+  if (rect->width <= 0 || rect->height <= 0)
+    return;
+
+  get_covered_span (grid->area.x, grid->area.x + grid->area.width, grid->n_columns,
+                    rect->x, rect->x + rect->width,
+                    &first_column, &last_column);
+  get_covered_span (grid->area.y, grid->area.y + grid->area.height, grid->n_rows,
+                    rect->y, rect->y + rect->height,
+                    &first_row, &last_row);
+
+  for (j = first_row; j < last_row; j++)
+    {
+      guint8 *row = grid->covered + j * grid->n_columns;
+
+      for (i = first_column; i < last_column; i++)
+        {
+          if (!row[i])
+            {
+              row[i] = TRUE;
+              grid->n_uncovered--;
+            }
+        }
+    }
+}
+
+/**
+ * meta_occlusion_grid_add_region:
+ * @grid: a #MetaOcclusionGrid
+ * @region: a region that is now covered
+ * @x_offset: amount to translate @region by horizontally
+ * @y_offset: amount to translate @region by vertically
+ *
+ * Marks the tiles that are entirely within a single rectangle of
+ * the translated @region as covered.
+ */
+void
+meta_occlusion_grid_add_region (MetaOcclusionGrid *grid,
+                                cairo_region_t    *region,
+                                int                x_offset,
+                                int                y_offset)
+{
+  int i, n_rects = cairo_region_num_rectangles (region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (region, i, &rect);
+      rect.x += x_offset;
+      rect.y += y_offset;
+
+      meta_occlusion_grid_add_rectangle (grid, &rect);
+    }
+}
+
+/**
+ * meta_occlusion_grid_is_covered:
+ * @grid: a #MetaOcclusionGrid
+ * @rect: a rectangle
+ *
+ * Return value: %TRUE if all the tiles that @rect touches are covered,
+ *  so that @rect is entirely hidden
+ */
+gboolean
+meta_occlusion_grid_is_covered (MetaOcclusionGrid           *grid,
+                                const cairo_rectangle_int_t *rect)
+{
+  int x1, y1, x2, y2;
+  int i, j;
+
+  x1 = MAX (rect->x, grid->area.x);
+  y1 = MAX (rect->y, grid->area.y);
+  x2 = MIN (rect->x + rect->width, grid->area.x + grid->area.width);
+  y2 = MIN (rect->y + rect->height, grid->area.y + grid->area.height);
+
+  if (x1 >= x2 || y1 >= y2)
+    return TRUE;
+
+  if (grid->n_uncovered == grid->n_columns * grid->n_rows)
+    return FALSE;
+
+  x1 = (x1 - grid->area.x) / OCCLUSION_TILE_SIZE;
+  y1 = (y1 - grid->area.y) / OCCLUSION_TILE_SIZE;
+  x2 = (x2 - 1 - grid->area.x) / OCCLUSION_TILE_SIZE;
+  y2 = (y2 - 1 - grid->area.y) / OCCLUSION_TILE_SIZE;
+
+  for (j = y1; j <= y2; j++)
+    {
+      guint8 *row = grid->covered + j * grid->n_columns;
+
+      for (i = x1; i <= x2; i++)
+        if (!row[i])
+          return FALSE;
+    }
+
+  return TRUE;
+}
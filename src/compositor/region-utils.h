@@ -99,4 +99,26 @@ cairo_region_t *meta_make_border_region (cairo_region_t *region,
                                          int             y_amount,
                                          gboolean        flip);
 
+/**
+ * MetaOcclusionGrid:
+ *
+ * A coarse grid of tiles over an area, recording which tiles are known
+ * to be completely covered. It is used alongside an exact region of
+ * what is still visible, to skip region operations for things that are
+ * obviously hidden; as it is conservative, a rectangle that isn't
+ * reported as covered may still be hidden.
+ */
+typedef struct _MetaOcclusionGrid MetaOcclusionGrid;
+
+MetaOcclusionGrid *meta_occlusion_grid_new            (const cairo_rectangle_int_t *area);
+void               meta_occlusion_grid_free           (MetaOcclusionGrid           *grid);
+void               meta_occlusion_grid_add_rectangle  (MetaOcclusionGrid           *grid,
+                                                       const cairo_rectangle_int_t *rect);
+void               meta_occlusion_grid_add_region     (MetaOcclusionGrid           *grid,
+                                                       cairo_region_t              *region,
+                                                       int                          x_offset,
+                                                       int                          y_offset);
+gboolean           meta_occlusion_grid_is_covered     (MetaOcclusionGrid           *grid,
+                                                       const cairo_rectangle_int_t *rect);
+
 #endif /* __META_REGION_UTILS_H__ */
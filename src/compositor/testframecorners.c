@@ -0,0 +1,281 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Frame mask test and benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Simulates reshaping a decorated window with rounded corners through
+ * 100 sizes, as when it is resized interactively. For each size, the
+ * frame mask and its opaque region are built the way the window actor
+ * used to, by rasterizing the whole frame with cairo and scanning every
+ * pixel of it, and with meta_frame_corners_draw_mask(); the results are
+ * checked to be identical and the times compared. This is done for a
+ * few sets of radii; for ones with which meta_frame_corners_draw_mask()
+ * can't draw the frame, it is checked to return %NULL.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meta-frame-corners.h"
+#include "region-utils.h"
+
+#define TAU (2*M_PI)
+#define N_SIZES 100
+
+/* Invisible borders and visible frame, as for a typical theme */
+#define INVISIBLE_BORDER 10
+#define TITLEBAR_HEIGHT 28
+#define FRAME_BORDER 1
+
+typedef struct
+{
+  float top_left, top_right, bottom_left, bottom_right;
+  gboolean tiled;
+} Radii;
+
+static const Radii test_radii[] = {
+  { 6, 6, 6, 6, TRUE },
+  { 6.5, 6, 0, 0, TRUE },
+  { 5, 3, 4, 8, TRUE },
+  { 6, 6.5, 6, 6, FALSE },
+  { 6.5, 6.5, 6.5, 6.5, FALSE },
+};
+
+static void
+reference_install_corners (cairo_t                     *cr,
+                           const cairo_rectangle_int_t *outer,
+                           const Radii                 *radii)
+{
+  int x, y;
+
+  x = outer->x;
+  y = outer->y;
+  cairo_arc (cr, x + radii->top_left, y + radii->top_left, radii->top_left,
+             2 * TAU / 4, 3 * TAU / 4);
+
+  x = outer->x + outer->width - radii->top_right;
+  y = outer->y;
+  cairo_arc (cr, x, y + radii->top_right, radii->top_right,
+             3 * TAU / 4, 4 * TAU / 4);
+
+  x = outer->x + outer->width - radii->bottom_right;
+  y = outer->y + outer->height - radii->bottom_right;
+  cairo_arc (cr, x, y, radii->bottom_right, 0 * TAU / 4, 1 * TAU / 4);
+
+  x = outer->x;
+  y = outer->y + outer->height - radii->bottom_left;
+  cairo_arc (cr, x + radii->bottom_left, y, radii->bottom_left,
+             1 * TAU / 4, 2 * TAU / 4);
+
+  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+  cairo_fill (cr);
+}
+
+static cairo_region_t *
+reference_scan_visible_region (guchar         *mask_data,
+                               int             stride,
+                               cairo_region_t *scan_area)
+{
+  int i, n_rects = cairo_region_num_rectangles (scan_area);
+  MetaRegionBuilder builder;
+
+  meta_region_builder_init (&builder);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      int x, y;
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (scan_area, i, &rect);
+
+      for (y = rect.y; y < (rect.y + rect.height); y++)
+        {
+          for (x = rect.x; x < (rect.x + rect.width); x++)
+            {
+              int x2 = x;
+              while (x2 < (rect.x + rect.width) && mask_data[y * stride + x2] == 255)
+                x2++;
+
+              if (x2 > x)
+                {
+                  meta_region_builder_add_rectangle (&builder, x, y, x2 - x, 1);
+                  x = x2;
+                }
+            }
+        }
+    }
+
+  return meta_region_builder_finish (&builder);
+}
+
+static cairo_region_t *
+reference_draw_mask (guchar                      *mask_data,
+                     int                          stride,
+                     int                          width,
+                     int                          height,
+                     cairo_region_t              *frame_region,
+                     const cairo_rectangle_int_t *outer,
+                     const Radii                 *radii)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  int i, n_rects;
+
+  surface = cairo_image_surface_create_for_data (mask_data,
+                                                 CAIRO_FORMAT_A8,
+                                                 width, height,
+                                                 stride);
+  cr = cairo_create (surface);
+
+  n_rects = cairo_region_num_rectangles (frame_region);
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (frame_region, i, &rect);
+      cairo_rectangle (cr, rect.x, rect.y, rect.width, rect.height);
+    }
+  cairo_clip (cr);
+
+  reference_install_corners (cr, outer, radii);
+
+  cairo_destroy (cr);
+  cairo_surface_flush (surface);
+  cairo_surface_destroy (surface);
+
+  return reference_scan_visible_region (mask_data, stride, frame_region);
+}
+
+static void
+test_radii_reshapes (GTimer      *timer,
+                     const Radii *radii)
+{
+  double reference_time = 0, new_time = 0;
+  int i;
+
+  for (i = 0; i < N_SIZES; i++)
+    {
+      int client_width = 200 + i * 17;
+      int client_height = 150 + i * 11;
+      cairo_rectangle_int_t outer, client_area, rect;
+      cairo_region_t *frame_region;
+      cairo_region_t *reference_region, *new_region;
+      guchar *reference_mask, *new_mask;
+      int width, height, stride;
+
+      outer.x = INVISIBLE_BORDER;
+      outer.y = INVISIBLE_BORDER;
+      outer.width = client_width + 2 * FRAME_BORDER;
+      outer.height = client_height + TITLEBAR_HEIGHT + FRAME_BORDER;
+
+      client_area.x = outer.x + FRAME_BORDER;
+      client_area.y = outer.y + TITLEBAR_HEIGHT;
+      client_area.width = client_width;
+      client_area.height = client_height;
+
+      width = outer.width + 2 * INVISIBLE_BORDER;
+      height = outer.height + 2 * INVISIBLE_BORDER;
+      stride = cairo_format_stride_for_width (CAIRO_FORMAT_A8, width);
+
+      rect.x = rect.y = 0;
+      rect.width = width;
+      rect.height = height;
+      frame_region = cairo_region_create_rectangle (&rect);
+      cairo_region_subtract_rectangle (frame_region, &client_area);
+
+      reference_mask = g_malloc0 (stride * height);
+      new_mask = g_malloc0 (stride * height);
+
+      g_timer_start (timer);
+      reference_region = reference_draw_mask (reference_mask, stride,
+                                              width, height,
+                                              frame_region, &outer,
+                                              radii);
+      reference_time += g_timer_elapsed (timer, NULL);
+
+      g_timer_start (timer);
+      new_region = meta_frame_corners_draw_mask (new_mask, stride,
+                                                 frame_region, &outer,
+                                                 radii->top_left,
+                                                 radii->top_right,
+                                                 radii->bottom_left,
+                                                 radii->bottom_right);
+      new_time += g_timer_elapsed (timer, NULL);
+
+      if (!radii->tiled)
+        {
+          if (new_region != NULL)
+            {
+              printf ("Radii %g %g %g %g should not be drawn with tiles\n",
+                      radii->top_left, radii->top_right,
+                      radii->bottom_left, radii->bottom_right);
+              exit (1);
+            }
+        }
+      else if (new_region == NULL ||
+               !cairo_region_equal (reference_region, new_region))
+        {
+          printf ("Opaque region for %dx%d differs from the reference\n",
+                  client_width, client_height);
+          exit (1);
+        }
+      else if (memcmp (reference_mask, new_mask, stride * height) != 0)
+        {
+          printf ("Mask for %dx%d differs from the reference\n",
+                  client_width, client_height);
+          exit (1);
+        }
+
+      cairo_region_destroy (reference_region);
+      if (new_region)
+        cairo_region_destroy (new_region);
+      cairo_region_destroy (frame_region);
+      g_free (reference_mask);
+      g_free (new_mask);
+    }
+
+  if (radii->tiled)
+    printf ("Radii %g %g %g %g, %d reshapes, from %dx%d to %dx%d: "
+            "reference %.3f ms, new %.3f ms per reshape\n",
+            radii->top_left, radii->top_right,
+            radii->bottom_left, radii->bottom_right,
+            N_SIZES, 200, 150, 200 + (N_SIZES - 1) * 17, 150 + (N_SIZES - 1) * 11,
+            reference_time * 1000 / N_SIZES,
+            new_time * 1000 / N_SIZES);
+}
+
+int
+main (int argc, char **argv)
+{
+  GTimer *timer;
+  int i;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (test_radii); i++)
+    test_radii_reshapes (timer, &test_radii[i]);
+
+  printf ("All masks matched the reference.\n");
+
+  g_timer_destroy (timer);
+
+  return 0;
+}
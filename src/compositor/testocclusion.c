@@ -0,0 +1,243 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Occlusion culling benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Simulates the culling pass of MetaWindowGroup for 100 stacked
+ * windows with shadows, the way it used to be done, by going through
+ * the visible region for every window, and with a MetaOcclusionGrid
+ * to skip the windows that are entirely hidden. The visible regions
+ * handed to each window are checked to be the same, and the times
+ * compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "region-utils.h"
+
+#define N_WINDOWS 100
+#define N_ITERATIONS 200
+
+#define SCREEN_WIDTH 1920
+#define SCREEN_HEIGHT 1080
+#define SHADOW_RADIUS 20
+
+typedef struct
+{
+  cairo_rectangle_int_t rect;
+  /* Opaque area, with rounded top corners cut out */
+  cairo_region_t *obscured_region;
+  /* Where the window and its shadow paint */
+  cairo_rectangle_int_t paint_bounds;
+  cairo_region_t *visible_region;
+} Window;
+
+static void
+init_windows (Window *windows)
+{
+  int i;
+
+  /* Bottom to top; a cascade of windows, with a few maximized ones
+   * that hide everything below them */
+  for (i = 0; i < N_WINDOWS; i++)
+    {
+      Window *window = &windows[i];
+      cairo_rectangle_int_t corner;
+
+      if (i % 25 == 10)
+        {
+          window->rect.x = 0;
+          window->rect.y = 0;
+          window->rect.width = SCREEN_WIDTH;
+          window->rect.height = SCREEN_HEIGHT;
+        }
+      else
+        {
+          window->rect.x = (i * 37) % (SCREEN_WIDTH - 800);
+          window->rect.y = (i * 23) % (SCREEN_HEIGHT - 600);
+          window->rect.width = 800;
+          window->rect.height = 600;
+        }
+
+      window->obscured_region = cairo_region_create_rectangle (&window->rect);
+      corner.width = corner.height = 4;
+      corner.x = window->rect.x;
+      corner.y = window->rect.y;
+      cairo_region_subtract_rectangle (window->obscured_region, &corner);
+      corner.x = window->rect.x + window->rect.width - 4;
+      cairo_region_subtract_rectangle (window->obscured_region, &corner);
+      /* Use the same coordinates as the actor */
+      cairo_region_translate (window->obscured_region,
+                              - window->rect.x, - window->rect.y);
+
+      window->paint_bounds.x = window->rect.x - SHADOW_RADIUS;
+      window->paint_bounds.y = window->rect.y - SHADOW_RADIUS;
+      window->paint_bounds.width = window->rect.width + 2 * SHADOW_RADIUS;
+      window->paint_bounds.height = window->rect.height + 2 * SHADOW_RADIUS;
+
+      window->visible_region = NULL;
+    }
+}
+
+static void
+clear_visible_regions (Window *windows)
+{
+  int i;
+
+  for (i = 0; i < N_WINDOWS; i++)
+    {
+      if (windows[i].visible_region)
+        cairo_region_destroy (windows[i].visible_region);
+      windows[i].visible_region = NULL;
+    }
+}
+
+static void
+reference_cull (Window                      *windows,
+                const cairo_rectangle_int_t *visible_rect)
+{
+  cairo_region_t *visible_region;
+  int i;
+
+  visible_region = cairo_region_create_rectangle (visible_rect);
+
+  for (i = N_WINDOWS - 1; i >= 0; i--)
+    {
+      Window *window = &windows[i];
+
+      cairo_region_translate (visible_region, - window->rect.x, - window->rect.y);
+      window->visible_region = cairo_region_copy (visible_region);
+      cairo_region_subtract (visible_region, window->obscured_region);
+      cairo_region_translate (visible_region, window->rect.x, window->rect.y);
+    }
+
+  cairo_region_destroy (visible_region);
+}
+
+static void
+new_cull (Window                      *windows,
+          const cairo_rectangle_int_t *visible_rect)
+{
+  cairo_region_t *visible_region;
+  MetaOcclusionGrid *occlusion;
+  int i;
+
+  visible_region = cairo_region_create_rectangle (visible_rect);
+  occlusion = meta_occlusion_grid_new (visible_rect);
+
+  for (i = N_WINDOWS - 1; i >= 0; i--)
+    {
+      Window *window = &windows[i];
+
+      if (meta_occlusion_grid_is_covered (occlusion, &window->paint_bounds) ||
+          cairo_region_contains_rectangle (visible_region, &window->paint_bounds) == CAIRO_REGION_OVERLAP_OUT)
+        {
+          window->visible_region = cairo_region_create ();
+          continue;
+        }
+
+      cairo_region_translate (visible_region, - window->rect.x, - window->rect.y);
+      window->visible_region = cairo_region_copy (visible_region);
+      cairo_region_subtract (visible_region, window->obscured_region);
+      meta_occlusion_grid_add_region (occlusion, window->obscured_region,
+                                      window->rect.x, window->rect.y);
+      cairo_region_translate (visible_region, window->rect.x, window->rect.y);
+    }
+
+  cairo_region_destroy (visible_region);
+  meta_occlusion_grid_free (occlusion);
+}
+
+/* What of the visible region matters for painting the window and its
+ * shadow */
+static cairo_region_t *
+get_painted_region (Window *window)
+{
+  cairo_region_t *region = cairo_region_copy (window->visible_region);
+  cairo_rectangle_int_t bounds = window->paint_bounds;
+
+  bounds.x -= window->rect.x;
+  bounds.y -= window->rect.y;
+  cairo_region_intersect_rectangle (region, &bounds);
+
+  return region;
+}
+
+int
+main (int argc, char **argv)
+{
+  Window reference_windows[N_WINDOWS];
+  Window new_windows[N_WINDOWS];
+  cairo_rectangle_int_t visible_rect = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+  GTimer *timer;
+  double reference_time, new_time;
+  int n_culled = 0;
+  int i;
+
+  init_windows (reference_windows);
+  init_windows (new_windows);
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < N_ITERATIONS; i++)
+    {
+      clear_visible_regions (reference_windows);
+      reference_cull (reference_windows, &visible_rect);
+    }
+  reference_time = g_timer_elapsed (timer, NULL);
+
+  g_timer_start (timer);
+  for (i = 0; i < N_ITERATIONS; i++)
+    {
+      clear_visible_regions (new_windows);
+      new_cull (new_windows, &visible_rect);
+    }
+  new_time = g_timer_elapsed (timer, NULL);
+
+  for (i = 0; i < N_WINDOWS; i++)
+    {
+      cairo_region_t *reference_region = get_painted_region (&reference_windows[i]);
+      cairo_region_t *new_region = get_painted_region (&new_windows[i]);
+
+      if (!cairo_region_equal (reference_region, new_region))
+        {
+          printf ("Visible region of window %d differs from the reference\n", i);
+          exit (1);
+        }
+
+      if (cairo_region_is_empty (new_region))
+        n_culled++;
+
+      cairo_region_destroy (reference_region);
+      cairo_region_destroy (new_region);
+    }
+
+  printf ("%d windows, %d hidden: reference %.3f ms, new %.3f ms per frame\n",
+          N_WINDOWS, n_culled,
+          reference_time * 1000 / N_ITERATIONS,
+          new_time * 1000 / N_ITERATIONS);
+  printf ("All visible regions matched the reference.\n");
+
+  clear_visible_regions (reference_windows);
+  clear_visible_regions (new_windows);
+  g_timer_destroy (timer);
+
+  return 0;
+}
@@ -0,0 +1,220 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Shadow blur kernel test and benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Checks that meta_shadow_blur_rows() produces exactly the same output
+ * as the original sliding window implementation, which is kept here as
+ * a reference, and compares the speed of both for a range of radii.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meta-shadow-factory-private.h"
+
+#define BUFFER_SIZE 1024
+#define N_RUNS 20
+
+static void
+reference_blur_xspan (guchar *row,
+                      guchar *tmp_buffer,
+                      int     row_width,
+                      int     x0,
+                      int     x1,
+                      int     d,
+                      int     shift)
+{
+  int offset;
+  int sum = 0;
+  int i;
+
+  if (d % 2 == 1)
+    offset = d / 2;
+  else
+    offset = (d - shift) / 2;
+
+  for (i = x0 - d + offset; i < x1 + offset; i++)
+    {
+      if (i >= 0 && i < row_width)
+	sum += row[i];
+
+      if (i >= x0 + offset)
+	{
+	  if (i >= d)
+	    sum -= row[i - d];
+
+	  tmp_buffer[i - offset] = (sum + d / 2) / d;
+	}
+    }
+
+  memcpy(row + x0, tmp_buffer + x0, x1 - x0);
+}
+
+static void
+reference_blur_rows (cairo_region_t   *convolve_region,
+                     int               x_offset,
+                     int               y_offset,
+                     guchar           *buffer,
+                     int               buffer_width,
+                     int               buffer_height,
+                     int               d)
+{
+  int i, j;
+  int n_rectangles;
+  guchar *tmp_buffer;
+
+  tmp_buffer = g_malloc (buffer_width);
+
+  n_rectangles = cairo_region_num_rectangles (convolve_region);
+  for (i = 0; i < n_rectangles; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (convolve_region, i, &rect);
+
+      for (j = y_offset + rect.y; j < y_offset + rect.y + rect.height; j++)
+	{
+	  guchar *row = buffer + j * buffer_width;
+	  int x0 = x_offset + rect.x;
+	  int x1 = x0 + rect.width;
+
+	  if (d % 2 == 1)
+	    {
+	      reference_blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
+	      reference_blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
+	      reference_blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 0);
+	    }
+	  else
+	    {
+	      reference_blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, 1);
+	      reference_blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d, -1);
+	      reference_blur_xspan (row, tmp_buffer, buffer_width, x0, x1, d + 1, 0);
+	    }
+	}
+    }
+
+  g_free (tmp_buffer);
+}
+
+/* Same formula as in meta-shadow-factory.c */
+static int
+get_box_filter_size (int radius)
+{
+  return (int)(0.5 + radius * (0.75 * sqrt(2*M_PI)));
+}
+
+/* A window-like shape: opaque rectangles with a margin around them for
+ * the blur to spread into */
+static guchar *
+make_shape (int margin)
+{
+  guchar *buffer;
+  int i, j;
+
+  buffer = g_malloc0 (BUFFER_SIZE * BUFFER_SIZE);
+
+  for (i = 0; i < 8; i++)
+    {
+      int x = margin + rand () % (BUFFER_SIZE - 2 * margin);
+      int y = margin + rand () % (BUFFER_SIZE - 2 * margin);
+      int width = 1 + rand () % (BUFFER_SIZE - margin - x);
+      int height = 1 + rand () % (BUFFER_SIZE - margin - y);
+
+      for (j = y; j < y + height; j++)
+        memset (buffer + j * BUFFER_SIZE + x, 255, width);
+    }
+
+  return buffer;
+}
+
+static void
+test_radius (int radius)
+{
+  cairo_rectangle_int_t rect = { 0, 0, BUFFER_SIZE, BUFFER_SIZE };
+  cairo_region_t *region;
+  guchar *shape, *reference, *result;
+  GTimer *timer;
+  double reference_time, new_time;
+  int d = get_box_filter_size (radius);
+  int i;
+
+  region = cairo_region_create_rectangle (&rect);
+  shape = make_shape (MIN (3 * d, BUFFER_SIZE / 4));
+  reference = g_malloc (BUFFER_SIZE * BUFFER_SIZE);
+  result = g_malloc (BUFFER_SIZE * BUFFER_SIZE);
+
+  timer = g_timer_new ();
+
+  reference_time = 0;
+  new_time = 0;
+  for (i = 0; i < N_RUNS; i++)
+    {
+      memcpy (reference, shape, BUFFER_SIZE * BUFFER_SIZE);
+      g_timer_start (timer);
+      reference_blur_rows (region, 0, 0, reference,
+                           BUFFER_SIZE, BUFFER_SIZE, d);
+      reference_time += g_timer_elapsed (timer, NULL);
+
+      memcpy (result, shape, BUFFER_SIZE * BUFFER_SIZE);
+      g_timer_start (timer);
+      meta_shadow_blur_rows (region, 0, 0, result,
+                             BUFFER_SIZE, BUFFER_SIZE, d);
+      new_time += g_timer_elapsed (timer, NULL);
+
+      if (memcmp (reference, result, BUFFER_SIZE * BUFFER_SIZE) != 0)
+        {
+          printf ("Blur output for radius %d differs from the reference\n",
+                  radius);
+          exit (1);
+        }
+    }
+
+  printf ("radius %3d (d = %3d): reference %6.2f ms, new %6.2f ms per %dx%d blur\n",
+          radius, d,
+          reference_time * 1000 / N_RUNS,
+          new_time * 1000 / N_RUNS,
+          BUFFER_SIZE, BUFFER_SIZE);
+
+  g_timer_destroy (timer);
+  g_free (result);
+  g_free (reference);
+  g_free (shape);
+  cairo_region_destroy (region);
+}
+
+int
+main (int argc, char **argv)
+{
+  int radius;
+
+  srand (42);
+
+  for (radius = 1; radius <= 64; radius *= 2)
+    {
+      test_radius (radius);
+      test_radius (radius + 1);
+    }
+
+  printf ("All blurs matched the reference.\n");
+
+  return 0;
+}
@@ -0,0 +1,364 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Stack synchronization benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Simulates what meta_compositor_sync_stack() does when a window is
+ * raised, for 50 to 1000 windows, a few of which are hidden and being
+ * animated out: merging the new stack with the old list of actors, and
+ * restacking the children of the window group to match. It is done the
+ * way it used to be, removing each window from both lists and lowering
+ * every actor to the bottom in turn, and with a single pass over both
+ * lists and only moving the actors that aren't in a longest increasing
+ * subsequence; the resulting stacks are checked to be the same, and the
+ * times and the number of actors moved compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "meta-stack-order.h"
+
+#define N_RAISES 100
+
+typedef struct
+{
+  int id;
+  gboolean hidden;
+  gboolean animating;
+} Window;
+
+/* The "actors" are the windows themselves; the children of the window
+ * group are a list, as in ClutterActor */
+
+static void
+move_child (GList  **children,
+            Window  *window,
+            Window  *below,
+            int     *n_moves)
+{
+  *children = g_list_remove (*children, window);
+
+  if (below == NULL)
+    *children = g_list_prepend (*children, window);
+  else
+    *children = g_list_insert_before (*children,
+                                      g_list_find (*children, below)->next,
+                                      window);
+  (*n_moves)++;
+}
+
+static GList *
+reference_merge (GList *windows,
+                 GList *stack)
+{
+  GList *old_stack;
+  GList *result = NULL;
+
+  stack = g_list_copy (stack);
+  old_stack = g_list_reverse (windows);
+
+  while (TRUE)
+    {
+      Window *old_window = NULL, *stack_window = NULL, *window;
+
+      while (old_stack)
+        {
+          old_window = old_stack->data;
+
+          if (old_window->hidden && !old_window->animating)
+            {
+              old_stack = g_list_delete_link (old_stack, old_stack);
+              old_window = NULL;
+            }
+          else
+            break;
+        }
+
+      if (stack)
+        stack_window = stack->data;
+
+      if (!old_window && !stack_window)
+        break;
+
+      if (old_window && (!stack_window || old_window->hidden))
+        window = old_window;
+      else
+        window = stack_window;
+
+      result = g_list_prepend (result, window);
+
+      stack = g_list_remove (stack, window);
+      old_stack = g_list_remove (old_stack, window);
+    }
+
+  return result;
+}
+
+static void
+reference_restack (GList **children,
+                   GList  *windows,
+                   int    *n_moves)
+{
+  GList *l, *expected = windows;
+  gboolean reordered = FALSE;
+
+  for (l = *children; l != NULL; l = l->next)
+    {
+      if (expected != NULL && l->data == expected->data)
+        expected = expected->next;
+      else
+        reordered = TRUE;
+    }
+
+  if (!reordered)
+    return;
+
+  for (l = g_list_last (windows); l != NULL; l = l->prev)
+    move_child (children, l->data, NULL, n_moves);
+}
+
+static GList *
+new_merge (GList *windows,
+           GList *stack)
+{
+  GList *old_stack, *old_node, *stack_node;
+  GHashTable *stacked;
+  GList *result = NULL;
+
+  stack_node = stack;
+  old_stack = g_list_reverse (windows);
+  old_node = old_stack;
+  stacked = g_hash_table_new (NULL, NULL);
+
+  while (TRUE)
+    {
+      Window *old_window = NULL, *stack_window = NULL, *window;
+
+      while (old_node)
+        {
+          old_window = old_node->data;
+
+          if (g_hash_table_lookup (stacked, old_window) ||
+              (old_window->hidden && !old_window->animating))
+            {
+              old_node = old_node->next;
+              old_window = NULL;
+            }
+          else
+            break;
+        }
+
+      while (stack_node)
+        {
+          stack_window = stack_node->data;
+
+          if (g_hash_table_lookup (stacked, stack_window))
+            {
+              stack_node = stack_node->next;
+              stack_window = NULL;
+            }
+          else
+            break;
+        }
+
+      if (!old_window && !stack_window)
+        break;
+
+      if (old_window && (!stack_window || old_window->hidden))
+        window = old_window;
+      else
+        window = stack_window;
+
+      result = g_list_prepend (result, window);
+      g_hash_table_insert (stacked, window, window);
+    }
+
+  g_hash_table_destroy (stacked);
+  g_list_free (old_stack);
+
+  return result;
+}
+
+static void
+new_restack (GList **children,
+             GList  *windows,
+             int    *n_moves)
+{
+  GHashTable *window_positions;
+  Window **by_position;
+  int *positions;
+  gboolean *kept, *kept_by_position;
+  int n_windows = 0, n_actors = 0;
+  GList *l;
+  int i;
+
+  window_positions = g_hash_table_new (NULL, NULL);
+  for (l = windows; l != NULL; l = l->next)
+    g_hash_table_insert (window_positions, l->data, GINT_TO_POINTER (n_windows++));
+
+  positions = g_new (int, n_windows);
+  kept = g_new (gboolean, n_windows);
+  by_position = g_new (Window *, n_windows);
+
+  for (l = *children; l != NULL; l = l->next)
+    {
+      gpointer position;
+
+      if (!g_hash_table_lookup_extended (window_positions, l->data, NULL, &position))
+        continue;
+
+      positions[n_actors] = GPOINTER_TO_INT (position);
+      by_position[positions[n_actors]] = l->data;
+      n_actors++;
+    }
+
+  if (meta_stack_order_find_kept (positions, n_actors, kept) < n_actors)
+    {
+      kept_by_position = g_new (gboolean, n_actors);
+      for (i = 0; i < n_actors; i++)
+        kept_by_position[positions[i]] = kept[i];
+
+      for (i = 0; i < n_actors; i++)
+        {
+          if (!kept_by_position[i])
+            move_child (children, by_position[i],
+                        i > 0 ? by_position[i - 1] : NULL, n_moves);
+        }
+
+      g_free (kept_by_position);
+    }
+
+  g_hash_table_destroy (window_positions);
+  g_free (positions);
+  g_free (kept);
+  g_free (by_position);
+}
+
+static gboolean
+lists_equal (GList *a,
+             GList *b)
+{
+  for (; a && b; a = a->next, b = b->next)
+    if (a->data != b->data)
+      return FALSE;
+
+  return a == NULL && b == NULL;
+}
+
+static void
+run (int n_windows)
+{
+  Window *all_windows;
+  GList *stack = NULL;
+  GList *reference_windows = NULL, *new_windows = NULL;
+  GList *reference_children, *new_children;
+  GTimer *timer;
+  double reference_time = 0, new_time = 0;
+  int reference_moves = 0, new_moves = 0;
+  int i;
+
+  all_windows = g_new0 (Window, n_windows);
+  for (i = 0; i < n_windows; i++)
+    {
+      all_windows[i].id = i;
+      /* A few windows are minimized, and a few of those still animating */
+      all_windows[i].hidden = (i % 10 == 3);
+      all_windows[i].animating = (i % 30 == 3);
+    }
+
+  /* Bottom to top, as info->windows is */
+  for (i = 0; i < n_windows; i++)
+    reference_windows = g_list_append (reference_windows, &all_windows[i]);
+  new_windows = g_list_copy (reference_windows);
+  reference_children = g_list_copy (reference_windows);
+  new_children = g_list_copy (reference_windows);
+
+  /* The MetaWindow stack: top first, hidden windows at the bottom */
+  for (i = 0; i < n_windows; i++)
+    if (!all_windows[i].hidden)
+      stack = g_list_prepend (stack, &all_windows[i]);
+  for (i = 0; i < n_windows; i++)
+    if (all_windows[i].hidden)
+      stack = g_list_append (stack, &all_windows[i]);
+
+  srand (n_windows);
+  timer = g_timer_new ();
+
+  for (i = 0; i < N_RAISES; i++)
+    {
+      GList *raised;
+
+      /* Raise a random visible window to the top */
+      do
+        raised = g_list_nth (stack, rand () % n_windows);
+      while (((Window *) raised->data)->hidden);
+      stack = g_list_remove_link (stack, raised);
+      stack = g_list_concat (raised, stack);
+
+      g_timer_start (timer);
+      reference_windows = reference_merge (reference_windows, stack);
+      reference_restack (&reference_children, reference_windows, &reference_moves);
+      reference_time += g_timer_elapsed (timer, NULL);
+
+      g_timer_start (timer);
+      new_windows = new_merge (new_windows, stack);
+      new_restack (&new_children, new_windows, &new_moves);
+      new_time += g_timer_elapsed (timer, NULL);
+    }
+
+  if (!lists_equal (reference_windows, new_windows))
+    {
+      printf ("%d windows: window lists differ from the reference\n", n_windows);
+      exit (1);
+    }
+
+  if (!lists_equal (reference_children, new_children))
+    {
+      printf ("%d windows: stacking differs from the reference\n", n_windows);
+      exit (1);
+    }
+
+  printf ("%4d windows: reference %.3f ms, %d moves; new %.3f ms, %d moves per raise\n",
+          n_windows,
+          reference_time * 1000 / N_RAISES, reference_moves / N_RAISES,
+          new_time * 1000 / N_RAISES, new_moves / N_RAISES);
+
+  g_list_free (stack);
+  g_list_free (reference_windows);
+  g_list_free (new_windows);
+  g_list_free (reference_children);
+  g_list_free (new_children);
+  g_timer_destroy (timer);
+  g_free (all_windows);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int sizes[] = { 50, 100, 200, 500, 1000 };
+  int i;
+
+  for (i = 0; i < (int) G_N_ELEMENTS (sizes); i++)
+    run (sizes[i]);
+
+  printf ("All stacks matched the reference.\n");
+
+  return 0;
+}
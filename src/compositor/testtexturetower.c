@@ -0,0 +1,273 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Texture tower revalidation test and benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Measures the cost of revalidating each level of a tower on the CPU,
+ * which is what happens when we can't render into the tower textures.
+ * The old way read back the whole source level and scaled the invalid
+ * area with scalar code; now only the part of the source level under the
+ * invalid area is read back and scaled with meta_texture_tower_scale_down().
+ * Reading back is modeled by copying out of the source level in memory,
+ * so this doesn't need a GL context; the GPU path isn't measured.
+ *
+ * The output of both is checked to be identical, for a full update of
+ * every level and for a small damaged area.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meta-texture-tower.h"
+
+#define BASE_WIDTH 1920
+#define BASE_HEIGHT 1200
+#define DAMAGE_SIZE 64
+#define N_RUNS 10
+
+typedef struct
+{
+  int width;
+  int height;
+  guchar *data;
+} Level;
+
+static void
+reference_fill_scale_down (guchar       *buf,
+                           const guchar *source,
+                           int           width)
+{
+  while (width > 1)
+    {
+      buf[0] = (source[0] + source[4]) / 2;
+      buf[1] = (source[1] + source[5]) / 2;
+      buf[2] = (source[2] + source[6]) / 2;
+      buf[3] = (source[3] + source[7]) / 2;
+
+      buf += 4;
+      source += 8;
+      width -= 2;
+    }
+
+  if (width > 0)
+    {
+      buf[0] = source[0] / 2;
+      buf[1] = source[1] / 2;
+      buf[2] = source[2] / 2;
+      buf[3] = source[3] / 2;
+    }
+}
+
+/* The old texture_tower_revalidate_client(), reading back the whole
+ * source level */
+static void
+reference_revalidate (const Level *source,
+                      Level       *dest,
+                      int          dest_x,
+                      int          dest_y,
+                      int          dest_width,
+                      int          dest_height)
+{
+  int source_rowstride = source->width * 4;
+  guchar *source_data;
+  guchar *dest_data;
+  guchar *source_tmp1, *source_tmp2;
+  int i, j;
+
+  source_data = g_malloc (source->height * source_rowstride);
+  memcpy (source_data, source->data, source->height * source_rowstride);
+
+  dest_data = g_malloc (dest_height * dest_width * 4);
+  source_tmp1 = g_malloc (dest_width * 4);
+  source_tmp2 = g_malloc (dest_width * 4);
+
+  for (i = 0; i < dest_height; i++)
+    {
+      guchar *dest_row = dest_data + i * dest_width * 4;
+      const guchar *source1, *source2;
+
+      reference_fill_scale_down (source_tmp1,
+                                 source_data + ((i + dest_y) * 2) * source_rowstride + dest_x * 2 * 4,
+                                 dest_width * 2);
+      reference_fill_scale_down (source_tmp2,
+                                 source_data + ((i + dest_y) * 2 + 1) * source_rowstride + dest_x * 2 * 4,
+                                 dest_width * 2);
+
+      source1 = source_tmp1;
+      source2 = source_tmp2;
+      for (j = 0; j < dest_width * 4; j++)
+        dest_row[j] = (source1[j] + source2[j]) / 2;
+    }
+
+  for (i = 0; i < dest_height; i++)
+    memcpy (dest->data + ((dest_y + i) * dest->width + dest_x) * 4,
+            dest_data + i * dest_width * 4,
+            dest_width * 4);
+
+  g_free (source_tmp1);
+  g_free (source_tmp2);
+  g_free (source_data);
+  g_free (dest_data);
+}
+
+/* What texture_tower_revalidate_client() does now */
+static void
+new_revalidate (const Level *source,
+                Level       *dest,
+                int          dest_x,
+                int          dest_y,
+                int          dest_width,
+                int          dest_height)
+{
+  int source_rowstride = dest_width * 2 * 4;
+  guchar *source_data;
+  guchar *dest_data;
+  int i;
+
+  source_data = g_malloc (dest_height * 2 * source_rowstride);
+  for (i = 0; i < dest_height * 2; i++)
+    memcpy (source_data + i * source_rowstride,
+            source->data + ((dest_y * 2 + i) * source->width + dest_x * 2) * 4,
+            source_rowstride);
+
+  dest_data = g_malloc (dest_height * dest_width * 4);
+
+  meta_texture_tower_scale_down (dest_data, dest_width * 4,
+                                 source_data, source_rowstride,
+                                 dest_width, dest_height,
+                                 TRUE, TRUE);
+
+  for (i = 0; i < dest_height; i++)
+    memcpy (dest->data + ((dest_y + i) * dest->width + dest_x) * 4,
+            dest_data + i * dest_width * 4,
+            dest_width * 4);
+
+  g_free (source_data);
+  g_free (dest_data);
+}
+
+static Level *
+make_levels (int *n_levels)
+{
+  Level *levels;
+  int width = BASE_WIDTH, height = BASE_HEIGHT;
+  int i, j;
+
+  levels = g_new0 (Level, 12);
+
+  for (i = 0; width > 1 && height > 1; i++)
+    {
+      levels[i].width = width;
+      levels[i].height = height;
+      levels[i].data = g_malloc0 (width * height * 4);
+
+      if (i == 0)
+        for (j = 0; j < width * height * 4; j++)
+          levels[i].data[j] = rand ();
+
+      width /= 2;
+      height /= 2;
+    }
+
+  *n_levels = i;
+
+  return levels;
+}
+
+static void
+run_benchmark (const char *name,
+               int         x,
+               int         y,
+               int         width,
+               int         height)
+{
+  Level *reference, *result;
+  GTimer *timer;
+  int n_levels, level, run;
+
+  srand (42);
+  reference = make_levels (&n_levels);
+  srand (42);
+  result = make_levels (&n_levels);
+
+  timer = g_timer_new ();
+
+  printf ("%s (%dx%d at %d,%d):\n", name, width, height, x, y);
+
+  for (level = 1; level < n_levels; level++)
+    {
+      double reference_time = 0, new_time = 0;
+      int x1 = x / 2;
+      int y1 = y / 2;
+      int x2 = MIN (reference[level].width, (x + width + 1) / 2);
+      int y2 = MIN (reference[level].height, (y + height + 1) / 2);
+
+      for (run = 0; run < N_RUNS; run++)
+        {
+          g_timer_start (timer);
+          reference_revalidate (&reference[level - 1], &reference[level],
+                                x1, y1, x2 - x1, y2 - y1);
+          reference_time += g_timer_elapsed (timer, NULL);
+
+          g_timer_start (timer);
+          new_revalidate (&result[level - 1], &result[level],
+                          x1, y1, x2 - x1, y2 - y1);
+          new_time += g_timer_elapsed (timer, NULL);
+        }
+
+      if (memcmp (reference[level].data, result[level].data,
+                  reference[level].width * reference[level].height * 4) != 0)
+        {
+          printf ("Level %d differs from the reference\n", level);
+          exit (1);
+        }
+
+      printf ("  level %2d (%4dx%4d): reference %8.3f ms, new %8.3f ms\n",
+              level, reference[level].width, reference[level].height,
+              reference_time * 1000 / N_RUNS,
+              new_time * 1000 / N_RUNS);
+
+      x = x1;
+      y = y1;
+      width = x2 - x1;
+      height = y2 - y1;
+    }
+
+  g_timer_destroy (timer);
+
+  for (level = 0; level < n_levels; level++)
+    {
+      g_free (reference[level].data);
+      g_free (result[level].data);
+    }
+  g_free (reference);
+  g_free (result);
+}
+
+int
+main (int argc, char **argv)
+{
+  run_benchmark ("Full update", 0, 0, BASE_WIDTH, BASE_HEIGHT);
+  run_benchmark ("Damaged area", 301, 517, DAMAGE_SIZE, DAMAGE_SIZE);
+
+  printf ("All levels matched the reference.\n");
+
+  return 0;
+}
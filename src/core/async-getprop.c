@@ -29,6 +29,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
 #undef DEBUG_SPEW
 #ifdef DEBUG_SPEW
@@ -46,10 +47,12 @@
 
 typedef struct _ListNode ListNode;
 typedef struct _AgPerDisplayData AgPerDisplayData;
+typedef struct _AgPendingSlot AgPendingSlot;
 
 struct _ListNode
 {
   ListNode *next;
+  ListNode *prev;
 };
 
 struct _AgGetPropertyTask
@@ -73,14 +76,30 @@ struct _AgGetPropertyTask
   Bool have_reply;
 };
 
+struct _AgPendingSlot
+{
+  unsigned long request_seq;
+  AgGetPropertyTask *task; /* NULL once the reply is in */
+};
+
 struct _AgPerDisplayData
 {
   ListNode node;
   _XAsyncHandler async;
   
   Display *display;
-  ListNode *pending_tasks;
-  ListNode *pending_tasks_tail;
+
+  /* The pending tasks in the order of their requests, so by increasing
+   * request sequence, in a ring buffer of pending_size slots.  Slots
+   * are only dropped from the start, so a task that gets its reply
+   * before the ones sent earlier leaves an empty slot behind until
+   * those get theirs.
+   */
+  AgPendingSlot *pending;
+  int pending_size;
+  int pending_start;
+  int n_pending_slots;
+
   ListNode *completed_tasks;
   ListNode *completed_tasks_tail;
   int n_tasks_pending;
@@ -90,12 +109,20 @@ struct _AgPerDisplayData
 static ListNode *display_datas = NULL;
 static ListNode *display_datas_tail = NULL;
 
+/* Freed tasks, kept for reuse since many are created at once */
+#define MAX_FREE_TASKS 256
+static ListNode *free_tasks = NULL;
+static int n_free_tasks = 0;
+
+#define INITIAL_PENDING_SIZE 64
+
 static void
 append_to_list (ListNode **head,
                 ListNode **tail,
                 ListNode  *task)
 {
   task->next = NULL;
+  task->prev = *tail;
   
   if (*tail == NULL)
     {
@@ -115,43 +142,82 @@ remove_from_list (ListNode **head,
                   ListNode **tail,
                   ListNode  *task)
 {
-  ListNode *prev;
-  ListNode *node;
+  /* can't remove what's not there */
+  assert (task->prev != NULL || *head == task);
+  assert (task->next != NULL || *tail == task);
 
-  prev = NULL;
-  node = *head;
-  while (node != NULL)
+  if (task->prev)
+    task->prev->next = task->next;
+  else
+    *head = task->next;
+
+  if (task->next)
+    task->next->prev = task->prev;
+  else
+    *tail = task->prev;
+
+  task->next = NULL;
+  task->prev = NULL;
+}
+
+static AgPendingSlot*
+get_pending_slot (AgPerDisplayData *dd,
+                  int               i)
+{
+  return &dd->pending[(dd->pending_start + i) & (dd->pending_size - 1)];
+}
+
+static Bool
+append_to_pending (AgPerDisplayData  *dd,
+                   AgGetPropertyTask *task)
+{
+  AgPendingSlot *slot;
+
+  if (dd->n_pending_slots == dd->pending_size)
     {
-      if (node == task)
-        {
-          if (prev)
-            prev->next = node->next;
-          else
-            *head = node->next;
-
-          if (node == *tail)
-            *tail = prev;
-          
-          break;
-        }
-      
-      prev = node;
-      node = node->next;
+      AgPendingSlot *pending;
+      int size;
+      int i;
+
+      size = dd->pending_size ? dd->pending_size * 2 : INITIAL_PENDING_SIZE;
+      pending = Xmalloc (size * sizeof (AgPendingSlot));
+      if (pending == NULL)
+        return False;
+
+      for (i = 0; i < dd->n_pending_slots; i++)
+        pending[i] = *get_pending_slot (dd, i);
+
+      if (dd->pending)
+        XFree (dd->pending);
+      dd->pending = pending;
+      dd->pending_size = size;
+      dd->pending_start = 0;
     }
 
-  /* can't remove what's not there */
-  assert (node != NULL);
+  slot = get_pending_slot (dd, dd->n_pending_slots);
+  slot->request_seq = task->request_seq;
+  slot->task = task;
 
-  node->next = NULL;
+  dd->n_pending_slots += 1;
+  dd->n_tasks_pending += 1;
+
+  return True;
 }
 
 static void
 move_to_completed (AgPerDisplayData  *dd,
-                   AgGetPropertyTask *task)
+                   AgPendingSlot     *slot)
 {
-  remove_from_list (&dd->pending_tasks,
-                    &dd->pending_tasks_tail,
-                    &task->node);
+  AgGetPropertyTask *task = slot->task;
+
+  slot->task = NULL;
+
+  while (dd->n_pending_slots > 0 &&
+         get_pending_slot (dd, 0)->task == NULL)
+    {
+      dd->pending_start = (dd->pending_start + 1) & (dd->pending_size - 1);
+      dd->n_pending_slots -= 1;
+    }
   
   append_to_list (&dd->completed_tasks,
                   &dd->completed_tasks_tail,
@@ -161,47 +227,73 @@ move_to_completed (AgPerDisplayData  *dd,
   dd->n_tasks_completed += 1;
 }
 
-static AgGetPropertyTask*
+static AgPendingSlot*
 find_pending_by_request_sequence (AgPerDisplayData *dd,
                                   unsigned long     request_seq)
 {
-  ListNode *node;
+  AgPendingSlot *slot;
+  int lo, hi;
 
-  /* if the sequence is after our last pending task, we
-   * aren't going to find a match
-   */
-  {
-    AgGetPropertyTask *task = (AgGetPropertyTask*) dd->pending_tasks_tail;
-    if (task != NULL)
-      {
-        if (task->request_seq < request_seq)
-          return NULL;
-        else if (task->request_seq == request_seq)
-          return task; /* why not check this */
-      }
-  }
-
-  /* Generally we should get replies in the order we sent
-   * requests, so we should usually be using the task
-   * at the head of the list, if we use any task at all.
-   * I'm not sure this is 100% guaranteed, if it is,
-   * it would be a big speedup.
+  if (dd->n_pending_slots == 0)
+    return NULL;
+
+  /* We get replies in the order we sent requests, so we should
+   * usually be using the first slot, if we use any at all.
    */
-  
-  node = dd->pending_tasks;
-  while (node != NULL)
+  slot = get_pending_slot (dd, 0);
+  if (slot->request_seq == request_seq)
+    return slot;
+
+  /* Otherwise the slots are sorted by request sequence */
+  lo = 1;
+  hi = dd->n_pending_slots;
+  while (lo < hi)
     {
-      AgGetPropertyTask *task = (AgGetPropertyTask*) node;
-      
-      if (task->request_seq == request_seq)
-        return task;
-      
-      node = node->next;
+      int mid = lo + (hi - lo) / 2;
+
+      slot = get_pending_slot (dd, mid);
+      if (slot->request_seq < request_seq)
+        lo = mid + 1;
+      else if (slot->request_seq > request_seq)
+        hi = mid;
+      else
+        return slot->task != NULL ? slot : NULL;
     }
   
   return NULL;
 }
 
+static AgGetPropertyTask*
+alloc_task (void)
+{
+  AgGetPropertyTask *task;
+
+  if (free_tasks == NULL)
+    return Xcalloc (1, sizeof (AgGetPropertyTask));
+
+  task = (AgGetPropertyTask*) free_tasks;
+  free_tasks = free_tasks->next;
+  n_free_tasks -= 1;
+
+  memset (task, 0, sizeof (AgGetPropertyTask));
+
+  return task;
+}
+
+static void
+release_task (AgGetPropertyTask *task)
+{
+  if (n_free_tasks >= MAX_FREE_TASKS)
+    {
+      XFree (task);
+      return;
+    }
+
+  task->node.next = free_tasks;
+  free_tasks = &task->node;
+  n_free_tasks += 1;
+}
+
 static Bool
 async_get_property_handler (Display *dpy,
                             xReply  *rep,
@@ -212,6 +304,7 @@ async_get_property_handler (Display *dpy,
   xGetPropertyReply  replbuf;
   xGetPropertyReply *reply;
   AgGetPropertyTask *task;
+  AgPendingSlot *slot;
   AgPerDisplayData *dd;
   int bytes_read;
 
@@ -222,15 +315,16 @@ async_get_property_handler (Display *dpy,
           dpy->last_request_read, len);
 #endif
   
-  task = find_pending_by_request_sequence (dd, dpy->last_request_read);
+  slot = find_pending_by_request_sequence (dd, dpy->last_request_read);
 
-  if (task == NULL)
+  if (slot == NULL)
     return False;
 
+  task = slot->task;
   assert (dpy->last_request_read == task->request_seq);
 
   task->have_reply = True;
-  move_to_completed (dd, task);
+  move_to_completed (dd, slot);
   
   /* read bytes so far */
   bytes_read = SIZEOF (xReply);
@@ -503,12 +597,14 @@ get_display_data (Display *display,
 static void
 maybe_free_display_data (AgPerDisplayData *dd)
 {
-  if (dd->pending_tasks == NULL &&
+  if (dd->n_tasks_pending == 0 &&
       dd->completed_tasks == NULL)
     {
       DeqAsyncHandler (dd->display, &dd->async);
       remove_from_list (&display_datas, &display_datas_tail,
                         &dd->node);
+      if (dd->pending)
+        XFree (dd->pending);
       XFree (dd);
     }
 }
@@ -545,7 +641,7 @@ ag_task_create (Display *dpy,
   req->longLength = length;
 
   /* Queue up our async task */
-  task = Xcalloc (1, sizeof (AgGetPropertyTask));
+  task = alloc_task ();
   if (task == NULL)
     {
       UnlockDisplay (dpy);
@@ -557,10 +653,12 @@ ag_task_create (Display *dpy,
   task->property = property;
   task->request_seq = dpy->request;
 
-  append_to_list (&dd->pending_tasks,
-                  &dd->pending_tasks_tail,
-                  &task->node);
-  dd->n_tasks_pending += 1;
+  if (!append_to_pending (dd, task))
+    {
+      release_task (task);
+      UnlockDisplay (dpy);
+      return NULL;
+    }
   
   UnlockDisplay (dpy);
 
@@ -577,7 +675,7 @@ free_task (AgGetPropertyTask *task)
                     &task->node);
   task->dd->n_tasks_completed -= 1;
   maybe_free_display_data (task->dd);
-  XFree (task);
+  release_task (task);
 }
 
 Status
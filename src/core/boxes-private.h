@@ -204,6 +204,15 @@ GList* meta_rectangle_remove_intersections_with_boxes_from_edges (
                                            GList *edges,
                                            const GSList *rectangles);
 
+/* Finds the parts of the edges of the given windows, listed from bottom
+ * to top, that are within clip and not obscured by windows above them.
+ * Only windows with has_edges set get edges.
+ */
+GList* meta_rectangle_find_window_edges (const MetaRectangle *rects,
+                                         const gboolean      *has_edges,
+                                         int                  n_rects,
+                                         const MetaRectangle *clip);
+
 /* Finds all the edges of an onscreen region, returning a GList* of
  * MetaEdgeRect's.
  */
@@ -29,6 +29,7 @@
 #include "boxes-private.h"
 #include <meta/util.h>
 #include <X11/Xutil.h>  /* Just for the definition of the various gravities */
+#include <stdlib.h>
 
 /* It would make sense to use GSlice here, but until we clean up the
  * rest of this file and the internal API to use these functions, we
@@ -421,15 +422,10 @@ meta_rectangle_resize_with_gravity (const MetaRectangle *old_rect,
   rect->height = new_height;
 }
 
-/* Not so simple helper function for get_minimal_spanning_set_for_region() */
+/* Not so simple helper function for get_spanning_set_by_splitting() */
 static GList*
 merge_spanning_rects_in_region (GList *region)
 {
-  /* NOTE FOR ANY OPTIMIZATION PEOPLE OUT THERE: Please see the
-   * documentation of get_minimal_spanning_set_for_region() for performance
-   * considerations that also apply to this function.
-   */
-
   GList* compare;
   compare = region;
 
@@ -544,67 +540,15 @@ compare_rect_areas (gconstpointer a, gconstpointer b)
   return b_area - a_area; /* positive ret value denotes b > a, ... */
 }
 
-/**
- * meta_rectangle_get_minimal_spanning_set_for_region:
- * @basic_rect: Input rectangle
- * @all_struts: (element-type Meta.Rectangle): List of struts
- *
- * This function is trying to find a "minimal spanning set (of rectangles)"
- * for a given region.
- *
- * The region is given by taking basic_rect, then removing the areas
- * covered by all the rectangles in the all_struts list, and then expanding
- * the resulting region by the given number of pixels in each direction.
- *
- * A "minimal spanning set (of rectangles)" is the best name I could come
- * up with for the concept I had in mind.  Basically, for a given region, I
- * want a set of rectangles with the property that a window is contained in
- * the region if and only if it is contained within at least one of the
- * rectangles.
- *
- * Returns: (transfer full) (element-type Meta.Rectangle): Minimal spanning set
+/* Helper function for get_minimal_spanning_set_for_region() splitting
+ * basic_rect by each strut and merging the resulting rectangles.  This is
+ * O(n^2) in the number of rectangles generated by the splitting, which
+ * grows quickly with the number of partial struts.
  */
-GList*
-meta_rectangle_get_minimal_spanning_set_for_region (
-  const MetaRectangle *basic_rect,
-  const GSList  *all_struts)
+static GList*
+get_spanning_set_by_splitting (const MetaRectangle *basic_rect,
+                               const GSList        *all_struts)
 {
-  /* NOTE FOR OPTIMIZERS: This function *might* be somewhat slow,
-   * especially due to the call to merge_spanning_rects_in_region() (which
-   * is O(n^2) where n is the size of the list generated in this function).
-   * This is made more onerous due to the fact that it involves a fair
-   * number of memory allocation and deallocation calls.  However, n is 1
-   * for default installations of Gnome (because partial struts aren't used
-   * by default and only partial struts increase the size of the spanning
-   * set generated).  With one partial strut, n will be 2 or 3.  With 2
-   * partial struts, n will probably be 4 or 5.  So, n probably isn't large
-   * enough to make this worth bothering.  Further, it is only called from
-   * workspace.c:ensure_work_areas_validated (at least as of the time of
-   * writing this comment), which in turn should only be called if the
-   * strut list changes or the screen or monitor size changes.  If it ever
-   * does show up on profiles (most likely because people start using
-   * ridiculously huge numbers of partial struts), possible optimizations
-   * include:
-   *
-   * (1) rewrite merge_spanning_rects_in_region() to be O(n) or O(nlogn).
-   *     I'm not totally sure it's possible, but with a couple copies of
-   *     the list and sorting them appropriately, I believe it might be.
-   * (2) only call merge_spanning_rects_in_region() with a subset of the
-   *     full list of rectangles.  I believe from some of my preliminary
-   *     debugging and thinking about it that it is possible to figure out
-   *     apriori groups of rectangles which are only merge candidates with
-   *     each other.  (See testboxes.c:get_screen_region() when which==2
-   *     and track the steps of this function carefully to see what gave
-   *     me the hint that this might work)
-   * (3) figure out how to avoid merge_spanning_rects_in_region().  I think
-   *     it might be possible to modify this function to make that
-   *     possible, and I spent just a little while thinking about it, but n
-   *     wasn't large enough to convince me to care yet.
-   * (4) Some of the stuff Rob mentioned at http://mail.gnome.org/archives\
-   *     /metacity-devel-list/2005-November/msg00028.html.  (Sorry for the
-   *     URL splitting.)
-   */
-
   GList         *ret;
   GList         *tmp_list;
   const GSList  *strut_iter;
@@ -694,6 +638,270 @@ meta_rectangle_get_minimal_spanning_set_for_region (
   return ret;
 }
 
+static int
+compare_ints (const void *a, const void *b)
+{
+  int a_int = *(const int *) a;
+  int b_int = *(const int *) b;
+
+  return (a_int > b_int) - (a_int < b_int);
+}
+
+/* Sorts coords and drops the duplicates; returns how many are left */
+static int
+sort_unique_coords (int *coords,
+                    int  n_coords)
+{
+  int i, n;
+
+  qsort (coords, n_coords, sizeof (int), compare_ints);
+
+  for (i = 1, n = 1; i < n_coords; i++)
+    if (coords[i] != coords[n - 1])
+      coords[n++] = coords[i];
+
+  return n;
+}
+
+static int
+find_coord (const int *coords,
+            int        n_coords,
+            int        coord)
+{
+  const int *found;
+
+  found = bsearch (&coord, coords, n_coords, sizeof (int), compare_ints);
+
+  return found - coords;
+}
+
+/* Helper function for get_minimal_spanning_set_for_region() finding the
+ * maximal rectangles in basic_rect that don't overlap any of the struts
+ * directly, instead of splitting and merging rectangles.
+ *
+ * The sides of the struts divide basic_rect into a grid of cells, each
+ * of which is either entirely covered by struts or not covered at all,
+ * and every maximal rectangle is made of whole cells.  The rows of the
+ * grid are swept from top to bottom, keeping the number of free cells
+ * above and including the current row in each column.  A stack of those
+ * heights then gives, in one pass over the row, every rectangle ending
+ * in the row that can't be extended up, left or right; the ones that
+ * can't be extended down either are the maximal ones.
+ *
+ * This is linear in the number of cells, which is quadratic in the number
+ * of struts at worst, as can be the number of maximal rectangles.  Only
+ * works for struts with a positive width and height.
+ */
+static GList*
+get_spanning_set_by_sweeping (const MetaRectangle *basic_rect,
+                              const GSList        *all_struts)
+{
+  const GSList  *strut_iter;
+  MetaRectangle *struts;
+  int           *xs, *ys;
+  int            n_struts, n_cols, n_rows;
+  /* The number of struts covering each cell (after summing up), and the
+   * number of covered cells to the left of each cell in its row
+   */
+  int           *covered;
+  int           *covered_before;
+  int           *heights;
+  int           *stack_starts, *stack_heights;
+  GList         *ret;
+  int            row, col, i;
+
+#define CELL(array, row, col) ((array)[(row) * (n_cols + 1) + (col)])
+
+  /*
+   * 1st: Find the grid
+   */
+  n_struts = g_slist_length ((GSList *) all_struts);
+  struts = g_new (MetaRectangle, n_struts);
+  xs = g_new (int, 2 * n_struts + 2);
+  ys = g_new (int, 2 * n_struts + 2);
+
+  xs[0] = BOX_LEFT (*basic_rect);
+  xs[1] = BOX_RIGHT (*basic_rect);
+  ys[0] = BOX_TOP (*basic_rect);
+  ys[1] = BOX_BOTTOM (*basic_rect);
+  n_cols = n_rows = 2;
+
+  for (strut_iter = all_struts, i = 0; strut_iter; strut_iter = strut_iter->next)
+    {
+      MetaRectangle *strut_rect = &((MetaStrut*)strut_iter->data)->rect;
+
+      if (meta_rectangle_intersect (strut_rect, basic_rect, &struts[i]))
+        {
+          xs[n_cols++] = BOX_LEFT (struts[i]);
+          xs[n_cols++] = BOX_RIGHT (struts[i]);
+          ys[n_rows++] = BOX_TOP (struts[i]);
+          ys[n_rows++] = BOX_BOTTOM (struts[i]);
+          i++;
+        }
+    }
+  n_struts = i;
+
+  n_cols = sort_unique_coords (xs, n_cols) - 1;
+  n_rows = sort_unique_coords (ys, n_rows) - 1;
+
+  /*
+   * 2nd: Find the cells covered by struts
+   */
+  covered = g_new0 (int, (n_rows + 1) * (n_cols + 1));
+  for (i = 0; i < n_struts; i++)
+    {
+      int left   = find_coord (xs, n_cols + 1, BOX_LEFT (struts[i]));
+      int right  = find_coord (xs, n_cols + 1, BOX_RIGHT (struts[i]));
+      int top    = find_coord (ys, n_rows + 1, BOX_TOP (struts[i]));
+      int bottom = find_coord (ys, n_rows + 1, BOX_BOTTOM (struts[i]));
+
+      CELL (covered, top, left)++;
+      CELL (covered, top, right)--;
+      CELL (covered, bottom, left)--;
+      CELL (covered, bottom, right)++;
+    }
+
+  covered_before = g_new (int, n_rows * (n_cols + 1));
+  for (row = 0; row < n_rows; row++)
+    {
+      CELL (covered_before, row, 0) = 0;
+      for (col = 0; col < n_cols; col++)
+        {
+          if (row > 0)
+            CELL (covered, row, col) += CELL (covered, row - 1, col);
+          if (col > 0)
+            CELL (covered, row, col) += CELL (covered, row, col - 1);
+          if (row > 0 && col > 0)
+            CELL (covered, row, col) -= CELL (covered, row - 1, col - 1);
+
+          CELL (covered_before, row, col + 1) =
+            CELL (covered_before, row, col) + (CELL (covered, row, col) > 0);
+        }
+    }
+
+  /*
+   * 3rd: Sweep over the rows to find the maximal rectangles
+   */
+  heights = g_new0 (int, n_cols + 1);
+  stack_starts = g_new (int, n_cols + 1);
+  stack_heights = g_new (int, n_cols + 1);
+  ret = NULL;
+
+  for (row = 0; row < n_rows; row++)
+    {
+      int n_stack = 0;
+
+      for (col = 0; col <= n_cols; col++)
+        {
+          int start = col;
+
+          /* The column after the last one is never free */
+          if (col < n_cols && CELL (covered, row, col) == 0)
+            heights[col]++;
+          else
+            heights[col] = 0;
+
+          /* The rectangles as high as the columns on the stack that are
+           * higher than this one end at this column
+           */
+          while (n_stack > 0 && stack_heights[n_stack - 1] > heights[col])
+            {
+              int top;
+
+              n_stack--;
+              start = stack_starts[n_stack];
+              top = row + 1 - stack_heights[n_stack];
+
+              if (row + 1 == n_rows ||
+                  CELL (covered_before, row + 1, col) !=
+                  CELL (covered_before, row + 1, start))
+                {
+                  MetaRectangle *rect = g_new (MetaRectangle, 1);
+
+                  rect->x = xs[start];
+                  rect->y = ys[top];
+                  rect->width = xs[col] - xs[start];
+                  rect->height = ys[row + 1] - ys[top];
+                  ret = g_list_prepend (ret, rect);
+                }
+            }
+
+          if (heights[col] > 0 &&
+              (n_stack == 0 || stack_heights[n_stack - 1] < heights[col]))
+            {
+              stack_starts[n_stack] = start;
+              stack_heights[n_stack] = heights[col];
+              n_stack++;
+            }
+        }
+    }
+
+#undef CELL
+
+  g_free (stack_heights);
+  g_free (stack_starts);
+  g_free (heights);
+  g_free (covered_before);
+  g_free (covered);
+  g_free (ys);
+  g_free (xs);
+  g_free (struts);
+
+  if (ret == NULL)
+    meta_warning ("Region to merge was empty!  Either you have a some "
+                  "pathological STRUT list or there's a bug somewhere!\n");
+
+  /* Sort by maximal area, just because I feel like it... */
+  return g_list_sort (g_list_reverse (ret), compare_rect_areas);
+}
+
+/**
+ * meta_rectangle_get_minimal_spanning_set_for_region:
+ * @basic_rect: Input rectangle
+ * @all_struts: (element-type Meta.Rectangle): List of struts
+ *
+ * This function is trying to find a "minimal spanning set (of rectangles)"
+ * for a given region.
+ *
+ * The region is given by taking basic_rect, then removing the areas
+ * covered by all the rectangles in the all_struts list, and then expanding
+ * the resulting region by the given number of pixels in each direction.
+ *
+ * A "minimal spanning set (of rectangles)" is the best name I could come
+ * up with for the concept I had in mind.  Basically, for a given region, I
+ * want a set of rectangles with the property that a window is contained in
+ * the region if and only if it is contained within at least one of the
+ * rectangles.  Those are the maximal rectangles of the region, largest
+ * first.
+ *
+ * Returns: (transfer full) (element-type Meta.Rectangle): Minimal spanning set
+ */
+GList*
+meta_rectangle_get_minimal_spanning_set_for_region (
+  const MetaRectangle *basic_rect,
+  const GSList  *all_struts)
+{
+  const GSList *strut_iter;
+
+  /* Struts without any area still split the rectangles they cross in
+   * get_spanning_set_by_splitting(), and the pieces don't necessarily
+   * make up the maximal rectangles of the region, so leave those (and
+   * empty regions) to it.  Nothing sane sets such struts.
+   */
+  if (basic_rect->width <= 0 || basic_rect->height <= 0)
+    return get_spanning_set_by_splitting (basic_rect, all_struts);
+
+  for (strut_iter = all_struts; strut_iter; strut_iter = strut_iter->next)
+    {
+      MetaRectangle *strut_rect = &((MetaStrut*)strut_iter->data)->rect;
+
+      if (strut_rect->width <= 0 || strut_rect->height <= 0)
+        return get_spanning_set_by_splitting (basic_rect, all_struts);
+    }
+
+  return get_spanning_set_by_sweeping (basic_rect, all_struts);
+}
+
 /**
  * meta_rectangle_expand_region: (skip)
  *
@@ -1764,6 +1972,482 @@ meta_rectangle_remove_intersections_with_boxes_from_edges (
   return edges;
 }
 
+/* The window edges of one side, for find_window_edges_for_side(), in
+ * coordinates where the edges are vertical.
+ */
+typedef struct
+{
+  int pos;
+  int start;
+  int end;
+  int stack_position;
+} SweepEdge;
+
+/* A window that obscures the edges at pos in [active_start, active_end)
+ * over [start, end), if they're below it.
+ */
+typedef struct
+{
+  int active_start;
+  int active_end;
+  int start;
+  int end;
+  int stack_position;
+  gboolean added;
+} SweepBox;
+
+/* An entry in the list of windows covering a node of a CoverTree */
+typedef struct
+{
+  int stack_position;
+  int next;
+} CoverEntry;
+
+/* A segment tree over the coordinates along the edges, with one leaf
+ * per pixel.  Each node has a list of the stack positions of the
+ * windows covering all of it and not all of its parent, highest first,
+ * and the highest stack position in its subtree.  Looking for the parts
+ * of an edge not covered by windows above it then stops at the nodes
+ * that are covered by one, or that have no window above it at all in
+ * their subtree.
+ *
+ * The leaves are nodes n_leaves to 2 * n_leaves - 1, and the children
+ * of node i are 2 * i and 2 * i + 1.  The lists are linked through
+ * entries, so that adding and removing windows doesn't allocate.
+ */
+typedef struct
+{
+  int         origin;
+  int         n_leaves;
+  int        *lists;
+  int        *subtree_max;
+  CoverEntry *entries;
+  int         free_entries;
+
+  /* The uncovered part of the edge being looked up */
+  MetaSide    side;
+  int         pos;
+  int         run_start;
+  int         run_end;
+  GList      *edges;
+} CoverTree;
+
+static MetaRectangle
+transpose_rect (const MetaRectangle *rect)
+{
+  MetaRectangle transposed;
+
+  transposed.x = rect->y;
+  transposed.y = rect->x;
+  transposed.width = rect->height;
+  transposed.height = rect->width;
+
+  return transposed;
+}
+
+static int
+compare_sweep_edges (const void *a, const void *b)
+{
+  const SweepEdge *edge_a = a;
+  const SweepEdge *edge_b = b;
+
+  return edge_a->pos - edge_b->pos;
+}
+
+static int
+compare_sweep_box_starts (const void *a, const void *b)
+{
+  const SweepBox *box_a = a;
+  const SweepBox *box_b = b;
+
+  return box_a->active_start - box_b->active_start;
+}
+
+static int
+compare_sweep_box_ends (const void *a, const void *b)
+{
+  const SweepBox * const *box_a = a;
+  const SweepBox * const *box_b = b;
+
+  return (*box_a)->active_end - (*box_b)->active_end;
+}
+
+static void
+cover_tree_init (CoverTree *tree,
+                 int        origin,
+                 int        length,
+                 int        n_boxes)
+{
+  int depth, n_entries, i;
+
+  tree->origin = origin;
+  for (tree->n_leaves = 1, depth = 1; tree->n_leaves < length; depth++)
+    tree->n_leaves *= 2;
+
+  tree->lists = g_new (int, 2 * tree->n_leaves);
+  tree->subtree_max = g_new (int, 2 * tree->n_leaves);
+  for (i = 0; i < 2 * tree->n_leaves; i++)
+    tree->lists[i] = tree->subtree_max[i] = -1;
+
+  /* A window is in at most two nodes at each depth */
+  n_entries = MAX (2 * depth * n_boxes, 1);
+  tree->entries = g_new (CoverEntry, n_entries);
+  for (i = 0; i < n_entries; i++)
+    tree->entries[i].next = i + 1;
+  tree->entries[n_entries - 1].next = -1;
+  tree->free_entries = 0;
+}
+
+static void
+cover_tree_destroy (CoverTree *tree)
+{
+  g_free (tree->lists);
+  g_free (tree->subtree_max);
+  g_free (tree->entries);
+}
+
+static void
+cover_tree_update_max (CoverTree *tree,
+                       int        node)
+{
+  int max = -1;
+
+  if (tree->lists[node] != -1)
+    max = tree->entries[tree->lists[node]].stack_position;
+
+  if (node < tree->n_leaves)
+    max = MAX (max, MAX (tree->subtree_max[2 * node],
+                         tree->subtree_max[2 * node + 1]));
+
+  tree->subtree_max[node] = max;
+}
+
+static void
+cover_tree_update_node (CoverTree *tree,
+                        int        node,
+                        int        stack_position,
+                        gboolean   add)
+{
+  int *link = &tree->lists[node];
+  int entry;
+
+  while (*link != -1 &&
+         tree->entries[*link].stack_position > stack_position)
+    link = &tree->entries[*link].next;
+
+  if (add)
+    {
+      entry = tree->free_entries;
+      tree->free_entries = tree->entries[entry].next;
+
+      tree->entries[entry].stack_position = stack_position;
+      tree->entries[entry].next = *link;
+      *link = entry;
+    }
+  else
+    {
+      entry = *link;
+      *link = tree->entries[entry].next;
+
+      tree->entries[entry].next = tree->free_entries;
+      tree->free_entries = entry;
+    }
+
+  cover_tree_update_max (tree, node);
+}
+
+/* Adds or removes a window covering the leaves from start to end */
+static void
+cover_tree_update (CoverTree *tree,
+                   int        start,
+                   int        end,
+                   int        stack_position,
+                   gboolean   add)
+{
+  int first = start + tree->n_leaves;
+  int last = end - 1 + tree->n_leaves;
+  int node;
+
+  for (start = first, end = last + 1; start < end; start /= 2, end /= 2)
+    {
+      if (start & 1)
+        cover_tree_update_node (tree, start++, stack_position, add);
+      if (end & 1)
+        cover_tree_update_node (tree, --end, stack_position, add);
+    }
+
+  /* The nodes changed are all children of the ancestors of the first
+   * and the last leaf; where their ancestors meet, the second pass
+   * sees both children updated.
+   */
+  for (node = first / 2; node > 0; node /= 2)
+    cover_tree_update_max (tree, node);
+  for (node = last / 2; node > 0; node /= 2)
+    cover_tree_update_max (tree, node);
+}
+
+static void
+cover_tree_add_run (CoverTree *tree,
+                    int        start,
+                    int        end)
+{
+  MetaEdge *edge;
+
+  start += tree->origin;
+  end += tree->origin;
+
+  if (tree->run_end == start)
+    {
+      tree->run_end = end;
+      return;
+    }
+
+  if (tree->run_start < tree->run_end)
+    {
+      edge = g_new (MetaEdge, 1);
+      edge->side_type = tree->side;
+      edge->edge_type = META_EDGE_WINDOW;
+
+      if (tree->side == META_SIDE_LEFT || tree->side == META_SIDE_RIGHT)
+        {
+          edge->rect.x = tree->pos;
+          edge->rect.width = 0;
+          edge->rect.y = tree->run_start;
+          edge->rect.height = tree->run_end - tree->run_start;
+        }
+      else
+        {
+          edge->rect.y = tree->pos;
+          edge->rect.height = 0;
+          edge->rect.x = tree->run_start;
+          edge->rect.width = tree->run_end - tree->run_start;
+        }
+
+      tree->edges = g_list_prepend (tree->edges, edge);
+    }
+
+  tree->run_start = start;
+  tree->run_end = end;
+}
+
+/* Finds the leaves from start to end under node, which is over the
+ * leaves from lo to hi, that aren't covered by any window above
+ * stack_position.
+ */
+static void
+cover_tree_find_uncovered (CoverTree *tree,
+                           int        node,
+                           int        lo,
+                           int        hi,
+                           int        start,
+                           int        end,
+                           int        stack_position)
+{
+  int mid;
+
+  if (end <= lo || hi <= start)
+    return;
+
+  if (tree->lists[node] != -1 &&
+      tree->entries[tree->lists[node]].stack_position > stack_position)
+    return;
+
+  if (tree->subtree_max[node] <= stack_position)
+    {
+      cover_tree_add_run (tree, MAX (lo, start), MIN (hi, end));
+      return;
+    }
+
+  mid = (lo + hi) / 2;
+  cover_tree_find_uncovered (tree, 2 * node, lo, mid,
+                             start, end, stack_position);
+  cover_tree_find_uncovered (tree, 2 * node + 1, mid, hi,
+                             start, end, stack_position);
+}
+
+static GList*
+find_window_edges_for_side (GList               *edges,
+                            const MetaRectangle *rects,
+                            const gboolean      *has_edges,
+                            int                  n_rects,
+                            const MetaRectangle *clip,
+                            MetaSide             side)
+{
+  /* Top and bottom edges are handled as left and right edges of the
+   * transposed rectangles.  The right and bottom sides are the ones at
+   * the origin of the windows, since they're what the right and bottom
+   * sides of the window being moved resist against.
+   */
+  gboolean transposed = side == META_SIDE_TOP || side == META_SIDE_BOTTOM;
+  gboolean at_origin = side == META_SIDE_RIGHT || side == META_SIDE_BOTTOM;
+  MetaRectangle bounds;
+  SweepEdge *sweep_edges;
+  SweepBox *boxes;
+  SweepBox **boxes_by_end;
+  CoverTree tree;
+  int n_edges, n_boxes;
+  int next_start, next_end;
+  int i;
+
+  bounds = transposed ? transpose_rect (clip) : *clip;
+
+  sweep_edges = g_new (SweepEdge, n_rects);
+  boxes = g_new (SweepBox, n_rects);
+  n_edges = n_boxes = 0;
+
+  for (i = 0; i < n_rects; i++)
+    {
+      MetaRectangle rect, reduced;
+
+      rect = transposed ? transpose_rect (&rects[i]) : rects[i];
+
+      /* We don't care about snapping to any portion of the window that
+       * is offscreen.
+       */
+      if (has_edges[i] &&
+          meta_rectangle_intersect (&rect, &bounds, &reduced))
+        {
+          SweepEdge *edge = &sweep_edges[n_edges++];
+
+          edge->pos = at_origin ? BOX_LEFT (reduced) : BOX_RIGHT (reduced);
+          edge->start = BOX_TOP (reduced) - BOX_TOP (bounds);
+          edge->end = BOX_BOTTOM (reduced) - BOX_TOP (bounds);
+          edge->stack_position = i;
+        }
+
+      /* Which edges a window obscures follows from how
+       * meta_rectangle_remove_intersections_with_boxes_from_edges()
+       * treats edges touching the sides of a box: an edge lying on the
+       * side of the window it faces away from is not obscured.  That is
+       * left < pos <= right for edges on the far side of windows, and
+       * left <= pos < right for edges at their origin, where a
+       * zero-width window still obscures the edges at its position.
+       */
+      if (rect.width >= 0)
+        {
+          SweepBox *box = &boxes[n_boxes];
+
+          if (at_origin)
+            {
+              box->active_start = BOX_LEFT (rect);
+              box->active_end = MAX (BOX_RIGHT (rect), BOX_LEFT (rect) + 1);
+            }
+          else
+            {
+              box->active_start = BOX_LEFT (rect) + 1;
+              box->active_end = BOX_RIGHT (rect) + 1;
+            }
+
+          /* Only the part alongside the edges matters */
+          box->start = MAX (BOX_TOP (rect), BOX_TOP (bounds)) - BOX_TOP (bounds);
+          box->end = MIN (BOX_BOTTOM (rect), BOX_BOTTOM (bounds)) - BOX_TOP (bounds);
+          box->stack_position = i;
+
+          if (box->active_start < box->active_end && box->start < box->end)
+            n_boxes++;
+        }
+    }
+
+  qsort (sweep_edges, n_edges, sizeof (SweepEdge), compare_sweep_edges);
+  qsort (boxes, n_boxes, sizeof (SweepBox), compare_sweep_box_starts);
+
+  boxes_by_end = g_new (SweepBox*, n_boxes);
+  for (i = 0; i < n_boxes; i++)
+    boxes_by_end[i] = &boxes[i];
+  qsort (boxes_by_end, n_boxes, sizeof (SweepBox*), compare_sweep_box_ends);
+
+  cover_tree_init (&tree, BOX_TOP (bounds), bounds.height, n_boxes);
+  tree.side = side;
+  tree.edges = edges;
+  next_start = next_end = 0;
+
+  for (i = 0; i < n_edges; i++)
+    {
+      SweepEdge *edge = &sweep_edges[i];
+
+      /* Update the windows obscuring the edges at this position; the
+       * ones in between the positions of edges are skipped entirely.
+       */
+      for (; next_start < n_boxes &&
+             boxes[next_start].active_start <= edge->pos; next_start++)
+        {
+          SweepBox *box = &boxes[next_start];
+
+          box->added = box->active_end > edge->pos;
+          if (box->added)
+            cover_tree_update (&tree, box->start, box->end,
+                               box->stack_position, TRUE);
+        }
+
+      for (; next_end < n_boxes &&
+             boxes_by_end[next_end]->active_end <= edge->pos; next_end++)
+        {
+          SweepBox *box = boxes_by_end[next_end];
+
+          if (box->added)
+            cover_tree_update (&tree, box->start, box->end,
+                               box->stack_position, FALSE);
+        }
+
+      /* And add what's left of the edge */
+      tree.pos = edge->pos;
+      tree.run_start = tree.run_end = G_MININT;
+      cover_tree_find_uncovered (&tree, 1, 0, tree.n_leaves,
+                                 edge->start, edge->end,
+                                 edge->stack_position);
+      cover_tree_add_run (&tree, G_MININT, G_MININT);
+    }
+
+  edges = tree.edges;
+
+  cover_tree_destroy (&tree);
+  g_free (boxes_by_end);
+  g_free (boxes);
+  g_free (sweep_edges);
+
+  return edges;
+}
+
+/**
+ * meta_rectangle_find_window_edges: (skip)
+ * @rects: the windows, from bottom to top of the stack
+ * @has_edges: whether each window has edges; windows without edges,
+ *   like docks, only obscure the edges of the windows below them
+ * @n_rects: the length of @rects and @has_edges
+ * @clip: the part of the windows to find edges for
+ *
+ * Finds the parts of the window edges that are within @clip and not
+ * obscured by any window above them, like
+ * meta_rectangle_remove_intersections_with_boxes_from_edges() would for
+ * the edges of each window and the windows above it. Instead of
+ * splitting each edge by every window above it, the positions of the
+ * edges are swept over, keeping the windows that obscure edges at the
+ * current position in a segment tree, so that the parts of an edge
+ * covered by some window above it are skipped in one step.
+ *
+ * Return value: a list of newly allocated #MetaEdge with edge type
+ *   %META_EDGE_WINDOW
+ */
+GList*
+meta_rectangle_find_window_edges (const MetaRectangle *rects,
+                                  const gboolean      *has_edges,
+                                  int                  n_rects,
+                                  const MetaRectangle *clip)
+{
+  GList *edges = NULL;
+
+  edges = find_window_edges_for_side (edges, rects, has_edges, n_rects,
+                                      clip, META_SIDE_LEFT);
+  edges = find_window_edges_for_side (edges, rects, has_edges, n_rects,
+                                      clip, META_SIDE_RIGHT);
+  edges = find_window_edges_for_side (edges, rects, has_edges, n_rects,
+                                      clip, META_SIDE_TOP);
+  edges = find_window_edges_for_side (edges, rects, has_edges, n_rects,
+                                      clip, META_SIDE_BOTTOM);
+
+  return edges;
+}
+
 /**
  * meta_rectangle_find_onscreen_edges: (skip)
  *
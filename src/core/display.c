@@ -1802,6 +1802,53 @@ handle_net_restack_window (MetaDisplay* display,
 }
 #endif
 
+static gboolean
+update_pointer_monitor (MetaDisplay *display,
+                        XIEvent     *input_event)
+{
+  MetaScreen *screen;
+  Window root;
+  double root_x, root_y;
+
+  if (input_event == NULL)
+    return FALSE;
+
+  switch (input_event->evtype)
+    {
+    case XI_Motion:
+    case XI_ButtonPress:
+    case XI_ButtonRelease:
+      {
+        XIDeviceEvent *device_event = (XIDeviceEvent *) input_event;
+
+        root = device_event->root;
+        root_x = device_event->root_x;
+        root_y = device_event->root_y;
+      }
+      break;
+    case XI_Enter:
+    case XI_Leave:
+      {
+        XIEnterEvent *enter_event = (XIEnterEvent *) input_event;
+
+        root = enter_event->root;
+        root_x = enter_event->root_x;
+        root_y = enter_event->root_y;
+      }
+      break;
+    default:
+      return FALSE;
+    }
+
+  screen = meta_display_screen_for_root (display, root);
+  if (screen == NULL)
+    return FALSE;
+
+  meta_screen_update_pointer_monitor (screen, root_x, root_y);
+
+  return TRUE;
+}
+
 static XIEvent *
 get_input_event (MetaDisplay *display,
                  XEvent      *event)
@@ -1892,11 +1939,19 @@ event_callback (XEvent   *event,
   bypass_compositor = FALSE;
   filter_out_event = FALSE;
   display->current_time = event_get_time (display, event);
-  display->monitor_cache_invalidated = TRUE;
   
   modified = event_get_modified_window (display, event);
 
   input_event = get_input_event (display, event);
+
+  /* Pointer events tell us which monitor the pointer is on. Otherwise
+   * it may have moved without us knowing, unless we are getting all
+   * the pointer events for a grab.
+   */
+  if (!update_pointer_monitor (display, input_event) &&
+      !(display->grab_op != META_GRAB_OP_NONE &&
+        meta_grab_op_is_mouse (display->grab_op)))
+    display->monitor_cache_invalidated = TRUE;
   
   if (event->type == UnmapNotify)
     {
@@ -1935,6 +1990,15 @@ event_callback (XEvent   *event,
       property_for_window = window;
       window = NULL;
     }
+
+  /* Requests from a client must see the properties it set before
+   * making them, so apply any of its property changes still queued.
+   */
+  if (window &&
+      (event->type == MapRequest ||
+       event->type == ConfigureRequest ||
+       event->type == ClientMessage))
+    meta_window_flush_property_reloads (window);
     
 
   frame_was_receiver = FALSE;
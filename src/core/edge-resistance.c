@@ -33,11 +33,29 @@
 #define WINDOW_EDGES_RELEVANT(window, display) \
   meta_window_should_be_showing (window) &&    \
   window->screen == display->grab_screen &&    \
-  window         != display->grab_window &&    \
+  !moves_with_grab_window (window, display) && \
   window->type   != META_WINDOW_DESKTOP &&     \
   window->type   != META_WINDOW_MENU    &&     \
   window->type   != META_WINDOW_SPLASHSCREEN
 
+/* Whether a window is the grab window or a dialog attached to it,
+ * which is moved along with it
+ */
+static gboolean
+moves_with_grab_window (MetaWindow  *window,
+                        MetaDisplay *display)
+{
+  while (window != display->grab_window &&
+         meta_window_is_attached_dialog (window))
+    {
+      window = meta_window_get_transient_for (window);
+      if (window == NULL)
+        return FALSE;
+    }
+
+  return window == display->grab_window;
+}
+
 struct ResistanceDataForAnEdge
 {
   gboolean     timeout_setup;
@@ -61,6 +79,10 @@ struct MetaEdgeResistanceData
   ResistanceDataForAnEdge right_data;
   ResistanceDataForAnEdge top_data;
   ResistanceDataForAnEdge bottom_data;
+
+  /* Whether a window other than the one being moved has moved since
+   * the window edges were found */
+  gboolean window_edges_stale;
 };
 
 static void compute_resistance_and_snapping_edges (MetaDisplay *display);
@@ -552,7 +574,8 @@ apply_edge_resistance_to_each_side (MetaDisplay         *display,
   gboolean                modified;
   int new_left, new_right, new_top, new_bottom;
 
-  if (display->grab_edge_resistance_data == NULL)
+  if (display->grab_edge_resistance_data == NULL ||
+      display->grab_edge_resistance_data->window_edges_stale)
     compute_resistance_and_snapping_edges (display);
 
   edge_data = display->grab_edge_resistance_data;
@@ -668,16 +691,12 @@ apply_edge_resistance_to_each_side (MetaDisplay         *display,
   return modified;
 }
 
-void
-meta_display_cleanup_edges (MetaDisplay *display)
+static void
+free_cached_edges (MetaEdgeResistanceData *edge_data)
 {
   guint i,j;
-  MetaEdgeResistanceData *edge_data = display->grab_edge_resistance_data;
   GHashTable *edges_to_be_freed;
 
-  if (edge_data == NULL) /* Not currently cached */
-    return;
-
   /* We first need to clean out any window edges */
   edges_to_be_freed = g_hash_table_new_full (g_direct_hash, g_direct_equal,
                                              g_free, NULL);
@@ -735,6 +754,17 @@ meta_display_cleanup_edges (MetaDisplay *display)
   edge_data->right_edges = NULL;
   edge_data->top_edges = NULL;
   edge_data->bottom_edges = NULL;
+}
+
+void
+meta_display_cleanup_edges (MetaDisplay *display)
+{
+  MetaEdgeResistanceData *edge_data = display->grab_edge_resistance_data;
+
+  if (edge_data == NULL) /* Not currently cached */
+    return;
+
+  free_cached_edges (edge_data);
 
   /* Cleanup the timeouts */
   if (edge_data->left_data.timeout_setup   &&
@@ -754,6 +784,31 @@ meta_display_cleanup_edges (MetaDisplay *display)
   display->grab_edge_resistance_data = NULL;
 }
 
+/**
+ * meta_display_window_edges_changed:
+ * @display: a #MetaDisplay
+ * @window: a window that was moved or resized
+ *
+ * Notes that the edges of @window may have changed, so that the window
+ * edges resisting the current grab op are found again before they're
+ * next used. The state of the resistance, like its timeouts, is kept.
+ */
+void
+meta_display_window_edges_changed (MetaDisplay *display,
+                                   MetaWindow  *window)
+{
+  MetaEdgeResistanceData *edge_data = display->grab_edge_resistance_data;
+
+  /* Neither the grab window nor its attached dialogs, which move with
+   * it on every update of the grab op, resist it */
+  if (edge_data == NULL ||
+      window->screen != display->grab_screen ||
+      moves_with_grab_window (window, display))
+    return;
+
+  edge_data->window_edges_stale = TRUE;
+}
+
 static int
 stupid_sort_requiring_extra_pointer_dereference (gconstpointer a, 
                                                  gconstpointer b)
@@ -764,12 +819,11 @@ stupid_sort_requiring_extra_pointer_dereference (gconstpointer a,
 }
 
 static void
-cache_edges (MetaDisplay *display,
+cache_edges (MetaEdgeResistanceData *edge_data,
              GList *window_edges,
              GList *monitor_edges,
              GList *screen_edges)
 {
-  MetaEdgeResistanceData *edge_data;
   GList *tmp;
   int num_left, num_right, num_top, num_bottom;
   int i;
@@ -848,9 +902,6 @@ cache_edges (MetaDisplay *display,
   /*
    * 2nd: Allocate the edges
    */
-  g_assert (display->grab_edge_resistance_data == NULL);
-  display->grab_edge_resistance_data = g_new0 (MetaEdgeResistanceData, 1);
-  edge_data = display->grab_edge_resistance_data;
   edge_data->left_edges   = g_array_sized_new (FALSE,
                                                FALSE,
                                                sizeof(MetaEdge*),
@@ -917,13 +968,13 @@ cache_edges (MetaDisplay *display,
    * avoided this sort by sticking them into the array with some simple
    * merging of the lists).
    */
-  g_array_sort (display->grab_edge_resistance_data->left_edges, 
+  g_array_sort (edge_data->left_edges, 
                 stupid_sort_requiring_extra_pointer_dereference);
-  g_array_sort (display->grab_edge_resistance_data->right_edges, 
+  g_array_sort (edge_data->right_edges, 
                 stupid_sort_requiring_extra_pointer_dereference);
-  g_array_sort (display->grab_edge_resistance_data->top_edges, 
+  g_array_sort (edge_data->top_edges, 
                 stupid_sort_requiring_extra_pointer_dereference);
-  g_array_sort (display->grab_edge_resistance_data->bottom_edges, 
+  g_array_sort (edge_data->bottom_edges, 
                 stupid_sort_requiring_extra_pointer_dereference);
 }
 
@@ -946,16 +997,16 @@ initialize_grab_edge_resistance_data (MetaDisplay *display)
 static void
 compute_resistance_and_snapping_edges (MetaDisplay *display)
 {
+  MetaEdgeResistanceData *edge_data;
   GList *stacked_windows;
   GList *cur_window_iter;
   GList *edges;
-  /* Lists of window positions (rects) and their relative stacking positions */
-  int stack_position;
-  GSList *obscuring_windows, *window_stacking;
-  /* The portions of the above lists that still remain at the stacking position
-   * in the layer that we are working on
+  /* The positions of the relevant windows, from bottom to top, and
+   * whether we snap to their edges
    */
-  GSList *rem_windows, *rem_win_stacking;
+  MetaRectangle *window_rects;
+  gboolean *window_has_edges;
+  int n_windows;
 
   g_assert (display->grab_window != NULL);
   meta_topic (META_DEBUG_WINDOW_OPS,
@@ -970,148 +1021,42 @@ compute_resistance_and_snapping_edges (MetaDisplay *display)
                              display->grab_screen->active_workspace);
 
   /*
-   * 2nd: we need to separate that stacked list into a list of windows that
-   * can obscure other edges.  To make sure we only have windows obscuring
-   * those below it instead of going both ways, we also need to keep a
-   * counter list.  Messy, I know.
+   * 2nd: Get the positions of the windows that can obscure other edges.
+   * Docks obscure the edges below them, but their own edges are
+   * considered screen edges, which are handled separately.
    */
-  obscuring_windows = window_stacking = NULL;
-  cur_window_iter = stacked_windows;
-  stack_position = 0;
-  while (cur_window_iter != NULL)
+  window_rects = g_new (MetaRectangle, g_list_length (stacked_windows));
+  window_has_edges = g_new (gboolean, g_list_length (stacked_windows));
+  n_windows = 0;
+  for (cur_window_iter = stacked_windows;
+       cur_window_iter != NULL;
+       cur_window_iter = cur_window_iter->next)
     {
       MetaWindow *cur_window = cur_window_iter->data;
       if (WINDOW_EDGES_RELEVANT (cur_window, display))
         {
-          MetaRectangle *new_rect;
-          new_rect = g_new (MetaRectangle, 1);
-          meta_window_get_outer_rect (cur_window, new_rect);
-          obscuring_windows = g_slist_prepend (obscuring_windows, new_rect);
-          window_stacking = 
-            g_slist_prepend (window_stacking, GINT_TO_POINTER (stack_position));
+          meta_window_get_outer_rect (cur_window, &window_rects[n_windows]);
+          window_has_edges[n_windows] = cur_window->type != META_WINDOW_DOCK;
+          n_windows++;
         }
-
-      stack_position++;
-      cur_window_iter = cur_window_iter->next;
     }
-  /* Put 'em in bottom to top order */
-  rem_windows = obscuring_windows = g_slist_reverse (obscuring_windows);
-  rem_win_stacking = window_stacking = g_slist_reverse (window_stacking);
 
   /*
-   * 3rd: loop over the windows again, this time getting the edges from
-   * them and removing intersections with the relevant obscuring_windows &
-   * obscuring_docks.
+   * 3rd: Get the edges of the windows, without the parts that are
+   * offscreen or covered by other windows or docks.  We don't care about
+   * snapping to those.
    */
-  edges = NULL;
-  stack_position = 0;
-  cur_window_iter = stacked_windows;
-  while (cur_window_iter != NULL)
-    {
-      MetaRectangle  cur_rect;
-      MetaWindow    *cur_window = cur_window_iter->data;
-      meta_window_get_outer_rect (cur_window, &cur_rect);
-
-      /* Check if we want to use this window's edges for edge
-       * resistance (note that dock edges are considered screen edges
-       * which are handled separately
-       */
-      if (WINDOW_EDGES_RELEVANT (cur_window, display) &&
-          cur_window->type != META_WINDOW_DOCK)
-        {
-          GList *new_edges;
-          MetaEdge *new_edge;
-          MetaRectangle reduced;
-
-          /* We don't care about snapping to any portion of the window that
-           * is offscreen (we also don't care about parts of edges covered
-           * by other windows or DOCKS, but that's handled below).
-           */
-          meta_rectangle_intersect (&cur_rect, 
-                                    &display->grab_screen->rect,
-                                    &reduced);
-
-          new_edges = NULL;
-
-          /* Left side of this window is resistance for the right edge of
-           * the window being moved.
-           */
-          new_edge = g_new (MetaEdge, 1);
-          new_edge->rect = reduced;
-          new_edge->rect.width = 0;
-          new_edge->side_type = META_SIDE_RIGHT;
-          new_edge->edge_type = META_EDGE_WINDOW;
-          new_edges = g_list_prepend (new_edges, new_edge);
-
-          /* Right side of this window is resistance for the left edge of
-           * the window being moved.
-           */
-          new_edge = g_new (MetaEdge, 1);
-          new_edge->rect = reduced;
-          new_edge->rect.x += new_edge->rect.width;
-          new_edge->rect.width = 0;
-          new_edge->side_type = META_SIDE_LEFT;
-          new_edge->edge_type = META_EDGE_WINDOW;
-          new_edges = g_list_prepend (new_edges, new_edge);
-          
-          /* Top side of this window is resistance for the bottom edge of
-           * the window being moved.
-           */
-          new_edge = g_new (MetaEdge, 1);
-          new_edge->rect = reduced;
-          new_edge->rect.height = 0;
-          new_edge->side_type = META_SIDE_BOTTOM;
-          new_edge->edge_type = META_EDGE_WINDOW;
-          new_edges = g_list_prepend (new_edges, new_edge);
-
-          /* Top side of this window is resistance for the bottom edge of
-           * the window being moved.
-           */
-          new_edge = g_new (MetaEdge, 1);
-          new_edge->rect = reduced;
-          new_edge->rect.y += new_edge->rect.height;
-          new_edge->rect.height = 0;
-          new_edge->side_type = META_SIDE_TOP;
-          new_edge->edge_type = META_EDGE_WINDOW;
-          new_edges = g_list_prepend (new_edges, new_edge);
-
-          /* Update the remaining windows to only those at a higher
-           * stacking position than this one.
-           */
-          while (rem_win_stacking && 
-                 stack_position >= GPOINTER_TO_INT (rem_win_stacking->data))
-            {
-              rem_windows      = rem_windows->next;
-              rem_win_stacking = rem_win_stacking->next;
-            }
-
-          /* Remove edge portions overlapped by rem_windows and rem_docks */
-          new_edges = 
-            meta_rectangle_remove_intersections_with_boxes_from_edges (
-              new_edges,
-              rem_windows);
-
-          /* Save the new edges */
-          edges = g_list_concat (new_edges, edges);
-        }
-
-      stack_position++;
-      cur_window_iter = cur_window_iter->next;
-    }
+  edges = meta_rectangle_find_window_edges (window_rects,
+                                            window_has_edges,
+                                            n_windows,
+                                            &display->grab_screen->rect);
 
   /*
    * 4th: Free the extra memory not needed and sort the list
    */
   g_list_free (stacked_windows);
-  /* Free the memory used by the obscuring windows/docks lists */
-  g_slist_free (window_stacking);
-  /* FIXME: Shouldn't there be a helper function to make this one line of code
-   * to free a list instead of four ugly ones?
-   */
-  g_slist_foreach (obscuring_windows, 
-                   (void (*)(gpointer,gpointer))&g_free, /* ew, for ugly */
-                   NULL);
-  g_slist_free (obscuring_windows);
+  g_free (window_rects);
+  g_free (window_has_edges);
 
   /* Sort the list.  FIXME: Should I bother with this sorting?  I just
    * sort again later in cache_edges() anyway...
@@ -1121,18 +1066,25 @@ compute_resistance_and_snapping_edges (MetaDisplay *display)
   /*
    * 5th: Cache the combination of these edges with the onscreen and
    * monitor edges in an array for quick access.  Free the edges since
-   * they've been cached elsewhere.
+   * they've been cached elsewhere.  If only the window edges changed
+   * during the grab, the timeouts and buildups are kept.
    */
-  cache_edges (display,
+  edge_data = display->grab_edge_resistance_data;
+  if (edge_data == NULL)
+    {
+      edge_data = g_new0 (MetaEdgeResistanceData, 1);
+      display->grab_edge_resistance_data = edge_data;
+      initialize_grab_edge_resistance_data (display);
+    }
+  else
+    free_cached_edges (edge_data);
+
+  cache_edges (edge_data,
                edges,
                display->grab_screen->active_workspace->monitor_edges,
                display->grab_screen->active_workspace->screen_edges);
   g_list_free (edges);
-
-  /*
-   * 6th: Initialize the resistance timeouts and buildups
-   */
-  initialize_grab_edge_resistance_data (display);
+  edge_data->window_edges_stale = FALSE;
 }
 
 /* Note that old_[xy] and new_[xy] are with respect to inner positions of
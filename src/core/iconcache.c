@@ -28,8 +28,34 @@
 
 #include <X11/Xatom.h>
 
+#include <string.h>
+
 /* The icon-reading code is also in libwnck, please sync bugfixes */
 
+/* Icons read from _NET_WM_ICON are shared between windows: many windows
+ * of the same application have the same icon, and converting and
+ * scaling it is the expensive part. The shared icons are looked up by
+ * a hash of the ARGB data of the size that was picked, which is then
+ * compared in full, and kept in most-recently-used order until they go over SHARED_ICONS_BUDGET
+ * bytes. Windows keep their own references, so evicting an icon from
+ * here doesn't affect the windows that use it.
+ */
+#define SHARED_ICONS_BUDGET (4 * 1024 * 1024)
+
+typedef struct
+{
+  guint64 hash;
+  gulong *argb_data;
+  int src_width;
+  int src_height;
+  int width;
+  int height;
+  GdkPixbuf *pixbuf;
+} SharedIcon;
+
+static GList *shared_icons = NULL;
+static gsize shared_icons_size = 0;
+
 static void
 get_fallback_icons (MetaScreen     *screen,
                     GdkPixbuf     **iconp,
@@ -206,85 +232,6 @@ argbdata_to_pixdata (gulong *argb_data, int len, guchar **pixdata)
     }
 }
 
-static gboolean
-read_rgb_icon (MetaDisplay   *display,
-               Window         xwindow,
-               int            ideal_width,
-               int            ideal_height,
-               int            ideal_mini_width,
-               int            ideal_mini_height,
-               int           *width,
-               int           *height,
-               guchar       **pixdata,
-               int           *mini_width,
-               int           *mini_height,
-               guchar       **mini_pixdata)
-{
-  Atom type;
-  int format;
-  gulong nitems;
-  gulong bytes_after;
-  int result, err;
-  guchar *data;
-  gulong *best;
-  int w, h;
-  gulong *best_mini;
-  int mini_w, mini_h;
-  gulong *data_as_long;
-
-  meta_error_trap_push_with_return (display);
-  type = None;
-  data = NULL;
-  result = XGetWindowProperty (display->xdisplay,
-			       xwindow,
-                               display->atom__NET_WM_ICON,
-			       0, G_MAXLONG,
-			       False, XA_CARDINAL, &type, &format, &nitems,
-			       &bytes_after, &data);
-  err = meta_error_trap_pop_with_return (display);
-
-  if (err != Success ||
-      result != Success)
-    return FALSE;
-
-  if (type != XA_CARDINAL)
-    {
-      XFree (data);
-      return FALSE;
-    }
-
-  data_as_long = (gulong *)data;
-
-  if (!find_best_size (data_as_long, nitems,
-                       ideal_width, ideal_height,
-                       &w, &h, &best))
-    {
-      XFree (data);
-      return FALSE;
-    }
-
-  if (!find_best_size (data_as_long, nitems,
-                       ideal_mini_width, ideal_mini_height,
-                       &mini_w, &mini_h, &best_mini))
-    {
-      XFree (data);
-      return FALSE;
-    }
-
-  *width = w;
-  *height = h;
-
-  *mini_width = mini_w;
-  *mini_height = mini_h;
-
-  argbdata_to_pixdata (best, w * h, pixdata);
-  argbdata_to_pixdata (best_mini, mini_w * mini_h, mini_pixdata);
-
-  XFree (data);
-
-  return TRUE;
-}
-
 static void
 free_pixels (guchar *pixels, gpointer data)
 {
@@ -544,6 +491,7 @@ meta_icon_cache_init (MetaIconCache *icon_cache)
   icon_cache->origin = USING_NO_ICON;
   icon_cache->prev_pixmap = None;
   icon_cache->prev_mask = None;
+  icon_cache->net_wm_icon_fetch = NULL;
 #if 0
   icon_cache->icon = NULL;
   icon_cache->mini_icon = NULL;
@@ -585,6 +533,13 @@ clear_icon_cache (MetaIconCache *icon_cache,
 void
 meta_icon_cache_free (MetaIconCache *icon_cache)
 {
+  if (icon_cache->net_wm_icon_fetch)
+    {
+      meta_prop_fetch_values_finish (icon_cache->net_wm_icon_fetch);
+      meta_prop_free_values (&icon_cache->net_wm_icon_value, 1);
+      icon_cache->net_wm_icon_fetch = NULL;
+    }
+
   clear_icon_cache (icon_cache, FALSE);
 }
 
@@ -625,6 +580,28 @@ meta_icon_cache_get_icon_invalidated (MetaIconCache *icon_cache)
     return FALSE;
 }
 
+/**
+ * meta_icon_cache_prefetch:
+ * @icon_cache: the icon cache of @xwindow
+ * @display: the display
+ * @xwindow: the window
+ *
+ * Sends the request for _NET_WM_ICON if meta_read_icons() is going to
+ * need it, without waiting for the reply. Prefetching the icons of
+ * several windows before reading any of them gets all of them with a
+ * single round trip.
+ */
+void
+meta_icon_cache_prefetch (MetaIconCache *icon_cache,
+                          MetaDisplay   *display,
+                          Window         xwindow)
+{
+  if (icon_cache->net_wm_icon_fetch == NULL &&
+      icon_cache->origin <= USING_NET_WM_ICON &&
+      icon_cache->net_wm_icon_dirty)
+    start_net_wm_icon_fetch (icon_cache, display, xwindow);
+}
+
 static void
 replace_cache (MetaIconCache *icon_cache,
                IconOrigin     origin,
@@ -704,6 +681,166 @@ scaled_from_pixdata (guchar *pixdata,
   return dest;
 }
 
+static guint64
+hash_argb (gulong *argb_data,
+           int     len)
+{
+  guint64 hash = G_GUINT64_CONSTANT (14695981039346656037);
+  int i;
+
+  for (i = 0; i < len; i++)
+    {
+      hash ^= (guint32) argb_data[i];
+      hash *= G_GUINT64_CONSTANT (1099511628211);
+    }
+
+  return hash;
+}
+
+static gsize
+shared_icon_size (SharedIcon *shared)
+{
+  return gdk_pixbuf_get_rowstride (shared->pixbuf) *
+    gdk_pixbuf_get_height (shared->pixbuf) +
+    shared->src_width * shared->src_height * sizeof (gulong);
+}
+
+static void
+shared_icon_free (SharedIcon *shared)
+{
+  shared_icons_size -= shared_icon_size (shared);
+  g_object_unref (shared->pixbuf);
+  g_free (shared->argb_data);
+  g_slice_free (SharedIcon, shared);
+}
+
+/* Returns a new reference to the icon for the w by h ARGB data scaled
+ * to new_w by new_h, converting it only if no other window has it.
+ */
+static GdkPixbuf*
+get_shared_icon (gulong *argb_data,
+                 int     w,
+                 int     h,
+                 int     new_w,
+                 int     new_h)
+{
+  SharedIcon *shared;
+  GdkPixbuf *pixbuf;
+  guchar *pixdata;
+  guint64 hash;
+  GList *l;
+
+  hash = hash_argb (argb_data, w * h);
+
+  for (l = shared_icons; l; l = l->next)
+    {
+      shared = l->data;
+
+      if (shared->hash == hash &&
+          shared->src_width == w && shared->src_height == h &&
+          shared->width == new_w && shared->height == new_h &&
+          memcmp (shared->argb_data, argb_data, w * h * sizeof (gulong)) == 0)
+        {
+          shared_icons = g_list_remove_link (shared_icons, l);
+          shared_icons = g_list_concat (l, shared_icons);
+
+          return g_object_ref (shared->pixbuf);
+        }
+    }
+
+  argbdata_to_pixdata (argb_data, w * h, &pixdata);
+  pixbuf = scaled_from_pixdata (pixdata, w, h, new_w, new_h);
+
+  if (pixbuf == NULL)
+    return NULL;
+
+  shared = g_slice_new (SharedIcon);
+  shared->hash = hash;
+  shared->argb_data = g_memdup (argb_data, w * h * sizeof (gulong));
+  shared->src_width = w;
+  shared->src_height = h;
+  shared->width = new_w;
+  shared->height = new_h;
+  shared->pixbuf = g_object_ref (pixbuf);
+
+  shared_icons = g_list_prepend (shared_icons, shared);
+  shared_icons_size += shared_icon_size (shared);
+
+  /* Always keep the icon we just added */
+  while (shared_icons_size > SHARED_ICONS_BUDGET && shared_icons->next)
+    {
+      l = g_list_last (shared_icons);
+      shared_icon_free (l->data);
+      shared_icons = g_list_delete_link (shared_icons, l);
+    }
+
+  return pixbuf;
+}
+
+static void
+start_net_wm_icon_fetch (MetaIconCache *icon_cache,
+                         MetaDisplay   *display,
+                         Window         xwindow)
+{
+  icon_cache->net_wm_icon_value.type = META_PROP_VALUE_CARDINAL_LIST;
+  icon_cache->net_wm_icon_value.atom = display->atom__NET_WM_ICON;
+  icon_cache->net_wm_icon_value.required_type = None;
+
+  icon_cache->net_wm_icon_fetch =
+    meta_prop_fetch_values_begin (display, xwindow,
+                                  &icon_cache->net_wm_icon_value, 1);
+}
+
+static gboolean
+read_rgb_icon (MetaDisplay   *display,
+               Window         xwindow,
+               MetaIconCache *icon_cache,
+               GdkPixbuf    **iconp,
+               int            ideal_width,
+               int            ideal_height,
+               GdkPixbuf    **mini_iconp,
+               int            ideal_mini_width,
+               int            ideal_mini_height)
+{
+  MetaPropValue *value;
+  gulong *best;
+  int w, h;
+  gulong *best_mini;
+  int mini_w, mini_h;
+  gboolean found;
+
+  if (icon_cache->net_wm_icon_fetch == NULL)
+    start_net_wm_icon_fetch (icon_cache, display, xwindow);
+
+  meta_prop_fetch_values_finish (icon_cache->net_wm_icon_fetch);
+  icon_cache->net_wm_icon_fetch = NULL;
+
+  value = &icon_cache->net_wm_icon_value;
+  if (value->type == META_PROP_VALUE_INVALID)
+    return FALSE;
+
+  found = find_best_size (value->v.cardinal_list.cardinals,
+                          value->v.cardinal_list.n_cardinals,
+                          ideal_width, ideal_height,
+                          &w, &h, &best) &&
+          find_best_size (value->v.cardinal_list.cardinals,
+                          value->v.cardinal_list.n_cardinals,
+                          ideal_mini_width, ideal_mini_height,
+                          &mini_w, &mini_h, &best_mini);
+
+  if (found)
+    {
+      *iconp = get_shared_icon (best, w, h,
+                                ideal_width, ideal_height);
+      *mini_iconp = get_shared_icon (best_mini, mini_w, mini_h,
+                                     ideal_mini_width, ideal_mini_height);
+    }
+
+  meta_prop_free_values (value, 1);
+
+  return found;
+}
+
 gboolean
 meta_read_icons (MetaScreen     *screen,
                  Window          xwindow,
@@ -717,10 +854,6 @@ meta_read_icons (MetaScreen     *screen,
                  int             ideal_mini_width,
                  int             ideal_mini_height)
 {
-  guchar *pixdata;
-  int w, h;
-  guchar *mini_pixdata;
-  int mini_w, mini_h;
   Pixmap pixmap;
   Pixmap mask;
 
@@ -747,8 +880,6 @@ meta_read_icons (MetaScreen     *screen,
   if (!meta_icon_cache_get_icon_invalidated (icon_cache))
     return FALSE; /* we have no new info to use */
 
-  pixdata = NULL;
-
   /* Our algorithm here assumes that we can't have for example origin
    * < USING_NET_WM_ICON and icon_cache->net_wm_icon_dirty == FALSE
    * unless we have tried to read NET_WM_ICON.
@@ -764,18 +895,10 @@ meta_read_icons (MetaScreen     *screen,
     {
       icon_cache->net_wm_icon_dirty = FALSE;
 
-      if (read_rgb_icon (screen->display, xwindow,
-                         ideal_width, ideal_height,
-                         ideal_mini_width, ideal_mini_height,
-                         &w, &h, &pixdata,
-                         &mini_w, &mini_h, &mini_pixdata))
+      if (read_rgb_icon (screen->display, xwindow, icon_cache,
+                         iconp, ideal_width, ideal_height,
+                         mini_iconp, ideal_mini_width, ideal_mini_height))
         {
-          *iconp = scaled_from_pixdata (pixdata, w, h,
-                                        ideal_width, ideal_height);
-
-          *mini_iconp = scaled_from_pixdata (mini_pixdata, mini_w, mini_h,
-                                             ideal_mini_width, ideal_mini_height);
-
           if (*iconp && *mini_iconp)
             {
               replace_cache (icon_cache, USING_NET_WM_ICON,
@@ -789,6 +912,9 @@ meta_read_icons (MetaScreen     *screen,
                 g_object_unref (G_OBJECT (*iconp));
               if (*mini_iconp)
                 g_object_unref (G_OBJECT (*mini_iconp));
+
+              *iconp = NULL;
+              *mini_iconp = NULL;
             }
         }
     }
@@ -25,6 +25,7 @@
 #define META_ICON_CACHE_H
 
 #include "screen-private.h"
+#include "xprops.h"
 
 typedef struct _MetaIconCache MetaIconCache;
 
@@ -46,6 +47,9 @@ struct _MetaIconCache
   int origin;
   Pixmap prev_pixmap;
   Pixmap prev_mask;
+  /* _NET_WM_ICON requested by meta_icon_cache_prefetch() */
+  MetaPropFetch *net_wm_icon_fetch;
+  MetaPropValue net_wm_icon_value;
   guint want_fallback : 1;
   /* TRUE if these props have changed */
   guint wm_hints_dirty : 1;
@@ -59,6 +63,9 @@ void           meta_icon_cache_property_changed     (MetaIconCache *icon_cache,
                                                      MetaDisplay   *display,
                                                      Atom           atom);
 gboolean       meta_icon_cache_get_icon_invalidated (MetaIconCache *icon_cache);
+void           meta_icon_cache_prefetch             (MetaIconCache *icon_cache,
+                                                     MetaDisplay   *display,
+                                                     Window         xwindow);
 
 gboolean meta_read_icons         (MetaScreen     *screen,
                                   Window          xwindow,
@@ -73,6 +73,12 @@ void     meta_set_keybindings_disabled      (gboolean     setting);
 void     meta_display_process_mapping_event (MetaDisplay *display,
                                              XEvent      *event);
 
+GHashTable *meta_key_binding_index_new    (MetaKeyBinding *bindings,
+                                           int             n_bindings);
+GSList     *meta_key_binding_index_lookup (GHashTable     *index,
+                                           unsigned int    keycode,
+                                           unsigned int    mask);
+
 gboolean meta_prefs_add_keybinding          (const char           *name,
                                              GSettings            *settings,
                                              MetaKeyBindingAction  action,
@@ -32,6 +32,7 @@
 #include <meta/compositor.h>
 #include <meta/errors.h>
 #include "edge-resistance.h"
+#include "meta-frame-profiler.h"
 #include "ui.h"
 #include "frame.h"
 #include "place.h"
@@ -305,6 +306,142 @@ keysym_to_keycode (MetaDisplay *display,
     return XKeysymToKeycode (display->xdisplay, keysym);
 }
 
+static guint
+key_binding_index_key (guint keycode,
+                       guint mask)
+{
+  /* Keycodes are at most 8 bits, and only the low byte of the mask
+   * can ever match an event (see process_event()).
+   */
+  return (keycode & 0xff) | ((mask & 0xffffff) << 8);
+}
+
+static void
+free_index_bucket (gpointer data)
+{
+  g_slist_free (data);
+}
+
+/**
+ * meta_key_binding_index_new: (skip)
+ * @bindings: a binding table
+ * @n_bindings: the number of entries in @bindings
+ *
+ * Builds an index of @bindings keyed by keycode and devirtualized
+ * modifier mask, so that looking up the bindings for a key event
+ * doesn't depend on the size of the table. Each entry holds the
+ * indices of all bindings sharing a key, in table order.
+ *
+ * Return value: the index; free it with g_hash_table_destroy()
+ */
+GHashTable *
+meta_key_binding_index_new (MetaKeyBinding *bindings,
+                            int             n_bindings)
+{
+  GHashTable *index;
+  int i;
+
+  index = g_hash_table_new_full (NULL, NULL, NULL, free_index_bucket);
+
+  /* Walk backwards so that prepending leaves each bucket in table order */
+  for (i = n_bindings - 1; i >= 0; i--)
+    {
+      gpointer key;
+      GSList *bucket;
+
+      if (bindings[i].keycode == 0)
+        continue;
+
+      key = GUINT_TO_POINTER (key_binding_index_key (bindings[i].keycode,
+                                                     bindings[i].mask));
+      bucket = g_hash_table_lookup (index, key);
+
+      /* Steal so that replacing the bucket doesn't free it */
+      g_hash_table_steal (index, key);
+      g_hash_table_insert (index, key,
+                           g_slist_prepend (bucket, GINT_TO_POINTER (i)));
+    }
+
+  return index;
+}
+
+/**
+ * meta_key_binding_index_lookup: (skip)
+ * @index: an index created by meta_key_binding_index_new()
+ * @keycode: a keycode
+ * @mask: a devirtualized modifier mask
+ *
+ * Return value: (transfer none): the indices, as GINT_TO_POINTER(), of the
+ *   bindings for @keycode and @mask in table order, or %NULL
+ */
+GSList *
+meta_key_binding_index_lookup (GHashTable   *index,
+                               unsigned int  keycode,
+                               unsigned int  mask)
+{
+  return g_hash_table_lookup (index,
+                              GUINT_TO_POINTER (key_binding_index_key (keycode,
+                                                                       mask)));
+}
+
+/* Adds binding @i, which must come after all indexed bindings in the
+ * table, to the index of the display's bindings.
+ */
+static void
+index_key_binding (MetaDisplay *display,
+                   int          i)
+{
+  MetaKeyBinding *binding = &display->key_bindings[i];
+  gpointer key;
+  GSList *bucket;
+
+  key = GUINT_TO_POINTER (key_binding_index_key (binding->keycode,
+                                                 binding->mask));
+  bucket = g_hash_table_lookup (display->key_bindings_index, key);
+
+  /* Steal so that replacing the bucket doesn't free it */
+  g_hash_table_steal (display->key_bindings_index, key);
+  g_hash_table_insert (display->key_bindings_index, key,
+                       g_slist_append (bucket, GINT_TO_POINTER (i)));
+}
+
+/* Removes binding @i from the index of the display's bindings; call
+ * this before clearing its keycode and mask.
+ */
+static void
+unindex_key_binding (MetaDisplay *display,
+                     int          i)
+{
+  MetaKeyBinding *binding = &display->key_bindings[i];
+  gpointer key;
+  GSList *bucket;
+
+  key = GUINT_TO_POINTER (key_binding_index_key (binding->keycode,
+                                                 binding->mask));
+  bucket = g_hash_table_lookup (display->key_bindings_index, key);
+
+  /* Steal so that replacing the bucket doesn't free it */
+  g_hash_table_steal (display->key_bindings_index, key);
+  bucket = g_slist_remove (bucket, GINT_TO_POINTER (i));
+  if (bucket)
+    g_hash_table_insert (display->key_bindings_index, key, bucket);
+}
+
+/* Must be called whenever the keycodes or masks in the binding table
+ * change, or bindings are added or removed, other than through
+ * index_key_binding() and unindex_key_binding().
+ */
+static void
+reindex_key_bindings (MetaDisplay *display)
+{
+  if (display->key_bindings_index)
+    g_hash_table_destroy (display->key_bindings_index);
+
+  display->key_bindings_index =
+    meta_key_binding_index_new (display->key_bindings,
+                                display->n_key_bindings);
+}
+
 static void
 reload_keycodes (MetaDisplay *display)
 {
@@ -365,6 +502,10 @@ reload_modifiers (MetaDisplay *display)
           ++i;
         }
     }
+
+  /* Keycodes are always reloaded before the modifiers, so this is the
+   * point where the table is complete again */
+  reindex_key_bindings (display);
 }
 
 
@@ -565,22 +706,22 @@ display_get_keybinding (MetaDisplay  *display,
                         unsigned int  keycode,
                         unsigned long mask)
 {
-  int i;
+  MetaKeyBinding *binding = NULL;
+  GSList *l;
 
-  i = display->n_key_bindings - 1;
-  while (i >= 0)
+  /* The last matching binding in the table wins */
+  for (l = meta_key_binding_index_lookup (display->key_bindings_index,
+                                          keycode, mask);
+       l != NULL;
+       l = l->next)
     {
-      if (display->key_bindings[i].keysym == keysym &&
-          display->key_bindings[i].keycode == keycode &&
-          display->key_bindings[i].mask == mask)
-        {
-          return &display->key_bindings[i];
-        }
+      MetaKeyBinding *candidate = &display->key_bindings[GPOINTER_TO_INT (l->data)];
 
-      --i;
+      if (candidate->keysym == keysym)
+        binding = candidate;
     }
 
-  return NULL;
+  return binding;
 }
 
 static guint
@@ -843,6 +984,8 @@ meta_display_shutdown_keys (MetaDisplay *display)
   if (display->modmap)
     XFreeModifiermap (display->modmap);
   g_free (display->key_bindings);
+  if (display->key_bindings_index)
+    g_hash_table_destroy (display->key_bindings_index);
 }
 
 static const char*
@@ -1120,7 +1263,6 @@ meta_display_grab_accelerator (MetaDisplay *display,
   guint mask = 0;
   MetaVirtualModifier modifiers = 0;
   GSList *l;
-  int i;
 
   if (!meta_ui_parse_accelerator (accelerator, &keysym, &keycode, &modifiers))
     {
@@ -1137,10 +1279,9 @@ meta_display_grab_accelerator (MetaDisplay *display,
   if (keycode == 0)
     return META_KEYBINDING_ACTION_NONE;
 
-  for (i = 0; i < display->n_key_bindings; i++)
-    if (display->key_bindings[i].keycode == keycode &&
-        display->key_bindings[i].mask == mask)
-      return META_KEYBINDING_ACTION_NONE;
+  if (meta_key_binding_index_lookup (display->key_bindings_index,
+                                     keycode, mask) != NULL)
+    return META_KEYBINDING_ACTION_NONE;
 
   for (l = display->screens; l; l = l->next)
     {
@@ -1171,6 +1312,8 @@ meta_display_grab_accelerator (MetaDisplay *display,
   binding->modifiers = grab->combo->modifiers;
   binding->mask = mask;
 
+  index_key_binding (display, display->n_key_bindings - 1);
+
   return grab->action;
 }
 
@@ -1204,6 +1347,8 @@ meta_display_ungrab_accelerator (MetaDisplay *display,
                                  display->key_bindings[i].mask);
           }
 
+        unindex_key_binding (display, i);
+
         display->key_bindings[i].keysym = 0;
         display->key_bindings[i].keycode = 0;
         display->key_bindings[i].modifiers = 0;
@@ -1598,7 +1743,7 @@ invoke_handler_by_name (MetaDisplay    *display,
 /* now called from only one place, may be worth merging */
 static gboolean
 process_event (MetaKeyBinding       *bindings,
-               int                   n_bindings,
+               GHashTable           *index,
                MetaDisplay          *display,
                MetaScreen           *screen,
                MetaWindow           *window,
@@ -1606,25 +1751,25 @@ process_event (MetaKeyBinding       *bindings,
                KeySym                keysym,
                gboolean              on_window)
 {
-  int i;
+  GSList *l;
 
   /* we used to have release-based bindings but no longer. */
-  if (event->evtype == XI_KeyRelease)
+  if (event->evtype != XI_KeyPress)
     return FALSE;
 
-  /*
-   * TODO: This would be better done with a hash table;
-   * it doesn't suit to use O(n) for such a common operation.
+  /* The index only gives us the bindings for this keycode and mask,
+   * so the cost doesn't grow with the number of bindings.
    */
-  for (i=0; i<n_bindings; i++)
+  for (l = meta_key_binding_index_lookup (index, event->detail,
+                                          event->mods.effective & 0xff &
+                                          ~(display->ignored_modifier_mask));
+       l != NULL;
+       l = l->next)
     {
+      int i = GPOINTER_TO_INT (l->data);
       MetaKeyHandler *handler = bindings[i].handler;
 
       if ((!on_window && handler->flags & META_KEY_BINDING_PER_WINDOW) ||
-          event->evtype != XI_KeyPress ||
-          bindings[i].keycode != event->detail ||
-          ((event->mods.effective & 0xff & ~(display->ignored_modifier_mask)) !=
-           bindings[i].mask) ||
           meta_compositor_filter_keybinding (display->compositor, screen, &bindings[i]))
         continue;
 
@@ -1687,7 +1832,7 @@ process_overlay_key (MetaDisplay *display,
            * luck.
            */
           if (process_event (display->key_bindings,
-                             display->n_key_bindings,
+                             display->key_bindings_index,
                              display, screen, NULL, event, keysym,
                              FALSE))
             {
@@ -1910,7 +2055,7 @@ meta_display_process_key_event (MetaDisplay   *display,
 
   /* Do the normal keybindings */
   return process_event (display->key_bindings,
-                        display->n_key_bindings,
+                        display->key_bindings_index,
                         display, screen, window, event, keysym,
                         !all_keys_grabbed && window);
 }
@@ -3815,6 +3960,9 @@ handle_set_spew_mark (MetaDisplay    *display,
                       gpointer        dummy)
 {
   meta_verbose ("-- MARK MARK MARK MARK --\n");
+
+  /* Whatever prompted the mark likely shows up in the last frames */
+  meta_frame_profiler_dump ();
 }
 
 void
@@ -4483,6 +4631,7 @@ meta_display_init_keys (MetaDisplay *display)
   display->meta_mask = 0;
   display->key_bindings = NULL;
   display->n_key_bindings = 0;
+  display->key_bindings_index = NULL;
 
   XDisplayKeycodes (display->xdisplay,
                     &display->min_keycode,
@@ -107,6 +107,18 @@ struct _MetaScreen
   /* Cache the current monitor */
   int last_monitor_index;
 
+  /* Index of the monitor layout, built by reload_monitor_infos():
+   * the neighbor of each monitor in each MetaScreenDirection, or -1,
+   * and a grid whose lines are the monitor edges, where each cell
+   * holds the first monitor covering it, or -1.
+   */
+  int *monitor_neighbors;
+  int *monitor_grid_xs;
+  int *monitor_grid_ys;
+  int n_monitor_grid_xs;
+  int n_monitor_grid_ys;
+  int *monitor_grid;
+
 #ifdef HAVE_STARTUP_NOTIFICATION
   SnMonitorContext *sn_context;
   GSList *startup_sequences;
@@ -184,7 +196,15 @@ void          meta_screen_tile_preview_hide            (MetaScreen    *screen);
 MetaWindow*   meta_screen_get_mouse_window     (MetaScreen                 *screen,
                                                 MetaWindow                 *not_this_one);
 
+void          meta_screen_build_monitor_index    (MetaScreen *screen);
+int           meta_screen_find_monitor_at_point  (MetaScreen *screen,
+                                                  int         x,
+                                                  int         y);
+
 const MetaMonitorInfo* meta_screen_get_current_monitor_info   (MetaScreen    *screen);
+void          meta_screen_update_pointer_monitor (MetaScreen *screen,
+                                                  int         root_x,
+                                                  int         root_y);
 const MetaMonitorInfo* meta_screen_get_monitor_for_rect   (MetaScreen    *screen,
                                                            MetaRectangle *rect);
 const MetaMonitorInfo* meta_screen_get_monitor_for_window (MetaScreen    *screen,
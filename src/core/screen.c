@@ -32,6 +32,7 @@
 #include <meta/util.h>
 #include <meta/errors.h>
 #include "window-private.h"
+#include "window-props.h"
 #include "frame.h"
 #include <meta/prefs.h>
 #include "workspace-private.h"
@@ -424,6 +425,190 @@ find_main_output_for_crtc (MetaScreen *screen, XRRScreenResources *resources, XR
 
 #endif
 
+static int
+compare_ints (const void *a,
+              const void *b)
+{
+  int ia = *(const int *) a;
+  int ib = *(const int *) b;
+
+  return ia < ib ? -1 : (ia > ib ? 1 : 0);
+}
+
+/* Sorts coords and drops the duplicates, returning how many are left */
+static int
+sort_unique_coords (int *coords,
+                    int  n_coords)
+{
+  int i, n;
+
+  qsort (coords, n_coords, sizeof (int), compare_ints);
+
+  n = 0;
+  for (i = 0; i < n_coords; i++)
+    if (n == 0 || coords[n - 1] != coords[i])
+      coords[n++] = coords[i];
+
+  return n;
+}
+
+/* Returns the index of the grid cell holding coord, or -1 if it
+ * is outside of all the monitors
+ */
+static int
+find_grid_cell (const int *coords,
+                int        n_coords,
+                int        coord)
+{
+  int lo, hi;
+
+  if (n_coords < 2 || coord < coords[0] || coord >= coords[n_coords - 1])
+    return -1;
+
+  /* Find the last line at or before coord */
+  lo = 0;
+  hi = n_coords - 1;
+  while (hi - lo > 1)
+    {
+      int mid = lo + (hi - lo) / 2;
+
+      if (coords[mid] <= coord)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static void
+free_monitor_index (MetaScreen *screen)
+{
+  g_free (screen->monitor_neighbors);
+  g_free (screen->monitor_grid_xs);
+  g_free (screen->monitor_grid_ys);
+  g_free (screen->monitor_grid);
+
+  screen->monitor_neighbors = NULL;
+  screen->monitor_grid_xs = NULL;
+  screen->monitor_grid_ys = NULL;
+  screen->monitor_grid = NULL;
+  screen->n_monitor_grid_xs = 0;
+  screen->n_monitor_grid_ys = 0;
+}
+
+static gboolean
+is_monitor_neighbor (const MetaRectangle *input,
+                     const MetaRectangle *current,
+                     MetaScreenDirection  direction)
+{
+  switch (direction)
+    {
+    case META_SCREEN_RIGHT:
+      return current->x == input->x + input->width &&
+        meta_rectangle_vert_overlap (current, input);
+    case META_SCREEN_LEFT:
+      return input->x == current->x + current->width &&
+        meta_rectangle_vert_overlap (current, input);
+    case META_SCREEN_UP:
+      return input->y == current->y + current->height &&
+        meta_rectangle_horiz_overlap (current, input);
+    case META_SCREEN_DOWN:
+      return current->y == input->y + input->height &&
+        meta_rectangle_horiz_overlap (current, input);
+    }
+
+  return FALSE;
+}
+
+/* Monitor lookups happen on every configure and constraint pass,
+ * so precompute the answers that don't depend on the window.
+ */
+void
+meta_screen_build_monitor_index (MetaScreen *screen)
+{
+  int n = screen->n_monitor_infos;
+  int n_cols, n_rows;
+  int i, j, d;
+
+  free_monitor_index (screen);
+
+  screen->monitor_neighbors = g_new (int, n * 4);
+  for (i = 0; i < n; i++)
+    for (d = 0; d < 4; d++)
+      {
+        screen->monitor_neighbors[i * 4 + d] = -1;
+
+        for (j = 0; j < n; j++)
+          if (is_monitor_neighbor (&screen->monitor_infos[i].rect,
+                                   &screen->monitor_infos[j].rect,
+                                   d))
+            {
+              screen->monitor_neighbors[i * 4 + d] = j;
+              break;
+            }
+      }
+
+  screen->monitor_grid_xs = g_new (int, 2 * n);
+  screen->monitor_grid_ys = g_new (int, 2 * n);
+  for (i = 0; i < n; i++)
+    {
+      const MetaRectangle *rect = &screen->monitor_infos[i].rect;
+
+      screen->monitor_grid_xs[2 * i] = rect->x;
+      screen->monitor_grid_xs[2 * i + 1] = rect->x + rect->width;
+      screen->monitor_grid_ys[2 * i] = rect->y;
+      screen->monitor_grid_ys[2 * i + 1] = rect->y + rect->height;
+    }
+  screen->n_monitor_grid_xs = sort_unique_coords (screen->monitor_grid_xs, 2 * n);
+  screen->n_monitor_grid_ys = sort_unique_coords (screen->monitor_grid_ys, 2 * n);
+
+  n_cols = MAX (screen->n_monitor_grid_xs - 1, 0);
+  n_rows = MAX (screen->n_monitor_grid_ys - 1, 0);
+  screen->monitor_grid = g_new (int, MAX (n_cols * n_rows, 1));
+  for (i = 0; i < n_cols * n_rows; i++)
+    screen->monitor_grid[i] = -1;
+
+  /* Backwards, so that the first monitor covering a cell wins */
+  for (i = n - 1; i >= 0; i--)
+    {
+      const MetaRectangle *rect = &screen->monitor_infos[i].rect;
+      int col, row, end_col, end_row;
+
+      if (rect->width <= 0 || rect->height <= 0)
+        continue;
+
+      col = find_grid_cell (screen->monitor_grid_xs, screen->n_monitor_grid_xs,
+                            rect->x);
+      end_col = find_grid_cell (screen->monitor_grid_xs, screen->n_monitor_grid_xs,
+                                rect->x + rect->width - 1) + 1;
+      row = find_grid_cell (screen->monitor_grid_ys, screen->n_monitor_grid_ys,
+                            rect->y);
+      end_row = find_grid_cell (screen->monitor_grid_ys, screen->n_monitor_grid_ys,
+                                rect->y + rect->height - 1) + 1;
+
+      for (j = row; j < end_row; j++)
+        for (d = col; d < end_col; d++)
+          screen->monitor_grid[j * n_cols + d] = i;
+    }
+}
+
+/* Returns the index of the first monitor containing the point, or -1 */
+int
+meta_screen_find_monitor_at_point (MetaScreen *screen,
+                                   int         x,
+                                   int         y)
+{
+  int col, row;
+
+  col = find_grid_cell (screen->monitor_grid_xs, screen->n_monitor_grid_xs, x);
+  row = find_grid_cell (screen->monitor_grid_ys, screen->n_monitor_grid_ys, y);
+  if (col < 0 || row < 0)
+    return -1;
+
+  return screen->monitor_grid[row * (screen->n_monitor_grid_xs - 1) + col];
+}
+
 static void
 reload_monitor_infos (MetaScreen *screen)
 {
@@ -577,6 +762,8 @@ reload_monitor_infos (MetaScreen *screen)
 
   g_assert (screen->n_monitor_infos > 0);
   g_assert (screen->monitor_infos != NULL);
+
+  meta_screen_build_monitor_index (screen);
 }
 
 /* The guard window allows us to leave minimized windows mapped so
@@ -990,6 +1177,7 @@ meta_screen_free (MetaScreen *screen,
 
   if (screen->monitor_infos)
     g_free (screen->monitor_infos);
+  free_monitor_index (screen);
 
   if (screen->tile_preview_timeout_id)
     g_source_remove (screen->tile_preview_timeout_id);
@@ -1038,11 +1226,19 @@ list_windows (MetaScreen *screen)
           meta_verbose ("Failed to get attributes for window 0x%lx\n",
                         children[i]);
 	  g_free (info);
+          continue;
         }
-      else
-        {
-	  info->xwindow = children[i];
-	}
+
+      info->xwindow = children[i];
+
+      /* Send the property requests for this window now; the replies
+       * come in while we wait for the attributes of the next window,
+       * so by the time the windows are created there is nothing left
+       * to wait for.
+       */
+      meta_display_prefetch_initial_properties (screen->display,
+                                                info->xwindow,
+                                                info->attrs.override_redirect);
 
       result = g_list_prepend (result, info);
     }
@@ -1058,6 +1254,9 @@ meta_screen_manage_all_windows (MetaScreen *screen)
 {
   GList *windows;
   GList *list;
+  gint64 start_time;
+  guint n_prop_syncs;
+  guint n_windows;
 
   meta_display_grab (screen->display);
 
@@ -1065,7 +1264,11 @@ meta_screen_manage_all_windows (MetaScreen *screen)
     screen->guard_window = create_guard_window (screen->display->xdisplay,
                                                 screen);
 
+  start_time = g_get_monotonic_time ();
+  n_prop_syncs = screen->display->n_initial_prop_syncs;
+
   windows = list_windows (screen);
+  n_windows = g_list_length (windows);
 
   meta_stack_freeze (screen->stack);
   for (list = windows; list != NULL; list = list->next)
@@ -1078,10 +1281,20 @@ meta_screen_manage_all_windows (MetaScreen *screen)
     }
   meta_stack_thaw (screen->stack);
 
+  /* Windows we decided not to manage never used their properties */
+  meta_display_discard_prefetched_properties (screen->display);
+
   g_list_foreach (windows, (GFunc)g_free, NULL);
   g_list_free (windows);
 
   meta_display_ungrab (screen->display);
+
+  meta_topic (META_DEBUG_STARTUP,
+              "Adopted %u windows on screen %d in %" G_GINT64_FORMAT " us "
+              "with %u round trips for initial properties\n",
+              n_windows, screen->number,
+              g_get_monotonic_time () - start_time,
+              screen->display->n_initial_prop_syncs - n_prop_syncs);
 }
 
 /**
@@ -2007,10 +2220,23 @@ meta_screen_get_monitor_for_rect (MetaScreen    *screen,
   if (screen->n_monitor_infos == 1)
     return &screen->monitor_infos[0];
 
+  rect_area = meta_rectangle_area (rect);
+
+  /* Usually the rectangle is within a single monitor; then the first
+   * monitor containing its corner contains all of it, and no monitor
+   * before it can.
+   */
+  if (rect_area > 0)
+    {
+      i = meta_screen_find_monitor_at_point (screen, rect->x, rect->y);
+      if (i >= 0 &&
+          meta_rectangle_contains_rect (&screen->monitor_infos[i].rect, rect))
+        return &screen->monitor_infos[i];
+    }
+
   best_monitor = 0;
   monitor_score = -1;
 
-  rect_area = meta_rectangle_area (rect);
   for (i = 0; i < screen->n_monitor_infos; i++)
     {
       gboolean result;
@@ -2065,32 +2291,13 @@ meta_screen_get_monitor_neighbor (MetaScreen         *screen,
                                   int                 which_monitor,
                                   MetaScreenDirection direction)
 {
-  MetaMonitorInfo* input = screen->monitor_infos + which_monitor;
-  MetaMonitorInfo* current;
-  int i;
+  int neighbor;
 
-  for (i = 0; i < screen->n_monitor_infos; i++)
-    {
-      current = screen->monitor_infos + i;
-
-      if ((direction == META_SCREEN_RIGHT && 
-           current->rect.x == input->rect.x + input->rect.width &&
-           meta_rectangle_vert_overlap(&current->rect, &input->rect)) ||
-          (direction == META_SCREEN_LEFT && 
-           input->rect.x == current->rect.x + current->rect.width &&
-           meta_rectangle_vert_overlap(&current->rect, &input->rect)) ||
-          (direction == META_SCREEN_UP && 
-           input->rect.y == current->rect.y + current->rect.height &&
-           meta_rectangle_horiz_overlap(&current->rect, &input->rect)) ||
-          (direction == META_SCREEN_DOWN && 
-           current->rect.y == input->rect.y + input->rect.height &&
-           meta_rectangle_horiz_overlap(&current->rect, &input->rect)))
-        {
-          return current;
-        }
-    }
-  
-  return NULL;
+  neighbor = screen->monitor_neighbors[which_monitor * 4 + direction];
+  if (neighbor < 0)
+    return NULL;
+
+  return &screen->monitor_infos[neighbor];
 }
 
 void
@@ -2221,8 +2428,6 @@ meta_screen_get_current_monitor (MetaScreen *screen)
       XIButtonState buttons;
       XIModifierState mods;
       XIGroupState group;
-      int i;
-      MetaRectangle pointer_position;
 
       screen->display->monitor_cache_invalidated = FALSE;
       
@@ -2240,20 +2445,10 @@ meta_screen_get_current_monitor (MetaScreen *screen)
                       &group);
       free (buttons.mask);
 
-      pointer_position.x = root_x_return;
-      pointer_position.y = root_y_return;
-      pointer_position.width = pointer_position.height = 1;
-
-      screen->last_monitor_index = 0;
-      for (i = 0; i < screen->n_monitor_infos; i++)
-        {
-          if (meta_rectangle_contains_rect (&screen->monitor_infos[i].rect,
-                                            &pointer_position))
-            {
-              screen->last_monitor_index = i;
-              break;
-            }
-        }
+      screen->last_monitor_index =
+        MAX (0, meta_screen_find_monitor_at_point (screen,
+                                                   root_x_return,
+                                                   root_y_return));
       
       meta_topic (META_DEBUG_XINERAMA,
                   "Rechecked current monitor, now %d\n",
@@ -2263,6 +2458,26 @@ meta_screen_get_current_monitor (MetaScreen *screen)
   return screen->last_monitor_index;
 }
 
+/**
+ * meta_screen_update_pointer_monitor: (skip)
+ * @screen: a #MetaScreen
+ * @root_x: the X position of the pointer
+ * @root_y: the Y position of the pointer
+ *
+ * Updates the cached current monitor from the position of the pointer
+ * in an event, so that meta_screen_get_current_monitor() doesn't have
+ * to query it.
+ */
+void
+meta_screen_update_pointer_monitor (MetaScreen *screen,
+                                    int         root_x,
+                                    int         root_y)
+{
+  screen->last_monitor_index =
+    MAX (0, meta_screen_find_monitor_at_point (screen, root_x, root_y));
+  screen->display->monitor_cache_invalidated = FALSE;
+}
+
 /**
  * meta_screen_get_n_monitors:
  * @screen: a #MetaScreen
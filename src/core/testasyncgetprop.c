@@ -362,27 +362,19 @@ main (int argc, char **argv)
   return 0;
 }
 
-/* This function doesn't have all the printf's
- * and other noise, it just compares async to sync
+/* Sends n_props requests at once, so that all of them are in flight
+ * before the first reply is matched, and returns how long it took
+ * to collect all the replies.
  */
-static void
-run_speed_comparison (Display *xdisplay,
-                      Window   window)
+static double
+time_async_requests (Display *xdisplay,
+                     Window   window,
+                     int      n_props)
 {
   int i;
-  int n_props;
   struct timeval start, end;
   int n_left;
   
-  /* We just use atom values (0 to n_props) % 200, many are probably
-   * BadAtom, that's fine, but the %200 keeps most of them valid. The
-   * async case is about twice as advantageous when using valid atoms
-   * (or the issue may be that it's more advantageous when the
-   * properties are present and data is transmitted).
-   */
-  n_props = 4000;
-  printf ("Timing with %d property requests\n", n_props);
-  
   gettimeofday (&start, NULL);
   
   i = 0;
@@ -451,9 +443,17 @@ run_speed_comparison (Display *xdisplay,
     }
   
   gettimeofday (&end, NULL);
-  
-  printf ("Async time: %gms\n",
-          ELAPSED (start, end));
+
+  return ELAPSED (start, end);
+}
+
+static double
+time_sync_requests (Display *xdisplay,
+                    Window   window,
+                    int      n_props)
+{
+  int i;
+  struct timeval start, end;
   
   gettimeofday (&start, NULL);
 
@@ -490,7 +490,42 @@ run_speed_comparison (Display *xdisplay,
   error_trap_pop (xdisplay);
   
   gettimeofday (&end, NULL);
+
+  return ELAPSED (start, end);
+}
+
+/* This function doesn't have all the printf's
+ * and other noise, it just compares async to sync
+ * for growing numbers of requests in flight
+ */
+static void
+run_speed_comparison (Display *xdisplay,
+                      Window   window)
+{
+  static const int n_in_flight[] = { 100, 1000, 4000, 16000, 64000 };
+  int i;
   
-  printf ("Sync time:  %gms\n",
-          ELAPSED (start, end));
+  /* We just use atom values (0 to n_props) % 200, many are probably
+   * BadAtom, that's fine, but the %200 keeps most of them valid. The
+   * async case is about twice as advantageous when using valid atoms
+   * (or the issue may be that it's more advantageous when the
+   * properties are present and data is transmitted).
+   */
+  for (i = 0; i < (int) (sizeof (n_in_flight) / sizeof (n_in_flight[0])); i++)
+    {
+      int n_props = n_in_flight[i];
+      double async_time, sync_time;
+
+      /* Once to warm up the task pool and the pending ring */
+      time_async_requests (xdisplay, window, n_props);
+
+      async_time = time_async_requests (xdisplay, window, n_props);
+      sync_time = time_sync_requests (xdisplay, window, n_props);
+
+      printf ("%6d requests: async %9gms (%9.0f replies/s), "
+              "sync %9gms (%9.0f replies/s)\n",
+              n_props,
+              async_time, n_props / (async_time / 1000.0),
+              sync_time, n_props / (sync_time / 1000.0));
+    }
 }
@@ -99,6 +99,21 @@ new_monitor_edge (int x, int y, int width, int height, int side_type)
   return temporary;
 }
 
+static MetaEdge*
+new_window_edge (int x, int y, int width, int height, int side_type)
+{
+  MetaEdge* temporary;
+  temporary = g_new (MetaEdge, 1);
+  temporary->rect.x = x;
+  temporary->rect.y = y;
+  temporary->rect.width  = width;
+  temporary->rect.height = height;
+  temporary->side_type = side_type;
+  temporary->edge_type = META_EDGE_WINDOW;
+
+  return temporary;
+}
+
 static void
 test_area ()
 {
@@ -664,13 +679,246 @@ test_regions_okay ()
   region = get_screen_region (5);
   verify_lists_are_equal (region, NULL);
 
-  /* FIXME: Still to do:
-   *   - Create random struts and check the regions somehow
-   */
+  printf ("%s passed.\n", G_STRFUNC);
+}
+
+static GSList*
+get_random_strut_list (int n_struts)
+{
+  GSList *ans = NULL;
+  int i;
+
+  for (i = 0; i < n_struts; i++)
+    {
+      MetaRectangle rect;
+
+      if (rand () % 2)
+        {
+          /* Partial struts along the sides of the screen, like panels */
+          int thickness = (rand () % 5 + 1) * 8;
+          int begin = (rand () % 8) * 200;
+          int length = (rand () % 4 + 1) * 200;
+
+          switch (rand () % 4)
+            {
+            case 0:
+              rect = meta_rect (0, begin, thickness, length);
+              break;
+            case 1:
+              rect = meta_rect (1600 - thickness, begin, thickness, length);
+              break;
+            case 2:
+              rect = meta_rect (begin, 0, length, thickness);
+              break;
+            default:
+              rect = meta_rect (begin, 1200 - thickness, length, thickness);
+              break;
+            }
+        }
+      else
+        {
+          /* Anything, possibly sticking out of the screen */
+          rect.x = rand () % 1700 - 50;
+          rect.y = rand () % 1300 - 50;
+          rect.width  = rand () % 400 + 1;
+          rect.height = rand () % 300 + 1;
+        }
+
+      ans = g_slist_prepend (ans, new_meta_strut (rect.x, rect.y,
+                                                  rect.width, rect.height,
+                                                  0));
+    }
+
+  return ans;
+}
+
+static gboolean
+rect_is_clear_of_struts (const MetaRectangle *rect,
+                         const MetaRectangle *basic_rect,
+                         GSList              *struts)
+{
+  GSList *tmp;
+
+  if (!meta_rectangle_contains_rect (basic_rect, rect))
+    return FALSE;
+
+  for (tmp = struts; tmp; tmp = tmp->next)
+    if (meta_rectangle_overlap (rect, &((MetaStrut*)tmp->data)->rect))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* The maximal rectangles of basic_rect not overlapping any of the
+ * struts, found by trying all the rectangles with their sides on the
+ * sides of basic_rect and the struts
+ */
+static GList*
+get_maximal_rects_by_brute_force (const MetaRectangle *basic_rect,
+                                  GSList              *struts)
+{
+  GArray *xs, *ys;
+  GSList *tmp;
+  GList *ret = NULL;
+  int x0, x1, y0, y1;
+
+  xs = g_array_new (FALSE, FALSE, sizeof (int));
+  ys = g_array_new (FALSE, FALSE, sizeof (int));
+  g_array_append_val (xs, basic_rect->x);
+  g_array_append_val (ys, basic_rect->y);
+  for (tmp = struts; tmp; tmp = tmp->next)
+    {
+      MetaRectangle *rect = &((MetaStrut*)tmp->data)->rect;
+      int right = BOX_RIGHT (*rect);
+      int bottom = BOX_BOTTOM (*rect);
+
+      g_array_append_val (xs, rect->x);
+      g_array_append_val (xs, right);
+      g_array_append_val (ys, rect->y);
+      g_array_append_val (ys, bottom);
+    }
+  x0 = BOX_RIGHT (*basic_rect);
+  y0 = BOX_BOTTOM (*basic_rect);
+  g_array_append_val (xs, x0);
+  g_array_append_val (ys, y0);
+
+  for (x0 = 0; x0 < (int) xs->len; x0++)
+    for (x1 = 0; x1 < (int) xs->len; x1++)
+      for (y0 = 0; y0 < (int) ys->len; y0++)
+        for (y1 = 0; y1 < (int) ys->len; y1++)
+          {
+            MetaRectangle rect, bigger;
+            GList *other;
+            gboolean maximal = TRUE;
+
+            rect.x = g_array_index (xs, int, x0);
+            rect.y = g_array_index (ys, int, y0);
+            rect.width = g_array_index (xs, int, x1) - rect.x;
+            rect.height = g_array_index (ys, int, y1) - rect.y;
+
+            if (rect.width <= 0 || rect.height <= 0 ||
+                !rect_is_clear_of_struts (&rect, basic_rect, struts))
+              continue;
+
+            /* Every side of a bigger rectangle is on one of those sides
+             * too, so growing it by one pixel in any direction is enough
+             * to check.
+             */
+            bigger = rect;
+            bigger.x--;
+            bigger.width++;
+            maximal = maximal &&
+              !rect_is_clear_of_struts (&bigger, basic_rect, struts);
+            bigger = rect;
+            bigger.width++;
+            maximal = maximal &&
+              !rect_is_clear_of_struts (&bigger, basic_rect, struts);
+            bigger = rect;
+            bigger.y--;
+            bigger.height++;
+            maximal = maximal &&
+              !rect_is_clear_of_struts (&bigger, basic_rect, struts);
+            bigger = rect;
+            bigger.height++;
+            maximal = maximal &&
+              !rect_is_clear_of_struts (&bigger, basic_rect, struts);
+
+            for (other = ret; maximal && other; other = other->next)
+              maximal = !meta_rectangle_equal (&rect, other->data);
+
+            if (maximal)
+              ret = g_list_prepend (ret, new_meta_rect (rect.x, rect.y,
+                                                        rect.width,
+                                                        rect.height));
+          }
+
+  g_array_free (xs, TRUE);
+  g_array_free (ys, TRUE);
+
+  return ret;
+}
+
+static gint
+rect_cmp (gconstpointer a, gconstpointer b)
+{
+  const MetaRectangle *a_rect = a;
+  const MetaRectangle *b_rect = b;
+
+  if (a_rect->x != b_rect->x)
+    return a_rect->x - b_rect->x;
+  if (a_rect->y != b_rect->y)
+    return a_rect->y - b_rect->y;
+  if (a_rect->width != b_rect->width)
+    return a_rect->width - b_rect->width;
+  return a_rect->height - b_rect->height;
+}
+
+static void
+test_random_regions ()
+{
+  MetaRectangle basic_rect = { 0, 0, 1600, 1200 };
+  GList *region, *answer, *tmp;
+  GSList *struts;
+  int i;
+
+  /* The brute force is slow, so keep the number of struts down */
+  for (i = 0; i < NUM_RANDOM_RUNS / 10; i++)
+    {
+      struts = get_random_strut_list (rand () % 9);
+
+      region = meta_rectangle_get_minimal_spanning_set_for_region (&basic_rect,
+                                                                   struts);
+      answer = get_maximal_rects_by_brute_force (&basic_rect, struts);
+
+      /* The region is sorted by area, largest first */
+      for (tmp = region; tmp && tmp->next; tmp = tmp->next)
+        g_assert (meta_rectangle_area (tmp->data) >=
+                  meta_rectangle_area (tmp->next->data));
+
+      region = g_list_sort (region, rect_cmp);
+      answer = g_list_sort (answer, rect_cmp);
+      verify_lists_are_equal (region, answer);
+
+      meta_rectangle_free_list_and_elements (region);
+      meta_rectangle_free_list_and_elements (answer);
+      free_strut_list (struts);
+    }
 
   printf ("%s passed.\n", G_STRFUNC);
 }
 
+static void
+time_minimal_spanning_set ()
+{
+  static const int strut_counts[] = { 2, 8, 32, 128 };
+  MetaRectangle basic_rect = { 0, 0, 1600, 1200 };
+  GSList *struts;
+  GTimer *timer;
+  int i, j;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < (int) G_N_ELEMENTS (strut_counts); i++)
+    {
+      int n_runs = 20000 / strut_counts[i];
+
+      struts = get_random_strut_list (strut_counts[i]);
+
+      g_timer_start (timer);
+      for (j = 0; j < n_runs; j++)
+        meta_rectangle_free_list_and_elements (
+          meta_rectangle_get_minimal_spanning_set_for_region (&basic_rect,
+                                                              struts));
+
+      printf ("%d struts: %.3f ms\n", strut_counts[i],
+              g_timer_elapsed (timer, NULL) / n_runs * 1000);
+
+      free_strut_list (struts);
+    }
+
+  g_timer_destroy (timer);
+}
+
 static void
 test_region_fitting ()
 {
@@ -1233,6 +1481,163 @@ test_find_nonintersected_monitor_edges ()
   printf ("%s passed.\n", G_STRFUNC);
 }
 
+/* What compute_resistance_and_snapping_edges() used to do: split the
+ * edges of each window by every window above it.
+ */
+static GList*
+find_window_edges_by_splitting (const MetaRectangle *rects,
+                                const gboolean      *has_edges,
+                                int                  n_rects,
+                                const MetaRectangle *clip)
+{
+  GList *edges = NULL;
+  GSList *above = NULL;
+  int i;
+
+  for (i = n_rects - 1; i >= 0; i--)
+    {
+      MetaRectangle reduced;
+      GList *new_edges = NULL;
+
+      if (has_edges[i] && meta_rectangle_intersect (&rects[i], clip, &reduced))
+        {
+          new_edges = g_list_prepend (new_edges,
+            new_window_edge (reduced.x, reduced.y, 0, reduced.height,
+                             META_SIDE_RIGHT));
+          new_edges = g_list_prepend (new_edges,
+            new_window_edge (BOX_RIGHT (reduced), reduced.y, 0, reduced.height,
+                             META_SIDE_LEFT));
+          new_edges = g_list_prepend (new_edges,
+            new_window_edge (reduced.x, reduced.y, reduced.width, 0,
+                             META_SIDE_BOTTOM));
+          new_edges = g_list_prepend (new_edges,
+            new_window_edge (reduced.x, BOX_BOTTOM (reduced), reduced.width, 0,
+                             META_SIDE_TOP));
+
+          new_edges =
+            meta_rectangle_remove_intersections_with_boxes_from_edges (new_edges,
+                                                                       above);
+          edges = g_list_concat (new_edges, edges);
+        }
+
+      above = g_slist_prepend (above, (gpointer) &rects[i]);
+    }
+
+  g_slist_free (above);
+
+  return edges;
+}
+
+/* meta_rectangle_edge_cmp() doesn't look at the lengths */
+static gint
+edge_cmp_with_length (gconstpointer a, gconstpointer b)
+{
+  const MetaEdge *a_edge = a;
+  const MetaEdge *b_edge = b;
+  int result;
+
+  result = meta_rectangle_edge_cmp (a, b);
+  if (result == 0)
+    result = (a_edge->rect.width + a_edge->rect.height) -
+             (b_edge->rect.width + b_edge->rect.height);
+
+  return result;
+}
+
+static void
+get_random_window_layout (MetaRectangle *rects,
+                          gboolean      *has_edges,
+                          int            n_rects)
+{
+  int i;
+
+  for (i = 0; i < n_rects; i++)
+    {
+      /* Lots of windows sharing edges, like tiled or cascaded ones */
+      rects[i].x = (rand () % 1800) / 50 * 50 - 100;
+      rects[i].y = (rand () % 1400) / 50 * 50 - 100;
+      rects[i].width  = (rand () % 900) / 50 * 50 + (rand () % 4 == 0);
+      rects[i].height = (rand () % 700) / 50 * 50;
+      /* Some docks, which only obscure */
+      has_edges[i] = rand () % 8 != 0;
+    }
+}
+
+static void
+test_find_window_edges ()
+{
+  MetaRectangle screen = { 0, 0, 1600, 1200 };
+  MetaRectangle rects[40];
+  gboolean has_edges[40];
+  GList *edges, *answer;
+  int i;
+
+  for (i = 0; i < NUM_RANDOM_RUNS; i++)
+    {
+      int n_rects = rand () % (int) G_N_ELEMENTS (rects) + 1;
+
+      get_random_window_layout (rects, has_edges, n_rects);
+
+      edges = meta_rectangle_find_window_edges (rects, has_edges, n_rects,
+                                                &screen);
+      answer = find_window_edges_by_splitting (rects, has_edges, n_rects,
+                                               &screen);
+
+      edges = g_list_sort (edges, edge_cmp_with_length);
+      answer = g_list_sort (answer, edge_cmp_with_length);
+      verify_edge_lists_are_equal (edges, answer);
+
+      meta_rectangle_free_list_and_elements (edges);
+      meta_rectangle_free_list_and_elements (answer);
+    }
+
+  printf ("%s passed.\n", G_STRFUNC);
+}
+
+static void
+time_find_window_edges ()
+{
+  static const int window_counts[] = { 10, 50, 200, 500, 1000 };
+  MetaRectangle screen = { 0, 0, 1600, 1200 };
+  MetaRectangle *rects;
+  gboolean *has_edges;
+  GTimer *timer;
+  int i, j;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < (int) G_N_ELEMENTS (window_counts); i++)
+    {
+      int n_rects = window_counts[i];
+      int n_runs = 20000 / n_rects;
+      double split_time, sweep_time;
+
+      rects = g_new (MetaRectangle, n_rects);
+      has_edges = g_new (gboolean, n_rects);
+      get_random_window_layout (rects, has_edges, n_rects);
+
+      g_timer_start (timer);
+      for (j = 0; j < n_runs; j++)
+        meta_rectangle_free_list_and_elements (
+          find_window_edges_by_splitting (rects, has_edges, n_rects, &screen));
+      split_time = g_timer_elapsed (timer, NULL) / n_runs;
+
+      g_timer_start (timer);
+      for (j = 0; j < n_runs; j++)
+        meta_rectangle_free_list_and_elements (
+          meta_rectangle_find_window_edges (rects, has_edges, n_rects, &screen));
+      sweep_time = g_timer_elapsed (timer, NULL) / n_runs;
+
+      printf ("%d windows: splitting %.3f ms, sweeping %.3f ms\n",
+              n_rects, split_time * 1000, sweep_time * 1000);
+
+      g_free (rects);
+      g_free (has_edges);
+    }
+
+  g_timer_destroy (timer);
+}
+
 static void
 test_gravity_resize ()
 {
@@ -1397,6 +1802,7 @@ main()
   test_basic_fitting ();
 
   test_regions_okay ();
+  test_random_regions ();
   test_region_fitting ();
 
   test_clamping_to_region ();
@@ -1406,11 +1812,15 @@ main()
   /* And now the functions dealing with edges more than boxes */
   test_find_onscreen_edges ();
   test_find_nonintersected_monitor_edges ();
+  test_find_window_edges ();
 
   /* And now the misfit functions that don't quite fit in anywhere else... */
   test_gravity_resize ();
   test_find_closest_point_to_line ();
 
+  time_minimal_spanning_set ();
+  time_find_window_edges ();
+
   printf ("All tests passed.\n");
   return 0;
 }
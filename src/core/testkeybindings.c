@@ -0,0 +1,154 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Mutter keybinding lookup benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Times looking up the bindings for a key event in tables of 10, 100
+ * and 1000 bindings, comparing the linear scan we used to do with the
+ * (keycode, mask) index, and checks that both find the same bindings.
+ */
+
+#include "keybindings-private.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define N_LOOKUPS 1000000
+
+/* The modifier masks a binding can realistically end up with */
+static const unsigned int masks[] = {
+  0, ShiftMask, ControlMask, Mod1Mask, Mod4Mask,
+  ControlMask | Mod1Mask, ShiftMask | Mod4Mask, ControlMask | ShiftMask
+};
+
+static MetaKeyBinding *
+make_bindings (int n_bindings)
+{
+  MetaKeyBinding *bindings;
+  int i;
+
+  bindings = g_new0 (MetaKeyBinding, n_bindings);
+
+  for (i = 0; i < n_bindings; i++)
+    {
+      bindings[i].name = "benchmark";
+      bindings[i].keysym = i;
+      bindings[i].keycode = 8 + rand () % 248;
+      bindings[i].mask = masks[rand () % G_N_ELEMENTS (masks)];
+    }
+
+  return bindings;
+}
+
+static int
+linear_lookup (MetaKeyBinding *bindings,
+               int             n_bindings,
+               unsigned int    keycode,
+               unsigned int    mask)
+{
+  int i;
+
+  for (i = 0; i < n_bindings; i++)
+    if (bindings[i].keycode == keycode &&
+        bindings[i].mask == mask)
+      return i;
+
+  return -1;
+}
+
+static int
+index_lookup (GHashTable   *index,
+              unsigned int  keycode,
+              unsigned int  mask)
+{
+  GSList *l;
+
+  l = meta_key_binding_index_lookup (index, keycode, mask);
+
+  return l ? GPOINTER_TO_INT (l->data) : -1;
+}
+
+static void
+run_benchmark (int n_bindings)
+{
+  MetaKeyBinding *bindings;
+  GHashTable *index;
+  unsigned int *keycodes, *event_masks;
+  GTimer *timer;
+  double linear_time, index_time;
+  int linear_found, index_found;
+  int i;
+
+  bindings = make_bindings (n_bindings);
+  index = meta_key_binding_index_new (bindings, n_bindings);
+
+  keycodes = g_new (unsigned int, N_LOOKUPS);
+  event_masks = g_new (unsigned int, N_LOOKUPS);
+  for (i = 0; i < N_LOOKUPS; i++)
+    {
+      keycodes[i] = 8 + rand () % 248;
+      event_masks[i] = masks[rand () % G_N_ELEMENTS (masks)];
+    }
+
+  for (i = 0; i < N_LOOKUPS; i++)
+    g_assert (linear_lookup (bindings, n_bindings, keycodes[i], event_masks[i]) ==
+              index_lookup (index, keycodes[i], event_masks[i]));
+
+  timer = g_timer_new ();
+
+  linear_found = 0;
+  g_timer_start (timer);
+  for (i = 0; i < N_LOOKUPS; i++)
+    if (linear_lookup (bindings, n_bindings, keycodes[i], event_masks[i]) >= 0)
+      linear_found++;
+  linear_time = g_timer_elapsed (timer, NULL);
+
+  index_found = 0;
+  g_timer_start (timer);
+  for (i = 0; i < N_LOOKUPS; i++)
+    if (index_lookup (index, keycodes[i], event_masks[i]) >= 0)
+      index_found++;
+  index_time = g_timer_elapsed (timer, NULL);
+
+  g_assert (linear_found == index_found);
+
+  printf ("%5d bindings: linear %7.1f ns/lookup, index %7.1f ns/lookup (%d hits)\n",
+          n_bindings,
+          linear_time * 1e9 / N_LOOKUPS,
+          index_time * 1e9 / N_LOOKUPS,
+          index_found);
+
+  g_timer_destroy (timer);
+  g_free (keycodes);
+  g_free (event_masks);
+  g_hash_table_destroy (index);
+  g_free (bindings);
+}
+
+int
+main (int argc, char **argv)
+{
+  srand (42);
+
+  run_benchmark (10);
+  run_benchmark (100);
+  run_benchmark (1000);
+
+  return 0;
+}
@@ -0,0 +1,264 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Monitor index testing program */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Checks the monitor lookups that use the index built by
+ * meta_screen_build_monitor_index() against the linear scans over the
+ * monitors they replaced, on random layouts. Half of the monitors are
+ * laid out on a grid, as real ones are; the others may overlap each
+ * other or be empty.
+ */
+
+#include "screen-private.h"
+#include "boxes-private.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>      /* To initialize random seed */
+
+#define NUM_RANDOM_LAYOUTS 20000
+#define NUM_RECTS_PER_LAYOUT 500
+#define MAX_MONITORS 8
+
+static void
+init_random_ness ()
+{
+  srand(time(NULL));
+}
+
+static void
+get_random_layout (MetaScreen *screen)
+{
+  int i;
+
+  screen->n_monitor_infos = 1 + rand () % MAX_MONITORS;
+
+  for (i = 0; i < screen->n_monitor_infos; i++)
+    {
+      MetaRectangle *rect = &screen->monitor_infos[i].rect;
+
+      screen->monitor_infos[i].number = i;
+
+      if (rand () % 2)
+        {
+          rect->x = (rand () % 4) * 100;
+          rect->y = (rand () % 3) * 100;
+          rect->width = 100 * (1 + rand () % 2);
+          rect->height = 100;
+        }
+      else
+        {
+          rect->x = rand () % 300 - 50;
+          rect->y = rand () % 300 - 50;
+          rect->width = rand () % 200;
+          rect->height = rand () % 200;
+        }
+    }
+
+  meta_screen_build_monitor_index (screen);
+}
+
+static void
+get_random_rect (MetaRectangle *rect)
+{
+  rect->x = rand () % 500 - 100;
+  rect->y = rand () % 500 - 100;
+  rect->width = rand () % 150;
+  rect->height = rand () % 150;
+}
+
+/* The scan meta_screen_get_current_monitor() used to do */
+static int
+old_monitor_at_point (MetaScreen *screen,
+                      int         x,
+                      int         y)
+{
+  MetaRectangle pointer = { x, y, 1, 1 };
+  int i;
+
+  for (i = 0; i < screen->n_monitor_infos; i++)
+    if (meta_rectangle_contains_rect (&screen->monitor_infos[i].rect,
+                                      &pointer))
+      return i;
+
+  return 0;
+}
+
+/* The scan meta_screen_get_monitor_for_rect() used to do */
+static const MetaMonitorInfo*
+old_monitor_for_rect (MetaScreen    *screen,
+                      MetaRectangle *rect)
+{
+  int i;
+  int best_monitor, monitor_score, rect_area;
+
+  if (screen->n_monitor_infos == 1)
+    return &screen->monitor_infos[0];
+
+  rect_area = meta_rectangle_area (rect);
+  best_monitor = 0;
+  monitor_score = -1;
+
+  for (i = 0; i < screen->n_monitor_infos; i++)
+    {
+      gboolean result;
+      int cur;
+
+      if (rect_area > 0)
+        {
+          MetaRectangle dest;
+          result = meta_rectangle_intersect (&screen->monitor_infos[i].rect,
+                                             rect,
+                                             &dest);
+          cur = meta_rectangle_area (&dest);
+        }
+      else
+        {
+          result = meta_rectangle_contains_rect (&screen->monitor_infos[i].rect,
+                                                 rect);
+          cur = rect_area;
+        }
+
+      if (result && cur > monitor_score)
+        {
+          monitor_score = cur;
+          best_monitor = i;
+        }
+    }
+
+  return &screen->monitor_infos[best_monitor];
+}
+
+/* The scan meta_screen_get_monitor_neighbor() used to do */
+static const MetaMonitorInfo*
+old_monitor_neighbor (MetaScreen         *screen,
+                      int                 which_monitor,
+                      MetaScreenDirection direction)
+{
+  MetaMonitorInfo *input = screen->monitor_infos + which_monitor;
+  MetaMonitorInfo *current;
+  int i;
+
+  for (i = 0; i < screen->n_monitor_infos; i++)
+    {
+      current = screen->monitor_infos + i;
+
+      if ((direction == META_SCREEN_RIGHT &&
+           current->rect.x == input->rect.x + input->rect.width &&
+           meta_rectangle_vert_overlap (&current->rect, &input->rect)) ||
+          (direction == META_SCREEN_LEFT &&
+           input->rect.x == current->rect.x + current->rect.width &&
+           meta_rectangle_vert_overlap (&current->rect, &input->rect)) ||
+          (direction == META_SCREEN_UP &&
+           input->rect.y == current->rect.y + current->rect.height &&
+           meta_rectangle_horiz_overlap (&current->rect, &input->rect)) ||
+          (direction == META_SCREEN_DOWN &&
+           current->rect.y == input->rect.y + input->rect.height &&
+           meta_rectangle_horiz_overlap (&current->rect, &input->rect)))
+        {
+          return current;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+test_monitor_at_point (MetaScreen *screen)
+{
+  int i, j;
+
+  for (i = 0; i < NUM_RANDOM_LAYOUTS; i++)
+    {
+      get_random_layout (screen);
+
+      for (j = 0; j < NUM_RECTS_PER_LAYOUT; j++)
+        {
+          MetaRectangle rect;
+
+          get_random_rect (&rect);
+          g_assert (MAX (0, meta_screen_find_monitor_at_point (screen,
+                                                               rect.x,
+                                                               rect.y)) ==
+                    old_monitor_at_point (screen, rect.x, rect.y));
+        }
+    }
+
+  printf ("%s passed.\n", G_STRFUNC);
+}
+
+static void
+test_monitor_for_rect (MetaScreen *screen)
+{
+  int i, j;
+
+  for (i = 0; i < NUM_RANDOM_LAYOUTS; i++)
+    {
+      get_random_layout (screen);
+
+      for (j = 0; j < NUM_RECTS_PER_LAYOUT; j++)
+        {
+          MetaRectangle rect;
+
+          get_random_rect (&rect);
+          g_assert (meta_screen_get_monitor_for_rect (screen, &rect) ==
+                    old_monitor_for_rect (screen, &rect));
+        }
+    }
+
+  printf ("%s passed.\n", G_STRFUNC);
+}
+
+static void
+test_monitor_neighbors (MetaScreen *screen)
+{
+  int i, j, d;
+
+  for (i = 0; i < NUM_RANDOM_LAYOUTS; i++)
+    {
+      get_random_layout (screen);
+
+      for (j = 0; j < screen->n_monitor_infos; j++)
+        for (d = META_SCREEN_UP; d <= META_SCREEN_RIGHT; d++)
+          g_assert (meta_screen_get_monitor_neighbor (screen, j, d) ==
+                    old_monitor_neighbor (screen, j, d));
+    }
+
+  printf ("%s passed.\n", G_STRFUNC);
+}
+
+int
+main()
+{
+  MetaScreen *screen;
+
+  init_random_ness ();
+
+  /* Only the monitor fields are used */
+  screen = g_new0 (MetaScreen, 1);
+  screen->monitor_infos = g_new0 (MetaMonitorInfo, MAX_MONITORS);
+
+  test_monitor_at_point (screen);
+  test_monitor_for_rect (screen);
+  test_monitor_neighbors (screen);
+
+  printf ("All tests passed.\n");
+  return 0;
+}
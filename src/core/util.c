@@ -32,6 +32,8 @@
 
 #include <clutter/clutter.h> /* For clutter_threads_add_repaint_func() */
 
+#include "meta-frame-profiler.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -717,6 +719,13 @@ meta_show_dialog (const char *type,
 
 static guint last_later_id = 0;
 
+#define N_LATER_PHASES (META_LATER_IDLE + 1)
+
+/* How long a dispatch of the META_LATER_IDLE phase may take before the
+ * rest is left for the next one, so that a pile of low priority work
+ * doesn't hold up the next frame */
+#define IDLE_LATERS_BUDGET_US 4000
+
 typedef struct
 {
   guint id;
@@ -725,11 +734,28 @@ typedef struct
   GSourceFunc func;
   gpointer data;
   GDestroyNotify notify;
-  int source;
+  /* Our node in the queue of our phase, NULL once removed */
+  GList *link;
   gboolean run_once;
 } MetaLater;
 
-static GSList *laters = NULL;
+typedef struct
+{
+  /* Oldest first */
+  GQueue laters;
+  /* Idle handler running the phase from the main loop, if any */
+  guint source;
+} MetaLaterPhase;
+
+static MetaLaterPhase later_phases[N_LATER_PHASES];
+static GHashTable *laters_by_id = NULL;
+
+static const MetaFrameStage later_stages[N_LATER_PHASES] = {
+  META_FRAME_STAGE_RESIZE_LATERS,
+  META_FRAME_STAGE_BEFORE_REDRAW_LATERS,
+  META_FRAME_STAGE_IDLE_LATERS
+};
+
 /* This is a dummy timeline used to get the Clutter master clock running */
 static ClutterTimeline *later_timeline;
 static guint later_repaint_func = 0;
@@ -753,38 +779,39 @@ unref_later (MetaLater *later)
 static void
 destroy_later (MetaLater *later)
 {
-  if (later->source)
-    {
-      g_source_remove (later->source);
-      later->source = 0;
-    }
   later->func = NULL;
   unref_later (later);
 }
 
-/* Used to sort the list of laters with the highest priority
- * functions first.
+/* Runs the laters of a phase. From the repaint function, the laters
+ * that already ran from the idle handler of their phase are skipped.
+ * If @deadline is non-zero, the laters that are left when it is passed
+ * are deferred.
+ *
+ * Return value: %TRUE if a later that ran wants to be run again
  */
-static int
-compare_laters (gconstpointer a,
-                gconstpointer b)
-{
-  return ((const MetaLater *)a)->when - ((const MetaLater *)b)->when;
-}
-
 static gboolean
-run_repaint_laters (gpointer data)
+run_laters (MetaLaterType when,
+            gboolean      from_idle,
+            gint64        deadline)
 {
-  GSList *laters_copy;
+  MetaLaterPhase *phase = &later_phases[when];
+  GSList *laters_copy = NULL;
   GSList *l;
-  gboolean keep_timeline_running = FALSE;
+  GList *node;
+  gboolean run_again = FALSE;
+  int n_run = 0, n_deferred = 0;
 
-  laters_copy = NULL;
-  for (l = laters; l; l = l->next)
+  if (g_queue_is_empty (&phase->laters))
+    return FALSE;
+
+  meta_frame_profiler_stage_begin (later_stages[when]);
+
+  for (node = phase->laters.head; node; node = node->next)
     {
-      MetaLater *later = l->data;
-      if (later->source == 0 ||
-          (later->when <= META_LATER_BEFORE_REDRAW && !later->run_once))
+      MetaLater *later = node->data;
+
+      if (from_idle || !later->run_once)
         {
           later->ref_count++;
           laters_copy = g_slist_prepend (laters_copy, later);
@@ -796,22 +823,53 @@ run_repaint_laters (gpointer data)
     {
       MetaLater *later = l->data;
 
-      if (later->func && later->func (later->data))
+      /* Removed by an earlier one */
+      if (later->func == NULL)
+        ;
+      else if (deadline != 0 && n_run > 0 && g_get_monotonic_time () > deadline)
+        n_deferred++;
+      else if (later->func (later->data))
         {
-          if (later->source == 0)
-            keep_timeline_running = TRUE;
+          if (from_idle)
+            later->run_once = TRUE;
+          run_again = TRUE;
+          n_run++;
         }
       else
-        meta_later_remove (later->id);
+        {
+          meta_later_remove (later->id);
+          n_run++;
+        }
+
       unref_later (later);
     }
 
+  g_slist_free (laters_copy);
+
+  meta_frame_profiler_stage_end (later_stages[when]);
+
+  if (n_deferred > 0)
+    {
+      meta_frame_profiler_count (META_FRAME_COUNT_DEFERRED_LATERS, n_deferred);
+      meta_verbose ("Ran %d idle laters, deferred %d to the next idle\n",
+                    n_run, n_deferred);
+    }
+
+  return run_again;
+}
+
+static gboolean
+run_repaint_laters (gpointer data)
+{
+  gboolean keep_timeline_running;
+
+  run_laters (META_LATER_RESIZE, FALSE, 0);
+  keep_timeline_running = run_laters (META_LATER_BEFORE_REDRAW, FALSE, 0);
+
   if (!keep_timeline_running)
     clutter_timeline_stop (later_timeline);
 
-  g_slist_free (laters_copy);
-
-  /* Just keep the repaint func around - it's cheap if the list is empty */
+  /* Just keep the repaint func around - it's cheap if there are no laters */
   return TRUE;
 }
 
@@ -830,20 +888,35 @@ ensure_later_repaint_func (void)
 }
 
 static gboolean
-call_idle_later (gpointer data)
+run_idle_laters (gpointer data)
 {
-  MetaLater *later = data;
+  MetaLaterType when = GPOINTER_TO_INT (data);
+  MetaLaterPhase *phase = &later_phases[when];
+  gint64 deadline = 0;
+
+  if (when == META_LATER_IDLE)
+    deadline = g_get_monotonic_time () + IDLE_LATERS_BUDGET_US;
+
+  run_laters (when, TRUE, deadline);
 
-  if (!later->func (later->data))
+  if (g_queue_is_empty (&phase->laters))
     {
-      meta_later_remove (later->id);
+      phase->source = 0;
       return FALSE;
     }
-  else
-    {
-      later->run_once = TRUE;
-      return TRUE;
-    }
+
+  return TRUE;
+}
+
+static void
+ensure_later_idle (MetaLaterType when,
+                   int           priority)
+{
+  MetaLaterPhase *phase = &later_phases[when];
+
+  if (phase->source == 0)
+    phase->source = g_idle_add_full (priority, run_idle_laters,
+                                     GINT_TO_POINTER (when), NULL);
 }
 
 /**
@@ -870,6 +943,7 @@ meta_later_add (MetaLaterType  when,
                 GDestroyNotify notify)
 {
   MetaLater *later = g_slice_new0 (MetaLater);
+  MetaLaterPhase *phase = &later_phases[when];
 
   later->id = ++last_later_id;
   later->ref_count = 1;
@@ -878,12 +952,17 @@ meta_later_add (MetaLaterType  when,
   later->data = data;
   later->notify = notify;
 
-  laters = g_slist_insert_sorted (laters, later, compare_laters);
+  if (laters_by_id == NULL)
+    laters_by_id = g_hash_table_new (NULL, NULL);
+
+  g_queue_push_tail (&phase->laters, later);
+  later->link = phase->laters.tail;
+  g_hash_table_insert (laters_by_id, GUINT_TO_POINTER (later->id), later);
 
   switch (when)
     {
     case META_LATER_RESIZE:
-      /* We add this one two ways - as a high-priority idle and as a
+      /* We run this phase two ways - from a high-priority idle and from a
        * repaint func. If we are in a clutter event callback, the repaint
        * handler will get hit first, and we'll take care of this function
        * there so it gets called before the stage is redrawn, even if
@@ -891,14 +970,14 @@ meta_later_add (MetaLaterType  when,
        * handler will get hit first and we want to call this function
        * there so it will happen before GTK+ repaints.
        */
-      later->source = g_idle_add_full (META_PRIORITY_RESIZE, call_idle_later, later, NULL);
+      ensure_later_idle (when, META_PRIORITY_RESIZE);
       ensure_later_repaint_func ();
       break;
     case META_LATER_BEFORE_REDRAW:
       ensure_later_repaint_func ();
       break;
     case META_LATER_IDLE:
-      later->source = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, call_idle_later, later, NULL);
+      ensure_later_idle (when, G_PRIORITY_DEFAULT_IDLE);
       break;
     }
 
@@ -914,21 +993,22 @@ meta_later_add (MetaLaterType  when,
 void
 meta_later_remove (guint later_id)
 {
-  GSList *l;
+  MetaLater *later;
 
-  for (l = laters; l; l = l->next)
-    {
-      MetaLater *later = l->data;
-      if (later->id == later_id)
-        {
-          laters = g_slist_delete_link (laters, l);
-          /* If this was a "repaint func" later, we just let the
-           * repaint func run and get removed
-           */
-          destroy_later (later);
-          return;
-        }
-    }
+  if (laters_by_id == NULL)
+    return;
+
+  later = g_hash_table_lookup (laters_by_id, GUINT_TO_POINTER (later_id));
+  if (later == NULL)
+    return;
+
+  g_hash_table_remove (laters_by_id, GUINT_TO_POINTER (later_id));
+  g_queue_delete_link (&later_phases[later->when].laters, later->link);
+  later->link = NULL;
+
+  /* The idle handler of the phase, if any, goes away the next time it
+   * finds nothing to run */
+  destroy_later (later);
 }
 
 /* eof util.c */
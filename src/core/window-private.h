@@ -95,6 +95,9 @@ struct _MetaWindow
   
   MetaWindowType type;
   Atom type_atom;
+
+  /* Number of property reloads queued or in flight, see window-props.c */
+  guint n_prop_reloads;
   
   /* NOTE these five are not in UTF-8, we just treat them as random
    * binary data
@@ -8,7 +8,9 @@
  * and take appropriate action given their values.
  *
  * Note that all the meta_window_reload_propert* functions require a
- * round trip to the server.
+ * round trip to the server. Property changes notified by clients go
+ * through meta_window_queue_property_reload() instead, which doesn't
+ * wait for the replies.
  *
  * The guts of this system are in meta_display_init_window_prop_hooks().
  * Reading this function will give you insight into how this all fits
@@ -70,12 +72,18 @@ struct _MetaWindowPropHooks
 static void init_prop_value            (MetaWindow          *window,
                                         MetaWindowPropHooks *hooks,
                                         MetaPropValue       *value);
+static void init_prop_value_for_window (MetaWindowPropHooks *hooks,
+                                        gboolean             override_redirect,
+                                        MetaPropValue       *value);
 static void reload_prop_value          (MetaWindow          *window,
                                         MetaWindowPropHooks *hooks,
                                         MetaPropValue       *value,
                                         gboolean             initial);
 static MetaWindowPropHooks* find_hooks (MetaDisplay *display,
                                         Atom         property);
+static void cancel_property_reload (MetaWindow *window,
+                                    Window      xwindow,
+                                    Atom        property);
 
 
 void
@@ -91,6 +99,10 @@ meta_window_reload_property_from_xwindow (MetaWindow      *window,
   if (!hooks)
     return;
 
+  /* What we get now is newer than any reply to a queued reload */
+  if (window->n_prop_reloads > 0)
+    cancel_property_reload (window, xwindow, property);
+
   init_prop_value (window, hooks, &value);
 
   meta_prop_get_values (window->display, xwindow,
@@ -113,29 +125,494 @@ meta_window_reload_property (MetaWindow      *window,
                                             initial);
 }
 
+/* Property reloads queued by meta_window_queue_property_reload() are
+ * kept by a GSource with a priority just below that of the X event
+ * source, so that its requests are only sent once the pending events
+ * have been handled; all the changes a client makes to a property in a
+ * burst are collapsed into a single request. The replies are collected
+ * by the same source as they are read, in the order of the requests.
+ */
+typedef struct
+{
+  MetaWindow          *window;   /* NULL if cancelled while in flight */
+  Window               xwindow;
+  Atom                 property;
+  MetaWindowPropHooks *hooks;
+  MetaPropValue        value;
+  MetaPropFetch       *fetch;    /* NULL until the request is sent */
+} PropReload;
+
+typedef struct
+{
+  GSource      source;
+  MetaDisplay *display;
+  GPollFD      poll_fd;
+  GQueue       queued;      /* not sent yet, in the order of the notifies */
+  GHashTable  *queued_set;  /* the same, keyed by (xwindow, property) */
+  GQueue       in_flight;   /* sent, in the order of the requests */
+} PropReloadSource;
+
+static guint
+prop_reload_hash (gconstpointer key)
+{
+  const PropReload *reload = key;
+
+  return reload->xwindow ^ (reload->property * 31);
+}
+
+static gboolean
+prop_reload_equal (gconstpointer a,
+                   gconstpointer b)
+{
+  const PropReload *reload_a = a;
+  const PropReload *reload_b = b;
+
+  return reload_a->xwindow == reload_b->xwindow &&
+    reload_a->property == reload_b->property;
+}
+
+static void
+prop_reload_free (PropReload *reload)
+{
+  if (reload->fetch)
+    meta_prop_fetch_values_finish (reload->fetch);
+  meta_prop_free_values (&reload->value, 1);
+  g_slice_free (PropReload, reload);
+}
+
+static void
+send_queued_reloads (PropReloadSource *reload_source)
+{
+  PropReload *reload;
+
+  if (g_queue_is_empty (&reload_source->queued))
+    return;
+
+  while ((reload = g_queue_pop_head (&reload_source->queued)))
+    {
+      g_hash_table_remove (reload_source->queued_set, reload);
+
+      init_prop_value (reload->window, reload->hooks, &reload->value);
+      reload->fetch = meta_prop_fetch_values_begin (reload_source->display,
+                                                    reload->xwindow,
+                                                    &reload->value, 1);
+      g_queue_push_tail (&reload_source->in_flight, reload);
+    }
+
+  XFlush (reload_source->display->xdisplay);
+}
+
+static void
+finish_reload (PropReload *reload)
+{
+  meta_prop_fetch_values_finish (reload->fetch);
+  reload->fetch = NULL;
+
+  if (reload->window)
+    {
+      reload->window->n_prop_reloads -= 1;
+      reload_prop_value (reload->window, reload->hooks, &reload->value,
+                         FALSE);
+    }
+
+  prop_reload_free (reload);
+}
+
+static gboolean
+prop_reloads_ready (PropReloadSource *reload_source)
+{
+  PropReload *reload;
+
+  if (!g_queue_is_empty (&reload_source->queued))
+    return TRUE;
+
+  reload = g_queue_peek_head (&reload_source->in_flight);
+
+  return reload != NULL && meta_prop_fetch_values_ready (reload->fetch);
+}
+
+static gboolean
+prop_reload_prepare (GSource *source,
+                     gint    *timeout)
+{
+  *timeout = -1;
+
+  return prop_reloads_ready ((PropReloadSource *) source);
+}
+
+static gboolean
+prop_reload_check (GSource *source)
+{
+  PropReloadSource *reload_source = (PropReloadSource *) source;
+
+  /* The X event source usually reads the replies for us, but it may
+   * be checked after this one.
+   */
+  if ((reload_source->poll_fd.revents & G_IO_IN) &&
+      !g_queue_is_empty (&reload_source->in_flight))
+    XEventsQueued (reload_source->display->xdisplay, QueuedAfterReading);
+
+  return prop_reloads_ready (reload_source);
+}
+
+static gboolean
+prop_reload_dispatch (GSource     *source,
+                      GSourceFunc  callback,
+                      gpointer     user_data)
+{
+  PropReloadSource *reload_source = (PropReloadSource *) source;
+  PropReload *reload;
+
+  send_queued_reloads (reload_source);
+
+  /* Reload functions may queue more reloads, or flush them */
+  while ((reload = g_queue_peek_head (&reload_source->in_flight)) &&
+         meta_prop_fetch_values_ready (reload->fetch))
+    {
+      g_queue_pop_head (&reload_source->in_flight);
+      finish_reload (reload);
+    }
+
+  return TRUE;
+}
+
+static void
+prop_reload_finalize (GSource *source)
+{
+  PropReloadSource *reload_source = (PropReloadSource *) source;
+  PropReload *reload;
+
+  g_hash_table_destroy (reload_source->queued_set);
+
+  while ((reload = g_queue_pop_head (&reload_source->queued)))
+    prop_reload_free (reload);
+  while ((reload = g_queue_pop_head (&reload_source->in_flight)))
+    prop_reload_free (reload);
+}
+
+static GSourceFuncs prop_reload_funcs = {
+  prop_reload_prepare,
+  prop_reload_check,
+  prop_reload_dispatch,
+  prop_reload_finalize
+};
+
+static PropReloadSource*
+get_prop_reload_source (MetaDisplay *display)
+{
+  PropReloadSource *reload_source;
+
+  if (display->prop_reload_source)
+    return (PropReloadSource *) display->prop_reload_source;
+
+  reload_source = (PropReloadSource *) g_source_new (&prop_reload_funcs,
+                                                     sizeof (PropReloadSource));
+  reload_source->display = display;
+  g_queue_init (&reload_source->queued);
+  g_queue_init (&reload_source->in_flight);
+  reload_source->queued_set = g_hash_table_new (prop_reload_hash,
+                                                prop_reload_equal);
+
+  reload_source->poll_fd.fd = ConnectionNumber (display->xdisplay);
+  reload_source->poll_fd.events = G_IO_IN;
+  g_source_add_poll (&reload_source->source, &reload_source->poll_fd);
+
+  g_source_set_priority (&reload_source->source, G_PRIORITY_DEFAULT + 1);
+  g_source_attach (&reload_source->source, NULL);
+
+  display->prop_reload_source = &reload_source->source;
+
+  return reload_source;
+}
+
 void
-meta_window_load_initial_properties (MetaWindow *window)
+meta_window_queue_property_reload (MetaWindow *window,
+                                   Window      xwindow,
+                                   Atom        property)
 {
-  int i, j;
-  MetaPropValue *values;
-  int n_properties = 0;
+  PropReloadSource *reload_source;
+  MetaWindowPropHooks *hooks;
+  PropReload key;
+  PropReload *reload;
+
+  hooks = find_hooks (window->display, property);
+  if (!hooks || hooks->reload_func == NULL ||
+      (window->override_redirect && !hooks->include_override_redirect))
+    return;
+
+  reload_source = get_prop_reload_source (window->display);
+
+  key.xwindow = xwindow;
+  key.property = property;
+  if (g_hash_table_lookup (reload_source->queued_set, &key))
+    {
+      meta_verbose ("Coalescing reload of property %lu on %s\n",
+                    property, window->desc);
+      return;
+    }
+
+  reload = g_slice_new0 (PropReload);
+  reload->window = window;
+  reload->xwindow = xwindow;
+  reload->property = property;
+  reload->hooks = hooks;
+
+  g_queue_push_tail (&reload_source->queued, reload);
+  g_hash_table_insert (reload_source->queued_set, reload, reload);
+  window->n_prop_reloads += 1;
+}
+
+void
+meta_window_flush_property_reloads (MetaWindow *window)
+{
+  PropReloadSource *reload_source;
+  GList *l;
+
+  if (window->n_prop_reloads == 0)
+    return;
+
+  reload_source = get_prop_reload_source (window->display);
+
+  /* Send all of them, it costs nothing more */
+  send_queued_reloads (reload_source);
 
-  values = g_new0 (MetaPropValue, window->display->n_prop_hooks);
+  meta_topic (META_DEBUG_SYNC, "Flushing %u property reloads for %s\n",
+              window->n_prop_reloads, window->desc);
+
+  l = reload_source->in_flight.head;
+  while (l != NULL && window->n_prop_reloads > 0)
+    {
+      PropReload *reload = l->data;
+      GList *next = l->next;
+
+      if (reload->window == window)
+        {
+          g_queue_delete_link (&reload_source->in_flight, l);
+          finish_reload (reload);
+        }
+
+      l = next;
+    }
+}
+
+static void
+cancel_property_reload (MetaWindow *window,
+                        Window      xwindow,
+                        Atom        property)
+{
+  PropReloadSource *reload_source;
+  PropReload key;
+  PropReload *reload;
+  GList *l;
+
+  reload_source = get_prop_reload_source (window->display);
+
+  key.xwindow = xwindow;
+  key.property = property;
+  reload = g_hash_table_lookup (reload_source->queued_set, &key);
+  if (reload)
+    {
+      g_hash_table_remove (reload_source->queued_set, reload);
+      g_queue_remove (&reload_source->queued, reload);
+      prop_reload_free (reload);
+      window->n_prop_reloads -= 1;
+    }
+
+  /* Replies still in flight are collected but ignored */
+  for (l = reload_source->in_flight.head; l != NULL; l = l->next)
+    {
+      reload = l->data;
+
+      if (reload->window == window &&
+          reload->xwindow == xwindow &&
+          reload->property == property)
+        {
+          reload->window = NULL;
+          window->n_prop_reloads -= 1;
+        }
+    }
+}
+
+void
+meta_window_cancel_property_reloads (MetaWindow *window)
+{
+  PropReloadSource *reload_source;
+  GList *l;
+
+  if (window->n_prop_reloads == 0)
+    return;
+
+  reload_source = get_prop_reload_source (window->display);
+
+  l = reload_source->queued.head;
+  while (l != NULL)
+    {
+      PropReload *reload = l->data;
+      GList *next = l->next;
+
+      if (reload->window == window)
+        {
+          g_hash_table_remove (reload_source->queued_set, reload);
+          g_queue_delete_link (&reload_source->queued, l);
+          prop_reload_free (reload);
+        }
+
+      l = next;
+    }
+
+  for (l = reload_source->in_flight.head; l != NULL; l = l->next)
+    {
+      PropReload *reload = l->data;
+
+      if (reload->window == window)
+        reload->window = NULL;
+    }
+
+  window->n_prop_reloads = 0;
+}
+
+typedef struct
+{
+  Window         xwindow;
+  gboolean       override_redirect;
+  MetaPropValue *values;
+  int            n_values;
+  MetaPropFetch *fetch;
+} InitialPropFetch;
+
+static int
+init_initial_prop_values (MetaDisplay   *display,
+                          gboolean       override_redirect,
+                          MetaPropValue *values)
+{
+  int i, j;
 
   j = 0;
-  for (i = 0; i < window->display->n_prop_hooks; i++)
+  for (i = 0; i < display->n_prop_hooks; i++)
     {
-      MetaWindowPropHooks *hooks = &window->display->prop_hooks_table[i];
+      MetaWindowPropHooks *hooks = &display->prop_hooks_table[i];
       if (hooks->load_initially)
         {
-          init_prop_value (window, hooks, &values[j]);
+          init_prop_value_for_window (hooks, override_redirect, &values[j]);
           ++j;
         }
     }
-  n_properties = j;
 
-  meta_prop_get_values (window->display, window->xwindow,
-                        values, n_properties);
+  return j;
+}
+
+static void
+initial_prop_fetch_free (InitialPropFetch *initial)
+{
+  if (initial->fetch)
+    meta_prop_fetch_values_finish (initial->fetch);
+
+  meta_prop_free_values (initial->values, initial->n_values);
+  g_free (initial->values);
+  g_slice_free (InitialPropFetch, initial);
+}
+
+void
+meta_display_prefetch_initial_properties (MetaDisplay *display,
+                                          Window       xwindow,
+                                          gboolean     override_redirect)
+{
+  InitialPropFetch *initial;
+
+  if (display->initial_prop_fetches == NULL)
+    display->initial_prop_fetches =
+      g_hash_table_new_full (meta_unsigned_long_hash,
+                             meta_unsigned_long_equal,
+                             NULL,
+                             (GDestroyNotify) initial_prop_fetch_free);
+
+  initial = g_slice_new (InitialPropFetch);
+  initial->xwindow = xwindow;
+  initial->override_redirect = override_redirect;
+  initial->values = g_new0 (MetaPropValue, display->n_prop_hooks);
+  initial->n_values = init_initial_prop_values (display, override_redirect,
+                                                initial->values);
+  initial->fetch = meta_prop_fetch_values_begin (display, xwindow,
+                                                 initial->values,
+                                                 initial->n_values);
+
+  /* Replaces (and collects) any earlier prefetch for the same window;
+   * the key points into the value, so it must be replaced too.
+   */
+  g_hash_table_replace (display->initial_prop_fetches,
+                        &initial->xwindow, initial);
+}
+
+void
+meta_display_discard_prefetched_properties (MetaDisplay *display)
+{
+  if (display->initial_prop_fetches == NULL)
+    return;
+
+  g_hash_table_destroy (display->initial_prop_fetches);
+  display->initial_prop_fetches = NULL;
+}
+
+static InitialPropFetch*
+steal_initial_prop_fetch (MetaWindow *window)
+{
+  MetaDisplay *display = window->display;
+  InitialPropFetch *initial;
+
+  if (display->initial_prop_fetches == NULL)
+    return NULL;
+
+  initial = g_hash_table_lookup (display->initial_prop_fetches,
+                                 &window->xwindow);
+  if (initial == NULL)
+    return NULL;
+
+  g_hash_table_steal (display->initial_prop_fetches, &window->xwindow);
+
+  /* The prefetch chose its properties based on the override-redirect
+   * attribute at the time; throw it away if that changed since.
+   */
+  if (initial->override_redirect != window->override_redirect)
+    {
+      initial_prop_fetch_free (initial);
+      return NULL;
+    }
+
+  return initial;
+}
+
+void
+meta_window_load_initial_properties (MetaWindow *window)
+{
+  int i, j;
+  MetaPropValue *values;
+  int n_properties = 0;
+  InitialPropFetch *initial;
+
+  initial = steal_initial_prop_fetch (window);
+  if (initial != NULL)
+    {
+      /* The requests were sent by meta_display_prefetch_initial_properties();
+       * normally some earlier round trip has already read the replies.
+       */
+      if (meta_prop_fetch_values_finish (initial->fetch))
+        window->display->n_initial_prop_syncs++;
+      initial->fetch = NULL;
+
+      values = initial->values;
+      n_properties = initial->n_values;
+    }
+  else
+    {
+      values = g_new0 (MetaPropValue, window->display->n_prop_hooks);
+      n_properties = init_initial_prop_values (window->display,
+                                               window->override_redirect,
+                                               values);
+
+      meta_prop_get_values (window->display, window->xwindow,
+                            values, n_properties);
+      window->display->n_initial_prop_syncs++;
+    }
 
   j = 0;
   for (i = 0; i < window->display->n_prop_hooks; i++)
@@ -153,9 +630,15 @@ meta_window_load_initial_properties (MetaWindow *window)
         }
     }
 
-  meta_prop_free_values (values, n_properties);
-
-  g_free (values);
+  if (initial != NULL)
+    {
+      initial_prop_fetch_free (initial);
+    }
+  else
+    {
+      meta_prop_free_values (values, n_properties);
+      g_free (values);
+    }
 }
 
 /* Fill in the MetaPropValue used to get the value of "property" */
@@ -163,9 +646,17 @@ static void
 init_prop_value (MetaWindow          *window,
                  MetaWindowPropHooks *hooks,
                  MetaPropValue       *value)
+{
+  init_prop_value_for_window (hooks, window->override_redirect, value);
+}
+
+static void
+init_prop_value_for_window (MetaWindowPropHooks *hooks,
+                            gboolean             override_redirect,
+                            MetaPropValue       *value)
 {
   if (!hooks || hooks->type == META_PROP_VALUE_INVALID ||
-      (window->override_redirect && !hooks->include_override_redirect))
+      (override_redirect && !hooks->include_override_redirect))
     {
       value->type = META_PROP_VALUE_INVALID;
       value->atom = None;
@@ -1809,6 +2300,15 @@ meta_display_init_window_prop_hooks (MetaDisplay *display)
 void
 meta_display_free_window_prop_hooks (MetaDisplay *display)
 {
+  meta_display_discard_prefetched_properties (display);
+
+  if (display->prop_reload_source)
+    {
+      g_source_destroy (display->prop_reload_source);
+      g_source_unref (display->prop_reload_source);
+      display->prop_reload_source = NULL;
+    }
+
   g_hash_table_unref (display->prop_hooks);
   display->prop_hooks = NULL;
 
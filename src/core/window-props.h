@@ -51,6 +51,40 @@ void meta_window_reload_property_from_xwindow (MetaWindow      *window,
                                                Atom             property,
                                                gboolean         initial);
 
+/**
+ * meta_window_queue_property_reload:
+ * @window:     The window the property belongs to.
+ * @xwindow:    The X handle for the window; this is different from
+ *              that of @window for the user time window.
+ * @property:   A single X atom.
+ *
+ * Like meta_window_reload_property_from_xwindow(), but without waiting
+ * for the reply. The request is sent once the pending events have been
+ * handled, and repeated changes of the same property before then only
+ * make one request. The property is dealt with when the reply arrives.
+ */
+void meta_window_queue_property_reload (MetaWindow *window,
+                                        Window      xwindow,
+                                        Atom        property);
+
+/**
+ * meta_window_flush_property_reloads:
+ * @window:      The window.
+ *
+ * Deals with the property reloads queued for @window right away,
+ * making a round trip if their replies haven't arrived yet.
+ */
+void meta_window_flush_property_reloads (MetaWindow *window);
+
+/**
+ * meta_window_cancel_property_reloads:
+ * @window:      The window.
+ *
+ * Drops the property reloads queued for @window; used when the window
+ * is unmanaged.
+ */
+void meta_window_cancel_property_reloads (MetaWindow *window);
+
 /**
  * meta_window_load_initial_properties:
  * @window:      The window.
@@ -61,6 +95,30 @@ void meta_window_reload_property_from_xwindow (MetaWindow      *window,
  */
 void meta_window_load_initial_properties (MetaWindow *window);
 
+/**
+ * meta_display_prefetch_initial_properties:
+ * @display:           The display.
+ * @xwindow:           The X handle for a window we are about to manage.
+ * @override_redirect: Whether the window is override-redirect.
+ *
+ * Sends the requests for the properties meta_window_load_initial_properties()
+ * needs, without waiting for the replies. When the window is later created,
+ * its initial properties are taken from the prefetched replies instead of
+ * making another round trip. Used to pipeline window adoption at startup.
+ */
+void meta_display_prefetch_initial_properties (MetaDisplay *display,
+                                               Window       xwindow,
+                                               gboolean     override_redirect);
+
+/**
+ * meta_display_discard_prefetched_properties:
+ * @display:  The display.
+ *
+ * Frees any prefetched properties that weren't used by a new window,
+ * for example because the window turned out not to need managing.
+ */
+void meta_display_discard_prefetched_properties (MetaDisplay *display);
+
 /**
  * meta_display_init_window_prop_hooks:
  * @display:  The display.
@@ -1694,6 +1694,8 @@ meta_window_unmanage (MetaWindow  *window,
 
   window->unmanaging = TRUE;
 
+  meta_window_cancel_property_reloads (window);
+
   if (meta_prefs_get_attach_modal_dialogs ())
     {
       GList *attached_children = NULL, *iter;
@@ -1985,6 +1987,7 @@ meta_window_update_on_all_workspaces (MetaWindow *window)
               tmp = tmp->next;
             }
         }
+      meta_workspace_update_window_location (window);
       meta_window_set_current_workspace_hint (window);
     }
 }
@@ -2293,6 +2296,64 @@ stackcmp (gconstpointer a, gconstpointer b)
                                    aw, bw);
 }
 
+/* Above this many windows, sort_by_stacking() goes through the stacks
+ * instead of sorting */
+#define SORT_BY_STACK_WALK_THRESHOLD 16
+
+/* Sorts @windows bottom to top. When many windows are queued at once,
+ * as on a workspace switch, picking them out of the stacks, which are
+ * already sorted, is cheaper than comparing them.
+ */
+static GSList *
+sort_by_stacking (GSList *windows)
+{
+  GHashTable *queued;
+  GSList *screens = NULL;
+  GSList *sorted = NULL;
+  GSList *tmp;
+
+  if (g_slist_length (windows) <= SORT_BY_STACK_WALK_THRESHOLD)
+    return g_slist_sort (windows, stackcmp);
+
+  queued = g_hash_table_new (NULL, NULL);
+  for (tmp = windows; tmp != NULL; tmp = tmp->next)
+    {
+      MetaWindow *window = tmp->data;
+
+      g_hash_table_insert (queued, window, window);
+      if (!g_slist_find (screens, window->screen))
+        screens = g_slist_prepend (screens, window->screen);
+    }
+
+  for (tmp = screens; tmp != NULL; tmp = tmp->next)
+    {
+      MetaScreen *screen = tmp->data;
+      GList *stacked, *l;
+
+      /* Bottom to top */
+      stacked = meta_stack_list_windows (screen->stack, NULL);
+      for (l = g_list_last (stacked); l != NULL; l = l->prev)
+        {
+          if (g_hash_table_remove (queued, l->data))
+            sorted = g_slist_prepend (sorted, l->data);
+        }
+      g_list_free (stacked);
+    }
+
+  /* Windows that aren't in a stack; don't care where they go */
+  for (tmp = windows; tmp != NULL; tmp = tmp->next)
+    {
+      if (g_hash_table_remove (queued, tmp->data))
+        sorted = g_slist_prepend (sorted, tmp->data);
+    }
+
+  g_hash_table_destroy (queued);
+  g_slist_free (screens);
+  g_slist_free (windows);
+
+  return sorted;
+}
+
 static gboolean
 idle_calc_showing (gpointer data)
 {
@@ -2331,6 +2392,9 @@ idle_calc_showing (gpointer data)
   unplaced = NULL;
   displays = NULL;
 
+  /* Sort once, bottom to top, and split the result keeping the order */
+  copy = sort_by_stacking (copy);
+
   tmp = copy;
   while (tmp != NULL)
     {
@@ -2349,11 +2413,9 @@ idle_calc_showing (gpointer data)
     }
 
   /* bottom to top */
-  unplaced = g_slist_sort (unplaced, stackcmp);
-  should_hide = g_slist_sort (should_hide, stackcmp);
-  /* top to bottom */
-  should_show = g_slist_sort (should_show, stackcmp);
-  should_show = g_slist_reverse (should_show);
+  unplaced = g_slist_reverse (unplaced);
+  should_hide = g_slist_reverse (should_hide);
+  /* should_show is top to bottom already */
 
   first_window = copy->data;
 
@@ -5262,6 +5324,8 @@ meta_window_move_resize_internal (MetaWindow          *window,
         meta_compositor_sync_window_geometry (window->display->compositor,
                                               window,
                                               did_placement);
+
+      meta_display_window_edges_changed (window->display, window);
     }
   else
     {
@@ -7339,7 +7403,7 @@ process_property_notify (MetaWindow     *window,
         xid = window->user_time_window;
     }
 
-  meta_window_reload_property_from_xwindow (window, xid, event->atom, FALSE);
+  meta_window_queue_property_reload (window, xid, event->atom);
 
   return TRUE;
 }
@@ -7772,6 +7836,16 @@ idle_update_icon (gpointer data)
 
   destroying_windows_disallowed += 1;
 
+  /* Send all the requests first, so that reading the icons below
+   * makes at most one round trip */
+  for (tmp = copy; tmp != NULL; tmp = tmp->next)
+    {
+      MetaWindow *window = tmp->data;
+
+      meta_icon_cache_prefetch (&window->icon_cache,
+                                window->display, window->xwindow);
+    }
+
   tmp = copy;
   while (tmp != NULL)
     {
@@ -36,6 +36,8 @@
 #include <meta/workspace.h>
 #include "window-private.h"
 
+typedef struct _MetaWorkAreas MetaWorkAreas;
+
 struct _MetaWorkspace
 {
   GObject parent_instance;
@@ -54,8 +56,18 @@ struct _MetaWorkspace
    */
   GList *mru_list;
 
+  /* The windows located on the workspace, as a set: the windows above
+   * and the windows on all workspaces (but not override-redirect ones).
+   * Kept up to date with meta_workspace_update_window_location().
+   */
+  GHashTable *located_windows;
+
   GList  *list_containing_self;
 
+  /* The work areas, regions, edges and struts below are those of
+   * work_areas, which is shared with the other workspaces that have the
+   * same struts */
+  MetaWorkAreas *work_areas;
   MetaRectangle work_area_screen;
   MetaRectangle *work_area_monitor;
   GList  *screen_region;
@@ -84,6 +96,8 @@ void           meta_workspace_remove_window (MetaWorkspace *workspace,
 void           meta_workspace_relocate_windows (MetaWorkspace *workspace,
                                                 MetaWorkspace *new_home);
 
+void           meta_workspace_update_window_location (MetaWindow *window);
+
 void meta_workspace_invalidate_work_area (MetaWorkspace *workspace);
 
 GList* meta_workspace_get_onscreen_region       (MetaWorkspace *workspace);
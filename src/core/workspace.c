@@ -151,10 +151,15 @@ meta_workspace_init (MetaWorkspace *workspace)
 static void
 maybe_add_to_list (MetaScreen *screen, MetaWindow *window, gpointer data)
 {
-  GList **mru_list = data;
+  MetaWorkspace *workspace = data;
 
   if (window->on_all_workspaces)
-    *mru_list = g_list_prepend (*mru_list, window);
+    {
+      workspace->mru_list = g_list_prepend (workspace->mru_list, window);
+
+      if (window->workspace != NULL)
+        g_hash_table_insert (workspace->located_windows, window, window);
+    }
 }
 
 MetaWorkspace*
@@ -169,7 +174,8 @@ meta_workspace_new (MetaScreen *screen)
     g_list_append (workspace->screen->workspaces, workspace);
   workspace->windows = NULL;
   workspace->mru_list = NULL;
-  meta_screen_foreach_window (screen, maybe_add_to_list, &workspace->mru_list);
+  workspace->located_windows = g_hash_table_new (NULL, NULL);
+  meta_screen_foreach_window (screen, maybe_add_to_list, workspace);
 
   workspace->work_areas_invalid = TRUE;
   workspace->work_area_monitor = NULL;
@@ -178,6 +184,7 @@ meta_workspace_new (MetaScreen *screen)
   workspace->work_area_screen.width = 0;
   workspace->work_area_screen.height = 0;
 
+  workspace->work_areas = NULL;
   workspace->screen_region = NULL;
   workspace->monitor_region = NULL;
   workspace->screen_edges = NULL;
@@ -199,21 +206,77 @@ free_this (gpointer candidate, gpointer dummy)
   g_free (candidate);
 }
 
+/* The work areas computed for a set of struts and a monitor layout,
+ * shared by all the workspaces with those struts.  When a sticky panel
+ * changes its struts, all the workspaces are invalidated, and all but
+ * the first one to be validated again find the new work areas here.
+ */
+struct _MetaWorkAreas
+{
+  int            ref_count;
+
+  /* What they were computed for; struts is sorted with compare_struts() */
+  MetaRectangle  screen_rect;
+  MetaRectangle *monitor_rects;
+  int            n_monitors;
+  GSList        *struts;
+
+  MetaRectangle  work_area_screen;
+  MetaRectangle *work_area_monitor;
+  GList         *screen_region;
+  GList        **monitor_region;
+  GList         *screen_edges;
+  GList         *monitor_edges;
+};
+
+/* All the MetaWorkAreas in use */
+static GList *all_work_areas = NULL;
+
+static void
+work_areas_unref (MetaWorkAreas *work_areas)
+{
+  int i;
+
+  if (--work_areas->ref_count > 0)
+    return;
+
+  all_work_areas = g_list_remove (all_work_areas, work_areas);
+
+  g_slist_foreach (work_areas->struts, free_this, NULL);
+  g_slist_free (work_areas->struts);
+  for (i = 0; i < work_areas->n_monitors; i++)
+    meta_rectangle_free_list_and_elements (work_areas->monitor_region[i]);
+  g_free (work_areas->monitor_region);
+  meta_rectangle_free_list_and_elements (work_areas->screen_region);
+  meta_rectangle_free_list_and_elements (work_areas->screen_edges);
+  meta_rectangle_free_list_and_elements (work_areas->monitor_edges);
+  g_free (work_areas->work_area_monitor);
+  g_free (work_areas->monitor_rects);
+  g_slice_free (MetaWorkAreas, work_areas);
+}
+
 /**
- * workspace_free_all_struts:
+ * workspace_release_work_areas:
  * @workspace: The workspace.
  *
- * Frees the combined struts list of a workspace.
+ * Drops the work areas, regions, edges and combined struts list of a
+ * workspace.
  */
 static void
-workspace_free_all_struts (MetaWorkspace *workspace)
+workspace_release_work_areas (MetaWorkspace *workspace)
 {
-  if (workspace->all_struts == NULL)
+  if (workspace->work_areas == NULL)
     return;
-    
-  g_slist_foreach (workspace->all_struts, free_this, NULL);
-  g_slist_free (workspace->all_struts);
+
+  work_areas_unref (workspace->work_areas);
+  workspace->work_areas = NULL;
+
   workspace->all_struts = NULL;
+  workspace->work_area_monitor = NULL;
+  workspace->monitor_region = NULL;
+  workspace->screen_region = NULL;
+  workspace->screen_edges = NULL;
+  workspace->monitor_edges = NULL;
 }
 
 /**
@@ -237,8 +300,6 @@ void
 meta_workspace_remove (MetaWorkspace *workspace)
 {
   GList *tmp;
-  MetaScreen *screen;
-  int i;
 
   g_return_if_fail (workspace != workspace->screen->active_workspace);
 
@@ -262,35 +323,21 @@ meta_workspace_remove (MetaWorkspace *workspace)
 
   g_assert (workspace->windows == NULL);
 
-  screen = workspace->screen;
-  
   workspace->screen->workspaces =
     g_list_remove (workspace->screen->workspaces, workspace);
-  
-  g_free (workspace->work_area_monitor);
 
   g_list_free (workspace->mru_list);
   g_list_free (workspace->list_containing_self);
+  g_hash_table_destroy (workspace->located_windows);
 
   workspace_free_builtin_struts (workspace);
 
   /* screen.c:update_num_workspaces(), which calls us, removes windows from
    * workspaces first, which can cause the workareas on the workspace to be
-   * invalidated (and hence for struts/regions/edges to be freed).
-   * So, no point trying to double free it; that causes a crash
-   * anyway.  #361804.
+   * invalidated (and hence for struts/regions/edges to be released).
+   * Releasing them again does nothing.  #361804.
    */
-
-  if (!workspace->work_areas_invalid)
-    {
-      workspace_free_all_struts (workspace);
-      for (i = 0; i < screen->n_monitor_infos; i++)
-        meta_rectangle_free_list_and_elements (workspace->monitor_region[i]);
-      g_free (workspace->monitor_region);
-      meta_rectangle_free_list_and_elements (workspace->screen_region);
-      meta_rectangle_free_list_and_elements (workspace->screen_edges);
-      meta_rectangle_free_list_and_elements (workspace->monitor_edges);
-    }
+  workspace_release_work_areas (workspace);
 
   g_object_unref (workspace);
 
@@ -332,6 +379,7 @@ meta_workspace_add_window (MetaWorkspace *workspace,
   workspace->windows = g_list_prepend (workspace->windows, window);
 
   window->workspace = workspace;
+  meta_workspace_update_window_location (window);
 
   meta_window_set_current_workspace_hint (window);
   
@@ -360,6 +408,7 @@ meta_workspace_remove_window (MetaWorkspace *workspace,
 
   workspace->windows = g_list_remove (workspace->windows, window);
   window->workspace = NULL;
+  meta_workspace_update_window_location (window);
 
   /* If the window is on all workspaces, we don't want to remove it
    * from the MRU list unless this causes it to be removed from all 
@@ -443,6 +492,47 @@ meta_workspace_queue_calc_showing  (MetaWorkspace *workspace)
     }
 }
 
+/**
+ * meta_workspace_update_window_location:
+ * @window: a #MetaWindow
+ *
+ * Updates the sets of windows located on each workspace for @window,
+ * after it moved to or from a workspace or started or stopped being
+ * on all workspaces.
+ */
+void
+meta_workspace_update_window_location (MetaWindow *window)
+{
+  GList *tmp;
+
+  for (tmp = window->screen->workspaces; tmp != NULL; tmp = tmp->next)
+    {
+      MetaWorkspace *workspace = tmp->data;
+
+      if (!window->override_redirect &&
+          window->workspace != NULL &&
+          meta_window_located_on_workspace (window, workspace))
+        g_hash_table_insert (workspace->located_windows, window, window);
+      else
+        g_hash_table_remove (workspace->located_windows, window);
+    }
+}
+
+static void
+queue_calc_showing_if_not_located (MetaWorkspace *workspace,
+                                   MetaWorkspace *other)
+{
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init (&iter, workspace->located_windows);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (!g_hash_table_lookup (other->located_windows, key))
+        meta_window_queue (key, META_QUEUE_CALC_SHOWING);
+    }
+}
+
 static void
 workspace_switch_sound(MetaWorkspace *from,
                        MetaWorkspace *to)
@@ -593,8 +683,18 @@ meta_workspace_activate_with_focus (MetaWorkspace *workspace,
         }
     }
 
-  meta_workspace_queue_calc_showing (old);
-  meta_workspace_queue_calc_showing (workspace);
+  /* Only the windows on one of the workspaces but not the other change
+   * showing, unless the "show desktop" mode changes too */
+  if (old->showing_desktop != workspace->showing_desktop)
+    {
+      meta_workspace_queue_calc_showing (old);
+      meta_workspace_queue_calc_showing (workspace);
+    }
+  else
+    {
+      queue_calc_showing_if_not_located (old, workspace);
+      queue_calc_showing_if_not_located (workspace, old);
+    }
 
   /* FIXME: Why do we need this?!?  Isn't it handled in the lines above? */
   if (move_window)
@@ -727,29 +827,7 @@ meta_workspace_update_window_hints (MetaWorkspace *workspace)
 GList*
 meta_workspace_list_windows (MetaWorkspace *workspace)
 {
-  GSList *display_windows;
-  GSList *tmp;
-  GList *workspace_windows;
-  
-  display_windows = meta_display_list_windows (workspace->screen->display,
-                                               META_LIST_DEFAULT);
-
-  workspace_windows = NULL;
-  tmp = display_windows;
-  while (tmp != NULL)
-    {
-      MetaWindow *window = tmp->data;
-
-      if (meta_window_located_on_workspace (window, workspace))
-        workspace_windows = g_list_prepend (workspace_windows,
-                                            window);
-
-      tmp = tmp->next;
-    }
-
-  g_slist_free (display_windows);
-
-  return workspace_windows;
+  return g_hash_table_get_keys (workspace->located_windows);
 }
 
 void
@@ -757,8 +835,7 @@ meta_workspace_invalidate_work_area (MetaWorkspace *workspace)
 {
   GList *tmp;
   GList *windows;
-  int i;
-  
+
   if (workspace->work_areas_invalid)
     {
       meta_topic (META_DEBUG_WORKAREA,
@@ -776,22 +853,8 @@ meta_workspace_invalidate_work_area (MetaWorkspace *workspace)
   if (workspace == workspace->screen->active_workspace)
     meta_display_cleanup_edges (workspace->screen->display);
 
-  g_free (workspace->work_area_monitor);
-  workspace->work_area_monitor = NULL;
-      
-  workspace_free_all_struts (workspace);
+  workspace_release_work_areas (workspace);
 
-  for (i = 0; i < workspace->screen->n_monitor_infos; i++)
-    meta_rectangle_free_list_and_elements (workspace->monitor_region[i]);
-  g_free (workspace->monitor_region);
-  meta_rectangle_free_list_and_elements (workspace->screen_region);
-  meta_rectangle_free_list_and_elements (workspace->screen_edges);
-  meta_rectangle_free_list_and_elements (workspace->monitor_edges);
-  workspace->monitor_region = NULL;
-  workspace->screen_region = NULL;
-  workspace->screen_edges = NULL;
-  workspace->monitor_edges = NULL;
-  
   workspace->work_areas_invalid = TRUE;
 
   /* redo the size/position constraints on all windows */
@@ -831,68 +894,118 @@ copy_strut_list(GSList *original)
   return g_slist_reverse (result);
 }
 
-static void
-ensure_work_areas_validated (MetaWorkspace *workspace)
+static gboolean
+strut_lists_equal (GSList *l,
+                   GSList *m)
 {
-  GList         *windows;
-  GList         *tmp;
-  MetaRectangle  work_area;
-  int            i;  /* C89 absolutely sucks... */
+  for (; l && m; l = l->next, m = m->next)
+    {
+      MetaStrut *a = l->data;
+      MetaStrut *b = m->data;
 
-  if (!workspace->work_areas_invalid)
-    return;
+      if (a->side != b->side ||
+          !meta_rectangle_equal (&a->rect, &b->rect))
+        return FALSE;
+    }
 
-  g_assert (workspace->all_struts == NULL);
-  g_assert (workspace->monitor_region == NULL);
-  g_assert (workspace->screen_region == NULL);
-  g_assert (workspace->screen_edges == NULL);
-  g_assert (workspace->monitor_edges == NULL);
+  return l == NULL && m == NULL;
+}
 
-  /* STEP 1: Get the list of struts */
+static gint
+compare_struts (gconstpointer a,
+                gconstpointer b)
+{
+  const MetaStrut *a_strut = a;
+  const MetaStrut *b_strut = b;
+
+  if (a_strut->side != b_strut->side)
+    return a_strut->side - b_strut->side;
+  if (a_strut->rect.x != b_strut->rect.x)
+    return a_strut->rect.x - b_strut->rect.x;
+  if (a_strut->rect.y != b_strut->rect.y)
+    return a_strut->rect.y - b_strut->rect.y;
+  if (a_strut->rect.width != b_strut->rect.width)
+    return a_strut->rect.width - b_strut->rect.width;
+  return a_strut->rect.height - b_strut->rect.height;
+}
 
-  workspace->all_struts = copy_strut_list (workspace->builtin_struts);
+/* Finds the work areas in use computed for the current monitor layout
+ * of screen and struts, which is sorted with compare_struts().
+ */
+static MetaWorkAreas *
+find_work_areas (MetaScreen *screen,
+                 GSList     *struts)
+{
+  GList *tmp;
+  int i;
 
-  windows = meta_workspace_list_windows (workspace);
-  for (tmp = windows; tmp != NULL; tmp = tmp->next)
+  for (tmp = all_work_areas; tmp != NULL; tmp = tmp->next)
     {
-      MetaWindow *win = tmp->data;
-      GSList *s_iter;
+      MetaWorkAreas *work_areas = tmp->data;
 
-      for (s_iter = win->struts; s_iter != NULL; s_iter = s_iter->next) {
-        workspace->all_struts = g_slist_prepend (workspace->all_struts,
-                                                 copy_strut(s_iter->data));
-      }
+      if (work_areas->n_monitors != screen->n_monitor_infos ||
+          !meta_rectangle_equal (&work_areas->screen_rect, &screen->rect))
+        continue;
+
+      for (i = 0; i < screen->n_monitor_infos; i++)
+        if (!meta_rectangle_equal (&work_areas->monitor_rects[i],
+                                   &screen->monitor_infos[i].rect))
+          break;
+
+      if (i == screen->n_monitor_infos &&
+          strut_lists_equal (work_areas->struts, struts))
+        return work_areas;
     }
-  g_list_free (windows);
+
+  return NULL;
+}
+
+/* Computes the work areas of workspace, which has the given struts,
+ * sorted with compare_struts(); takes ownership of the struts.
+ */
+static MetaWorkAreas *
+work_areas_new (MetaWorkspace *workspace,
+                GSList        *struts)
+{
+  MetaWorkAreas *work_areas;
+  GList         *tmp;
+  MetaRectangle  work_area;
+  int            i;  /* C89 absolutely sucks... */
+
+  work_areas = g_slice_new0 (MetaWorkAreas);
+  work_areas->ref_count = 1;
+  work_areas->screen_rect = workspace->screen->rect;
+  work_areas->n_monitors = workspace->screen->n_monitor_infos;
+  work_areas->monitor_rects = g_new (MetaRectangle, work_areas->n_monitors);
+  for (i = 0; i < work_areas->n_monitors; i++)
+    work_areas->monitor_rects[i] = workspace->screen->monitor_infos[i].rect;
+  work_areas->struts = struts;
 
   /* STEP 2: Get the maximal/spanning rects for the onscreen and
    *         on-single-monitor regions
    */  
-  g_assert (workspace->monitor_region == NULL);
-  g_assert (workspace->screen_region   == NULL);
-
-  workspace->monitor_region = g_new (GList*,
+  work_areas->monitor_region = g_new (GList*,
                                       workspace->screen->n_monitor_infos);
   for (i = 0; i < workspace->screen->n_monitor_infos; i++)
     {
-      workspace->monitor_region[i] =
+      work_areas->monitor_region[i] =
         meta_rectangle_get_minimal_spanning_set_for_region (
           &workspace->screen->monitor_infos[i].rect,
-          workspace->all_struts);
+          work_areas->struts);
     }
-  workspace->screen_region =
+  work_areas->screen_region =
     meta_rectangle_get_minimal_spanning_set_for_region (
       &workspace->screen->rect,
-      workspace->all_struts);
+      work_areas->struts);
 
   /* STEP 3: Get the work areas (region-to-maximize-to) for the screen and
    *         monitors.
    */
   work_area = workspace->screen->rect;  /* start with the screen */
-  if (workspace->screen_region == NULL)
+  if (work_areas->screen_region == NULL)
     work_area = meta_rect (0, 0, -1, -1);
   else
-    meta_rectangle_clip_to_region (workspace->screen_region,
+    meta_rectangle_clip_to_region (work_areas->screen_region,
                                    FIXED_DIRECTION_NONE,
                                    &work_area);
 
@@ -932,90 +1045,132 @@ ensure_work_areas_validated (MetaWorkspace *workspace)
           work_area.height += 2*amount;
         }
     }
-  workspace->work_area_screen = work_area;
+  work_areas->work_area_screen = work_area;
   meta_topic (META_DEBUG_WORKAREA,
               "Computed work area for workspace %d: %d,%d %d x %d\n",
               meta_workspace_index (workspace),
-              workspace->work_area_screen.x,
-              workspace->work_area_screen.y,
-              workspace->work_area_screen.width,
-              workspace->work_area_screen.height);    
+              work_areas->work_area_screen.x,
+              work_areas->work_area_screen.y,
+              work_areas->work_area_screen.width,
+              work_areas->work_area_screen.height);    
 
   /* Now find the work areas for each monitor */
-  g_free (workspace->work_area_monitor);
-  workspace->work_area_monitor = g_new (MetaRectangle,
+  work_areas->work_area_monitor = g_new (MetaRectangle,
                                          workspace->screen->n_monitor_infos);
 
   for (i = 0; i < workspace->screen->n_monitor_infos; i++)
     {
       work_area = workspace->screen->monitor_infos[i].rect;
 
-      if (workspace->monitor_region[i] == NULL)
+      if (work_areas->monitor_region[i] == NULL)
         /* FIXME: constraints.c untested with this, but it might be nice for
          * a screen reader or magnifier.
          */
         work_area = meta_rect (work_area.x, work_area.y, -1, -1);
       else
-        meta_rectangle_clip_to_region (workspace->monitor_region[i],
+        meta_rectangle_clip_to_region (work_areas->monitor_region[i],
                                        FIXED_DIRECTION_NONE,
                                        &work_area);
 
-      workspace->work_area_monitor[i] = work_area;
+      work_areas->work_area_monitor[i] = work_area;
       meta_topic (META_DEBUG_WORKAREA,
                   "Computed work area for workspace %d "
                   "monitor %d: %d,%d %d x %d\n",
                   meta_workspace_index (workspace),
                   i,
-                  workspace->work_area_monitor[i].x,
-                  workspace->work_area_monitor[i].y,
-                  workspace->work_area_monitor[i].width,
-                  workspace->work_area_monitor[i].height);
+                  work_areas->work_area_monitor[i].x,
+                  work_areas->work_area_monitor[i].y,
+                  work_areas->work_area_monitor[i].width,
+                  work_areas->work_area_monitor[i].height);
     }
 
   /* STEP 4: Make sure the screen_region is nonempty (separate from step 2
    *         since it relies on step 3).
    */  
-  if (workspace->screen_region == NULL)
+  if (work_areas->screen_region == NULL)
     {
       MetaRectangle *nonempty_region;
       nonempty_region = g_new (MetaRectangle, 1);
-      *nonempty_region = workspace->work_area_screen;
-      workspace->screen_region = g_list_prepend (NULL, nonempty_region);
+      *nonempty_region = work_areas->work_area_screen;
+      work_areas->screen_region = g_list_prepend (NULL, nonempty_region);
     }
 
   /* STEP 5: Cache screen and monitor edges for edge resistance and snapping */
-  g_assert (workspace->screen_edges    == NULL);
-  g_assert (workspace->monitor_edges  == NULL);
-  workspace->screen_edges =
+  work_areas->screen_edges =
     meta_rectangle_find_onscreen_edges (&workspace->screen->rect,
-                                        workspace->all_struts);
+                                        work_areas->struts);
   tmp = NULL;
   for (i = 0; i < workspace->screen->n_monitor_infos; i++)
     tmp = g_list_prepend (tmp, &workspace->screen->monitor_infos[i].rect);
-  workspace->monitor_edges =
+  work_areas->monitor_edges =
     meta_rectangle_find_nonintersected_monitor_edges (tmp,
-                                                       workspace->all_struts);
+                                                       work_areas->struts);
   g_list_free (tmp);
 
-  /* We're all done, YAAY!  Record that everything has been validated. */
-  workspace->work_areas_invalid = FALSE;
+  all_work_areas = g_list_prepend (all_work_areas, work_areas);
+
+  return work_areas;
 }
 
-static gboolean
-strut_lists_equal (GSList *l,
-                   GSList *m)
+static void
+ensure_work_areas_validated (MetaWorkspace *workspace)
 {
-  for (; l && m; l = l->next, m = m->next)
+  GList         *windows;
+  GList         *tmp;
+  GSList        *struts;
+  MetaWorkAreas *work_areas;
+
+  if (!workspace->work_areas_invalid)
+    return;
+
+  g_assert (workspace->work_areas == NULL);
+
+  /* STEP 1: Get the list of struts */
+
+  struts = copy_strut_list (workspace->builtin_struts);
+
+  windows = meta_workspace_list_windows (workspace);
+  for (tmp = windows; tmp != NULL; tmp = tmp->next)
     {
-      MetaStrut *a = l->data;
-      MetaStrut *b = m->data;
+      MetaWindow *win = tmp->data;
+      GSList *s_iter;
 
-      if (a->side != b->side ||
-          !meta_rectangle_equal (&a->rect, &b->rect))
-        return FALSE;
+      for (s_iter = win->struts; s_iter != NULL; s_iter = s_iter->next) {
+        struts = g_slist_prepend (struts, copy_strut (s_iter->data));
+      }
     }
+  g_list_free (windows);
 
-  return l == NULL && m == NULL;
+  struts = g_slist_sort (struts, compare_struts);
+
+  /* STEPS 2-5: Find the work areas, unless another workspace already
+   *            has them
+   */
+  work_areas = find_work_areas (workspace->screen, struts);
+  if (work_areas != NULL)
+    {
+      meta_topic (META_DEBUG_WORKAREA,
+                  "Reusing work areas for workspace %d\n",
+                  meta_workspace_index (workspace));
+
+      work_areas->ref_count++;
+      g_slist_foreach (struts, free_this, NULL);
+      g_slist_free (struts);
+    }
+  else
+    work_areas = work_areas_new (workspace, struts);
+
+  workspace->work_areas = work_areas;
+  workspace->all_struts = work_areas->struts;
+  workspace->work_area_screen = work_areas->work_area_screen;
+  workspace->work_area_monitor = work_areas->work_area_monitor;
+  workspace->screen_region = work_areas->screen_region;
+  workspace->monitor_region = work_areas->monitor_region;
+  workspace->screen_edges = work_areas->screen_edges;
+  workspace->monitor_edges = work_areas->monitor_edges;
+
+  /* We're all done, YAAY!  Record that everything has been validated. */
+  workspace->work_areas_invalid = FALSE;
 }
 
 /**
@@ -964,255 +964,355 @@ latin1_to_utf8 (const char *text)
   return g_string_free (str, FALSE);
 }
 
-void
-meta_prop_get_values (MetaDisplay   *display,
-                      Window         xwindow,
-                      MetaPropValue *values,
-                      int            n_values)
+struct _MetaPropFetch
 {
-  int i;
+  MetaDisplay        *display;
+  Window              xwindow;
+  MetaPropValue      *values;
+  int                 n_values;
   AgGetPropertyTask **tasks;
+};
 
-  meta_verbose ("Requesting %d properties of 0x%lx at once\n",
-                n_values, xwindow);
-  
-  if (n_values == 0)
+static void
+init_required_type (MetaDisplay   *display,
+                    MetaPropValue *value)
+{
+  if (value->required_type != None)
     return;
-  
-  tasks = g_new0 (AgGetPropertyTask*, n_values);
 
-  /* Start up tasks. The "values" array can have values
-   * with atom == None, which means to ignore that element.
-   */
-  i = 0;
-  while (i < n_values)
+  switch (value->type)
     {
-      if (values[i].required_type == None)
-        {
-          switch (values[i].type)
-            {
-            case META_PROP_VALUE_INVALID:
-              /* This means we don't really want a value, e.g. got
-               * property notify on an atom we don't care about.
-               */
-              if (values[i].atom != None)
-                meta_bug ("META_PROP_VALUE_INVALID requested in %s\n", G_STRFUNC);
-              break;
-            case META_PROP_VALUE_UTF8_LIST:
-            case META_PROP_VALUE_UTF8:
-              values[i].required_type = display->atom_UTF8_STRING;
-              break;
-            case META_PROP_VALUE_STRING:
-            case META_PROP_VALUE_STRING_AS_UTF8:
-              values[i].required_type = XA_STRING;
-              break;
-            case META_PROP_VALUE_MOTIF_HINTS:
-              values[i].required_type = AnyPropertyType;
-              break;
-            case META_PROP_VALUE_CARDINAL_LIST:
-            case META_PROP_VALUE_CARDINAL:
-              values[i].required_type = XA_CARDINAL;
-              break;
-            case META_PROP_VALUE_WINDOW:
-              values[i].required_type = XA_WINDOW;
-              break;
-            case META_PROP_VALUE_ATOM_LIST:
-              values[i].required_type = XA_ATOM;
-              break;
-            case META_PROP_VALUE_TEXT_PROPERTY:
-              values[i].required_type = AnyPropertyType;
-              break;
-            case META_PROP_VALUE_WM_HINTS:
-              values[i].required_type = XA_WM_HINTS;
-              break;
-            case META_PROP_VALUE_CLASS_HINT:
-              values[i].required_type = XA_STRING;
-              break;
-            case META_PROP_VALUE_SIZE_HINTS:
-              values[i].required_type = XA_WM_SIZE_HINTS;
-              break;
-            case META_PROP_VALUE_SYNC_COUNTER:
-            case META_PROP_VALUE_SYNC_COUNTER_LIST:
-	      values[i].required_type = XA_CARDINAL;
-              break;
-            }
-        }
+    case META_PROP_VALUE_INVALID:
+      /* This means we don't really want a value, e.g. got
+       * property notify on an atom we don't care about.
+       */
+      if (value->atom != None)
+        meta_bug ("META_PROP_VALUE_INVALID requested in %s\n", G_STRFUNC);
+      break;
+    case META_PROP_VALUE_UTF8_LIST:
+    case META_PROP_VALUE_UTF8:
+      value->required_type = display->atom_UTF8_STRING;
+      break;
+    case META_PROP_VALUE_STRING:
+    case META_PROP_VALUE_STRING_AS_UTF8:
+      value->required_type = XA_STRING;
+      break;
+    case META_PROP_VALUE_MOTIF_HINTS:
+      value->required_type = AnyPropertyType;
+      break;
+    case META_PROP_VALUE_CARDINAL_LIST:
+    case META_PROP_VALUE_CARDINAL:
+      value->required_type = XA_CARDINAL;
+      break;
+    case META_PROP_VALUE_WINDOW:
+      value->required_type = XA_WINDOW;
+      break;
+    case META_PROP_VALUE_ATOM_LIST:
+      value->required_type = XA_ATOM;
+      break;
+    case META_PROP_VALUE_TEXT_PROPERTY:
+      value->required_type = AnyPropertyType;
+      break;
+    case META_PROP_VALUE_WM_HINTS:
+      value->required_type = XA_WM_HINTS;
+      break;
+    case META_PROP_VALUE_CLASS_HINT:
+      value->required_type = XA_STRING;
+      break;
+    case META_PROP_VALUE_SIZE_HINTS:
+      value->required_type = XA_WM_SIZE_HINTS;
+      break;
+    case META_PROP_VALUE_SYNC_COUNTER:
+    case META_PROP_VALUE_SYNC_COUNTER_LIST:
+      value->required_type = XA_CARDINAL;
+      break;
+    }
+}
 
-      if (values[i].atom != None)
-        tasks[i] = get_task (display, xwindow,
-                             values[i].atom, values[i].required_type);
-      
-      ++i;
-    }  
-  
-  /* Get replies for all our tasks */
-  meta_topic (META_DEBUG_SYNC, "Syncing to get %d GetProperty replies in %s\n",
-              n_values, G_STRFUNC);
-  XSync (display->xdisplay, False);
-  
-  /* Collect results, should arrive in order requested */
-  i = 0;
-  while (i < n_values)
+static void
+collect_value (MetaDisplay       *display,
+               Window             xwindow,
+               MetaPropValue     *value,
+               AgGetPropertyTask *task)
+{
+  GetPropertyResults results;
+
+  if (task == NULL)
     {
-      AgGetPropertyTask *task;
-      GetPropertyResults results;
-      
-      if (tasks[i] == NULL)
-        {
-          /* Probably values[i].type was None, or ag_task_create()
-           * returned NULL.
-           */
-          values[i].type = META_PROP_VALUE_INVALID;
-          goto next;
-        }
-      
-      task = ag_get_next_completed_task (display->xdisplay);
-      g_assert (task != NULL);
-      g_assert (ag_task_have_reply (task));
-
-      results.display = display;
-      results.xwindow = xwindow;
-      results.xatom = values[i].atom;
-      results.prop = NULL;
-      results.n_items = 0;
-      results.type = None;
-      results.bytes_after = 0;
-      results.format = 0;
-      
-      if (ag_task_get_reply_and_free (task,
-                                      &results.type, &results.format,
-                                      &results.n_items,
-                                      &results.bytes_after,
-                                      &results.prop) != Success ||
-          results.type == None)
+      /* Probably value->type was None, or ag_task_create()
+       * returned NULL.
+       */
+      value->type = META_PROP_VALUE_INVALID;
+      return;
+    }
+
+  g_assert (ag_task_have_reply (task));
+
+  results.display = display;
+  results.xwindow = xwindow;
+  results.xatom = value->atom;
+  results.prop = NULL;
+  results.n_items = 0;
+  results.type = None;
+  results.bytes_after = 0;
+  results.format = 0;
+
+  if (ag_task_get_reply_and_free (task,
+                                  &results.type, &results.format,
+                                  &results.n_items,
+                                  &results.bytes_after,
+                                  &results.prop) != Success ||
+      results.type == None)
+    {
+      value->type = META_PROP_VALUE_INVALID;
+      if (results.prop)
         {
-          values[i].type = META_PROP_VALUE_INVALID;
-          if (results.prop)
-            {
-              XFree (results.prop);
-              results.prop = NULL;
-            }
-          goto next;
+          XFree (results.prop);
+          results.prop = NULL;
         }
+      return;
+    }
 
-      switch (values[i].type)
+  switch (value->type)
+    {
+    case META_PROP_VALUE_INVALID:
+      g_assert_not_reached ();
+      break;
+    case META_PROP_VALUE_UTF8_LIST:
+      if (!utf8_list_from_results (&results,
+                                   &value->v.string_list.strings,
+                                   &value->v.string_list.n_strings))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_UTF8:
+      if (!utf8_string_from_results (&results,
+                                     &value->v.str))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_STRING:
+      if (!latin1_string_from_results (&results,
+                                       &value->v.str))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_STRING_AS_UTF8:
+      if (!latin1_string_from_results (&results,
+                                       &value->v.str))
+        value->type = META_PROP_VALUE_INVALID;
+      else
         {
-        case META_PROP_VALUE_INVALID:
-          g_assert_not_reached ();
-          break;
-        case META_PROP_VALUE_UTF8_LIST:
-          if (!utf8_list_from_results (&results,
-                                       &values[i].v.string_list.strings,
-                                       &values[i].v.string_list.n_strings))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_UTF8:
-          if (!utf8_string_from_results (&results,
-                                         &values[i].v.str))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_STRING:
-          if (!latin1_string_from_results (&results,
-                                           &values[i].v.str))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_STRING_AS_UTF8:
-          if (!latin1_string_from_results (&results,
-                                           &values[i].v.str))
-            values[i].type = META_PROP_VALUE_INVALID;
-          else
+          char *new_str;
+          char *xmalloc_new_str;
+
+          new_str = latin1_to_utf8 (value->v.str);
+          xmalloc_new_str = ag_Xmalloc (strlen (new_str) + 1);
+          if (xmalloc_new_str != NULL)
             {
-              char *new_str;
-              char *xmalloc_new_str;
-
-              new_str = latin1_to_utf8 (values[i].v.str);
-              xmalloc_new_str = ag_Xmalloc (strlen (new_str) + 1);
-              if (xmalloc_new_str != NULL)
-                {
-                  strcpy (xmalloc_new_str, new_str);
-                  meta_XFree (values[i].v.str);
-                  values[i].v.str = xmalloc_new_str;
-                }
-
-              g_free (new_str);
+              strcpy (xmalloc_new_str, new_str);
+              meta_XFree (value->v.str);
+              value->v.str = xmalloc_new_str;
             }
-          break;
-        case META_PROP_VALUE_MOTIF_HINTS:
-          if (!motif_hints_from_results (&results,
-                                         &values[i].v.motif_hints))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_CARDINAL_LIST:
-          if (!cardinal_list_from_results (&results,
-                                           &values[i].v.cardinal_list.cardinals,
-                                           &values[i].v.cardinal_list.n_cardinals))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_CARDINAL:
-          if (!cardinal_with_atom_type_from_results (&results,
-                                                     values[i].required_type,
-                                                     &values[i].v.cardinal))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_WINDOW:
-          if (!window_from_results (&results,
-                                    &values[i].v.xwindow))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_ATOM_LIST:
-          if (!atom_list_from_results (&results,
-                                       &values[i].v.atom_list.atoms,
-                                       &values[i].v.atom_list.n_atoms))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_TEXT_PROPERTY:
-          if (!text_property_from_results (&results, &values[i].v.str))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_WM_HINTS:
-          if (!wm_hints_from_results (&results, &values[i].v.wm_hints))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_CLASS_HINT:
-          if (!class_hint_from_results (&results, &values[i].v.class_hint))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_SIZE_HINTS:
-          if (!size_hints_from_results (&results,
-                                        &values[i].v.size_hints.hints,
-                                        &values[i].v.size_hints.flags))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
+
+          g_free (new_str);
+        }
+      break;
+    case META_PROP_VALUE_MOTIF_HINTS:
+      if (!motif_hints_from_results (&results,
+                                     &value->v.motif_hints))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_CARDINAL_LIST:
+      if (!cardinal_list_from_results (&results,
+                                       &value->v.cardinal_list.cardinals,
+                                       &value->v.cardinal_list.n_cardinals))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_CARDINAL:
+      if (!cardinal_with_atom_type_from_results (&results,
+                                                 value->required_type,
+                                                 &value->v.cardinal))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_WINDOW:
+      if (!window_from_results (&results,
+                                &value->v.xwindow))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_ATOM_LIST:
+      if (!atom_list_from_results (&results,
+                                   &value->v.atom_list.atoms,
+                                   &value->v.atom_list.n_atoms))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_TEXT_PROPERTY:
+      if (!text_property_from_results (&results, &value->v.str))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_WM_HINTS:
+      if (!wm_hints_from_results (&results, &value->v.wm_hints))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_CLASS_HINT:
+      if (!class_hint_from_results (&results, &value->v.class_hint))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_SIZE_HINTS:
+      if (!size_hints_from_results (&results,
+                                    &value->v.size_hints.hints,
+                                    &value->v.size_hints.flags))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
 #ifdef HAVE_XSYNC
-        case META_PROP_VALUE_SYNC_COUNTER:
-          if (!counter_from_results (&results,
-                                     &values[i].v.xcounter))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
-        case META_PROP_VALUE_SYNC_COUNTER_LIST:
-          if (!counter_list_from_results (&results,
-                                          &values[i].v.xcounter_list.counters,
-                                          &values[i].v.xcounter_list.n_counters))
-            values[i].type = META_PROP_VALUE_INVALID;
-          break;
+    case META_PROP_VALUE_SYNC_COUNTER:
+      if (!counter_from_results (&results,
+                                 &value->v.xcounter))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
+    case META_PROP_VALUE_SYNC_COUNTER_LIST:
+      if (!counter_list_from_results (&results,
+                                      &value->v.xcounter_list.counters,
+                                      &value->v.xcounter_list.n_counters))
+        value->type = META_PROP_VALUE_INVALID;
+      break;
 #else
-        case META_PROP_VALUE_SYNC_COUNTER:
-        case META_PROP_VALUE_SYNC_COUNTER_LIST:
-          values[i].type = META_PROP_VALUE_INVALID;
-          if (results.prop)
-            {
-              XFree (results.prop);
-              results.prop = NULL;
-            }
-          break;
-#endif
+    case META_PROP_VALUE_SYNC_COUNTER:
+    case META_PROP_VALUE_SYNC_COUNTER_LIST:
+      value->type = META_PROP_VALUE_INVALID;
+      if (results.prop)
+        {
+          XFree (results.prop);
+          results.prop = NULL;
         }
+      break;
+#endif
+    }
+}
 
-    next:
-      ++i;
+/**
+ * meta_prop_fetch_values_begin: (skip)
+ * @display: the display
+ * @xwindow: the window to get the properties of
+ * @values: the properties to get; filled in by meta_prop_fetch_values_finish()
+ * @n_values: the length of @values
+ *
+ * Sends the GetProperty requests for @values without waiting for the
+ * replies, so that requests for many windows can be pipelined and
+ * collected with a single round trip. @values must stay valid until
+ * meta_prop_fetch_values_finish() is called.
+ *
+ * Return value: a fetch to pass to meta_prop_fetch_values_finish()
+ */
+MetaPropFetch*
+meta_prop_fetch_values_begin (MetaDisplay   *display,
+                              Window         xwindow,
+                              MetaPropValue *values,
+                              int            n_values)
+{
+  MetaPropFetch *fetch;
+  int i;
+
+  meta_verbose ("Requesting %d properties of 0x%lx at once\n",
+                n_values, xwindow);
+
+  fetch = g_slice_new (MetaPropFetch);
+  fetch->display = display;
+  fetch->xwindow = xwindow;
+  fetch->values = values;
+  fetch->n_values = n_values;
+  fetch->tasks = g_new0 (AgGetPropertyTask*, n_values);
+
+  /* Start up tasks. The "values" array can have values
+   * with atom == None, which means to ignore that element.
+   */
+  for (i = 0; i < n_values; i++)
+    {
+      init_required_type (display, &values[i]);
+
+      if (values[i].atom != None)
+        fetch->tasks[i] = get_task (display, xwindow,
+                                    values[i].atom, values[i].required_type);
+    }
+
+  return fetch;
+}
+
+static gboolean
+fetch_has_all_replies (MetaPropFetch *fetch)
+{
+  int i;
+
+  for (i = 0; i < fetch->n_values; i++)
+    if (fetch->tasks[i] != NULL && !ag_task_have_reply (fetch->tasks[i]))
+      return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * meta_prop_fetch_values_ready: (skip)
+ * @fetch: a fetch started with meta_prop_fetch_values_begin()
+ *
+ * Checks whether all the replies for @fetch have been read, so that
+ * meta_prop_fetch_values_finish() can be called without a round trip.
+ * This doesn't read from the connection itself.
+ *
+ * Return value: %TRUE if all the replies are in
+ */
+gboolean
+meta_prop_fetch_values_ready (MetaPropFetch *fetch)
+{
+  return fetch_has_all_replies (fetch);
+}
+
+/**
+ * meta_prop_fetch_values_finish: (skip)
+ * @fetch: a fetch started with meta_prop_fetch_values_begin()
+ *
+ * Fills in the values requested by meta_prop_fetch_values_begin() and
+ * frees @fetch. This only makes a round trip if some of the replies
+ * haven't been read yet; a round trip made for an earlier fetch will
+ * usually have brought them in already.
+ *
+ * Return value: %TRUE if a round trip was needed
+ */
+gboolean
+meta_prop_fetch_values_finish (MetaPropFetch *fetch)
+{
+  gboolean synced = FALSE;
+  int i;
+
+  if (!fetch_has_all_replies (fetch))
+    {
+      meta_topic (META_DEBUG_SYNC, "Syncing to get %d GetProperty replies in %s\n",
+                  fetch->n_values, G_STRFUNC);
+      XSync (fetch->display->xdisplay, False);
+      synced = TRUE;
     }
 
-  g_free (tasks);
+  /* Collect results by task rather than taking the next completed
+   * task, since replies to other pending fetches may have been read
+   * before ours.
+   */
+  for (i = 0; i < fetch->n_values; i++)
+    collect_value (fetch->display, fetch->xwindow,
+                   &fetch->values[i], fetch->tasks[i]);
+
+  g_free (fetch->tasks);
+  g_slice_free (MetaPropFetch, fetch);
+
+  return synced;
+}
+
+void
+meta_prop_get_values (MetaDisplay   *display,
+                      Window         xwindow,
+                      MetaPropValue *values,
+                      int            n_values)
+{
+  if (n_values == 0)
+    return;
+
+  meta_prop_fetch_values_finish (meta_prop_fetch_values_begin (display, xwindow,
+                                                               values, n_values));
 }
 
 static void
@@ -226,6 +226,18 @@ void meta_prop_get_values (MetaDisplay   *display,
 void meta_prop_free_values (MetaPropValue *values,
                             int            n_values);
 
+/* Split version of meta_prop_get_values(), so that requests for several
+ * windows can be sent before waiting for any of the replies.
+ */
+typedef struct _MetaPropFetch MetaPropFetch;
+
+MetaPropFetch* meta_prop_fetch_values_begin  (MetaDisplay   *display,
+                                              Window         xwindow,
+                                              MetaPropValue *values,
+                                              int            n_values);
+gboolean       meta_prop_fetch_values_ready  (MetaPropFetch *fetch);
+gboolean       meta_prop_fetch_values_finish (MetaPropFetch *fetch);
+
 #endif
 
 
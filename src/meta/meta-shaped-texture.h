@@ -67,6 +67,9 @@ void meta_shaped_texture_update_area (MetaShapedTexture *stex,
                                       int                width,
                                       int                height);
 
+void meta_shaped_texture_update_region (MetaShapedTexture *stex,
+                                        cairo_region_t    *region);
+
 void meta_shaped_texture_set_pixmap (MetaShapedTexture *stex,
                                      Pixmap             pixmap);
 
@@ -34,6 +34,7 @@
 #include <meta/theme.h>
 #include <meta/prefs.h>
 #include "ui.h"
+#include "meta-frame-profiler.h"
 
 #include <cairo-xlib.h>
 
@@ -97,6 +98,7 @@ static MetaFrameControl get_control  (MetaFrames        *frames,
                                       MetaUIFrame       *frame,
                                       int                x,
                                       int                y);
+static void invalidate_cache (MetaUIFrame *frame);
 static void invalidate_whole_window (MetaFrames *frames,
                                      MetaUIFrame *frame);
 
@@ -319,6 +321,7 @@ queue_recalc_func (gpointer key, gpointer value, gpointer data)
    */
   meta_frames_set_window_background (frames, frame);
   
+  invalidate_cache (frame);
   invalidate_whole_window (frames, frame);
   meta_core_queue_frame_resize (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()),
                                 frame->xwindow);
@@ -364,6 +367,7 @@ queue_draw_func (gpointer key, gpointer value, gpointer data)
    */
   meta_frames_set_window_background (frames, frame);
 
+  invalidate_cache (frame);
   invalidate_whole_window (frames, frame);
 }
 
@@ -384,6 +388,7 @@ reattach_style_func (gpointer key, gpointer value, gpointer data)
   frame = value;
 
   meta_frames_attach_style (frames, frame);
+  invalidate_cache (frame);
 }
 
 static void
@@ -589,6 +594,10 @@ meta_frames_manage_window (MetaFrames *frames,
   frame->shape_applied = FALSE;
   frame->prelit_control = META_FRAME_CONTROL_NONE;
 
+  memset (&frame->render_key, 0, sizeof (frame->render_key));
+  memset (frame->cached_pieces, 0, sizeof (frame->cached_pieces));
+  memset (frame->cached_buttons, 0, sizeof (frame->cached_buttons));
+
   /* Don't set the window background yet; we need frame->xwindow to be
    * registered with its MetaWindow, which happens after this function
    * and meta_ui_create_frame_window() return to meta_window_ensure_frame().
@@ -621,6 +630,7 @@ meta_frames_unmanage_window (MetaFrames *frames,
       
       g_hash_table_remove (frames->frames, &frame->xwindow);
 
+      invalidate_cache (frame);
       g_object_unref (frame->style);
 
       gdk_window_destroy (frame->window);
@@ -941,6 +951,9 @@ meta_frames_queue_draw (MetaFrames *frames,
   
   frame = meta_frames_lookup_window (frames, xwindow);
 
+  /* Whatever changed may not show in the render key, as when the
+   * theme is reloaded */
+  invalidate_cache (frame);
   invalidate_whole_window (frames, frame);
 }
 
@@ -964,6 +977,8 @@ meta_frames_set_title (MetaFrames *frames,
       frame->layout = NULL;
     }
 
+  /* The render key only has a hash of the title, which may not change */
+  invalidate_cache (frame);
   invalidate_whole_window (frames, frame);
 }
 
@@ -978,6 +993,7 @@ meta_frames_update_frame_style (MetaFrames *frames,
   g_assert (frame);
 
   meta_frames_attach_style (frames, frame);
+  invalidate_cache (frame);
   invalidate_whole_window (frames, frame);
 }
 
@@ -1870,20 +1886,271 @@ meta_frames_draw (GtkWidget *widget,
   return TRUE;
 }
 
+static gboolean
+render_key_equal (const MetaFrameRenderKey *a,
+                  const MetaFrameRenderKey *b)
+{
+  return (a->theme == b->theme &&
+          a->style == b->style &&
+          a->type == b->type &&
+          a->flags == b->flags &&
+          a->client_width == b->client_width &&
+          a->client_height == b->client_height &&
+          a->text_height == b->text_height &&
+          a->title_hash == b->title_hash &&
+          a->mini_icon == b->mini_icon &&
+          a->icon == b->icon);
+}
+
+static void
+invalidate_cache (MetaUIFrame *frame)
+{
+  int i;
+
+  for (i = 0; i < META_FRAME_N_CACHED_PIECES; i++)
+    {
+      if (frame->cached_pieces[i])
+        {
+          cairo_surface_destroy (frame->cached_pieces[i]);
+          frame->cached_pieces[i] = NULL;
+        }
+    }
+
+  for (i = 0; i < META_FRAME_N_CACHED_BUTTONS; i++)
+    {
+      if (frame->cached_buttons[i].surface)
+        {
+          cairo_surface_destroy (frame->cached_buttons[i].surface);
+          frame->cached_buttons[i].surface = NULL;
+        }
+    }
+}
+
+static void
+draw_frame (MetaUIFrame              *frame,
+            cairo_t                  *cr,
+            const MetaFrameRenderKey *key,
+            MetaButtonState           button_states[META_BUTTON_TYPE_LAST])
+{
+  MetaButtonLayout button_layout;
+
+  meta_prefs_get_button_layout (&button_layout);
+
+  meta_theme_draw_frame (key->theme,
+                         frame->style,
+                         cr,
+                         key->type,
+                         key->flags,
+                         key->client_width, key->client_height,
+                         frame->layout,
+                         frame->text_height,
+                         &button_layout,
+                         button_states,
+                         key->mini_icon, key->icon);
+}
+
+/* Draws the part of the frame in @rect into a new surface similar to
+ * the target of @cr */
+static cairo_surface_t *
+render_area (MetaUIFrame        *frame,
+             cairo_t            *cr,
+             const GdkRectangle *rect,
+             MetaButtonState     button_states[META_BUTTON_TYPE_LAST])
+{
+  cairo_surface_t *surface;
+  cairo_t *area_cr;
+
+  surface = cairo_surface_create_similar (cairo_get_target (cr),
+                                          CAIRO_CONTENT_COLOR_ALPHA,
+                                          rect->width, rect->height);
+
+  area_cr = cairo_create (surface);
+  cairo_translate (area_cr, - rect->x, - rect->y);
+  draw_frame (frame, area_cr, &frame->render_key, button_states);
+  cairo_destroy (area_cr);
+
+  meta_frame_profiler_count (META_FRAME_COUNT_DECORATION_MISSES, 1);
+
+  return surface;
+}
+
+static void
+paint_surface (cairo_t            *cr,
+               cairo_surface_t    *surface,
+               const GdkRectangle *rect)
+{
+  cairo_set_source_surface (cr, surface, rect->x, rect->y);
+  cairo_rectangle (cr, rect->x, rect->y, rect->width, rect->height);
+  cairo_fill (cr);
+}
+
+static void
+get_piece_rects (const MetaFrameGeometry *fgeom,
+                 GdkRectangle             pieces[META_FRAME_N_CACHED_PIECES])
+{
+  const MetaFrameBorders *borders = &fgeom->borders;
+  GdkRectangle visible;
+  int side_height;
+
+  visible.x = borders->invisible.left;
+  visible.y = borders->invisible.top;
+  visible.width = fgeom->width - borders->invisible.left - borders->invisible.right;
+  visible.height = fgeom->height - borders->invisible.top - borders->invisible.bottom;
+
+  side_height = visible.height - borders->visible.top - borders->visible.bottom;
+
+  /* Top */
+  pieces[0].x = visible.x;
+  pieces[0].y = visible.y;
+  pieces[0].width = visible.width;
+  pieces[0].height = borders->visible.top;
+
+  /* Bottom */
+  pieces[1].x = visible.x;
+  pieces[1].y = visible.y + visible.height - borders->visible.bottom;
+  pieces[1].width = visible.width;
+  pieces[1].height = borders->visible.bottom;
+
+  /* Left */
+  pieces[2].x = visible.x;
+  pieces[2].y = visible.y + borders->visible.top;
+  pieces[2].width = borders->visible.left;
+  pieces[2].height = side_height;
+
+  /* Right */
+  pieces[3].x = visible.x + visible.width - borders->visible.right;
+  pieces[3].y = visible.y + borders->visible.top;
+  pieces[3].width = borders->visible.right;
+  pieces[3].height = side_height;
+}
+
+static cairo_surface_t *
+get_cached_button (MetaUIFrame        *frame,
+                   cairo_t            *cr,
+                   const GdkRectangle *rect,
+                   MetaButtonState     button_states[META_BUTTON_TYPE_LAST],
+                   MetaButtonState     state)
+{
+  MetaCachedButton found;
+  int i;
+
+  for (i = 0; i < META_FRAME_N_CACHED_BUTTONS - 1; i++)
+    {
+      if (frame->cached_buttons[i].surface &&
+          frame->cached_buttons[i].control == frame->prelit_control &&
+          frame->cached_buttons[i].state == state)
+        break;
+    }
+
+  found = frame->cached_buttons[i];
+
+  if (found.surface == NULL ||
+      found.control != frame->prelit_control ||
+      found.state != state)
+    {
+      /* Not found, so i is the least recently used one */
+      if (found.surface)
+        cairo_surface_destroy (found.surface);
+
+      found.control = frame->prelit_control;
+      found.state = state;
+      found.surface = render_area (frame, cr, rect, button_states);
+    }
+  else
+    meta_frame_profiler_count (META_FRAME_COUNT_DECORATION_HITS, 1);
+
+  memmove (&frame->cached_buttons[1], &frame->cached_buttons[0],
+           i * sizeof (MetaCachedButton));
+  frame->cached_buttons[0] = found;
+
+  return found.surface;
+}
+
+/* Paints the frame from the cached pieces, drawing the missing ones;
+ * the button which is prelit or pressed, if any, is painted on its own
+ * from the cached buttons, so that hovering over the buttons doesn't
+ * redraw the whole titlebar.
+ */
+static void
+paint_from_cache (MetaFrames      *frames,
+                  MetaUIFrame     *frame,
+                  cairo_t         *cr,
+                  MetaButtonState  button_states[META_BUTTON_TYPE_LAST])
+{
+  MetaButtonState normal_states[META_BUTTON_TYPE_LAST];
+  MetaButtonState button_state;
+  MetaFrameGeometry fgeom;
+  GdkRectangle pieces[META_FRAME_N_CACHED_PIECES];
+  GdkRectangle clip, area;
+  GdkRectangle *button_rect;
+  int i;
+
+  button_state = META_BUTTON_STATE_NORMAL;
+  for (i = 0; i < META_BUTTON_TYPE_LAST; i++)
+    {
+      normal_states[i] = META_BUTTON_STATE_NORMAL;
+      if (button_states[i] != META_BUTTON_STATE_NORMAL)
+        button_state = button_states[i];
+    }
+
+  meta_frames_calc_geometry (frames, frame, &fgeom);
+  get_piece_rects (&fgeom, pieces);
+
+  gdk_cairo_get_clip_rectangle (cr, &clip);
+
+  button_rect = NULL;
+  if (button_state != META_BUTTON_STATE_NORMAL)
+    {
+      button_rect = control_rect (frame->prelit_control, &fgeom);
+      if (button_rect && !gdk_rectangle_intersect (button_rect, &clip, &area))
+        button_rect = NULL;
+    }
+
+  cairo_save (cr);
+
+  if (button_rect)
+    {
+      /* Leave the button out */
+      cairo_rectangle (cr, clip.x, clip.y, clip.width, clip.height);
+      cairo_rectangle (cr,
+                       button_rect->x, button_rect->y,
+                       button_rect->width, button_rect->height);
+      cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
+      cairo_clip (cr);
+    }
+
+  for (i = 0; i < META_FRAME_N_CACHED_PIECES; i++)
+    {
+      if (!gdk_rectangle_intersect (&pieces[i], &clip, &area))
+        continue;
+
+      if (frame->cached_pieces[i] == NULL)
+        frame->cached_pieces[i] = render_area (frame, cr, &pieces[i],
+                                               normal_states);
+      else
+        meta_frame_profiler_count (META_FRAME_COUNT_DECORATION_HITS, 1);
+
+      paint_surface (cr, frame->cached_pieces[i], &pieces[i]);
+    }
+
+  cairo_restore (cr);
+
+  if (button_rect)
+    paint_surface (cr,
+                   get_cached_button (frame, cr, button_rect,
+                                      button_states, button_state),
+                   button_rect);
+}
+
 static void
 meta_frames_paint (MetaFrames   *frames,
                    MetaUIFrame  *frame,
                    cairo_t      *cr)
 {
-  MetaFrameFlags flags;
-  MetaFrameType type;
-  GdkPixbuf *mini_icon;
-  GdkPixbuf *icon;
-  int w, h;
+  MetaFrameRenderKey key;
   MetaButtonState button_states[META_BUTTON_TYPE_LAST];
   Window grab_frame;
   int i;
-  MetaButtonLayout button_layout;
   MetaGrabOp grab_op;
   Display *display;
   
@@ -1971,29 +2238,36 @@ meta_frames_paint (MetaFrames   *frames,
     }
   
   meta_core_get (display, frame->xwindow,
-                 META_CORE_GET_FRAME_FLAGS, &flags,
-                 META_CORE_GET_FRAME_TYPE, &type,
-                 META_CORE_GET_MINI_ICON, &mini_icon,
-                 META_CORE_GET_ICON, &icon,
-                 META_CORE_GET_CLIENT_WIDTH, &w,
-                 META_CORE_GET_CLIENT_HEIGHT, &h,
+                 META_CORE_GET_FRAME_FLAGS, &key.flags,
+                 META_CORE_GET_FRAME_TYPE, &key.type,
+                 META_CORE_GET_MINI_ICON, &key.mini_icon,
+                 META_CORE_GET_ICON, &key.icon,
+                 META_CORE_GET_CLIENT_WIDTH, &key.client_width,
+                 META_CORE_GET_CLIENT_HEIGHT, &key.client_height,
                  META_CORE_GET_END);
 
   meta_frames_ensure_layout (frames, frame);
 
-  meta_prefs_get_button_layout (&button_layout);
+  key.theme = meta_theme_get_current ();
+  key.style = frame->style;
+  key.text_height = frame->text_height;
+  key.title_hash = g_str_hash (pango_layout_get_text (frame->layout));
 
-  meta_theme_draw_frame (meta_theme_get_current (),
-                         frame->style,
-                         cr,
-                         type,
-                         flags,
-                         w, h,
-                         frame->layout,
-                         frame->text_height,
-                         &button_layout,
-                         button_states,
-                         mini_icon, icon);
+  if (!render_key_equal (&key, &frame->render_key))
+    {
+      /* This happens for each step of an interactive resize, when the
+       * pieces would be used only once; so draw directly, and keep
+       * pieces from the next paint on if nothing changes.
+       */
+      invalidate_cache (frame);
+      frame->render_key = key;
+
+      draw_frame (frame, cr, &key, button_states);
+      meta_frame_profiler_count (META_FRAME_COUNT_DECORATION_MISSES, 1);
+      return;
+    }
+
+  paint_from_cache (frames, frame, cr, button_states);
 }
 
 static void
@@ -71,6 +71,36 @@ typedef struct _MetaFramesClass   MetaFramesClass;
 
 typedef struct _MetaUIFrame         MetaUIFrame;
 
+/* Everything a frame is drawn from, apart from the button states and
+ * the prefs; as long as it stays the same, the frame is drawn from the
+ * cached pieces.
+ */
+typedef struct
+{
+  MetaTheme *theme;
+  GtkStyleContext *style;
+  MetaFrameType type;
+  MetaFrameFlags flags;
+  int client_width;
+  int client_height;
+  int text_height;
+  guint title_hash;
+  GdkPixbuf *mini_icon;
+  GdkPixbuf *icon;
+} MetaFrameRenderKey;
+
+/* The top, bottom, left and right sides of the visible border */
+#define META_FRAME_N_CACHED_PIECES 4
+/* Buttons drawn prelit or pressed, most recently used first */
+#define META_FRAME_N_CACHED_BUTTONS 4
+
+typedef struct
+{
+  MetaFrameControl control;
+  MetaButtonState state;
+  cairo_surface_t *surface;
+} MetaCachedButton;
+
 struct _MetaUIFrame
 {
   Window xwindow;
@@ -84,6 +114,11 @@ struct _MetaUIFrame
   
   /* FIXME get rid of this, it can just be in the MetaFrames struct */
   MetaFrameControl prelit_control;
+
+  /* Render cache; the pieces are drawn with all the buttons normal */
+  MetaFrameRenderKey render_key;
+  cairo_surface_t *cached_pieces[META_FRAME_N_CACHED_PIECES];
+  MetaCachedButton cached_buttons[META_FRAME_N_CACHED_BUTTONS];
 };
 
 struct _MetaFrames
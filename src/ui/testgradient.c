@@ -20,8 +20,19 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
  * 02111-1307, USA.  */
 
+/* Without arguments, checks that meta_gradient_add_alpha() gives
+ * exactly the same pixels as the original per-pixel loops for a range
+ * of title bar sizes, and compares their speed. With --show, also
+ * opens windows showing the different kinds of gradients.
+ */
+
 #include <meta/gradient.h>
 #include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_SIZES 100
 
 typedef void (* RenderGradientFunc) (cairo_t     *cr,
                                      int          width,
@@ -303,14 +314,239 @@ meta_gradient_test (void)
 
 }
 
+static void
+reference_simple_multiply_alpha (GdkPixbuf *pixbuf,
+                                 guchar     alpha)
+{
+  guchar *pixels;
+  int rowstride;
+  int height;
+  int row;
+
+  if (alpha == 255)
+    return;
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  for (row = 0; row < height; row++)
+    {
+      guchar *p = pixels + row * rowstride;
+      guchar *end = p + rowstride;
+
+      while (p != end)
+        {
+          p += 3;
+          *p = (guchar) (((int) *p * (int) alpha) / (int) 255);
+          ++p;
+        }
+    }
+}
+
+static void
+reference_add_alpha_horizontal (GdkPixbuf           *pixbuf,
+                                const unsigned char *alphas,
+                                int                  n_alphas)
+{
+  int i, j;
+  long a, da;
+  unsigned char *p;
+  unsigned char *pixels;
+  int width2;
+  int rowstride;
+  int width, height;
+  unsigned char *gradient;
+  unsigned char *gradient_p;
+  unsigned char *gradient_end;
+
+  if (n_alphas == 1)
+    {
+      reference_simple_multiply_alpha (pixbuf, alphas[0]);
+      return;
+    }
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  gradient = g_new (unsigned char, width);
+  gradient_end = gradient + width;
+
+  if (n_alphas > width)
+    n_alphas = width;
+
+  if (n_alphas > 1)
+    width2 = width / (n_alphas - 1);
+  else
+    width2 = width;
+
+  a = alphas[0] << 8;
+  gradient_p = gradient;
+
+  for (i = 1; i < n_alphas; i++)
+    {
+      da = (((int)(alphas[i] - (int) alphas[i-1])) << 8) / (int) width2;
+
+      for (j = 0; j < width2; j++)
+        {
+          *gradient_p++ = (a >> 8);
+          a += da;
+        }
+
+      a = alphas[i] << 8;
+    }
+
+  while (gradient_p != gradient_end)
+    *gradient_p++ = a >> 8;
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+
+  p = pixels;
+  for (i = 0; i < height; i++)
+    {
+      unsigned char *row_end = p + rowstride;
+      gradient_p = gradient;
+
+      p += 3;
+      while (gradient_p != gradient_end)
+        {
+          *p = (guchar) (((int) *p * (int) *gradient_p) / (int) 255);
+
+          p += 4;
+          ++gradient_p;
+        }
+
+      p = row_end;
+    }
+
+  g_free (gradient);
+}
+
+/* A gradient with an alpha channel that isn't all opaque, so that the
+ * multiplication is tested with all sorts of values */
+static GdkPixbuf *
+create_test_pixbuf (int width,
+                    int height)
+{
+  GdkPixbuf *gradient, *pixbuf;
+  GdkRGBA from, to;
+  guchar *pixels;
+  int rowstride, x, y;
+
+  gdk_rgba_parse (&from, "blue");
+  gdk_rgba_parse (&to, "green");
+
+  gradient = meta_gradient_create_simple (width, height, &from, &to,
+                                          META_GRADIENT_DIAGONAL);
+  pixbuf = gdk_pixbuf_add_alpha (gradient, FALSE, 0, 0, 0);
+  g_object_unref (gradient);
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      pixels[y * rowstride + x * 4 + 3] = (x * 7 + y * 13) & 0xff;
+
+  return pixbuf;
+}
+
+static gboolean
+pixbufs_equal (GdkPixbuf *a,
+               GdkPixbuf *b)
+{
+  int width = gdk_pixbuf_get_width (a);
+  int height = gdk_pixbuf_get_height (a);
+  int rowstride = gdk_pixbuf_get_rowstride (a);
+  guchar *pixels_a = gdk_pixbuf_get_pixels (a);
+  guchar *pixels_b = gdk_pixbuf_get_pixels (b);
+  int y;
+
+  for (y = 0; y < height; y++)
+    if (memcmp (pixels_a + y * rowstride, pixels_b + y * rowstride, width * 4) != 0)
+      return FALSE;
+
+  return TRUE;
+}
+
+static void
+run_benchmark (void)
+{
+  const unsigned char multi_alphas[] = { 0xff, 0xaa, 0x2f, 0x0, 0xcc, 0xff, 0xff };
+  const unsigned char single_alpha[] = { 0x80 };
+  struct {
+    const char *name;
+    const unsigned char *alphas;
+    int n_alphas;
+  } cases[] = {
+    { "single alpha", single_alpha, G_N_ELEMENTS (single_alpha) },
+    { "horizontal alpha gradient", multi_alphas, G_N_ELEMENTS (multi_alphas) }
+  };
+  GTimer *timer;
+  int c, i;
+
+  timer = g_timer_new ();
+
+  for (c = 0; c < (int) G_N_ELEMENTS (cases); c++)
+    {
+      double reference_time = 0, new_time = 0;
+
+      for (i = 0; i < N_SIZES; i++)
+        {
+          int width = 100 + i * 19 + i % 3;
+          int height = 18 + i % 24;
+          GdkPixbuf *reference, *pixbuf;
+
+          reference = create_test_pixbuf (width, height);
+          pixbuf = gdk_pixbuf_copy (reference);
+
+          g_timer_start (timer);
+          reference_add_alpha_horizontal (reference,
+                                          cases[c].alphas, cases[c].n_alphas);
+          reference_time += g_timer_elapsed (timer, NULL);
+
+          g_timer_start (timer);
+          meta_gradient_add_alpha (pixbuf,
+                                   cases[c].alphas, cases[c].n_alphas,
+                                   META_GRADIENT_HORIZONTAL);
+          new_time += g_timer_elapsed (timer, NULL);
+
+          if (!pixbufs_equal (reference, pixbuf))
+            {
+              printf ("%s for %dx%d differs from the reference\n",
+                      cases[c].name, width, height);
+              exit (1);
+            }
+
+          g_object_unref (reference);
+          g_object_unref (pixbuf);
+        }
+
+      printf ("%s, %d sizes: reference %.3f ms, new %.3f ms per gradient\n",
+              cases[c].name, N_SIZES,
+              reference_time * 1000 / N_SIZES,
+              new_time * 1000 / N_SIZES);
+    }
+
+  printf ("All gradients matched the reference.\n");
+
+  g_timer_destroy (timer);
+}
+
 int
 main (int argc, char **argv)
 {
-  gtk_init (&argc, &argv);
+  run_benchmark ();
+
+  if (argc > 1 && strcmp (argv[1], "--show") == 0)
+    {
+      gtk_init (&argc, &argv);
 
-  meta_gradient_test ();
+      meta_gradient_test ();
 
-  gtk_main ();
+      gtk_main ();
+    }
 
   return 0;
 }
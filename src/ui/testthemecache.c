@@ -0,0 +1,402 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Theme cache test and benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* A theme is built only from the calls the parser makes to the start
+ * element, end element and text handlers, so a cached load gives the
+ * same theme as a fresh parse if it makes the same calls. This writes
+ * a theme file, parses it the way load_theme() does, saving the cache,
+ * and checks that replaying the cache makes the same calls, and that
+ * the cache is not used once the file has changed, even if its size
+ * and modification time haven't.
+ *
+ * Then it times loading the file both ways with handlers that do
+ * nothing. That is the part of loading a theme that the cache saves;
+ * the handlers, which build the theme, run either way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <glib/gstdio.h>
+
+#include "theme-cache.h"
+
+#define ITERATIONS 200
+
+/* Number of draw_ops in the theme file; with these, it is about the
+ * size of a typical theme */
+#define N_DRAW_OPS 150
+
+typedef struct
+{
+  /* The calls made to the handlers, if not NULL */
+  GString *calls;
+  MetaThemeCacheWriter *writer;
+} Recorder;
+
+static void
+record_start_element (GMarkupParseContext  *context,
+                      const char           *element_name,
+                      const char          **attribute_names,
+                      const char          **attribute_values,
+                      gpointer              user_data,
+                      GError              **error)
+{
+  Recorder *recorder = user_data;
+  int i;
+
+  if (recorder->writer)
+    meta_theme_cache_writer_start_element (recorder->writer, element_name,
+                                           attribute_names, attribute_values);
+
+  if (recorder->calls == NULL)
+    return;
+
+  g_string_append_printf (recorder->calls, "<%s", element_name);
+  for (i = 0; attribute_names[i]; i++)
+    g_string_append_printf (recorder->calls, " [%s]=[%s]",
+                            attribute_names[i], attribute_values[i]);
+  g_string_append (recorder->calls, ">\n");
+}
+
+static void
+record_end_element (GMarkupParseContext  *context,
+                    const char           *element_name,
+                    gpointer              user_data,
+                    GError              **error)
+{
+  Recorder *recorder = user_data;
+
+  if (recorder->writer)
+    meta_theme_cache_writer_end_element (recorder->writer, element_name);
+
+  if (recorder->calls)
+    g_string_append_printf (recorder->calls, "</%s>\n", element_name);
+}
+
+static void
+record_text (GMarkupParseContext  *context,
+             const char           *text,
+             gsize                 text_len,
+             gpointer              user_data,
+             GError              **error)
+{
+  Recorder *recorder = user_data;
+
+  if (recorder->writer)
+    meta_theme_cache_writer_text (recorder->writer, text, text_len);
+
+  if (recorder->calls)
+    {
+      g_string_append_printf (recorder->calls, "text %" G_GSIZE_FORMAT " [",
+                              text_len);
+      g_string_append_len (recorder->calls, text, text_len);
+      g_string_append (recorder->calls, "]\n");
+    }
+}
+
+static const GMarkupParser record_parser = {
+  record_start_element,
+  record_end_element,
+  record_text,
+  NULL,
+  NULL
+};
+
+static char *
+make_theme_text (void)
+{
+  GString *text;
+  int i;
+
+  text = g_string_new ("<?xml version=\"1.0\"?>\n"
+                       "<metacity_theme>\n"
+                       "<info>\n"
+                       "  <name>Cache Test</name>\n"
+                       "  <author>Nobody &lt;nobody@example.com&gt;</author>\n"
+                       "  <copyright>&#169; Nobody</copyright>\n"
+                       "  <date>2026</date>\n"
+                       "  <description>Checks the theme cache &amp; times it</description>\n"
+                       "</info>\n"
+                       "<!-- Comments and processing instructions aren't passed on -->\n"
+                       "<constant name=\"C_border\" value=\"2\"/>\n"
+                       "<frame_geometry name=\"normal\" rounded_top_left=\"4\" rounded_top_right=\"4\">\n"
+                       "  <distance name=\"left_width\" value=\"C_border\"/>\n"
+                       "  <distance name=\"right_width\" value=\"C_border\"/>\n"
+                       "  <distance name=\"bottom_height\" value=\"C_border\"/>\n"
+                       "  <border name=\"title_border\" left=\"10\" right=\"10\" top=\"3\" bottom=\"3\"/>\n"
+                       "</frame_geometry>\n");
+
+  for (i = 0; i < N_DRAW_OPS; i++)
+    g_string_append_printf (text,
+                            "<draw_ops name=\"ops_%d\">\n"
+                            "  <rectangle color=\"shade/gtk:bg[NORMAL]/0.9\" filled=\"true\"\n"
+                            "             x=\"0\" y=\"0\" width=\"width\" height=\"height\"/>\n"
+                            "  <line color=\"blend/gtk:fg[NORMAL]/gtk:bg[NORMAL]/0.5\"\n"
+                            "        x1=\"0\" y1=\"height - 1\" x2=\"width - 1\" y2=\"height - 1\"/>\n"
+                            "  <arc color=\"#e0e0e0\" x=\"(width - 8) / 2\" y=\"(height - 8) / 2\"\n"
+                            "       width=\"8\" height=\"8\" start_angle=\"0\" extent_angle=\"360\" filled=\"true\"/>\n"
+                            "  <title color=\"gtk:text[NORMAL]\"\n"
+                            "         x=\"(0 `max` ((width - title_width) / 2)) + %d\"\n"
+                            "         y=\"(0 `max` ((height - title_height) / 2))\"/>\n"
+                            "</draw_ops>\n",
+                            i, i % 3);
+
+  g_string_append (text, "</metacity_theme>\n");
+
+  return g_string_free (text, FALSE);
+}
+
+static void
+write_theme_file (const char *theme_file,
+                  const char *text,
+                  gsize       length)
+{
+  GError *error = NULL;
+
+  if (!g_file_set_contents (theme_file, text, length, &error))
+    {
+      printf ("Failed to write %s: %s\n", theme_file, error->message);
+      exit (1);
+    }
+}
+
+/* Like load_theme(), trying the cache first and parsing the file and
+ * saving the cache if that fails; returns whether the cache was used */
+static gboolean
+load_theme_file (const char *theme_file,
+                 const char *text,
+                 gsize       length,
+                 GString    *calls)
+{
+  GMarkupParseContext *context;
+  Recorder recorder;
+  GError *error = NULL;
+  gboolean from_cache;
+
+  recorder.calls = calls;
+  recorder.writer = NULL;
+
+  context = g_markup_parse_context_new (&record_parser, 0, &recorder, NULL);
+
+  from_cache = meta_theme_cache_replay (theme_file, text, length,
+                                        &record_parser, context, &recorder);
+
+  if (!from_cache)
+    {
+      if (calls)
+        g_string_truncate (calls, 0);
+      recorder.writer = meta_theme_cache_writer_new ();
+
+      if (!g_markup_parse_context_parse (context, text, length, &error) ||
+          !g_markup_parse_context_end_parse (context, &error))
+        {
+          printf ("Failed to parse %s: %s\n", theme_file, error->message);
+          exit (1);
+        }
+
+      meta_theme_cache_save (recorder.writer, theme_file, text, length);
+      meta_theme_cache_writer_free (recorder.writer);
+    }
+
+  g_markup_parse_context_free (context);
+
+  return from_cache;
+}
+
+static void
+test_replay_matches_parse (const char *theme_file)
+{
+  GString *parsed, *replayed;
+  char *text;
+  gsize length;
+
+  text = make_theme_text ();
+  length = strlen (text);
+  write_theme_file (theme_file, text, length);
+
+  parsed = g_string_new (NULL);
+  replayed = g_string_new (NULL);
+
+  g_assert (!load_theme_file (theme_file, text, length, parsed));
+  g_assert (load_theme_file (theme_file, text, length, replayed));
+  g_assert (strcmp (parsed->str, replayed->str) == 0);
+
+  g_string_free (parsed, TRUE);
+  g_string_free (replayed, TRUE);
+  g_free (text);
+
+  printf ("%s passed.\n", G_STRFUNC);
+}
+
+static void
+test_changed_file_invalidates (const char *theme_file)
+{
+  GString *parsed, *replayed;
+  struct stat buf;
+  struct utimbuf times;
+  char *text, *p;
+  gsize length;
+
+  text = make_theme_text ();
+  length = strlen (text);
+  write_theme_file (theme_file, text, length);
+
+  load_theme_file (theme_file, text, length, NULL);
+  g_assert (load_theme_file (theme_file, text, length, NULL));
+
+  /* Change a value without changing the size of the file, and put its
+   * modification time back, so that only its contents tell */
+  g_assert (g_stat (theme_file, &buf) == 0);
+  p = strstr (text, "value=\"2\"");
+  g_assert (p != NULL);
+  p[strlen ("value=\"")] = '3';
+  write_theme_file (theme_file, text, length);
+  times.actime = buf.st_atime;
+  times.modtime = buf.st_mtime;
+  g_assert (g_utime (theme_file, &times) == 0);
+
+  parsed = g_string_new (NULL);
+  replayed = g_string_new (NULL);
+
+  g_assert (!load_theme_file (theme_file, text, length, parsed));
+  g_assert (strstr (parsed->str, "[value]=[3]") != NULL);
+  g_assert (load_theme_file (theme_file, text, length, replayed));
+  g_assert (strcmp (parsed->str, replayed->str) == 0);
+
+  /* And a change of size */
+  text = g_realloc (text, length + 2);
+  strcpy (text + length, "\n");
+  length++;
+  write_theme_file (theme_file, text, length);
+
+  g_assert (!load_theme_file (theme_file, text, length, NULL));
+
+  g_string_free (parsed, TRUE);
+  g_string_free (replayed, TRUE);
+  g_free (text);
+
+  printf ("%s passed.\n", G_STRFUNC);
+}
+
+static void
+time_parse_and_replay (const char *theme_file)
+{
+  GMarkupParseContext *context;
+  Recorder recorder;
+  GTimer *timer;
+  double parse_time, replay_time;
+  char *text;
+  gsize length;
+  int i;
+
+  text = make_theme_text ();
+  length = strlen (text);
+  write_theme_file (theme_file, text, length);
+  load_theme_file (theme_file, text, length, NULL);
+
+  recorder.calls = NULL;
+  recorder.writer = NULL;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      context = g_markup_parse_context_new (&record_parser, 0, &recorder, NULL);
+      g_assert (g_markup_parse_context_parse (context, text, length, NULL));
+      g_assert (g_markup_parse_context_end_parse (context, NULL));
+      g_markup_parse_context_free (context);
+    }
+  parse_time = g_timer_elapsed (timer, NULL);
+
+  g_timer_start (timer);
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      context = g_markup_parse_context_new (&record_parser, 0, &recorder, NULL);
+      g_assert (meta_theme_cache_replay (theme_file, text, length,
+                                         &record_parser, context, &recorder));
+      g_markup_parse_context_free (context);
+    }
+  replay_time = g_timer_elapsed (timer, NULL);
+
+  printf ("%" G_GSIZE_FORMAT " byte theme file: parsing %.3f ms, "
+          "replaying the cache %.3f ms per load\n",
+          length,
+          parse_time * 1000 / ITERATIONS,
+          replay_time * 1000 / ITERATIONS);
+
+  g_timer_destroy (timer);
+  g_free (text);
+}
+
+static void
+remove_dir (const char *path)
+{
+  GDir *dir;
+  const char *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      char *child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        remove_dir (child);
+      else
+        g_unlink (child);
+
+      g_free (child);
+    }
+
+  g_dir_close (dir);
+  g_rmdir (path);
+}
+
+int
+main (int argc, char **argv)
+{
+  char *dir, *theme_file;
+
+  dir = g_dir_make_tmp ("testthemecache-XXXXXX", NULL);
+  g_assert (dir != NULL);
+
+  /* Keep the cache out of the user's */
+  g_setenv ("XDG_CACHE_HOME", dir, TRUE);
+
+  theme_file = g_build_filename (dir, "metacity-theme-3.xml", NULL);
+
+  test_replay_matches_parse (theme_file);
+  test_changed_file_invalidates (theme_file);
+  time_parse_and_replay (theme_file);
+
+  printf ("All tests passed.\n");
+
+  remove_dir (dir);
+  g_free (theme_file);
+  g_free (dir);
+
+  return 0;
+}
@@ -0,0 +1,368 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Theme expression test and benchmark */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Checks the position expressions below, evaluated both from the
+ * compiled program of their MetaDrawSpec and by interpreting their
+ * tokens, against the expected values and errors, and against each
+ * other. Then evaluates the valid ones repeatedly both ways, as when
+ * drawing frames, and compares the times.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "theme-private.h"
+
+#define ITERATIONS 100000
+
+typedef struct
+{
+  GdkRectangle rect;
+  const char *expr;
+  int expected_x;
+  int expected_y;
+  MetaThemeError expected_error;
+} PositionExpressionTest;
+
+#define NO_ERROR -1
+
+static const PositionExpressionTest position_expression_tests[] = {
+  /* Just numbers */
+  { { 10, 20, 40, 50 },
+    "10", 20, 30, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14.37", 24, 34, NO_ERROR },
+  /* Binary expressions with 2 ints */
+  { { 10, 20, 40, 50 },
+    "14 * 10", 150, 160, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14 + 10", 34, 44, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14 - 10", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8 / 2", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8 % 3", 12, 22, NO_ERROR },
+  /* Binary expressions with floats and mixed float/ints */
+  { { 10, 20, 40, 50 },
+    "7.0 / 3.5", 12, 22, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "12.1 / 3", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "12 / 2.95", 14, 24, NO_ERROR },
+  /* Binary expressions without whitespace after first number */
+  { { 10, 20, 40, 50 },
+    "14* 10", 150, 160, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14+ 10", 34, 44, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14- 10", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8/ 2", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "7.0/ 3.5", 12, 22, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "12.1/ 3", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "12/ 2.95", 14, 24, NO_ERROR },
+  /* Binary expressions without whitespace before second number */
+  { { 10, 20, 40, 50 },
+    "14 *10", 150, 160, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14 +10", 34, 44, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14 -10", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8 /2", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "7.0 /3.5", 12, 22, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "12.1 /3", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "12 /2.95", 14, 24, NO_ERROR },
+  /* Binary expressions without any whitespace */
+  { { 10, 20, 40, 50 },
+    "14*10", 150, 160, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14+10", 34, 44, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14-10", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8/2", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "7.0/3.5", 12, 22, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "12.1/3", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "12/2.95", 14, 24, NO_ERROR },
+  /* Binary expressions with parentheses */
+  { { 10, 20, 40, 50 },
+    "(14) * (10)", 150, 160, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(14) + (10)", 34, 44, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(14) - (10)", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(8) / (2)", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(7.0) / (3.5)", 12, 22, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(12.1) / (3)", 14, 24, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(12) / (2.95)", 14, 24, NO_ERROR },
+  /* Lots of extra parentheses */
+  { { 10, 20, 40, 50 },
+    "(((14)) * ((10)))", 150, 160, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "((((14)))) + ((((((((10))))))))", 34, 44, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "((((((((((14 - 10))))))))))", 14, 24, NO_ERROR },
+  /* Binary expressions with variables */
+  { { 10, 20, 40, 50 },
+    "2 * width", 90, 100, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "2 * height", 110, 120, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "width - 10", 40, 50, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "height / 2", 35, 45, NO_ERROR },
+  /* More than two operands */
+  { { 10, 20, 40, 50 },
+    "8 / 2 + 5", 19, 29, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8 * 2 + 5", 31, 41, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8 + 2 * 5", 28, 38, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8 + 8 / 2", 22, 32, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "14 / (2 + 5)", 12, 22, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "8 * (2 + 5)", 66, 76, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(8 + 2) * 5", 60, 70, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(8 + 8) / 2", 18, 28, NO_ERROR },
+  /* Errors */
+  { { 10, 20, 40, 50 },
+    "2 * foo", 0, 0, META_THEME_ERROR_UNKNOWN_VARIABLE },
+  { { 10, 20, 40, 50 },
+    "2 *", 0, 0, META_THEME_ERROR_FAILED },
+  { { 10, 20, 40, 50 },
+    "- width", 0, 0, META_THEME_ERROR_FAILED },
+  { { 10, 20, 40, 50 },
+    "5 % 1.0", 0, 0, META_THEME_ERROR_MOD_ON_FLOAT },
+  { { 10, 20, 40, 50 },
+    "1.0 % 5", 0, 0, META_THEME_ERROR_MOD_ON_FLOAT },
+  /* meta_draw_spec_new() doesn't keep the tokenizer's errors */
+  { { 10, 20, 40, 50 },
+    "! * 2", 0, 0, META_THEME_ERROR_FAILED },
+  { { 10, 20, 40, 50 },
+    "   ", 0, 0, META_THEME_ERROR_FAILED },
+  { { 10, 20, 40, 50 },
+    "() () (( ) ()) ((()))", 0, 0, META_THEME_ERROR_FAILED },
+  { { 10, 20, 40, 50 },
+    "(*) () ((/) ()) ((()))", 0, 0, META_THEME_ERROR_FAILED },
+  { { 10, 20, 40, 50 },
+    "2 * 5 /", 0, 0, META_THEME_ERROR_FAILED },
+  { { 10, 20, 40, 50 },
+    "+ 2 * 5", 0, 0, META_THEME_ERROR_FAILED },
+  { { 10, 20, 40, 50 },
+    "object_width `max` 16", 0, 0, META_THEME_ERROR_UNKNOWN_VARIABLE },
+  { { 10, 20, 40, 50 },
+    "width / (top_height - 0)", 0, 0, META_THEME_ERROR_DIVIDE_BY_ZERO },
+  { { 10, 20, 40, 50 },
+    "width % 1.5", 0, 0, META_THEME_ERROR_MOD_ON_FLOAT },
+  /* Expressions as found in themes */
+  { { 10, 20, 40, 50 },
+    "(width - title_width) / 2", 27, 37, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "width - right_width - 2", 48, 58, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "frame_x_center - mini_icon_width / 2", 22, 32, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "height / 2 - 4 * 2", 27, 37, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "width * 0.5 + 1", 31, 41, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "width `min` height - 2 `max` 3", 50, 60, NO_ERROR },
+  { { 10, 20, 40, 50 },
+    "(height - title_height) / 2 + top_height - 1 * 2", 30, 40, NO_ERROR }
+};
+
+static void
+init_env (MetaPositionExprEnv          *env,
+          const PositionExpressionTest *test,
+          MetaTheme                    *theme)
+{
+  env->rect = meta_rect (test->rect.x, test->rect.y,
+                         test->rect.width, test->rect.height);
+  env->object_width = -1;
+  env->object_height = -1;
+  env->left_width = 0;
+  env->right_width = 0;
+  env->top_height = 0;
+  env->bottom_height = 0;
+  env->title_width = 5;
+  env->title_height = 5;
+  env->frame_x_center = 20;
+  env->frame_y_center = 25;
+  env->icon_width = 32;
+  env->icon_height = 32;
+  env->mini_icon_width = 16;
+  env->mini_icon_height = 16;
+  env->theme = theme;
+}
+
+static void
+check_error (const PositionExpressionTest *test,
+             GError                       *err)
+{
+  if (((int) test->expected_error) == NO_ERROR)
+    {
+      printf ("\"%s\": unexpected error: %s\n", test->expr, err->message);
+      exit (1);
+    }
+
+  if (err->code != (int) test->expected_error)
+    {
+      printf ("\"%s\": error %d was expected but %d given\n",
+              test->expr, test->expected_error, err->code);
+      exit (1);
+    }
+}
+
+static void
+run_test (const PositionExpressionTest *test,
+          MetaTheme                    *theme)
+{
+  MetaPositionExprEnv env;
+  MetaDrawSpec *spec;
+  GError *err = NULL;
+  GError *interpreted_err = NULL;
+  gboolean retval, interpreted_retval;
+  int x, y, val;
+
+  init_env (&env, test, theme);
+
+  /* Constant expressions are evaluated, and fail, here */
+  spec = meta_draw_spec_new (theme, test->expr, &err);
+  if (spec == NULL)
+    {
+      check_error (test, err);
+      g_error_free (err);
+      return;
+    }
+
+  retval = meta_parse_position_expression (spec, &env, &x, &y, &err);
+  interpreted_retval = meta_draw_spec_interpret (spec, &env, &val,
+                                                 &interpreted_err);
+
+  if (retval != interpreted_retval ||
+      (retval && (x != env.rect.x + val || y != env.rect.y + val)) ||
+      (!retval && err->code != interpreted_err->code))
+    {
+      printf ("\"%s\": compiled expression differs from the reference\n",
+              test->expr);
+      exit (1);
+    }
+
+  if (!retval)
+    {
+      check_error (test, err);
+      g_error_free (err);
+      g_error_free (interpreted_err);
+    }
+  else if (((int) test->expected_error) != NO_ERROR)
+    {
+      printf ("\"%s\": error was expected but none given\n", test->expr);
+      exit (1);
+    }
+  else if (x != test->expected_x || y != test->expected_y)
+    {
+      printf ("\"%s\": got x = %d y = %d, expected x = %d y = %d\n",
+              test->expr, x, y, test->expected_x, test->expected_y);
+      exit (1);
+    }
+
+  meta_draw_spec_free (spec);
+}
+
+int
+main (int argc, char **argv)
+{
+  MetaTheme *theme;
+  MetaDrawSpec *specs[G_N_ELEMENTS (position_expression_tests)];
+  MetaPositionExprEnv envs[G_N_ELEMENTS (position_expression_tests)];
+  int n_specs, n_variable;
+  GTimer *timer;
+  double reference_time, new_time;
+  int i, j, x, val;
+
+  theme = meta_theme_new ();
+
+  for (i = 0; i < (int) G_N_ELEMENTS (position_expression_tests); i++)
+    run_test (&position_expression_tests[i], theme);
+
+  /* Time the expressions which are valid */
+  n_specs = 0;
+  n_variable = 0;
+  for (i = 0; i < (int) G_N_ELEMENTS (position_expression_tests); i++)
+    {
+      const PositionExpressionTest *test = &position_expression_tests[i];
+
+      if (((int) test->expected_error) != NO_ERROR)
+        continue;
+
+      specs[n_specs] = meta_draw_spec_new (theme, test->expr, NULL);
+      init_env (&envs[n_specs], test, theme);
+      if (!specs[n_specs]->constant)
+        n_variable++;
+      n_specs++;
+    }
+
+  timer = g_timer_new ();
+
+  g_timer_start (timer);
+  for (j = 0; j < ITERATIONS; j++)
+    for (i = 0; i < n_specs; i++)
+      meta_draw_spec_interpret (specs[i], &envs[i], &val, NULL);
+  reference_time = g_timer_elapsed (timer, NULL);
+
+  g_timer_start (timer);
+  for (j = 0; j < ITERATIONS; j++)
+    for (i = 0; i < n_specs; i++)
+      meta_parse_position_expression (specs[i], &envs[i], &x, NULL, NULL);
+  new_time = g_timer_elapsed (timer, NULL);
+
+  printf ("%d expressions (%d with variables), %d times: interpreted %.3f ms, compiled %.3f ms\n",
+          n_specs, n_variable, ITERATIONS,
+          reference_time * 1000, new_time * 1000);
+  printf ("All expressions matched the reference.\n");
+
+  for (i = 0; i < n_specs; i++)
+    meta_draw_spec_free (specs[i]);
+
+  g_timer_destroy (timer);
+  meta_theme_free (theme);
+
+  return 0;
+}
@@ -0,0 +1,478 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Mutter cache of parsed theme files */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* A theme file is cached as the sequence of GMarkup callbacks that
+ * parsing it produced: elements with their attributes, and text, with
+ * entities already decoded. Loading the theme again replays them into
+ * the same handlers, which skips the XML parser but builds the theme
+ * in exactly the same way, so the cache doesn't depend on how the
+ * theme is represented in memory, or on which parts of the file this
+ * version of mutter understands.
+ *
+ * The cache lives in $XDG_CACHE_HOME/mutter/themes, one file per theme
+ * file, and is only used if the size, modification time and hash of
+ * the theme file still match. It is mapped rather than read, and the
+ * strings are passed to the handlers straight from the mapping.
+ *
+ * So on a hit, the theme file is still read and hashed, and the
+ * handlers still do all their work, like compiling expressions and
+ * loading images; only tokenizing the XML is saved. testthemecache
+ * times that part.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include <meta/util.h>
+#include "theme-cache.h"
+
+#define CACHE_MAGIC "MTHEMEC"
+#define CACHE_VERSION 1
+#define CACHE_BYTE_ORDER 0x01020304
+
+enum
+{
+  EVENT_START_ELEMENT = 1,
+  EVENT_END_ELEMENT,
+  EVENT_TEXT
+};
+
+/* Laid out so that there is no padding on any architecture; the
+ * events follow it */
+typedef struct
+{
+  char magic[8];
+  guint64 source_mtime;
+  guint64 source_size;
+  guint64 source_hash;
+  guint32 version;
+  guint32 byte_order;
+  guint32 n_events;
+  guint32 data_size;
+} CacheHeader;
+
+struct _MetaThemeCacheWriter
+{
+  GString *data;
+  guint32 n_events;
+};
+
+typedef struct
+{
+  const char *p;
+  const char *end;
+} CacheReader;
+
+/* FNV-1a; the cache only has to notice that the file changed */
+static guint64
+hash_source (const char *text,
+             gsize       length)
+{
+  guint64 hash = G_GUINT64_CONSTANT (14695981039346656037);
+  gsize i;
+
+  for (i = 0; i < length; i++)
+    {
+      hash ^= (guchar) text[i];
+      hash *= G_GUINT64_CONSTANT (1099511628211);
+    }
+
+  return hash;
+}
+
+static gboolean
+get_source_mtime (const char *theme_file,
+                  guint64    *mtime)
+{
+  struct stat buf;
+
+  if (g_stat (theme_file, &buf) != 0)
+    return FALSE;
+
+  *mtime = buf.st_mtime;
+  return TRUE;
+}
+
+static char *
+get_cache_file (const char *theme_file)
+{
+  char *checksum, *basename, *filename;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, theme_file, -1);
+  basename = g_strconcat (checksum, ".cache", NULL);
+  filename = g_build_filename (g_get_user_cache_dir (),
+                               "mutter", "themes", basename,
+                               NULL);
+
+  g_free (checksum);
+  g_free (basename);
+
+  return filename;
+}
+
+MetaThemeCacheWriter *
+meta_theme_cache_writer_new (void)
+{
+  MetaThemeCacheWriter *writer;
+
+  writer = g_new (MetaThemeCacheWriter, 1);
+  writer->data = g_string_new (NULL);
+  writer->n_events = 0;
+
+  return writer;
+}
+
+void
+meta_theme_cache_writer_free (MetaThemeCacheWriter *writer)
+{
+  g_string_free (writer->data, TRUE);
+  g_free (writer);
+}
+
+static void
+write_u32 (MetaThemeCacheWriter *writer,
+           guint32               value)
+{
+  g_string_append_len (writer->data, (const char *) &value, sizeof (value));
+}
+
+/* Strings are stored with their length, and nul-terminated so that
+ * they can be used in place */
+static void
+write_string (MetaThemeCacheWriter *writer,
+              const char           *str,
+              gsize                 len)
+{
+  write_u32 (writer, len);
+  g_string_append_len (writer->data, str, len);
+  g_string_append_c (writer->data, '\0');
+}
+
+void
+meta_theme_cache_writer_start_element (MetaThemeCacheWriter  *writer,
+                                       const char            *element_name,
+                                       const char           **attribute_names,
+                                       const char           **attribute_values)
+{
+  guint32 i, n_attributes;
+
+  n_attributes = g_strv_length ((char **) attribute_names);
+
+  write_u32 (writer, EVENT_START_ELEMENT);
+  write_string (writer, element_name, strlen (element_name));
+  write_u32 (writer, n_attributes);
+
+  for (i = 0; i < n_attributes; i++)
+    {
+      write_string (writer, attribute_names[i], strlen (attribute_names[i]));
+      write_string (writer, attribute_values[i], strlen (attribute_values[i]));
+    }
+
+  writer->n_events++;
+}
+
+void
+meta_theme_cache_writer_end_element (MetaThemeCacheWriter *writer,
+                                     const char           *element_name)
+{
+  write_u32 (writer, EVENT_END_ELEMENT);
+  write_string (writer, element_name, strlen (element_name));
+
+  writer->n_events++;
+}
+
+void
+meta_theme_cache_writer_text (MetaThemeCacheWriter *writer,
+                              const char           *text,
+                              gsize                 text_len)
+{
+  write_u32 (writer, EVENT_TEXT);
+  write_string (writer, text, text_len);
+
+  writer->n_events++;
+}
+
+/**
+ * meta_theme_cache_save:
+ * @writer: the events recorded while parsing @text
+ * @theme_file: the theme file that was parsed
+ * @text: the contents of @theme_file
+ * @length: the length of @text
+ *
+ * Writes the cache for a theme file that was parsed successfully.
+ * Failing to write it is not an error; the theme file will just be
+ * parsed again next time.
+ */
+void
+meta_theme_cache_save (MetaThemeCacheWriter *writer,
+                       const char           *theme_file,
+                       const char           *text,
+                       gsize                 length)
+{
+  CacheHeader header;
+  GString *contents;
+  GError *error = NULL;
+  char *filename, *dirname;
+  guint64 mtime;
+
+  if (!get_source_mtime (theme_file, &mtime))
+    return;
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, CACHE_MAGIC, sizeof (CACHE_MAGIC));
+  header.source_mtime = mtime;
+  header.source_size = length;
+  header.source_hash = hash_source (text, length);
+  header.version = CACHE_VERSION;
+  header.byte_order = CACHE_BYTE_ORDER;
+  header.n_events = writer->n_events;
+  header.data_size = writer->data->len;
+
+  contents = g_string_sized_new (sizeof (header) + writer->data->len);
+  g_string_append_len (contents, (const char *) &header, sizeof (header));
+  g_string_append_len (contents, writer->data->str, writer->data->len);
+
+  filename = get_cache_file (theme_file);
+  dirname = g_path_get_dirname (filename);
+
+  if (g_mkdir_with_parents (dirname, 0755) != 0)
+    meta_topic (META_DEBUG_THEMES, "Failed to create %s: %s\n",
+                dirname, g_strerror (errno));
+  else if (!g_file_set_contents (filename, contents->str, contents->len, &error))
+    {
+      meta_topic (META_DEBUG_THEMES, "Failed to write theme cache %s: %s\n",
+                  filename, error->message);
+      g_error_free (error);
+    }
+  else
+    meta_topic (META_DEBUG_THEMES, "Wrote theme cache %s for %s\n",
+                filename, theme_file);
+
+  g_string_free (contents, TRUE);
+  g_free (filename);
+  g_free (dirname);
+}
+
+static gboolean
+read_u32 (CacheReader *reader,
+          guint32     *value)
+{
+  if (reader->end - reader->p < (gssize) sizeof (*value))
+    return FALSE;
+
+  memcpy (value, reader->p, sizeof (*value));
+  reader->p += sizeof (*value);
+
+  return TRUE;
+}
+
+static gboolean
+read_string (CacheReader  *reader,
+             const char  **str,
+             gsize        *len)
+{
+  guint32 str_len;
+
+  if (!read_u32 (reader, &str_len) ||
+      (gsize) (reader->end - reader->p) <= str_len ||
+      reader->p[str_len] != '\0')
+    return FALSE;
+
+  *str = reader->p;
+  if (len)
+    *len = str_len;
+  reader->p += str_len + 1;
+
+  return TRUE;
+}
+
+static gboolean
+header_is_valid (const CacheHeader *header,
+                 gsize              cache_length,
+                 const char        *theme_file,
+                 const char        *text,
+                 gsize              length)
+{
+  guint64 mtime;
+
+  return memcmp (header->magic, CACHE_MAGIC, sizeof (CACHE_MAGIC)) == 0 &&
+    header->version == CACHE_VERSION &&
+    header->byte_order == CACHE_BYTE_ORDER &&
+    header->data_size == cache_length - sizeof (*header) &&
+    header->source_size == length &&
+    get_source_mtime (theme_file, &mtime) &&
+    header->source_mtime == mtime &&
+    header->source_hash == hash_source (text, length);
+}
+
+/**
+ * meta_theme_cache_replay:
+ * @theme_file: the theme file to load
+ * @text: the contents of @theme_file
+ * @length: the length of @text
+ * @parser: the handlers to replay the cached events into
+ * @context: passed to the handlers
+ * @user_data: passed to the handlers
+ *
+ * Feeds the events of parsing @theme_file to @parser from the cache.
+ * On failure, the handlers may have been called with some of the
+ * events, and the caller has to start over by parsing the file; this
+ * also gives the proper error messages, with line numbers, if the
+ * handlers failed.
+ *
+ * Return value: %TRUE if the cache was valid and all the events were
+ *  handled without error
+ */
+gboolean
+meta_theme_cache_replay (const char          *theme_file,
+                         const char          *text,
+                         gsize                length,
+                         const GMarkupParser *parser,
+                         GMarkupParseContext *context,
+                         gpointer             user_data)
+{
+  GMappedFile *mapped;
+  CacheHeader header;
+  CacheReader reader;
+  GPtrArray *names, *values;
+  GError *error = NULL;
+  const char *contents;
+  char *filename;
+  gsize cache_length;
+  gboolean success = FALSE;
+  guint32 i, j;
+
+  filename = get_cache_file (theme_file);
+  mapped = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+
+  if (mapped == NULL)
+    return FALSE;
+
+  contents = g_mapped_file_get_contents (mapped);
+  cache_length = g_mapped_file_get_length (mapped);
+
+  if (cache_length < sizeof (header))
+    {
+      g_mapped_file_unref (mapped);
+      return FALSE;
+    }
+
+  memcpy (&header, contents, sizeof (header));
+  if (!header_is_valid (&header, cache_length, theme_file, text, length))
+    {
+      meta_topic (META_DEBUG_THEMES, "Theme cache for %s is out of date\n",
+                  theme_file);
+      g_mapped_file_unref (mapped);
+      return FALSE;
+    }
+
+  reader.p = contents + sizeof (header);
+  reader.end = contents + cache_length;
+
+  names = g_ptr_array_new ();
+  values = g_ptr_array_new ();
+
+  for (i = 0; i < header.n_events && error == NULL; i++)
+    {
+      const char *name, *value;
+      guint32 type, n_attributes;
+      gsize len;
+
+      if (!read_u32 (&reader, &type))
+        goto out;
+
+      switch (type)
+        {
+        case EVENT_START_ELEMENT:
+          if (!read_string (&reader, &name, NULL) ||
+              !read_u32 (&reader, &n_attributes))
+            goto out;
+
+          g_ptr_array_set_size (names, 0);
+          g_ptr_array_set_size (values, 0);
+
+          for (j = 0; j < n_attributes; j++)
+            {
+              const char *attribute_name, *attribute_value;
+
+              if (!read_string (&reader, &attribute_name, NULL) ||
+                  !read_string (&reader, &attribute_value, NULL))
+                goto out;
+
+              g_ptr_array_add (names, (char *) attribute_name);
+              g_ptr_array_add (values, (char *) attribute_value);
+            }
+
+          g_ptr_array_add (names, NULL);
+          g_ptr_array_add (values, NULL);
+
+          if (parser->start_element)
+            (* parser->start_element) (context, name,
+                                       (const char **) names->pdata,
+                                       (const char **) values->pdata,
+                                       user_data, &error);
+          break;
+
+        case EVENT_END_ELEMENT:
+          if (!read_string (&reader, &name, NULL))
+            goto out;
+
+          if (parser->end_element)
+            (* parser->end_element) (context, name, user_data, &error);
+          break;
+
+        case EVENT_TEXT:
+          if (!read_string (&reader, &value, &len))
+            goto out;
+
+          if (parser->text)
+            (* parser->text) (context, value, len, user_data, &error);
+          break;
+
+        default:
+          goto out;
+        }
+    }
+
+  success = error == NULL && reader.p == reader.end;
+
+ out:
+  if (error)
+    {
+      meta_topic (META_DEBUG_THEMES, "Replaying theme cache for %s failed: %s\n",
+                  theme_file, error->message);
+      g_error_free (error);
+    }
+  else if (!success)
+    meta_topic (META_DEBUG_THEMES, "Theme cache for %s is corrupt\n",
+                theme_file);
+
+  g_ptr_array_free (names, TRUE);
+  g_ptr_array_free (values, TRUE);
+  g_mapped_file_unref (mapped);
+
+  return success;
+}
@@ -0,0 +1,54 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Mutter cache of parsed theme files */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef META_THEME_CACHE_H
+#define META_THEME_CACHE_H
+
+#include <glib.h>
+
+typedef struct _MetaThemeCacheWriter MetaThemeCacheWriter;
+
+MetaThemeCacheWriter *meta_theme_cache_writer_new  (void);
+void                  meta_theme_cache_writer_free (MetaThemeCacheWriter *writer);
+
+void meta_theme_cache_writer_start_element (MetaThemeCacheWriter  *writer,
+                                            const char            *element_name,
+                                            const char           **attribute_names,
+                                            const char           **attribute_values);
+void meta_theme_cache_writer_end_element   (MetaThemeCacheWriter  *writer,
+                                            const char            *element_name);
+void meta_theme_cache_writer_text          (MetaThemeCacheWriter  *writer,
+                                            const char            *text,
+                                            gsize                  text_len);
+
+void     meta_theme_cache_save   (MetaThemeCacheWriter *writer,
+                                  const char           *theme_file,
+                                  const char           *text,
+                                  gsize                 length);
+
+gboolean meta_theme_cache_replay (const char           *theme_file,
+                                  const char           *text,
+                                  gsize                 length,
+                                  const GMarkupParser  *parser,
+                                  GMarkupParseContext  *context,
+                                  gpointer              user_data);
+
+#endif /* META_THEME_CACHE_H */
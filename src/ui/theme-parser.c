@@ -23,6 +23,7 @@
 
 #include <config.h>
 #include "theme-private.h"
+#include "theme-cache.h"
 #include <meta/util.h>
 #include <string.h>
 #include <stdlib.h>
@@ -116,6 +117,7 @@ typedef struct
   MetaButtonType button_type;   /* type of button/menuitem being parsed */
   MetaButtonState button_state; /* state of button being parsed */
   int skip_level;               /* depth of elements that we're ignoring */
+  MetaThemeCacheWriter *cache_writer; /* records the parse for the cache */
 } ParseInfo;
 
 typedef enum {
@@ -303,6 +305,7 @@ parse_info_init (ParseInfo *info)
   info->button_type = META_BUTTON_TYPE_LAST;
   info->button_state = META_BUTTON_STATE_LAST;
   info->skip_level = 0;
+  info->cache_writer = NULL;
 }
 
 static void
@@ -328,6 +331,9 @@ parse_info_free (ParseInfo *info)
 
   if (info->style_set)
     meta_frame_style_set_unref (info->style_set);
+
+  if (info->cache_writer)
+    meta_theme_cache_writer_free (info->cache_writer);
 }
 
 static void
@@ -3487,6 +3493,10 @@ start_element_handler (GMarkupParseContext *context,
   const char *version;
   guint required_version = 0;
 
+  if (info->cache_writer)
+    meta_theme_cache_writer_start_element (info->cache_writer, element_name,
+                                           attribute_names, attribute_values);
+
   if (info->skip_level > 0)
     {
       info->skip_level++;
@@ -3682,6 +3692,9 @@ end_element_handler (GMarkupParseContext *context,
 {
   ParseInfo *info = user_data;
 
+  if (info->cache_writer)
+    meta_theme_cache_writer_end_element (info->cache_writer, element_name);
+
   if (info->skip_level > 0)
     {
       info->skip_level--;
@@ -3997,6 +4010,11 @@ text_handler (GMarkupParseContext *context,
 {
   ParseInfo *info = user_data;
 
+  /* Whitespace is ignored below whatever the state, so there's no
+   * need to record it */
+  if (info->cache_writer && !all_whitespace (text, text_len))
+    meta_theme_cache_writer_text (info->cache_writer, text, text_len);
+
   if (info->skip_level > 0)
     return;
 
@@ -4179,6 +4197,22 @@ theme_error_is_fatal (GError *error)
            error->code == THEME_PARSE_ERROR_TOO_OLD));
 }
 
+static void
+load_theme_init_info (ParseInfo  *info,
+                      const char *theme_dir,
+                      const char *theme_name,
+                      const char *theme_file,
+                      guint       major_version)
+{
+  parse_info_init (info);
+
+  info->theme_name = theme_name;
+  info->theme_file = theme_file;
+  info->theme_dir = theme_dir;
+
+  info->format_version = 1000 * major_version;
+}
+
 static MetaTheme *
 load_theme (const char *theme_dir,
             const char *theme_name,
@@ -4208,18 +4242,30 @@ load_theme (const char *theme_dir,
                             error))
     goto out;
 
-  meta_topic (META_DEBUG_THEMES, "Parsing theme file %s\n", theme_file);
+  load_theme_init_info (&info, theme_dir, theme_name, theme_file, major_version);
 
-  parse_info_init (&info);
+  context = g_markup_parse_context_new (&metacity_theme_parser,
+                                        0, &info, NULL);
+
+  if (meta_theme_cache_replay (theme_file, text, length,
+                               &metacity_theme_parser, context, &info) &&
+      info.theme != NULL)
+    {
+      meta_topic (META_DEBUG_THEMES, "Loaded theme file %s from the cache\n",
+                  theme_file);
 
-  info.theme_name = theme_name;
-  info.theme_file = theme_file;
-  info.theme_dir = theme_dir;
+      retval = info.theme;
+      info.theme = NULL;
+      goto out;
+    }
 
-  info.format_version = 1000 * major_version;
+  /* Start over from the file, whatever part of the cache was replayed;
+   * that also gets errors reported with their position */
+  parse_info_free (&info);
+  load_theme_init_info (&info, theme_dir, theme_name, theme_file, major_version);
+  info.cache_writer = meta_theme_cache_writer_new ();
 
-  context = g_markup_parse_context_new (&metacity_theme_parser,
-                                        0, &info, NULL);
+  meta_topic (META_DEBUG_THEMES, "Parsing theme file %s\n", theme_file);
 
   if (!g_markup_parse_context_parse (context,
                                      text,
@@ -4230,6 +4276,8 @@ load_theme (const char *theme_dir,
   if (!g_markup_parse_context_end_parse (context, error))
     goto out;
 
+  meta_theme_cache_save (info.cache_writer, theme_file, text, length);
+
   retval = info.theme;
   info.theme = NULL;
 
@@ -196,6 +196,10 @@ struct _MetaFrameLayout
   guint bottom_left_corner_rounded_radius;
   /** Radius of the bottom right-hand corner; 0 if not rounded */
   guint bottom_right_corner_rounded_radius;
+
+  /** Geometries recently computed with this layout, most recently
+   * used first; not copied by meta_frame_layout_copy() */
+  GList *geometry_memo;
 };
 
 /**
@@ -441,13 +445,78 @@ typedef struct
   } d;
 } PosToken;
 
+/**
+ * The variables which can appear in an expression, resolved when the
+ * expression is compiled.
+ *
+ * \ingroup parser
+ */
+typedef enum
+{
+  POS_VARIABLE_WIDTH,
+  POS_VARIABLE_HEIGHT,
+  POS_VARIABLE_OBJECT_WIDTH,
+  POS_VARIABLE_OBJECT_HEIGHT,
+  POS_VARIABLE_LEFT_WIDTH,
+  POS_VARIABLE_RIGHT_WIDTH,
+  POS_VARIABLE_TOP_HEIGHT,
+  POS_VARIABLE_BOTTOM_HEIGHT,
+  POS_VARIABLE_MINI_ICON_WIDTH,
+  POS_VARIABLE_MINI_ICON_HEIGHT,
+  POS_VARIABLE_ICON_WIDTH,
+  POS_VARIABLE_ICON_HEIGHT,
+  POS_VARIABLE_TITLE_WIDTH,
+  POS_VARIABLE_TITLE_HEIGHT,
+  POS_VARIABLE_FRAME_X_CENTER,
+  POS_VARIABLE_FRAME_Y_CENTER,
+  POS_VARIABLE_LAST
+} PosVariable;
+
+typedef enum
+{
+  /** Push an integer constant */
+  POS_CODE_INT,
+  /** Push a floating-point constant */
+  POS_CODE_DOUBLE,
+  /** Push the value of a variable */
+  POS_CODE_VARIABLE,
+  /** Replace the top two values, both known to be integers, by the
+   *  result of an operator */
+  POS_CODE_INT_OPERATOR,
+  /** Replace the top two values by the result of an operator,
+   *  promoting to floating point as needed */
+  POS_CODE_OPERATOR
+} PosCodeType;
+
+/**
+ * An instruction of a compiled expression, which is a program for a
+ * stack machine in postfix order.
+ *
+ * \ingroup parser
+ */
+typedef struct
+{
+  PosCodeType type;
+
+  union
+  {
+    int int_val;
+    double double_val;
+    PosVariable variable;
+    PosOperatorType op;
+  } d;
+} PosCode;
+
 /**
  * MetaDrawSpec: (skip)
  *
  * A computed expression in our simple vector drawing language.
- * While it appears to take the form of a tree, this is actually
- * merely a list; concerns such as precedence of operators are
- * currently recomputed on every recalculation.
+ * When it is created, the list of tokens is compiled into a postfix
+ * program with the variables resolved and the constant subexpressions
+ * folded, so that evaluating it for each frame doesn't redo the
+ * parsing. Expressions which don't compile, because they are
+ * malformed, are interpreted from the tokens instead, which reports
+ * the error.
  *
  * Created by meta_draw_spec_new(), destroyed by meta_draw_spec_free().
  * pos_eval() fills this with ...FIXME. Are tokens a tree or a list?
@@ -468,6 +537,12 @@ struct _MetaDrawSpec
   /** How many tokens are in the tokens list. */
   int n_tokens;
 
+  /** The compiled expression, or %NULL if it is interpreted. */
+  PosCode *code;
+
+  /** How many instructions are in the compiled expression. */
+  int n_code;
+
   /** Does the expression contain any variables? */
   gboolean constant : 1;
 };
@@ -942,6 +1017,10 @@ MetaDrawSpec* meta_draw_spec_new (MetaTheme  *theme,
                                   const char *expr,
                                   GError    **error);
 void          meta_draw_spec_free (MetaDrawSpec *spec);
+gboolean      meta_draw_spec_interpret (MetaDrawSpec               *spec,
+                                        const MetaPositionExprEnv  *env,
+                                        int                        *val_return,
+                                        GError                    **err);
 
 MetaColorSpec* meta_color_spec_new             (MetaColorSpecType  type);
 MetaColorSpec* meta_color_spec_new_from_string (const char        *str,
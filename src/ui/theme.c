@@ -183,6 +183,46 @@ init_border (GtkBorder *border)
   border->right = -1;
 }
 
+/* Number of geometries to remember per layout; there is one for each
+ * combination of frame flags, and most windows share a handful of them */
+#define MAX_GEOMETRY_MEMO_ENTRIES 16
+
+/* A geometry computed by meta_frame_layout_calc_geometry(), along with
+ * what is needed to adapt it to another frame width. As long as all the
+ * buttons fit, the width only moves the right-hand buttons and the right
+ * edge of the title, so frames of any width over min_width share the
+ * same memo.
+ */
+typedef struct
+{
+  MetaTheme *theme;
+  MetaFrameType type;
+  MetaFrameFlags flags;
+  int text_height;
+  int draggable_border_width;
+  MetaButtonLayout button_layout;
+
+  MetaFrameGeometry fgeom;
+  /* Narrowest frame for which no button is stripped; G_MAXINT if
+   * buttons were stripped from fgeom */
+  int min_width;
+  /* Smallest position of the right-hand buttons that was checked
+   * for going negative; G_MAXINT if there are none */
+  int min_right_x;
+  /* The title rectangle before it was nuked for not fitting */
+  GdkRectangle title_rect;
+  /* Offsets in fgeom of the rectangles of the right-hand buttons */
+  int n_right_rects;
+  int right_rects[MAX_BUTTONS_PER_CORNER * 3];
+} GeometryMemo;
+
+static void
+free_geometry_memo (gpointer data,
+                    gpointer user_data)
+{
+  g_slice_free (GeometryMemo, data);
+}
+
 /**
  * meta_frame_layout_new: (skip)
  *
@@ -353,6 +393,7 @@ meta_frame_layout_copy (const MetaFrameLayout *src)
   *layout = *src;
 
   layout->refcount = 1;
+  layout->geometry_memo = NULL;
 
   return layout;
 }
@@ -375,6 +416,9 @@ meta_frame_layout_unref (MetaFrameLayout *layout)
 
   if (layout->refcount == 0)
     {
+      g_list_foreach (layout->geometry_memo, free_geometry_memo, NULL);
+      g_list_free (layout->geometry_memo);
+
       DEBUG_FILL_STRUCT (layout);
       g_free (layout);
     }
@@ -595,17 +639,34 @@ strip_button (MetaButtonSpace *func_rects[MAX_BUTTONS_PER_CORNER],
 }
 
 static void
-meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
-                                 int                     text_height,
-                                 MetaFrameFlags          flags,
-                                 int                     client_width,
-                                 int                     client_height,
-                                 const MetaButtonLayout *button_layout,
-                                 MetaFrameType           type,
-                                 MetaFrameGeometry      *fgeom,
-                                 MetaTheme              *theme)
+memo_right_rect (GeometryMemo      *memo,
+                 MetaFrameGeometry *fgeom,
+                 GdkRectangle      *rect)
 {
-  int i, n_left, n_right, n_left_spacers, n_right_spacers;
+  int offset = (char *) rect - (char *) fgeom;
+  int i;
+
+  /* A rect is only moved once, even if its function is there twice */
+  for (i = 0; i < memo->n_right_rects; i++)
+    if (memo->right_rects[i] == offset)
+      return;
+
+  memo->right_rects[memo->n_right_rects++] = offset;
+}
+
+static void
+calc_geometry_uncached (const MetaFrameLayout  *layout,
+                        int                     text_height,
+                        MetaFrameFlags          flags,
+                        int                     client_width,
+                        int                     client_height,
+                        const MetaButtonLayout *button_layout,
+                        MetaFrameType           type,
+                        MetaFrameGeometry      *fgeom,
+                        MetaTheme              *theme,
+                        GeometryMemo           *memo)
+{
+  int i, j, n_left, n_right, n_left_spacers, n_right_spacers;
   int x;
   int button_y;
   int title_right_edge;
@@ -742,6 +803,10 @@ meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
         right_bg_rects[i] = &fgeom->right_middle_backgrounds[i - 1];
     }
   
+  memo->min_width = 0;
+  memo->min_right_x = G_MAXINT;
+  memo->n_right_rects = 0;
+
   /* Be sure buttons fit */
   while (n_left > 0 || n_right > 0)
     {
@@ -763,7 +828,14 @@ meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
       space_used_by_buttons += layout->button_border.right * n_right;
 
       if (space_used_by_buttons <= space_available)
-        break; /* Everything fits, bail out */
+        {
+          if (memo->min_width == 0)
+            memo->min_width = space_used_by_buttons +
+              layout->left_titlebar_edge + layout->right_titlebar_edge;
+          break; /* Everything fits, bail out */
+        }
+
+      memo->min_width = G_MAXINT;
       
       /* First try to remove separators */
       if (n_left_spacers > 0)
@@ -848,8 +920,13 @@ meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
       MetaButtonSpace *rect;
 
       if (x < 0) /* if we go negative, leave the buttons we don't get to as 0-width */
-        break;
-      
+        {
+          memo->min_width = G_MAXINT;
+          break;
+        }
+
+      memo->min_right_x = MIN (memo->min_right_x, x);
+
       rect = right_func_rects[i];
       rect->visible.x = x - layout->button_border.right - button_width;
       if (right_buttons_has_spacer[i])
@@ -878,6 +955,10 @@ meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
       *(right_bg_rects[i]) = rect->visible;
       
       x = rect->visible.x - layout->button_border.left;
+
+      memo_right_rect (memo, fgeom, &rect->visible);
+      memo_right_rect (memo, fgeom, &rect->clickable);
+      memo_right_rect (memo, fgeom, right_bg_rects[i]);
       
       --i;
     }
@@ -894,6 +975,12 @@ meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
       MetaButtonSpace *rect;
 
       rect = left_func_rects[i];
+
+      /* A function on both sides shares its rect, which the right side
+       * positions relative to the width; don't adapt that to other widths */
+      for (j = 0; j < n_right; j++)
+        if (right_func_rects[j] == rect)
+          memo->min_width = G_MAXINT;
       
       rect->visible.x = x + layout->button_border.left;
       rect->visible.y = button_y;
@@ -935,6 +1022,8 @@ meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
   fgeom->title_rect.width = title_right_edge - fgeom->title_rect.x;
   fgeom->title_rect.height = borders.visible.top - layout->title_border.top - layout->title_border.bottom;
 
+  memo->title_rect = fgeom->title_rect;
+
   /* Nuke title if it won't fit */
   if (fgeom->title_rect.width < 0 ||
       fgeom->title_rect.height < 0)
@@ -964,6 +1053,133 @@ meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
     fgeom->bottom_right_corner_rounded_radius = layout->bottom_right_corner_rounded_radius;
 }
 
+static GeometryMemo *
+find_geometry_memo (const MetaFrameLayout  *layout,
+                    int                     text_height,
+                    MetaFrameFlags          flags,
+                    const MetaButtonLayout *button_layout,
+                    MetaFrameType           type,
+                    MetaTheme              *theme)
+{
+  int draggable_border_width = meta_prefs_get_draggable_border_width ();
+  GList *l;
+
+  for (l = layout->geometry_memo; l; l = l->next)
+    {
+      GeometryMemo *memo = l->data;
+
+      if (memo->text_height == text_height &&
+          memo->flags == flags &&
+          memo->type == type &&
+          memo->theme == theme &&
+          memo->draggable_border_width == draggable_border_width &&
+          memcmp (&memo->button_layout, button_layout,
+                  sizeof (MetaButtonLayout)) == 0)
+        return memo;
+    }
+
+  return NULL;
+}
+
+/* Computes the geometry of a frame. The geometry is remembered in the
+ * layout, keyed by everything it depends on but the client size, and
+ * frames of other widths are derived from it by moving the right-hand
+ * side of the titlebar, which is much cheaper than laying out the
+ * buttons again during interactive resizes. Theme, font, button layout
+ * and draggable border changes give different layouts or keys, so stale
+ * entries are never used and just fall off the end of the list.
+ */
+static void
+meta_frame_layout_calc_geometry (const MetaFrameLayout  *layout,
+                                 int                     text_height,
+                                 MetaFrameFlags          flags,
+                                 int                     client_width,
+                                 int                     client_height,
+                                 const MetaButtonLayout *button_layout,
+                                 MetaFrameType           type,
+                                 MetaFrameGeometry      *fgeom,
+                                 MetaTheme              *theme)
+{
+  MetaFrameLayout *mutable_layout = (MetaFrameLayout *) layout;
+  GeometryMemo *memo, computed;
+  GList *link;
+  int width, delta, i;
+
+  memo = find_geometry_memo (layout, text_height, flags, button_layout,
+                             type, theme);
+
+  if (memo != NULL)
+    {
+      width = client_width +
+        memo->fgeom.borders.total.left + memo->fgeom.borders.total.right;
+      delta = width - memo->fgeom.width;
+
+      if (width >= memo->min_width && delta >= -memo->min_right_x)
+        {
+          *fgeom = memo->fgeom;
+
+          fgeom->width = width;
+          fgeom->height = ((flags & META_FRAME_SHADED) ? 0 : client_height) +
+            fgeom->borders.total.top + fgeom->borders.total.bottom;
+
+          for (i = 0; i < memo->n_right_rects; i++)
+            ((GdkRectangle *) ((char *) fgeom + memo->right_rects[i]))->x += delta;
+
+          fgeom->title_rect = memo->title_rect;
+          fgeom->title_rect.width += delta;
+          if (fgeom->title_rect.width < 0 ||
+              fgeom->title_rect.height < 0)
+            {
+              fgeom->title_rect.width = 0;
+              fgeom->title_rect.height = 0;
+            }
+
+          link = g_list_find (layout->geometry_memo, memo);
+          mutable_layout->geometry_memo =
+            g_list_remove_link (mutable_layout->geometry_memo, link);
+          mutable_layout->geometry_memo =
+            g_list_concat (link, mutable_layout->geometry_memo);
+
+          return;
+        }
+    }
+  else
+    {
+      memo = g_slice_new0 (GeometryMemo);
+      memo->min_width = G_MAXINT;
+      memo->theme = theme;
+      memo->type = type;
+      memo->flags = flags;
+      memo->text_height = text_height;
+      memo->draggable_border_width = meta_prefs_get_draggable_border_width ();
+      memo->button_layout = *button_layout;
+
+      mutable_layout->geometry_memo =
+        g_list_prepend (mutable_layout->geometry_memo, memo);
+
+      if (g_list_length (layout->geometry_memo) > MAX_GEOMETRY_MEMO_ENTRIES)
+        {
+          link = g_list_last (layout->geometry_memo);
+          free_geometry_memo (link->data, NULL);
+          mutable_layout->geometry_memo =
+            g_list_delete_link (mutable_layout->geometry_memo, link);
+        }
+    }
+
+  computed = *memo;
+  calc_geometry_uncached (layout, text_height, flags,
+                          client_width, client_height,
+                          button_layout, type, fgeom, theme, &computed);
+
+  /* A geometry with stripped buttons can't be adapted to other widths,
+   * so don't replace one that can with it */
+  if (computed.min_width != G_MAXINT || memo->min_width == G_MAXINT)
+    {
+      *memo = computed;
+      memo->fgeom = *fgeom;
+    }
+}
+
 /**
  * meta_gradient_spec_new: (skip)
  *
@@ -2458,9 +2674,9 @@ pos_eval_get_variable (PosToken                  *t,
  * Evaluates a sequence of tokens within a particular environment context,
  * and returns the current value. May recur if parantheses are found.
  *
- * FIXME: Yes, we really do reparse the expression every time it's evaluated.
- *        We should keep the parse tree around all the time and just
- *        run the new values through it.
+ * This reparses the expression every time it's evaluated, so it is only
+ * used for expressions which pos_compile() rejects, to report the errors
+ * of pos_run(), and as the reference for the compiled expressions.
  */
 static gboolean
 pos_eval_helper (PosToken                   *tokens,
@@ -2617,6 +2833,489 @@ pos_eval_helper (PosToken                   *tokens,
   return TRUE;
 }
 
+/* Names of the variables, in the order of PosVariable */
+static const char * const pos_variable_names[] = {
+  "width",
+  "height",
+  "object_width",
+  "object_height",
+  "left_width",
+  "right_width",
+  "top_height",
+  "bottom_height",
+  "mini_icon_width",
+  "mini_icon_height",
+  "icon_width",
+  "icon_height",
+  "title_width",
+  "title_height",
+  "frame_x_center",
+  "frame_y_center"
+};
+
+/**
+ * PosCompiler:
+ *
+ * State of the compilation of a list of tokens into a #PosCode program.
+ * Along with the program, we keep track of the type each value on the
+ * stack will have when the program runs, which is known in advance since
+ * variables are always integers.
+ */
+typedef struct
+{
+  PosToken *tokens;
+  int n_tokens;
+  int pos;
+
+  PosCode *code;
+  int n_code;
+
+  PosExprType stack_types[MAX_EXPRS];
+  int depth;
+} PosCompiler;
+
+static int
+op_precedence (PosOperatorType op)
+{
+  switch (op)
+    {
+    case POS_OP_MULTIPLY:
+    case POS_OP_DIVIDE:
+    case POS_OP_MOD:
+      return 2;
+    case POS_OP_ADD:
+    case POS_OP_SUBTRACT:
+      return 1;
+    /* These are low-precedence, as in do_operations() */
+    case POS_OP_MAX:
+    case POS_OP_MIN:
+      return 0;
+    case POS_OP_NONE:
+      break;
+    }
+
+  g_assert_not_reached ();
+  return -1;
+}
+
+static gboolean
+pos_compile_push (PosCompiler *c,
+                  PosCode     *instruction,
+                  PosExprType  type)
+{
+  if (c->depth == MAX_EXPRS)
+    return FALSE;
+
+  c->code[c->n_code++] = *instruction;
+  c->stack_types[c->depth++] = type;
+
+  return TRUE;
+}
+
+static gboolean
+pos_compile_operand (PosCompiler *c,
+                     PosToken    *t)
+{
+  PosCode instruction;
+  int i;
+
+  switch (t->type)
+    {
+    case POS_TOKEN_INT:
+      instruction.type = POS_CODE_INT;
+      instruction.d.int_val = t->d.i.val;
+      return pos_compile_push (c, &instruction, POS_EXPR_INT);
+
+    case POS_TOKEN_DOUBLE:
+      instruction.type = POS_CODE_DOUBLE;
+      instruction.d.double_val = t->d.d.val;
+      return pos_compile_push (c, &instruction, POS_EXPR_DOUBLE);
+
+    case POS_TOKEN_VARIABLE:
+      for (i = 0; i < POS_VARIABLE_LAST; i++)
+        if (strcmp (t->d.v.name, pos_variable_names[i]) == 0)
+          break;
+
+      if (i == POS_VARIABLE_LAST)
+        return FALSE;
+
+      instruction.type = POS_CODE_VARIABLE;
+      instruction.d.variable = i;
+      return pos_compile_push (c, &instruction, POS_EXPR_INT);
+
+    default:
+      return FALSE;
+    }
+}
+
+static gboolean
+is_constant_code (const PosCode *instruction,
+                  PosExpr       *value)
+{
+  switch (instruction->type)
+    {
+    case POS_CODE_INT:
+      value->type = POS_EXPR_INT;
+      value->d.int_val = instruction->d.int_val;
+      return TRUE;
+    case POS_CODE_DOUBLE:
+      value->type = POS_EXPR_DOUBLE;
+      value->d.double_val = instruction->d.double_val;
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+static gboolean
+pos_compile_operator (PosCompiler     *c,
+                      PosOperatorType  op)
+{
+  PosExprType a_type, b_type;
+  PosExpr a, b;
+  PosCode *instruction;
+
+  g_assert (c->depth >= 2);
+
+  b_type = c->stack_types[--c->depth];
+  a_type = c->stack_types[c->depth - 1];
+
+  /* Expressions which fail whatever the values of the variables are
+   * left to the interpreter, which reports the error
+   */
+  if (op == POS_OP_MOD &&
+      (a_type == POS_EXPR_DOUBLE || b_type == POS_EXPR_DOUBLE))
+    return FALSE;
+
+  /* If both operands are constants, they are the last two instructions,
+   * and we can do the operation now.
+   */
+  if (is_constant_code (&c->code[c->n_code - 2], &a) &&
+      is_constant_code (&c->code[c->n_code - 1], &b))
+    {
+      if (!do_operation (&a, &b, op, NULL))
+        return FALSE;
+
+      instruction = &c->code[c->n_code - 2];
+      c->n_code--;
+
+      if (a.type == POS_EXPR_INT)
+        {
+          instruction->type = POS_CODE_INT;
+          instruction->d.int_val = a.d.int_val;
+        }
+      else
+        {
+          instruction->type = POS_CODE_DOUBLE;
+          instruction->d.double_val = a.d.double_val;
+        }
+
+      c->stack_types[c->depth - 1] = a.type;
+      return TRUE;
+    }
+
+  instruction = &c->code[c->n_code++];
+  instruction->d.op = op;
+
+  if (a_type == POS_EXPR_INT && b_type == POS_EXPR_INT)
+    {
+      instruction->type = POS_CODE_INT_OPERATOR;
+    }
+  else
+    {
+      instruction->type = POS_CODE_OPERATOR;
+      c->stack_types[c->depth - 1] = POS_EXPR_DOUBLE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * pos_compile_group:
+ * @c: the compiler
+ *
+ * Compiles the tokens up to the end of the expression or the next
+ * unmatched close parenthesis, converting them to postfix order with
+ * the precedences of do_operations().
+ *
+ * Returns: %FALSE if the tokens don't form a valid expression, or one
+ *          that pos_eval_helper() would reject for being too long.
+ */
+static gboolean
+pos_compile_group (PosCompiler *c)
+{
+  /* Pending operators have strictly increasing precedences */
+  PosOperatorType ops[3];
+  int n_ops;
+  int n_exprs;
+
+  n_ops = 0;
+  n_exprs = 0;
+  while (TRUE)
+    {
+      PosToken *t;
+      int precedence;
+
+      if (c->pos == c->n_tokens)
+        return FALSE;
+
+      t = &c->tokens[c->pos++];
+      if (t->type == POS_TOKEN_OPEN_PAREN)
+        {
+          if (!pos_compile_group (c))
+            return FALSE;
+
+          if (c->pos == c->n_tokens ||
+              c->tokens[c->pos].type != POS_TOKEN_CLOSE_PAREN)
+            return FALSE;
+
+          c->pos++;
+        }
+      else if (!pos_compile_operand (c, t))
+        return FALSE;
+
+      ++n_exprs;
+
+      if (c->pos == c->n_tokens ||
+          c->tokens[c->pos].type == POS_TOKEN_CLOSE_PAREN)
+        break;
+
+      t = &c->tokens[c->pos++];
+      if (t->type != POS_TOKEN_OPERATOR)
+        return FALSE;
+
+      precedence = op_precedence (t->d.o.op);
+      while (n_ops > 0 && op_precedence (ops[n_ops - 1]) >= precedence)
+        if (!pos_compile_operator (c, ops[--n_ops]))
+          return FALSE;
+
+      ops[n_ops++] = t->d.o.op;
+      ++n_exprs;
+    }
+
+  if (n_exprs > MAX_EXPRS)
+    return FALSE;
+
+  while (n_ops > 0)
+    if (!pos_compile_operator (c, ops[--n_ops]))
+      return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * pos_compile:
+ * @spec: the expression to compile
+ *
+ * Compiles the tokens of @spec into a program, which pos_run() evaluates
+ * with the same results as pos_eval_helper(). If the tokens don't form
+ * a valid expression, @spec is left without a program, and interpreting
+ * it reports the error each time it's evaluated, as before.
+ */
+static void
+pos_compile (MetaDrawSpec *spec)
+{
+  PosCompiler c;
+
+  if (spec->n_tokens == 0)
+    return;
+
+  c.tokens = spec->tokens;
+  c.n_tokens = spec->n_tokens;
+  c.pos = 0;
+  /* Each token makes at most one instruction */
+  c.code = g_new (PosCode, spec->n_tokens);
+  c.n_code = 0;
+  c.depth = 0;
+
+  if (!pos_compile_group (&c) || c.pos != c.n_tokens)
+    {
+      g_free (c.code);
+      return;
+    }
+
+  g_assert (c.depth == 1);
+
+  spec->code = g_renew (PosCode, c.code, c.n_code);
+  spec->n_code = c.n_code;
+}
+
+static inline gboolean
+pos_run_get_variable (PosVariable                variable,
+                      const MetaPositionExprEnv *env,
+                      int                       *result)
+{
+  switch (variable)
+    {
+    case POS_VARIABLE_WIDTH:
+      *result = env->rect.width;
+      return TRUE;
+    case POS_VARIABLE_HEIGHT:
+      *result = env->rect.height;
+      return TRUE;
+    case POS_VARIABLE_OBJECT_WIDTH:
+      if (env->object_width < 0)
+        break;
+      *result = env->object_width;
+      return TRUE;
+    case POS_VARIABLE_OBJECT_HEIGHT:
+      if (env->object_height < 0)
+        break;
+      *result = env->object_height;
+      return TRUE;
+    case POS_VARIABLE_LEFT_WIDTH:
+      *result = env->left_width;
+      return TRUE;
+    case POS_VARIABLE_RIGHT_WIDTH:
+      *result = env->right_width;
+      return TRUE;
+    case POS_VARIABLE_TOP_HEIGHT:
+      *result = env->top_height;
+      return TRUE;
+    case POS_VARIABLE_BOTTOM_HEIGHT:
+      *result = env->bottom_height;
+      return TRUE;
+    case POS_VARIABLE_MINI_ICON_WIDTH:
+      *result = env->mini_icon_width;
+      return TRUE;
+    case POS_VARIABLE_MINI_ICON_HEIGHT:
+      *result = env->mini_icon_height;
+      return TRUE;
+    case POS_VARIABLE_ICON_WIDTH:
+      *result = env->icon_width;
+      return TRUE;
+    case POS_VARIABLE_ICON_HEIGHT:
+      *result = env->icon_height;
+      return TRUE;
+    case POS_VARIABLE_TITLE_WIDTH:
+      *result = env->title_width;
+      return TRUE;
+    case POS_VARIABLE_TITLE_HEIGHT:
+      *result = env->title_height;
+      return TRUE;
+    case POS_VARIABLE_FRAME_X_CENTER:
+      *result = env->frame_x_center;
+      return TRUE;
+    case POS_VARIABLE_FRAME_Y_CENTER:
+      *result = env->frame_y_center;
+      return TRUE;
+    case POS_VARIABLE_LAST:
+      g_assert_not_reached ();
+      break;
+    }
+
+  return FALSE;
+}
+
+/**
+ * pos_run:
+ * @code: a program made by pos_compile()
+ * @n_code: how many instructions are in the program
+ * @env: The environment context in which to evaluate the expression.
+ * @result: (out): The current value of the expression
+ *
+ * Evaluates a compiled expression within a particular environment context.
+ * This doesn't say what went wrong when it fails, since the errors don't
+ * come up in the same order as in pos_eval_helper(); the caller gets the
+ * error by interpreting the expression.
+ *
+ * Returns: %FALSE if the expression divides by zero or uses a variable
+ *          which is not available in @env.
+ */
+static gboolean
+pos_run (const PosCode              *code,
+         int                         n_code,
+         const MetaPositionExprEnv  *env,
+         PosExpr                    *result)
+{
+  PosExpr stack[MAX_EXPRS];
+  PosExpr *top;
+  int i;
+
+  /* top points just above the topmost value */
+  top = stack;
+  for (i = 0; i < n_code; i++)
+    {
+      const PosCode *instruction = &code[i];
+
+      switch (instruction->type)
+        {
+        case POS_CODE_INT:
+          top->type = POS_EXPR_INT;
+          top->d.int_val = instruction->d.int_val;
+          ++top;
+          break;
+
+        case POS_CODE_DOUBLE:
+          top->type = POS_EXPR_DOUBLE;
+          top->d.double_val = instruction->d.double_val;
+          ++top;
+          break;
+
+        case POS_CODE_VARIABLE:
+          top->type = POS_EXPR_INT;
+          if (!pos_run_get_variable (instruction->d.variable, env,
+                                     &top->d.int_val))
+            return FALSE;
+          ++top;
+          break;
+
+        case POS_CODE_INT_OPERATOR:
+          {
+            int *a = &top[-2].d.int_val;
+            int b = top[-1].d.int_val;
+
+            switch (instruction->d.op)
+              {
+              case POS_OP_ADD:
+                *a = *a + b;
+                break;
+              case POS_OP_SUBTRACT:
+                *a = *a - b;
+                break;
+              case POS_OP_MULTIPLY:
+                *a = *a * b;
+                break;
+              case POS_OP_DIVIDE:
+                if (b == 0)
+                  return FALSE;
+                *a = *a / b;
+                break;
+              case POS_OP_MOD:
+                if (b == 0)
+                  return FALSE;
+                *a = *a % b;
+                break;
+              case POS_OP_MAX:
+                *a = MAX (*a, b);
+                break;
+              case POS_OP_MIN:
+                *a = MIN (*a, b);
+                break;
+              case POS_OP_NONE:
+                g_assert_not_reached ();
+                break;
+              }
+
+            --top;
+          }
+          break;
+
+        case POS_CODE_OPERATOR:
+          if (!do_operation (&top[-2], &top[-1], instruction->d.op, NULL))
+            return FALSE;
+          --top;
+          break;
+        }
+    }
+
+  g_assert (top == stack + 1);
+
+  *result = stack[0];
+
+  return TRUE;
+}
+
 /*
  *   expr = int | double | expr * expr | expr / expr |
  *          expr + expr | expr - expr | (expr)
@@ -2647,10 +3346,16 @@ pos_eval (MetaDrawSpec              *spec,
           GError                   **err)
 {
   PosExpr expr;
+  gboolean result;
 
   *val_p = 0;
 
-  if (pos_eval_helper (spec->tokens, spec->n_tokens, env, &expr, err))
+  if (spec->code != NULL && pos_run (spec->code, spec->n_code, env, &expr))
+    result = TRUE;
+  else
+    result = pos_eval_helper (spec->tokens, spec->n_tokens, env, &expr, err);
+
+  if (result)
     {
       switch (expr.type)
         {
@@ -2864,6 +3569,7 @@ meta_draw_spec_free (MetaDrawSpec *spec)
 {
   if (!spec) return;
   free_tokens (spec->tokens, spec->n_tokens);
+  g_free (spec->code);
   g_slice_free (MetaDrawSpec, spec);
 }
 
@@ -2895,10 +3601,45 @@ meta_draw_spec_new (MetaTheme  *theme,
           return NULL;
         }
     }
-    
+  else
+    pos_compile (spec);
+
   return spec;
 }
 
+/**
+ * meta_draw_spec_interpret: (skip)
+ *
+ * Evaluates @spec from its tokens, the way it was done before expressions
+ * were compiled; this is the reference the compiler is tested against.
+ */
+gboolean
+meta_draw_spec_interpret (MetaDrawSpec               *spec,
+                          const MetaPositionExprEnv  *env,
+                          int                        *val_return,
+                          GError                    **err)
+{
+  PosExpr expr;
+
+  *val_return = 0;
+
+  if (spec->constant)
+    {
+      *val_return = spec->value;
+      return TRUE;
+    }
+
+  if (!pos_eval_helper (spec->tokens, spec->n_tokens, env, &expr, err))
+    return FALSE;
+
+  if (expr.type == POS_EXPR_INT)
+    *val_return = expr.d.int_val;
+  else
+    *val_return = expr.d.double_val;
+
+  return TRUE;
+}
+
 /**
  * meta_draw_op_new: (skip)
  *
@@ -3169,6 +3910,167 @@ apply_alpha (GdkPixbuf             *pixbuf,
   return pixbuf;
 }
 
+/* Number of rendered gradients to keep; themes use a few gradients,
+ * in focused and unfocused versions, mostly for title bars */
+#define MAX_CACHED_GRADIENTS 8
+
+/* Vertical gradients are rendered this much wider than asked for, so
+ * that they can be reused while a window is made wider */
+#define GRADIENT_WIDTH_SLACK 256
+
+typedef struct
+{
+  MetaGradientType type;
+  int n_colors;
+  GdkRGBA *colors;
+  MetaGradientType alpha_type;
+  int n_alphas;
+  guchar *alphas;
+
+  int width, height;
+  GdkPixbuf *pixbuf;
+} CachedGradient;
+
+/* Most recently used first */
+static GList *gradient_cache;
+
+static void
+cached_gradient_free (CachedGradient *cached)
+{
+  g_free (cached->colors);
+  g_free (cached->alphas);
+  g_object_unref (cached->pixbuf);
+  g_slice_free (CachedGradient, cached);
+}
+
+/* Whether every row of the gradient is a single color, so that a
+ * rendering of it can be cut down to any narrower width */
+static gboolean
+gradient_is_width_invariant (const MetaGradientSpec      *spec,
+                             const MetaAlphaGradientSpec *alpha_spec)
+{
+  return spec->type == META_GRADIENT_VERTICAL &&
+    (alpha_spec == NULL ||
+     alpha_spec->n_alphas == 1 ||
+     alpha_spec->type != META_GRADIENT_HORIZONTAL);
+}
+
+/* Renders a gradient op, reusing a previous rendering of the same
+ * colors and alphas at the same size if there is one. Vertical
+ * gradients only depend on the height, so they are cut out of any
+ * wider rendering. The returned pixbuf may be shared and must not be
+ * modified.
+ */
+static GdkPixbuf *
+render_gradient (const MetaGradientSpec *spec,
+                 MetaAlphaGradientSpec  *alpha_spec,
+                 GtkStyleContext        *context,
+                 int                     width,
+                 int                     height)
+{
+  CachedGradient *cached;
+  gboolean width_invariant;
+  GdkPixbuf *pixbuf;
+  GdkRGBA *colors;
+  GSList *tmp;
+  GList *l;
+  int n_colors, n_alphas, render_width;
+  int i;
+
+  if (width <= 0 || height <= 0)
+    return apply_alpha (meta_gradient_spec_render (spec, context, width, height),
+                        alpha_spec, FALSE);
+
+  n_colors = g_slist_length (spec->color_specs);
+  if (n_colors == 0)
+    return NULL;
+
+  colors = g_new (GdkRGBA, n_colors);
+  for (tmp = spec->color_specs, i = 0; tmp != NULL; tmp = tmp->next, i++)
+    meta_color_spec_render (tmp->data, context, &colors[i]);
+
+  n_alphas = alpha_spec ? alpha_spec->n_alphas : 0;
+  width_invariant = gradient_is_width_invariant (spec, alpha_spec);
+
+  for (l = gradient_cache; l; l = l->next)
+    {
+      cached = l->data;
+
+      if (cached->type == spec->type &&
+          cached->height == height &&
+          (width_invariant || cached->width == width) &&
+          cached->n_colors == n_colors &&
+          memcmp (cached->colors, colors, n_colors * sizeof (GdkRGBA)) == 0 &&
+          cached->n_alphas == n_alphas &&
+          (n_alphas == 0 ||
+           (cached->alpha_type == alpha_spec->type &&
+            memcmp (cached->alphas, alpha_spec->alphas, n_alphas) == 0)))
+        break;
+    }
+
+  if (l != NULL)
+    {
+      if (cached->width == width)
+        pixbuf = g_object_ref (cached->pixbuf);
+      else if (width_invariant && cached->width > width)
+        pixbuf = gdk_pixbuf_new_subpixbuf (cached->pixbuf, 0, 0, width, height);
+      else
+        pixbuf = NULL;
+
+      if (pixbuf != NULL)
+        {
+          gradient_cache = g_list_remove_link (gradient_cache, l);
+          gradient_cache = g_list_concat (l, gradient_cache);
+
+          g_free (colors);
+          return pixbuf;
+        }
+
+      /* Too narrow; replace it with a wider rendering */
+      cached_gradient_free (cached);
+      gradient_cache = g_list_delete_link (gradient_cache, l);
+    }
+
+  if (width_invariant)
+    render_width = width + GRADIENT_WIDTH_SLACK;
+  else
+    render_width = width;
+
+  pixbuf = meta_gradient_create_multi (render_width, height,
+                                       colors, n_colors, spec->type);
+  pixbuf = apply_alpha (pixbuf, alpha_spec, FALSE);
+  if (pixbuf == NULL)
+    {
+      g_free (colors);
+      return NULL;
+    }
+
+  cached = g_slice_new (CachedGradient);
+  cached->type = spec->type;
+  cached->n_colors = n_colors;
+  cached->colors = colors;
+  cached->alpha_type = alpha_spec ? alpha_spec->type : META_GRADIENT_LAST;
+  cached->n_alphas = n_alphas;
+  cached->alphas = n_alphas ? g_memdup (alpha_spec->alphas, n_alphas) : NULL;
+  cached->width = render_width;
+  cached->height = height;
+  cached->pixbuf = pixbuf;
+
+  gradient_cache = g_list_prepend (gradient_cache, cached);
+
+  if (g_list_length (gradient_cache) > MAX_CACHED_GRADIENTS)
+    {
+      l = g_list_last (gradient_cache);
+      cached_gradient_free (l->data);
+      gradient_cache = g_list_delete_link (gradient_cache, l);
+    }
+
+  if (render_width != width)
+    return gdk_pixbuf_new_subpixbuf (pixbuf, 0, 0, width, height);
+  else
+    return g_object_ref (pixbuf);
+}
+
 static GdkPixbuf*
 pixbuf_tile (GdkPixbuf *tile,
              int        width,
@@ -3479,14 +4381,9 @@ draw_op_as_pixbuf (const MetaDrawOp    *op,
       break;
 
     case META_DRAW_GRADIENT:
-      {
-        pixbuf = meta_gradient_spec_render (op->data.gradient.gradient_spec,
-                                            context, width, height);
-
-        pixbuf = apply_alpha (pixbuf,
-                              op->data.gradient.alpha_spec,
-                              FALSE);
-      }
+      pixbuf = render_gradient (op->data.gradient.gradient_spec,
+                                op->data.gradient.alpha_spec,
+                                context, width, height);
       break;
 
       